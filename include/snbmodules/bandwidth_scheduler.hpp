@@ -0,0 +1,88 @@
+/**
+ * @file bandwidth_scheduler.hpp BandwidthScheduler class, share of the bandwidth of a client between its sessions
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_BANDWIDTH_SCHEDULER_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_BANDWIDTH_SCHEDULER_HPP_
+
+#include "snbmodules/transfer_session.hpp"
+#include "snbmodules/common/priority_enum.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief Divides the egress and ingress bandwidth of a client between its uploader and downloader sessions.
+    /// The active sessions of the highest priority class share the bandwidth by weight, the other sessions are
+    /// throttled to a small floor keeping their connections alive. The shares are given again when sessions
+    /// are added or removed, and periodically as sessions start and finish.
+    class BandwidthScheduler
+    {
+
+    public:
+        /// @brief What a session asks to the scheduler
+        struct demand_t
+        {
+            priority_type::e_priority priority = priority_type::e_priority::NORMAL;
+            int weight = 1;
+            /// @brief Transferring, inactive sessions only get the floor
+            bool active = true;
+        };
+
+        /// @brief Floor of the sessions not in the highest active class, in percent of the bandwidth
+        static constexpr int64_t min_share_percent = 1;
+
+        /// @brief Set the bandwidth of the client, 0 for no limit
+        /// @param egress bytes/s shared by the uploaders
+        /// @param ingress bytes/s shared by the downloaders
+        void set_bandwidth(int64_t egress, int64_t ingress);
+
+        /// @brief Schedule a session, its priority class and weight come from the "priority" and "weight" options of its group
+        void add_session(TransferSession &session);
+        void remove_session(const TransferSession &session);
+
+        /// @brief Give the shares again if the period elapsed, called by the loop of the client
+        void update();
+        /// @brief Give the shares again now
+        void rebalance();
+
+        /// @brief Share a bandwidth between sessions
+        /// @param bandwidth bytes/s to share, 0 for no limit
+        /// @param demands sessions sharing the bandwidth
+        /// @return rate in bytes/s of each demand in the same order, -1 for no limit
+        static std::vector<int64_t> compute_rates(int64_t bandwidth, const std::vector<demand_t> &demands);
+
+    private:
+        struct entry_t
+        {
+            TransferSession *session = nullptr;
+            demand_t demand;
+            /// @brief Rate last given to the session
+            int64_t rate = -1;
+            bool applied = false;
+        };
+
+        int64_t m_egress = 0;
+        int64_t m_ingress = 0;
+        /// @brief Scheduled sessions by id
+        std::map<std::string, entry_t> m_sessions;
+        std::mutex m_mutex;
+
+        std::chrono::steady_clock::time_point m_last_rebalance;
+        std::chrono::milliseconds m_rebalance_interval = std::chrono::milliseconds(1000);
+
+        /// @brief Share one direction between its sessions, m_mutex must be held
+        void rebalance(int64_t bandwidth, bool uploaders);
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_BANDWIDTH_SCHEDULER_HPP_
@@ -14,6 +14,7 @@
 #include "snbmodules/ip_format.hpp"
 #include "snbmodules/notification_interface.hpp"
 #include "snbmodules/common/status_enum.hpp"
+#include "snbmodules/interfaces/bittorrent_tracker.hpp"
 
 // errors handling
 #include "snbmodules/common/errors_declaration.hpp"
@@ -23,6 +24,7 @@
 #include <algorithm>
 #include <chrono>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 #include <utility>
@@ -73,6 +75,14 @@ namespace dunedaq::snbmodules
         /// @param force Force the update of the metadata even if the transfer is not in a dynamic state
         void request_update_metadata(bool force = false);
 
+        /// @brief Host a BitTorrent tracker on the ip of the bookkeeper, its url is sent to the clients for their bittorrent transfers
+        /// @param port port of the tracker, 0 to choose a free port
+        /// @return false if the tracker cannot listen
+        bool start_tracker(int port);
+
+        /// @brief Announce url of the tracker hosted by the bookkeeper, empty if there is none
+        std::string get_tracker_url() const { return m_tracker == nullptr ? "" : m_tracker->get_announce_url(); }
+
         // Setters
         inline void set_bookkeeper_id(std::string bookkeeper_id) { m_bookkeeper_id = std::move(bookkeeper_id); }
         inline void set_ip(const IPFormat &ip) { m_ip = ip; }
@@ -109,6 +119,9 @@ namespace dunedaq::snbmodules
         /// @brief Refresh rate of the information pannel of transfers in seconds
         int m_refresh_rate = 5;
 
+        /// @brief Optional tracker of the bittorrent transfers
+        std::unique_ptr<BittorrentTracker> m_tracker;
+
         /// @brief Send a notification to a clients id or connection to get available files
         /// @param client client id or connection name
         void request_connection_and_available_files(const std::string &client);
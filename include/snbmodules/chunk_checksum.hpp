@@ -0,0 +1,76 @@
+/**
+ * @file chunk_checksum.hpp ChunkChecksum class, XXH64 checksums of the chunks of a file
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_CHUNK_CHECKSUM_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_CHUNK_CHECKSUM_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief XXH64 checksums of the consecutive chunks of a file. Computed once by the uploader and sent in the hash
+    /// of the metadata of the file, as "xxh64:<chunk size>:<hex>,<hex>,...", so a downloader checks every chunk it writes
+    /// without reading the source again. The chunks are checked independently, in the order they are received
+    class ChunkChecksum
+    {
+
+    public:
+        ChunkChecksum() = default;
+        ChunkChecksum(uint64_t file_size, uint64_t chunk_size, std::vector<uint64_t> chunks);
+
+        /// @brief Read a checksum written by to_string
+        /// @return nothing if the string is not a chunk checksum, ex: the hash of a torrent
+        static std::optional<ChunkChecksum> parse(const std::string &checksum, uint64_t file_size);
+        std::string to_string() const;
+
+        /// @brief Hash a file, chunk by chunk
+        /// @param error why the file cannot be read
+        /// @param running checked between the blocks read, the hashing stops once it is cleared
+        static std::optional<ChunkChecksum> compute(const std::filesystem::path &file, uint64_t chunk_size, std::string &error,
+                                                    const std::atomic<bool> *running = nullptr);
+
+        /// @brief Same as compute, reusing the checksum computed before if the file did not change (same device, inode,
+        /// size and modification time). Checksums are kept in cache_dir
+        static std::optional<ChunkChecksum> compute_cached(const std::filesystem::path &file, uint64_t chunk_size,
+                                                           const std::filesystem::path &cache_dir, std::string &error,
+                                                           const std::atomic<bool> *running = nullptr);
+
+        /// @brief Remove the checksums of cache_dir whose file changed or disappeared
+        static void prune_cache(const std::filesystem::path &cache_dir);
+
+        /// @brief Check a chunk of a local file
+        /// @param fd file open for reading
+        /// @param error why the chunk does not match
+        bool verify_chunk(int fd, size_t index, std::string &error) const;
+
+        uint64_t get_chunk_size() const { return m_chunk_size; }
+        size_t get_chunk_count() const { return m_chunks.size(); }
+        /// @brief Bytes of a chunk, the last one can be shorter
+        uint64_t get_chunk_length(size_t index) const;
+
+        /// @brief XXH64 of a buffer
+        static uint64_t xxh64(const void *data, size_t size, uint64_t seed = 0);
+
+    private:
+        uint64_t m_file_size = 0;
+        uint64_t m_chunk_size = 0;
+        std::vector<uint64_t> m_chunks;
+
+        /// @brief XXH64 of a part of a file, read by blocks
+        /// @return nothing if the file cannot be read or running was cleared
+        static std::optional<uint64_t> hash_range(int fd, uint64_t offset, uint64_t length, std::vector<char> &buffer,
+                                                  const std::atomic<bool> *running = nullptr);
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_CHUNK_CHECKSUM_HPP_
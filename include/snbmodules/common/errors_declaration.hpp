@@ -98,6 +98,11 @@ namespace dunedaq
                       "RCloneNotSupportError: RClone does not support " << error_msg,
                       ((std::string)error_msg)) // NOLINT
 
+    ERS_DECLARE_ISSUE(snbmodules,
+                      RCloneServeError,
+                      "RCloneServeError: Cannot serve " << folder << " over HTTP on " << address << " : " << error_msg,
+                      ((std::string)folder)((std::string)address)((std::string)error_msg)) // NOLINT
+
     ERS_DECLARE_ISSUE(snbmodules,
                       BittorrentPeerDisconnectedError,
                       "BittorrentPeerDisconnectedError: Peer disconnected " << error_msg,
@@ -128,11 +133,21 @@ namespace dunedaq
                       "BittorrentLoadResumeFileError: Cannot load resume metadata from file " << file,
                       ((std::string)file)) // NOLINT
 
+    ERS_DECLARE_ISSUE(snbmodules,
+                      BittorrentHashingError,
+                      "BittorrentHashingError: Cannot hash " << file << " : " << error_msg,
+                      ((std::string)file)((std::string)error_msg)) // NOLINT
+
     ERS_DECLARE_ISSUE(snbmodules,
                       ConfigError,
                       "ConfigError: Please check the configuration file for more information, " << param,
                       ((std::string)param)) // NOLINT
 
+    ERS_DECLARE_ISSUE(snbmodules,
+                      MemoryBudgetExceededError,
+                      "MemoryBudgetExceededError: " << owner << " reserved " << reserved << " bytes, " << total << " bytes are now reserved for a budget of " << budget,
+                      ((std::string)owner)((uint64_t)reserved)((uint64_t)total)((uint64_t)budget)) // NOLINT
+
     // metadata errors
     ERS_DECLARE_ISSUE(snbmodules,
                       MetadataFileNotFoundError,
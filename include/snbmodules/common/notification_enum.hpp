@@ -28,6 +28,7 @@ namespace dunedaq::snbmodules
             // client
             GROUP_METADATA,
             TRANSFER_ERROR,
+            PEER_ENDPOINTS,
 
             // both
             START_TRANSFER,
@@ -45,6 +46,7 @@ namespace dunedaq::snbmodules
                 {UPDATE_REQUEST, "UPDATE_REQUEST"},
                 {GROUP_METADATA, "GROUP_METADATA"},
                 {TRANSFER_ERROR, "TRANSFER_ERROR"},
+                {PEER_ENDPOINTS, "PEER_ENDPOINTS"},
                 {START_TRANSFER, "START_TRANSFER"},
                 {TRANSFER_METADATA, "TRANSFER_METADATA"},
                 {PAUSE_TRANSFER, "PAUSE_TRANSFER"},
@@ -62,6 +64,7 @@ namespace dunedaq::snbmodules
                 {"UPDATE_REQUEST", UPDATE_REQUEST},
                 {"GROUP_METADATA", GROUP_METADATA},
                 {"TRANSFER_ERROR", TRANSFER_ERROR},
+                {"PEER_ENDPOINTS", PEER_ENDPOINTS},
                 {"START_TRANSFER", START_TRANSFER},
                 {"TRANSFER_METADATA", TRANSFER_METADATA},
                 {"PAUSE_TRANSFER", PAUSE_TRANSFER},
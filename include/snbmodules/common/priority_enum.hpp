@@ -0,0 +1,57 @@
+/**
+ * @file priority_enum.hpp priority_type::e_priority enum definition
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_COMMON_PRIORITY_ENUM_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_COMMON_PRIORITY_ENUM_HPP_
+
+#include <map>
+#include <string>
+#include <optional>
+
+namespace dunedaq::snbmodules
+{
+    struct priority_type
+    {
+        /// @brief Priority classes of the transfers, sorted by priority (highest last).
+        /// The active transfers of the highest class share the bandwidth of the client, the others are throttled
+        enum e_priority
+        {
+            /// @brief Re-sending data already stored
+            ARCHIVAL,
+            NORMAL,
+            /// @brief Fresh data to get to storage first, ex: a supernova burst
+            URGENT,
+        };
+
+        static std::string priority_to_string(e_priority e)
+        {
+            const std::map<e_priority, std::string> MyEnumStrings{
+                {ARCHIVAL, "archival"},
+                {NORMAL, "normal"},
+                {URGENT, "urgent"}};
+            auto it = MyEnumStrings.find(e);
+            return it == MyEnumStrings.end() ? "Not supported" : it->second;
+        }
+
+        static std::optional<e_priority> string_to_priority(std::string s)
+        {
+            const std::map<std::string, e_priority> MyStringsEnum{
+                {"archival", ARCHIVAL},
+                {"normal", NORMAL},
+                {"urgent", URGENT}};
+            auto it = MyStringsEnum.find(s);
+            if (it == MyStringsEnum.end())
+            {
+                return std::nullopt;
+            }
+            return it->second;
+        }
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_COMMON_PRIORITY_ENUM_HPP_
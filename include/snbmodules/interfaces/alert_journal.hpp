@@ -0,0 +1,63 @@
+/**
+ * @file alert_journal.hpp AlertJournal class, buffered asynchronous log of the libtorrent alerts
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_ALERT_JOURNAL_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_ALERT_JOURNAL_HPP_
+
+#include "utilities/WorkerThread.hpp"
+
+#include "libtorrent/alert.hpp"
+#include "libtorrent/time.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief Write the alerts of a bittorrent session in a file without slowing down the alert loop.
+    /// Alerts are formatted in a memory buffer, swapped and written by a background thread.
+    class AlertJournal
+    {
+
+    public:
+        /// @brief Constructor
+        /// @param file path of the journal, truncated
+        /// @param flush_size size of the buffer that wakes up the writer thread
+        explicit AlertJournal(const std::filesystem::path &file, size_t flush_size = 1024 * 1024);
+        ~AlertJournal();
+
+        AlertJournal(const AlertJournal &) = delete;
+        AlertJournal &operator=(const AlertJournal &) = delete;
+
+        /// @brief Append an alert to the journal
+        void log(lt::alert const *a);
+
+    private:
+        std::FILE *m_file = nullptr;
+        size_t m_flush_size;
+        bool m_has_first_ts = false;
+        lt::time_point m_first_ts;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        /// @brief Filled by log, guarded by m_mutex
+        std::string m_buffer;
+        bool m_stopping = false;
+
+        // Threading
+        dunedaq::utilities::WorkerThread m_thread;
+        void do_work(std::atomic<bool> &running_flag);
+        void write_pending();
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_ALERT_JOURNAL_HPP_
@@ -0,0 +1,180 @@
+/**
+ * @file bittorrent_session.hpp BittorrentSession class, libtorrent session shared by the bittorrent transfers of a client
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_BITTORRENT_SESSION_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_BITTORRENT_SESSION_HPP_
+
+#include "snbmodules/transfer_metadata.hpp"
+#include "snbmodules/ip_format.hpp"
+#include "snbmodules/memory_budget.hpp"
+#include "snbmodules/interfaces/sequential_disk_io.hpp"
+#include "snbmodules/common/errors_declaration.hpp"
+#include "utilities/WorkerThread.hpp"
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/session_params.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/torrent_handle.hpp"
+#include "libtorrent/torrent_status.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace dunedaq::snbmodules
+{
+    struct torrent_entry_t;
+
+    /// @brief Receives the alerts of the torrents it added to a shared session
+    class BittorrentSessionListener
+    {
+    public:
+        virtual ~BittorrentSessionListener() = default;
+
+        /// @brief Alert of one of the torrents of the listener, called from the alert thread of the session
+        virtual void on_alert(torrent_entry_t &entry, lt::alert const *a) = 0;
+        /// @brief New status of one of the torrents of the listener, called from the alert thread of the session
+        virtual void on_status(torrent_entry_t &entry, lt::torrent_status const &s) = 0;
+    };
+
+    /// @brief File of a multi-file torrent
+    struct torrent_file_t
+    {
+        TransferMetadata *meta = nullptr;
+        /// @brief Where the downloader writes the file, outside of the directory of the torrent
+        std::string path;
+    };
+
+    /// @brief State of one torrent of a session, given to libtorrent as the userdata of the torrent
+    struct torrent_entry_t
+    {
+        /// @brief File of the torrent, the first one added for a multi-file torrent
+        TransferMetadata *meta = nullptr;
+        /// @brief Files of a multi-file torrent by index in the torrent, empty for a single file torrent
+        std::map<int, torrent_file_t> files;
+        /// @brief Transfer interface the alerts of the torrent are given to
+        BittorrentSessionListener *owner = nullptr;
+        /// @brief Set by the alert thread when the torrent is added to the session, see BittorrentSession::get_handle
+        lt::torrent_handle handle;
+        /// @brief Last values seen, to update the metadata and log only on changes
+        int64_t total_done = -1;
+        lt::torrent_status::state_t state = lt::torrent_status::checking_resume_data;
+        std::chrono::steady_clock::time_point last_log;
+    };
+
+    /// @brief One libtorrent session, with its listen socket, network and disk threads, shared by every transfer
+    /// of the same role on the same interface. A single alert thread routes the alerts of each torrent to the
+    /// transfer that added it, found from the torrent handle.
+    class BittorrentSession
+    {
+
+    public:
+        /// @brief Constructor
+        /// @param listen_interface ip to listen on
+        /// @param is_client true for the sessions of the downloaders
+        /// @param protocol_options bittorrent options of the group creating the session
+        BittorrentSession(const IPFormat &listen_interface, bool is_client, const nlohmann::json &protocol_options);
+        ~BittorrentSession();
+
+        BittorrentSession(const BittorrentSession &) = delete;
+        BittorrentSession &operator=(const BittorrentSession &) = delete;
+
+        lt::session &get_session() { return m_session; }
+
+        /// @brief Port the session really listens on, 0 if it failed to listen
+        int get_listen_port() const { return m_session.listen_port(); }
+
+        /// @brief Disk jobs and bytes waiting to be written, from the last session statistics
+        int64_t get_queued_disk_jobs() const { return m_queued_disk_jobs; }
+        int64_t get_queued_write_bytes() const { return m_queued_write_bytes; }
+
+        /// @brief Register an entry before adding its torrent, its alerts are routed to its owner
+        void track(torrent_entry_t *entry);
+        /// @brief Unregister an entry, no alert is given to its owner once this returns
+        void forget(torrent_entry_t *entry);
+        /// @brief Handle of the torrent of an entry, invalid until the torrent is added
+        lt::torrent_handle get_handle(torrent_entry_t *entry);
+
+        /// @brief Bytes of the disk queue, disk buffer and socket buffers of a session without memory budget
+        static uint64_t wanted_memory(bool is_client, const nlohmann::json &protocol_options);
+        /// @brief Settings of the session, tuned for downloaders or seeders
+        /// @param memory bytes reserved by the session, its queues and buffers are scaled down to fit in
+        static lt::session_params make_params(const IPFormat &listen_interface, bool is_client, const nlohmann::json &protocol_options, uint64_t memory);
+        /// @brief Sizes of the disk queue and socket buffers of a session, scaled down to its share of the memory budget
+        static void set_memory_settings(lt::settings_pack &p, bool is_client, const nlohmann::json &protocol_options, uint64_t memory);
+
+    private:
+        // declared before the session, used by make_params
+        bool m_is_client;
+        /// @brief Share of the memory budget of the process
+        std::unique_ptr<MemoryBudget::Reservation> m_memory;
+        lt::session m_session;
+
+        /// @brief Entries of the torrents added, and of those already in the session by handle
+        std::mutex m_mutex;
+        std::unordered_set<torrent_entry_t *> m_entries;
+        std::unordered_map<lt::torrent_handle, torrent_entry_t *> m_by_handle;
+
+        /// @brief Set by libtorrent when alerts are waiting
+        std::mutex m_alert_mutex;
+        std::condition_variable m_alert_cv;
+        bool m_alert_pending = false;
+        /// @brief Period of the status updates of the torrents
+        std::chrono::milliseconds m_update_interval = std::chrono::milliseconds(200);
+        /// @brief Period of the session statistics, giving the memory used by the session
+        std::chrono::milliseconds m_stats_interval = std::chrono::milliseconds(1000);
+        std::atomic<int64_t> m_queued_disk_jobs = 0;
+        std::atomic<int64_t> m_queued_write_bytes = 0;
+
+        /// @brief Route an alert to the owner of its torrent, m_mutex must be held
+        void dispatch(lt::alert const *a);
+
+        // Threading
+        dunedaq::utilities::WorkerThread m_thread;
+        void do_work(std::atomic<bool> &running_flag);
+    };
+
+    /// @brief Sessions of the process, one per listening ip and role, alive as long as a transfer uses it
+    class BittorrentSessionPool
+    {
+
+    public:
+        static BittorrentSessionPool &get()
+        {
+            static BittorrentSessionPool instance;
+            return instance;
+        }
+
+        // not cloneable
+        BittorrentSessionPool(BittorrentSessionPool &other) = delete;
+        // not assignable
+        void operator=(const BittorrentSessionPool &) = delete;
+
+        /// @brief Get the session of an ip and role, created with the options of the first group using it
+        /// @param listen_interface ip to listen on
+        /// @param is_client true for the downloaders
+        /// @param protocol_options bittorrent options of the group, "shared_session": false gives a session of its own
+        std::shared_ptr<BittorrentSession> get_session(const IPFormat &listen_interface, bool is_client, const nlohmann::json &protocol_options);
+
+    private:
+        BittorrentSessionPool() = default;
+
+        std::mutex m_mutex;
+        std::map<std::string, std::weak_ptr<BittorrentSession>> m_sessions;
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_BITTORRENT_SESSION_HPP_
@@ -0,0 +1,126 @@
+/**
+ * @file bittorrent_telemetry.hpp BittorrentTelemetry class, periodic samples of the peers and queues of the torrents of a transfer
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_BITTORRENT_TELEMETRY_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_BITTORRENT_TELEMETRY_HPP_
+
+#include "snbmodules/interfaces/bittorrent_session.hpp"
+
+#include "libtorrent/torrent_handle.hpp"
+#include "libtorrent/peer_info.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief State of one torrent at the last sample
+    struct session_state_t
+    {
+        std::vector<lt::peer_info> peers;
+        std::vector<lt::partial_piece_info> download_queue;
+
+        void clear()
+        {
+            peers.clear();
+            download_queue.clear();
+        }
+    };
+
+    /// @brief Summary of the torrents of a transfer at one sample
+    struct telemetry_sample_t
+    {
+        std::chrono::system_clock::time_point time;
+        int peers = 0;
+        /// @brief Payload rates summed over the peers, in bytes/s
+        int64_t download_rate = 0;
+        int64_t upload_rate = 0;
+        /// @brief Connections choked and unchoked since the previous sample,
+        /// by the peers for a downloader, by this client for a seeder
+        int64_t chokes = 0;
+        int64_t unchokes = 0;
+        /// @brief Disk queue of the session, shared with the other transfers of the session
+        int64_t queued_disk_jobs = 0;
+        int64_t queued_write_bytes = 0;
+        /// @brief Pieces being downloaded
+        int download_queue = 0;
+        /// @brief Time a block requested now waits before it is received, -1 without request.
+        /// Mean of the download_queue_time of the peers estimated by libtorrent, weighted by their queued blocks
+        int64_t request_latency_ms = -1;
+        /// @brief Peer sending (downloader) or receiving (seeder) the slowest among those exchanging pieces, empty if none
+        std::string slowest_peer;
+        int64_t slowest_peer_rate = 0;
+
+        std::string to_string() const;
+    };
+
+    /// @brief Last state of a peer, summed over the torrents of the transfer
+    struct peer_telemetry_t
+    {
+        std::string endpoint;
+        std::string client;
+        int64_t download_rate = 0;
+        int64_t upload_rate = 0;
+        int64_t total_download = 0;
+        int64_t total_upload = 0;
+        /// @brief Choked at the last sample, and transitions since the peer is connected
+        bool choked = false;
+        int64_t chokes = 0;
+        int64_t unchokes = 0;
+        int rtt_ms = 0;
+        /// @brief Time estimated by libtorrent to receive the blocks requested to the peer
+        int64_t queue_time_ms = 0;
+        int queue_length = 0;
+    };
+
+    /// @brief Samples the peers, download queue and disk queue of the torrents of a transfer, and keeps the last
+    /// summaries in a bounded ring buffer. Shows a slow peer or a receiver bound by its disk while the transfer runs.
+    class BittorrentTelemetry
+    {
+
+    public:
+        /// @brief Constructor
+        /// @param is_client true for a downloader, the chokes and slowest peer are seen from its side
+        /// @param capacity number of samples kept
+        explicit BittorrentTelemetry(bool is_client, size_t capacity = 120);
+
+        /// @brief Take a sample of the torrents, blocks on the network thread of the session
+        /// @param handles torrents of the transfer
+        /// @param session session of the torrents, for its disk queue
+        /// @return summary of the sample
+        telemetry_sample_t sample(const std::vector<lt::torrent_handle> &handles, const BittorrentSession &session);
+
+        /// @brief Samples kept, oldest first
+        std::vector<telemetry_sample_t> get_samples();
+        std::optional<telemetry_sample_t> get_last_sample();
+        /// @brief Peers at the last sample
+        std::vector<peer_telemetry_t> get_peers();
+        /// @brief State of each torrent at the last sample. By handle, torrents of files with the same name are kept apart
+        std::map<lt::torrent_handle, session_state_t> get_torrents_state();
+
+    private:
+        bool m_is_client;
+        size_t m_capacity;
+
+        std::deque<telemetry_sample_t> m_samples;
+        std::map<std::string, peer_telemetry_t> m_peers;
+        std::map<lt::torrent_handle, session_state_t> m_torrents_state;
+        /// @brief Choke state of each connection, by torrent and endpoint
+        std::map<std::pair<lt::torrent_handle, std::string>, bool> m_choked;
+        std::mutex m_mutex;
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_BITTORRENT_TELEMETRY_HPP_
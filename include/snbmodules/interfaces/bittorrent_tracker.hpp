@@ -0,0 +1,92 @@
+/**
+ * @file bittorrent_tracker.hpp BittorrentTracker class, minimal HTTP tracker for the bittorrent transfers
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_BITTORRENT_TRACKER_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_BITTORRENT_TRACKER_HPP_
+
+#include "snbmodules/ip_format.hpp"
+#include "snbmodules/common/errors_declaration.hpp"
+#include "utilities/WorkerThread.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief HTTP tracker (BEP 3, compact peer lists of BEP 23) keeping the peers of every torrent in memory.
+    /// Every client announcing a torrent gets the endpoints of the other clients of the torrent,
+    /// the peers of a group find each other within one announce interval without any other service
+    class BittorrentTracker
+    {
+
+    public:
+        /// @brief Constructor, the tracker does not listen before start
+        /// @param listen_interface ip and port to listen on, port 0 to choose a free port
+        /// @param interval announce interval given to the clients in seconds
+        explicit BittorrentTracker(const IPFormat &listen_interface, int interval = 5);
+        ~BittorrentTracker();
+
+        BittorrentTracker(const BittorrentTracker &) = delete;
+        BittorrentTracker &operator=(const BittorrentTracker &) = delete;
+
+        /// @brief Listen and answer the announces in background
+        /// @return false if the socket cannot be opened
+        bool start();
+        void stop();
+
+        /// @brief Port the tracker listens on, 0 before start
+        int get_port() const { return m_port; }
+        /// @brief Url to put in the torrents, http://ip:port/announce
+        std::string get_announce_url() const;
+        /// @brief Number of peers known for a torrent
+        /// @param info_hash raw info-hash as announced by the clients
+        size_t get_peers_count(const std::string &info_hash);
+
+        /// @brief Answer an announce, public to be tested without socket
+        /// @param query query string of the request, after the '?'
+        /// @param remote_ip ip of the client, used when the announce has no "ip" parameter
+        /// @return bencoded body of the response
+        std::string handle_announce(const std::string &query, const std::string &remote_ip);
+
+    private:
+        struct peer_t
+        {
+            std::string ip;
+            uint16_t port = 0;
+            bool seed = false;
+            std::chrono::steady_clock::time_point last_seen;
+        };
+
+        IPFormat m_listen_interface;
+        int m_interval;
+        int m_socket = -1;
+        std::atomic<int> m_port = 0;
+
+        /// @brief Peers by peer id, by info-hash
+        std::map<std::string, std::map<std::string, peer_t>> m_swarms;
+        std::mutex m_mutex;
+
+        /// @brief Read one request from a client and answer it
+        void handle_connection(int fd, const std::string &remote_ip);
+        /// @brief Forget the peers that did not announce for a few intervals, m_mutex must be held
+        void expire_peers();
+
+        static std::string url_decode(const std::string &s);
+        static std::string failure(const std::string &reason);
+
+        // Threading
+        dunedaq::utilities::WorkerThread m_thread;
+        void do_work(std::atomic<bool> &running_flag);
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_BITTORRENT_TRACKER_HPP_
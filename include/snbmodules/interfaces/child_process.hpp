@@ -0,0 +1,67 @@
+/**
+ * @file child_process.hpp ChildProcess class, a command run in a child process without blocking the caller
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_CHILD_PROCESS_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_CHILD_PROCESS_HPP_
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief Command run in a child process, polled for its end instead of waited for.
+    /// No shell is involved, the arguments are given as they are. The last lines written on its error output are kept
+    class ChildProcess
+    {
+
+    public:
+        ChildProcess() = default;
+        /// @brief A process still running is terminated
+        ~ChildProcess();
+
+        ChildProcess(const ChildProcess &) = delete;
+        ChildProcess &operator=(const ChildProcess &) = delete;
+
+        /// @brief Start the command, args[0] is searched in the PATH
+        /// @param interactive keep the terminal and the standard input of the client, for commands asking a password.
+        /// Otherwise the command reads /dev/null and runs in its own process group, terminated with its children
+        /// @param error why the command cannot be started
+        bool start(const std::vector<std::string> &args, std::string &error, bool interactive = false);
+
+        /// @brief Check if the command ended, without blocking
+        /// @return exit code of the command, 128 + signal number if it was killed, -1 if it cannot be waited for,
+        /// nothing while it runs
+        std::optional<int> poll();
+
+        /// @brief Stop the command with SIGTERM, SIGKILL if it is still running after grace, and wait for it
+        void terminate(std::chrono::milliseconds grace = std::chrono::seconds(2));
+
+        bool is_running() const { return m_pid > 0; }
+        pid_t get_pid() const { return m_pid; }
+
+        /// @brief End of the error output of the command, the last 4 KiB
+        const std::string &get_error_output() const { return m_error_output; }
+
+    private:
+        pid_t m_pid = -1;
+        bool m_own_group = false;
+        /// @brief Read end of the error output, non-blocking
+        int m_stderr = -1;
+        std::string m_error_output;
+        std::optional<int> m_exit_code;
+
+        void read_error_output();
+        void close_error_output();
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_CHILD_PROCESS_HPP_
@@ -0,0 +1,87 @@
+/**
+ * @file http_range_client.hpp HttpRangeClient class, HTTP range requests writing a part of a file
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_HTTP_RANGE_CLIENT_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_HTTP_RANGE_CLIENT_HPP_
+
+#include "snbmodules/ip_format.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief Bandwidth limit shared by several streams, a token bucket holding at most one second of bytes
+    class RateLimiter
+    {
+
+    public:
+        /// @brief Change the limit, the streams waiting take it at their next bytes
+        /// @param bytes_per_second 0 for no limit
+        void set_rate(uint64_t bytes_per_second);
+        uint64_t get_rate() const { return m_rate; }
+
+        /// @brief Account received bytes, and wait until the limit allows them
+        /// @param stop set to stop waiting, checked every 100 ms
+        void consume(uint64_t bytes, const std::atomic<bool> &stop);
+
+    private:
+        std::atomic<uint64_t> m_rate = 0;
+        /// @brief Bytes that can still be received now, negative when the streams are ahead of the limit
+        double m_tokens = 0;
+        std::chrono::steady_clock::time_point m_last = std::chrono::steady_clock::now();
+        std::mutex m_mutex;
+    };
+
+    /// @brief Minimal HTTP/1.1 client getting byte ranges of a file served over HTTP (rclone serve http, web seeds),
+    /// written straight at their offset in a local file. Used to continue a download from the bytes already on disk
+    class HttpRangeClient
+    {
+
+    public:
+        /// @brief Size of a remote file, from a HEAD request
+        /// @param server ip and port of the server
+        /// @param path path of the file on the server, not escaped
+        /// @return nothing if the file cannot be reached
+        static std::optional<uint64_t> get_size(const IPFormat &server, const std::string &path);
+
+        /// @brief Get a range of a remote file and write it at the same offset in a local file
+        /// @param server ip and port of the server
+        /// @param path path of the file on the server, not escaped
+        /// @param offset first byte of the range
+        /// @param length number of bytes of the range
+        /// @param fd local file open for writing, written with pwrite
+        /// @param stop set to abort the request, checked every second at most
+        /// @param on_bytes called with the number of bytes written since the previous call
+        /// @param error why the request failed
+        /// @param limiter optional bandwidth limit of the request, shared with other requests
+        /// @return true when the whole range is written
+        static bool get_range(const IPFormat &server, const std::string &path, uint64_t offset, uint64_t length, int fd,
+                              const std::atomic<bool> &stop, const std::function<void(uint64_t)> &on_bytes, std::string &error,
+                              RateLimiter *limiter = nullptr);
+
+        /// @brief Percent-encode a path, '/' is kept
+        static std::string escape_path(const std::string &path);
+
+    private:
+        /// @brief Connect to the server and send a request
+        /// @return socket, -1 on error
+        static int send_request(const IPFormat &server, const std::string &request, std::string &error);
+        /// @brief Read the status line and headers of the response
+        /// @param body first bytes of the body read with the headers
+        /// @return status code, -1 on error
+        static int read_headers(int fd, const std::atomic<bool> &stop, std::string &headers, std::string &body, std::string &error);
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_HTTP_RANGE_CLIENT_HPP_
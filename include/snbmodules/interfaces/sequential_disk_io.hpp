@@ -0,0 +1,122 @@
+/**
+ * @file sequential_disk_io.hpp SequentialDiskIO class, libtorrent disk backend for a few large files read and written sequentially
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_SEQUENTIAL_DISK_IO_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_SEQUENTIAL_DISK_IO_HPP_
+
+#include "libtorrent/disk_interface.hpp"
+#include "libtorrent/disk_buffer_holder.hpp"
+#include "libtorrent/disk_observer.hpp"
+#include "libtorrent/storage_defs.hpp"
+#include "libtorrent/session_params.hpp"
+#include "libtorrent/io_context.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief Disk backend of the bittorrent sessions, made for SNB files: a few very large files, downloaded mostly in order.
+    /// Received blocks are gathered in piece sized aligned buffers, complete pieces are hashed from memory
+    /// and written at once with O_DIRECT by a pool of I/O threads. Files are preallocated when first opened for writing.
+    /// Block reads of the seeders go through the page cache to benefit from the kernel read ahead,
+    /// or, when the files are mapped, are served straight from a read-only memory mapping of each file without any copy.
+    class SequentialDiskIO final : public lt::disk_interface, public lt::buffer_allocator_interface
+    {
+
+    public:
+        /// @brief Constructor
+        /// @param ioc io context of the session, where the handlers are posted
+        /// @param num_threads number of I/O threads
+        /// @param max_buffered_bytes memory used by the pieces waiting to be written, peers are throttled above
+        /// @param map_files serve reads and hashes from memory mappings of the files, only for files that do not change anymore
+        SequentialDiskIO(lt::io_context &ioc, unsigned int num_threads, int64_t max_buffered_bytes, bool map_files = false);
+        ~SequentialDiskIO() override;
+
+        SequentialDiskIO(const SequentialDiskIO &) = delete;
+        SequentialDiskIO &operator=(const SequentialDiskIO &) = delete;
+
+        /// @brief Constructor to use in lt::session_params::disk_io_constructor
+        static lt::disk_io_constructor_type constructor(unsigned int num_threads, int64_t max_buffered_bytes, bool map_files = false);
+
+        // lt::disk_interface
+        lt::storage_holder new_torrent(lt::storage_params const &params, std::shared_ptr<void> const &torrent) override;
+        void remove_torrent(lt::storage_index_t idx) override;
+
+        void async_read(lt::storage_index_t storage, lt::peer_request const &r, std::function<void(lt::disk_buffer_holder, lt::storage_error const &)> handler, lt::disk_job_flags_t flags) override;
+        bool async_write(lt::storage_index_t storage, lt::peer_request const &r, char const *buf, std::shared_ptr<lt::disk_observer> o, std::function<void(lt::storage_error const &)> handler, lt::disk_job_flags_t flags) override;
+        void async_hash(lt::storage_index_t storage, lt::piece_index_t piece, lt::span<lt::sha256_hash> block_hashes, lt::disk_job_flags_t flags, std::function<void(lt::piece_index_t, lt::sha1_hash const &, lt::storage_error const &)> handler) override;
+        void async_hash2(lt::storage_index_t storage, lt::piece_index_t piece, int offset, lt::disk_job_flags_t flags, std::function<void(lt::piece_index_t, lt::sha256_hash const &, lt::storage_error const &)> handler) override;
+        void async_move_storage(lt::storage_index_t storage, std::string p, lt::move_flags_t flags, std::function<void(lt::status_t, std::string const &, lt::storage_error const &)> handler) override;
+        void async_release_files(lt::storage_index_t storage, std::function<void()> handler) override;
+        void async_check_files(lt::storage_index_t storage, lt::add_torrent_params const *resume_data, lt::aux::vector<std::string, lt::file_index_t> links, std::function<void(lt::status_t, lt::storage_error const &)> handler) override;
+        void async_stop_torrent(lt::storage_index_t storage, std::function<void()> handler) override;
+        void async_rename_file(lt::storage_index_t storage, lt::file_index_t index, std::string name, std::function<void(std::string const &, lt::file_index_t, lt::storage_error const &)> handler) override;
+        void async_delete_files(lt::storage_index_t storage, lt::remove_flags_t options, std::function<void(lt::storage_error const &)> handler) override;
+        void async_set_file_priority(lt::storage_index_t storage, lt::aux::vector<lt::download_priority_t, lt::file_index_t> prio, std::function<void(lt::storage_error const &, lt::aux::vector<lt::download_priority_t, lt::file_index_t>)> handler) override;
+        void async_clear_piece(lt::storage_index_t storage, lt::piece_index_t index, std::function<void(lt::piece_index_t)> handler) override;
+
+        void update_stats_counters(lt::counters &c) const override;
+        std::vector<lt::open_file_state> get_status(lt::storage_index_t storage) const override;
+        void abort(bool wait) override;
+        void submit_jobs() override;
+        void settings_updated() override;
+
+        // lt::buffer_allocator_interface
+        void free_disk_buffer(char *buf) override;
+
+        class Storage;
+        struct piece_buffer_t;
+
+    private:
+        lt::io_context &m_ioc;
+        int64_t m_max_buffered_bytes;
+        bool m_map_files;
+
+        /// @brief Blocks given to libtorrent that point in a mapping, with the mapping they keep alive
+        std::mutex m_mapped_mutex;
+        std::unordered_multimap<char const *, std::shared_ptr<void>> m_mapped_buffers;
+
+        mutable std::mutex m_mutex;
+        lt::aux::vector<std::shared_ptr<Storage>, lt::storage_index_t> m_torrents;
+        std::vector<lt::storage_index_t> m_free_slots;
+
+        /// @brief Bytes held by the piece buffers
+        std::atomic<int64_t> m_buffered_bytes = 0;
+        /// @brief Peers waiting for the buffers to be written
+        std::vector<std::weak_ptr<lt::disk_observer>> m_observers;
+
+        // I/O threads
+        std::mutex m_jobs_mutex;
+        std::condition_variable m_jobs_cv;
+        std::deque<std::function<void()>> m_jobs;
+        std::vector<std::thread> m_threads;
+        bool m_abort = false;
+
+        std::shared_ptr<Storage> get_storage(lt::storage_index_t idx) const;
+        void add_job(std::function<void()> job);
+        void io_thread();
+
+        /// @brief Write a complete piece buffer and release it
+        void flush_piece(const std::shared_ptr<Storage> &storage, const std::shared_ptr<piece_buffer_t> &buffer);
+        /// @brief Write every buffered block of a storage, complete or not
+        void flush_all(const std::shared_ptr<Storage> &storage);
+        /// @brief Account the memory released by a buffer, and wake up the throttled peers
+        void release_buffer(int64_t size);
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_SEQUENTIAL_DISK_IO_HPP_
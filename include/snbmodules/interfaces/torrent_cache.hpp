@@ -0,0 +1,70 @@
+/**
+ * @file torrent_cache.hpp TorrentCache class, persistent cache of the torrents generated for the files of the client
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TORRENT_CACHE_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TORRENT_CACHE_HPP_
+
+#include "snbmodules/common/errors_declaration.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief Keep the torrents generated for the files on disk, so a file that did not change is never hashed twice.
+    /// Entries are keyed by the identity of the file (device, inode, size, modification time),
+    /// a modified or replaced file gets a new key and its old entry is pruned.
+    class TorrentCache
+    {
+
+    public:
+        /// @brief Cached result of the hashing of a file
+        struct entry_t
+        {
+            /// @brief bencoded torrent
+            std::vector<char> torrent;
+            std::string magnet;
+            /// @brief hash of the whole file (hex merkle root)
+            std::string hash;
+            /// @brief tracker the torrent was generated with
+            std::string tracker;
+        };
+
+        /// @brief Constructor, remove the entries of files that changed or disappeared
+        /// @param cache_dir directory of the cache, created if needed
+        explicit TorrentCache(std::filesystem::path cache_dir);
+
+        /// @brief Look for the entry of a file
+        /// @param file path of the file
+        /// @param entry filled if found
+        /// @return true if the file did not change since the entry was stored
+        bool lookup(const std::filesystem::path &file, entry_t &entry) const;
+
+        /// @brief Store the entry of a file, files are written atomically
+        /// @return false if the entry cannot be written
+        bool store(const std::filesystem::path &file, const entry_t &entry);
+
+        /// @brief Identity of a file
+        /// @return "device-inode-size-mtime", empty if the file cannot be stat
+        static std::string file_key(const std::filesystem::path &file);
+
+        /// @brief Write a file under a unique temporary name then rename it, readers only see complete files
+        /// @return false if the file cannot be written, nothing is left then
+        static bool write_atomic(const std::filesystem::path &path, const char *data, size_t size);
+
+        const std::filesystem::path &get_cache_dir() const { return m_cache_dir; }
+
+    private:
+        std::filesystem::path m_cache_dir;
+
+        void prune();
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TORRENT_CACHE_HPP_
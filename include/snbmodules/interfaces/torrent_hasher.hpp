@@ -0,0 +1,86 @@
+/**
+ * @file torrent_hasher.hpp TorrentHasher class, multi-threaded v2 piece hashing used to create torrents
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TORRENT_HASHER_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TORRENT_HASHER_HPP_
+
+#include "snbmodules/common/errors_declaration.hpp"
+
+#include "libtorrent/create_torrent.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/sha1_hash.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief Compute the v2 (BEP 52) piece hashes of a torrent with a pool of threads.
+    /// Each worker reads whole, piece aligned ranges of the files with pread and computes the
+    /// merkle root of the 16 KiB blocks of the piece. Results are fed to lt::create_torrent::set_hash2
+    /// by the calling thread once every piece is hashed.
+    class TorrentHasher
+    {
+
+    public:
+        /// @brief Progress callback, called from the calling thread only
+        /// @param bytes_hashed number of bytes hashed so far
+        /// @param total_bytes total number of bytes to hash
+        using progress_callback_t = std::function<void(uint64_t bytes_hashed, uint64_t total_bytes)>;
+
+        /// @brief Constructor
+        /// @param num_threads number of hashing threads, 0 to use every hardware thread
+        explicit TorrentHasher(unsigned int num_threads = 0);
+
+        /// @brief Hash every piece of the torrent and set them with set_hash2
+        /// @param t torrent to fill, must be a v2 torrent
+        /// @param base_path directory containing the files of the torrent
+        /// @param progress optional callback to report progress
+        /// @return true if every piece was hashed
+        bool set_piece_hashes(lt::create_torrent &t, const std::filesystem::path &base_path, const progress_callback_t &progress = nullptr);
+
+        /// @brief Compute the merkle root of a piece from the data of the piece
+        /// @param data content of the piece, can be shorter than the piece size for the last piece of a file
+        /// @param len length of the data
+        /// @param blocks_per_piece number of 16 KiB blocks in a full piece
+        /// @param single_piece_file true if the file is not bigger than one piece, the tree is then padded to the next power of two only
+        /// @return root hash of the piece
+        static lt::sha256_hash piece_root(char const *data, int64_t len, int blocks_per_piece, bool single_piece_file);
+
+        inline unsigned int get_num_threads() const { return m_num_threads; }
+        inline uint64_t get_bytes_hashed() const { return m_bytes_hashed.load(); }
+
+    private:
+        /// @brief One piece to hash
+        struct piece_job_t
+        {
+            int fd;
+            lt::file_index_t file;
+            lt::piece_index_t::diff_type piece_in_file;
+            int64_t offset;
+            int64_t length;
+            bool single_piece_file;
+        };
+
+        void hash_worker(const std::vector<piece_job_t> &jobs, std::vector<lt::sha256_hash> &results, int piece_size);
+
+        unsigned int m_num_threads;
+        std::atomic<size_t> m_next_job{0};
+        std::atomic<uint64_t> m_bytes_hashed{0};
+        std::atomic<bool> m_failed{false};
+        std::string m_error_msg;
+        std::mutex m_error_mutex;
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TORRENT_HASHER_HPP_
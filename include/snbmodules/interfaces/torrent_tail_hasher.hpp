@@ -0,0 +1,84 @@
+/**
+ * @file torrent_tail_hasher.hpp TorrentTailHasher class, hash files while they are being written to have their torrent ready when they are closed
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TORRENT_TAIL_HASHER_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TORRENT_TAIL_HASHER_HPP_
+
+#include "snbmodules/interfaces/torrent_hasher.hpp"
+#include "snbmodules/common/errors_declaration.hpp"
+#include "utilities/WorkerThread.hpp"
+
+#include "libtorrent/create_torrent.hpp"
+#include "libtorrent/hasher.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief Follow the files written in a directory and hash each piece as soon as it is complete.
+    /// When the writer closes a file, the last piece is hashed and the torrent is written next to the file
+    /// in a hidden sidecar (see sidecar_path), ready to be used by TransferInterfaceBittorrent.
+    /// Files are expected to be written sequentially (append only), as readout does.
+    class TorrentTailHasher
+    {
+
+    public:
+        /// @brief Constructor
+        /// @param watch_dir directory to watch, not recursive
+        /// @param piece_size piece size of the torrents, power of two, at least 16 KiB
+        TorrentTailHasher(std::filesystem::path watch_dir, int piece_size);
+        ~TorrentTailHasher();
+
+        TorrentTailHasher(const TorrentTailHasher &) = delete;
+        TorrentTailHasher &operator=(const TorrentTailHasher &) = delete;
+
+        /// @brief Start watching the directory
+        /// @return false if the directory cannot be watched
+        bool start();
+        void stop();
+
+        /// @brief Path of the torrent generated for a file
+        /// @param file path of the file
+        /// @return hidden .torrent file in the same directory
+        static std::filesystem::path sidecar_path(const std::filesystem::path &file);
+
+    private:
+        /// @brief State of a file being written
+        struct tail_state_t
+        {
+            int fd = -1;
+            int64_t hashed_bytes = 0;
+            std::vector<lt::sha256_hash> piece_roots;
+        };
+
+        std::filesystem::path m_watch_dir;
+        int m_piece_size;
+        int m_inotify_fd = -1;
+        std::map<std::string, tail_state_t> m_files;
+        std::vector<char> m_buffer;
+
+        /// @brief Hash the complete pieces available, and the last one if the file is closed
+        /// @return false on read error
+        bool hash_available(tail_state_t &state, bool closed);
+
+        /// @brief Generate the torrent of a closed file and write it atomically in the sidecar
+        bool write_torrent(const std::filesystem::path &file, tail_state_t &state);
+
+        void forget(const std::string &name);
+
+        // Threading
+        dunedaq::utilities::WorkerThread m_thread;
+        void do_work(std::atomic<bool> &running_flag);
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TORRENT_TAIL_HASHER_HPP_
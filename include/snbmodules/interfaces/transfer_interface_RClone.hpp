@@ -10,12 +10,21 @@
 #define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TRANSFER_INTERFACE_RCLONE_HPP_
 
 #include "snbmodules/interfaces/transfer_interface_abstract.hpp"
+#include "snbmodules/chunk_checksum.hpp"
+#include "snbmodules/interfaces/http_range_client.hpp"
+#include "snbmodules/memory_budget.hpp"
 #include "snbmodules/common/status_enum.hpp"
 
 #include "appfwk/cmd/Nljs.hpp"
+#include "utilities/WorkerThread.hpp"
 
 #include <librclone.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
 #include <iostream>
 #include <cstdio>
@@ -23,9 +32,18 @@
 
 #include <string>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <utility>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace dunedaq::snbmodules
 {
@@ -40,8 +58,14 @@ namespace dunedaq::snbmodules
               m_thread([&](std::atomic<bool> &running)
                        { this->do_work(running); })
         {
-            RcloneInitialize();
-            m_thread.start_working_thread();
+            {
+                // rclone is shared by the transfers of the process, and its servers by the uploaders
+                std::lock_guard<std::mutex> lock(m_servers_mutex);
+                if (m_instances++ == 0)
+                {
+                    RcloneInitialize();
+                }
+            }
 
             // protocol parameters
 
@@ -56,6 +80,10 @@ namespace dunedaq::snbmodules
                 {
                     m_params.user = config.get_protocol_options()["user"].get<std::string>();
                 }
+                if (config.get_protocol_options().contains("key_file"))
+                {
+                    m_params.key_file = config.get_protocol_options()["key_file"].get<std::string>();
+                }
             }
 
             if (config.get_protocol_options().contains("rate_limit"))
@@ -101,11 +129,44 @@ namespace dunedaq::snbmodules
             {
                 m_params.checksum = config.get_protocol_options()["checksum"].get<bool>();
             }
+            if (config.get_protocol_options().contains("checksum_chunk_size"))
+            {
+                m_params.checksum_chunk_size = config.get_protocol_options()["checksum_chunk_size"].get<std::string>();
+            }
+            if (config.get_protocol_options().contains("mirrors"))
+            {
+                nlohmann::json mirrors = config.get_protocol_options()["mirrors"];
+                for (const auto &mirror : mirrors)
+                {
+                    m_params.mirrors.emplace_back(mirror.get<std::string>(), m_params.port);
+                }
+            }
+            if (config.get_protocol_options().contains("stripe_size"))
+            {
+                m_params.stripe_size = config.get_protocol_options()["stripe_size"].get<std::string>();
+            }
+            if (config.get_protocol_options().contains("serve"))
+            {
+                m_params.serve = config.get_protocol_options()["serve"].get<bool>();
+            }
             if (config.get_protocol_options().contains("root_folder"))
             {
                 m_params.root_folder = std::filesystem::absolute(config.get_protocol_options()["root_folder"].get<std::string>());
             }
 
+            // the checksums of the files changed or removed since they were computed are not needed anymore
+            if (m_params.checksum)
+            {
+                ChunkChecksum::prune_cache(m_work_dir.parent_path() / ".checksum_cache");
+            }
+
+            // every simultaneous transfer has its own buffer, they share what the memory budget gives.
+            // The jobs started after a change of the share take the new buffer size
+            m_memory = MemoryBudget::get().reserve("rclone " + config.get_group_id(), MemoryBudget::parse_size(m_params.buffer_size) * get_simult_transfers());
+            set_buffer_bytes(m_memory->get_bytes());
+            m_memory->set_on_resize([this](uint64_t bytes)
+                                    { set_buffer_bytes(bytes); });
+
             char *input_request = new char[100];
             sprintf(input_request, "{"
                                    "\"rate\": \"%s\""
@@ -114,6 +175,7 @@ namespace dunedaq::snbmodules
 
             requestRPC("core/bwlimit", input_request);
             delete[] input_request;
+            m_http_rate.set_rate(parse_rate(m_params.bwlimit));
 
             requestRPC("options/set", "{"
                                       "\"vfs\": "
@@ -125,279 +187,185 @@ namespace dunedaq::snbmodules
 
             // all global options
             requestRPC("options/get", "{}");
+
+            m_thread.start_working_thread();
         }
 
         virtual ~TransferInterfaceRClone()
         {
+            m_memory->set_on_resize(nullptr);
             m_thread.stop_working_thread();
 
-            RcloneFinalize();
-        }
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                for (auto &[meta, resume] : m_range_downloads)
+                {
+                    resume->stop = true;
+                }
+            }
+            for (auto &[meta, resume] : m_range_downloads)
+            {
+                resume->thread.join();
+            }
 
-        bool upload_file(TransferMetadata &f_meta) override
-        {
-            TLOG() << "debug : RClone : Uploading file " << f_meta.get_file_name();
+            {
+                std::lock_guard<std::mutex> lock(m_rates_mutex);
+                if (m_scheduled_rates.erase(this) != 0)
+                {
+                    apply_scheduled_rates();
+                }
+            }
 
-            // char exec[300];
-            // sprintf(exec,
-            //         "rclone serve http / --addr %s:%d --buffer-size '%s' --no-modtime --transfers %d -vv --vfs-cache-mode 'off' --vfs-cache-max-size 'off'",
-            //         f_meta.get_src().get_ip().c_str(),
-            //         m_params.port,
-            //         m_params.buffer_size,
-            //         m_params.simult_transfers);
+            stop_server();
 
-            // TLOG() << "debug : executing " << exec;
-            // if (system(exec) == 0)
-            // {
-            //     TLOG() << "debug : RClone : Sucess Starting server";
-            // }
-            // else
-            // {
-            //     // TODO: error
-            //     return false;
-            // }
+            std::lock_guard<std::mutex> lock(m_servers_mutex);
+            if (--m_instances == 0)
+            {
+                RcloneFinalize();
+            }
+        }
 
-            f_meta.set_status(status_type::e_status::FINISHED);
+        /// @brief The uploader sends the checksums of its files, computed before the transfer starts
+        bool is_checksum_enabled() const { return m_params.checksum; }
 
-            return true;
-        }
-        bool download_file(TransferMetadata &f_meta, std::filesystem::path dest) override
+        /// @brief Compute the chunk checksums of a file of the uploader, given to the downloaders in the hash of its metadata.
+        /// The checksums are kept in work_dir/../.checksum_cache, a file that did not change is not read again
+        /// @param running the hashing stops once it is cleared, the file is then left as it is
+        void prepare_file(TransferMetadata &f_meta, const std::atomic<bool> &running)
         {
-            TLOG() << "debug : RClone : Downloading file " << f_meta.get_file_name();
-
-            char *input_request = new char[1000];
+            TLOG() << "debug : RClone : Computing the checksum of " << f_meta.get_file_name();
 
-            if (m_params.protocol == "http")
+            std::string error;
+            auto checksum = ChunkChecksum::compute_cached(f_meta.get_file_path(), MemoryBudget::parse_size(m_params.checksum_chunk_size),
+                                                          m_work_dir.parent_path() / ".checksum_cache", error, &running);
+            if (!running.load())
             {
-                std::string file_relative_path = std::filesystem::relative(f_meta.get_file_path(), m_params.root_folder).generic_string();
+                return;
+            }
 
-                // check if file path is relative to root folder
-                if (file_relative_path.find("..") != std::string::npos)
+            // a file cancelled or paused meanwhile keeps its status
+            bool preparing = f_meta.get_status() == status_type::e_status::PREPARING || f_meta.get_status() == status_type::e_status::HASHING;
+            if (!checksum.has_value())
+            {
+                if (preparing)
                 {
-                    TLOG() << "debug : RClone : File path is not relative to root folder";
                     f_meta.set_status(status_type::e_status::ERROR);
-                    f_meta.set_error_code("File path is not relative to root folder !");
-                    return false;
+                    f_meta.set_error_code(error);
                 }
+                return;
+            }
+            f_meta.set_hash(checksum->to_string());
+            if (preparing)
+            {
+                f_meta.set_status(status_type::e_status::WAITING);
+            }
+        }
 
-                sprintf(input_request, "{"
-                                       "\"srcFs\": "
-                                       "{"
-                                       "\"type\": \"http\"," // HTTP/WebDAV/FTP/SFTP/DLNA/DOCKER
-                                       "\"url\": \"http://%s:%d\""
-                                       "},"
-                                       "\"srcRemote\": \"%s\","
-
-                                       "\"dstFs\": "
-                                       "\"/\","
-                                       "\"dstRemote\": \"%s\","
-
-                                       "\"_config\": {"
-
-                                       "\"BindAddr\": \"\","
-
-                                       "\"MultiThreadSet\": true,"
-                                       "\"Transfers\": %d,"
-                                       "\"Checkers\": %d,"
-                                       "\"MultiThreadStreams\": %d,"
-                                       "\"MultiThreadCutoff\": \"%s\","
-                                       "\"StreamingUploadCutoff\": \"%s\","
-
-                                       "\"UseMmap\": %s,"
-                                       "\"CheckSum\": %s,"
-                                       "\"BufferSize\": \"%s\","
-                                       "\"ErrorOnNoTransfer\": true"
-                                       "},"
-
-                                       "\"_async\": true"
-                                       "}",
-
-                        // source
-                        f_meta.get_src().get_ip().c_str(),
-                        m_params.port,
-                        file_relative_path.c_str(),
-
-                        // destination
-                        dest.append(f_meta.get_file_name()).string().c_str(),
-
-                        // config
-                        m_params.simult_transfers,
-                        m_params.transfer_threads,
-                        m_params.checkers_threads,
-                        m_params.chunk_size.c_str(),
-                        m_params.chunk_size.c_str(),
-                        m_params.use_mmap ? "true" : "false",
-                        m_params.checksum ? "true" : "false",
-                        m_params.buffer_size.c_str());
-            }
-            else if (m_params.protocol == "sftp")
-            {
-                sprintf(input_request, "{"
-                                       "\"srcFs\": "
-                                       //    "\":%s,host=\'%s\',user=\'%s\',key_file=\'/home/ljoly/.ssh/id_rsa\':/\","
-
-                                       //    "{"
-                                       //    "\"type\": \"http\"," // HTTP/WebDAV/FTP/SFTP/DLNA/DOCKER
-                                       //    "\"url\": \"http://127.0.0.1:8000\""
-                                       //    //    "\"no-head\": \"true\","
-                                       //    "},"
-
-                                       "{"
-                                       "\"type\": \"sftp\"," // HTTP/WebDAV/FTP/SFTP/DLNA/DOCKER
-                                       "\"host\": \"%s\","
-                                       "\"user\": \"%s\","
-                                       "\"port\": \"%d\","
-                                       "\"key_file\": \"/home/ljoly/.ssh/id_rsa\","
-                                       "\"disable_concurrent_writes\": \"false\","
-                                       "\"concurrency\": \"%d\""
-                                       // "\"pubkey_file\": \"/home/ljoly/.ssh/id_rsa.pub\","
-                                       //   "\"known_hosts_file\": \"/home/ljoly/.ssh/known_hosts\","
-                                       //    "\"_path\": \"/home/ljoly/N23-04-17\""
-                                       //   "\"_name\": \"distant\""
-                                       "},"
-                                       "\"srcRemote\": \"../..%s\","
-
-                                       //    "{"                  // not supported enought
-                                       //    "\"type\": \"ftp\"," // HTTP/WebDAV/FTP/SFTP/DLNA/DOCKER
-                                       //    "\"host\": \"%s\","
-                                       //    "\"user\": \"anonymous\","
-                                       //    "\"port\": \"2121\","
-                                       //    "\"pass\": \"LXOcWWr5yMievDLHrJ2IapoJZB_AQhinb9V0\""
-                                       //    "},"
-
-                                       //    "{"
-                                       //    "\"type\": \"chunker\","
-                                       //    "\"remote\": \":%s,host=\'%s\',user=\'%s\',key_file=\'/home/ljoly/.ssh/id_rsa\':%s\","
-                                       //    "\"chunk_size\": \"1Gi\","
-                                       //    "\"hash_type\": \"md5\""
-                                       //    "},"
-
-                                       "\"dstFs\": "
-                                       "\"/\","
-                                       "\"dstRemote\": \"%s\","
-
-                                       "\"_config\": {"
-
-                                       "\"BindAddr\": \"\","
-
-                                       "\"MultiThreadSet\": true,"
-                                       "\"Transfers\": %d,"
-                                       "\"Checkers\": %d,"
-                                       "\"MultiThreadStreams\": %d,"
-                                       "\"MultiThreadCutoff\": \"%s\","
-
-                                       "\"UseMmap\": %s,"
-                                       "\"CheckSum\": %s,"
-                                       "\"BufferSize\": \"%s\","
-                                       "\"ErrorOnNoTransfer\": true"
-                                       "},"
-
-                                       "\"_async\": true"
-                                       "}",
-
-                        // source
-                        // m_params.type.c_str(),
-                        f_meta.get_src().get_ip().c_str(),
-                        m_params.user.c_str(),
-                        m_params.port,
-                        m_params.simult_transfers,
-
-                        // f_meta.get_file_path().remove_filename().string().c_str(),
-                        f_meta.get_file_path().string().c_str(),
-                        // destination
-                        // dest.string().c_str(),
-                        dest.append(f_meta.get_file_name()).string().c_str(),
-
-                        // config
-                        m_params.simult_transfers,
-                        m_params.transfer_threads,
-                        m_params.checkers_threads,
-                        m_params.chunk_size.c_str(),
-                        m_params.use_mmap ? "true" : "false",
-                        m_params.checksum ? "true" : "false",
-                        m_params.buffer_size.c_str());
-            }
-
-            auto res = requestRPC("operations/copyfile", input_request);
-            TLOG() << "Requested copyfile operation with parameters : " << input_request;
-
-            // sprintf(input_request, "{"
-            //                        "\"url\": \"http://%s:8080%s\","
-
-            //                        "\"fs\": \"/\","
-            //                        "\"remote\": \"%s\","
-
-            //                        "\"autoFilename\": true,"
-
-            //                        //    "\"_config\": {"
-            //                        //    // for this file only
-            //                        //    //    "\"Progress\": true,"
-            //                        //    // general config to move
-            //                        //    "\"CheckSum\": true,"
-            //                        //    "\"BindAddr\": \"\","
-            //                        //    "\"BufferSize\": 67108864,"
-            //                        //    "\"CheckSum\": true,"
-            //                        //    "\"ErrorOnNoTransfer\": true,"
-            //                        //    "\"MultiThreadSet\": true,"
-            //                        //    "\"MultiThreadStreams\": 4,"
-            //                        //    "\"Transfers\": 200,"
-            //                        //    "\"UseMmap\": true"
-            //                        //    "},"
-
-            //                        "\"_async\": true"
-            //                        "}",
-
-            //         // source
-            //         f_meta.get_src().get_ip().c_str(),
-            //         f_meta.get_file_path().string().c_str(),
-
-            //         // destination
-            //         dest.string().c_str());
-
-            // auto res = requestRPC("operations/copyurl", input_request);
-
-            TLOG() << input_request;
+        /// @brief Serve the file with the rclone HTTP server of the uploader, started with the first file.
+        /// The file stays UPLOADING while it is served, the bytes sent to the downloaders are counted in its metadata
+        bool upload_file(TransferMetadata &f_meta) override
+        {
+            TLOG() << "debug : RClone : Uploading file " << f_meta.get_file_name();
 
-            delete[] input_request;
-            if (res.has_value())
+            // sftp downloads are served by the ssh server of the host
+            if (m_params.protocol != "http" || !m_params.serve)
             {
-                m_jobs_id[&f_meta] = res.value()["jobid"];
+                f_meta.set_status(status_type::e_status::FINISHED);
+                return true;
             }
-            else
+
+            std::string file_relative_path = std::filesystem::relative(f_meta.get_file_path(), m_params.root_folder).generic_string();
+            if (file_relative_path.find("..") != std::string::npos)
             {
+                f_meta.set_error_code("File path is not relative to root folder !");
                 return false;
             }
 
-            // print local options of the transfer
-            requestRPC("options/local", "");
+            if (!start_server(f_meta.get_src().get_ip()))
+            {
+                f_meta.set_error_code("cannot start the rclone http server");
+                return false;
+            }
 
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            m_served[file_relative_path] = &f_meta;
             return true;
         }
+        bool download_file(TransferMetadata &f_meta, std::filesystem::path dest) override
+        {
+            return download_files({&f_meta}, dest);
+        }
+
+        /// @brief One copy job per source directory, rclone schedules the files of a job on its "simult_transfers".
+        /// The files larger than "stripe_size" have their own job, see has_own_job
+        bool download_files(const std::vector<TransferMetadata *> &files, const std::filesystem::path &dest) override
+        {
+            return start_jobs(files, dest, true);
+        }
 
         bool pause_file(TransferMetadata &f_meta) override
         {
             TLOG() << "debug : RClone : Pausing file " << f_meta.get_file_name();
-            ers::warning(RCloneNotSupportError(ERS_HERE, "pausing a single file. Pausing everything."));
-
-            requestRPC("core/bwlimit", "{\"bytesPerSecond\": 0}");
 
+            // only the file stops, the bytes on disk are kept to resume it
+            detach_file(f_meta);
             return true;
         }
 
         bool resume_file(TransferMetadata &f_meta) override
         {
             TLOG() << "debug : RClone : Resuming file " << f_meta.get_file_name();
-            ers::warning(RCloneNotSupportError(ERS_HERE, "resuming a single file. Resuming everything."));
 
-            char *input_request = new char[100];
-            sprintf(input_request, "{"
-                                   "\"bytesPerSecond\": %s"
-                                   "}",
-                    m_params.bwlimit.c_str());
+            // a served file is still there for the downloaders
+            if (f_meta.get_status() == status_type::e_status::UPLOADING)
+            {
+                return true;
+            }
 
-            requestRPC("core/bwlimit", input_request);
-            delete[] input_request;
+            std::filesystem::path dest = m_work_dir;
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                auto it = m_destinations.find(&f_meta);
+                if (it != m_destinations.end())
+                {
+                    dest = it->second;
+                }
+            }
+
+            std::error_code ec;
+            std::filesystem::path local = dest / f_meta.get_file_name();
+            uint64_t on_disk = std::filesystem::exists(local, ec) ? std::filesystem::file_size(local, ec) : 0;
+            if (ec)
+            {
+                on_disk = 0;
+            }
+
+            // the stripes already written are kept
+            if (is_striped(f_meta))
+            {
+                return start_jobs({&f_meta}, dest, false);
+            }
 
+            // rclone writes a file received by a single stream in order, what is on disk is the start of the file.
+            // Files above the multi-thread cutoff are written by several streams, they start again
+            if (m_params.protocol == "http" && is_written_in_order(f_meta) && on_disk > 0 && on_disk < f_meta.get_size())
+            {
+                start_ranged_resume(f_meta, local, on_disk);
+                return true;
+            }
+            if (m_params.protocol != "http" && on_disk > 0)
+            {
+                ers::warning(RCloneNotSupportError(ERS_HERE, "resuming " + f_meta.get_file_name() + " from its offset with " + m_params.protocol + ". Restarting the file."));
+            }
+            return start_jobs({&f_meta}, dest, false);
+        }
+
+        bool set_rate_limit(int64_t bytes_per_second) override
+        {
+            std::lock_guard<std::mutex> lock(m_rates_mutex);
+            m_scheduled_rates[this] = bytes_per_second;
+            apply_scheduled_rates();
+            m_http_rate.set_rate(bytes_per_second > 0 ? static_cast<uint64_t>(bytes_per_second) : parse_rate(m_params.bwlimit));
             return true;
         }
 
@@ -412,27 +380,24 @@ namespace dunedaq::snbmodules
         {
             TLOG() << "debug : RClone : Cancelling file " << f_meta.get_file_name();
 
-            // find job id
-            int job_id = 0;
-            if (m_jobs_id.find(&f_meta) != m_jobs_id.end())
+            // the server cannot hide a file, it is only no longer counted
             {
-                job_id = m_jobs_id[&f_meta];
-            }
-            else
-            {
-                TLOG() << "debug : RClone : Job id not found";
-                return false;
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                for (auto it = m_served.begin(); it != m_served.end(); ++it)
+                {
+                    if (it->second == &f_meta)
+                    {
+                        m_served.erase(it);
+                        break;
+                    }
+                }
             }
 
-            char *input_request = new char[100];
-            sprintf(input_request, "{"
-                                   "\"jobid\": %d"
-                                   "}",
-                    job_id);
-
-            requestRPC("job/stop", input_request);
-            delete[] input_request;
-
+            detach_file(f_meta);
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            m_stripes_done.erase(&f_meta);
+            m_checksums.erase(&f_meta);
+            m_destinations.erase(&f_meta);
             return true;
         }
 
@@ -441,10 +406,17 @@ namespace dunedaq::snbmodules
         {
             std::string protocol = "http";
             std::string user = "anonymous";
+            // private key of the sftp user, empty for the ssh agent
+            std::string key_file;
             int port = 8080;
             std::string bwlimit = "off";
             int refresh_rate = 10;
             std::filesystem::path root_folder = "/";
+            // start the http server in the uploader, by default it is started outside
+            bool serve = false;
+            // other servers of root_folder, the large files are downloaded by ranges from all of them
+            std::vector<IPFormat> mirrors;
+            std::string stripe_size = "64M";
 
             // config
             int simult_transfers = 200;
@@ -455,11 +427,766 @@ namespace dunedaq::snbmodules
             std::string buffer_size = "100G";
             bool use_mmap = false;
             bool checksum = true;
+            // chunks of the checksums computed by the uploader
+            std::string checksum_chunk_size = "64M";
 
         } m_params;
 
         // job id to transfer metadata to keep track of the transfer and update the status
-        std::map<TransferMetadata *, int> m_jobs_id;
+        std::unordered_map<TransferMetadata *, int> m_jobs_id;
+        // files of the running jobs by name, as reported in the stats of the job
+        std::unordered_map<int, std::unordered_map<std::string, TransferMetadata *>> m_job_files;
+        std::mutex m_jobs_mutex;
+
+        /// @brief Remote of a source directory, as a JSON object configuring the backend
+        /// @param ip ip of the uploader
+        /// @param dir directory of the files, relative to the root of the server for http
+        nlohmann::json source_fs(const std::string &ip, const std::filesystem::path &dir) const
+        {
+            nlohmann::json fs;
+            if (m_params.protocol == "sftp")
+            {
+                fs["type"] = "sftp";
+                fs["host"] = ip;
+                fs["user"] = m_params.user;
+                fs["port"] = std::to_string(m_params.port);
+                // without key file, rclone uses the ssh agent
+                if (!m_params.key_file.empty())
+                {
+                    fs["key_file"] = m_params.key_file;
+                }
+                fs["disable_concurrent_writes"] = "false";
+                fs["concurrency"] = std::to_string(m_params.simult_transfers);
+            }
+            else
+            {
+                fs["type"] = "http";
+                fs["url"] = "http://" + ip + ":" + std::to_string(m_params.port);
+            }
+            fs["_root"] = dir.generic_string();
+            return fs;
+        }
+
+        /// @brief Options of the copy jobs
+        nlohmann::json transfer_config(bool error_on_no_transfer) const
+        {
+            return {
+                {"BindAddr", ""},
+                {"MultiThreadSet", true},
+                {"Transfers", m_params.simult_transfers},
+                {"Checkers", m_params.checkers_threads},
+                {"MultiThreadStreams", m_params.transfer_threads},
+                {"MultiThreadCutoff", m_params.chunk_size},
+                {"StreamingUploadCutoff", m_params.chunk_size},
+                {"UseMmap", m_params.use_mmap},
+                {"CheckSum", m_params.checksum},
+                {"BufferSize", get_buffer_size()},
+                // a stopped file keeps its bytes in place, instead of a temporary file removed with the job
+                {"Inplace", true},
+                {"ErrorOnNoTransfer", error_on_no_transfer}};
+        }
+
+        /// @brief Start one copy job per uploader and source directory
+        /// @param error_on_no_transfer fail a job finding every file already there, false when they are started again
+        bool start_jobs(const std::vector<TransferMetadata *> &files, const std::filesystem::path &dest, bool error_on_no_transfer)
+        {
+            bool result = true;
+
+            // files by uploader, source directory and, for the files having their own job, file
+            std::map<std::tuple<std::string, std::filesystem::path, TransferMetadata *>, std::vector<TransferMetadata *>> batches;
+            for (TransferMetadata *f_meta : files)
+            {
+                TLOG() << "debug : RClone : Downloading file " << f_meta->get_file_name();
+
+                if (is_striped(*f_meta))
+                {
+                    start_striped_download(*f_meta, dest);
+                    continue;
+                }
+
+                std::filesystem::path dir = f_meta->get_file_path().parent_path();
+                if (m_params.protocol == "http")
+                {
+                    std::string file_relative_path = std::filesystem::relative(f_meta->get_file_path(), m_params.root_folder).generic_string();
+
+                    // check if file path is relative to root folder
+                    if (file_relative_path.find("..") != std::string::npos)
+                    {
+                        TLOG() << "debug : RClone : File path is not relative to root folder";
+                        f_meta->set_status(status_type::e_status::ERROR);
+                        f_meta->set_error_code("File path is not relative to root folder !");
+                        result = false;
+                        continue;
+                    }
+                    dir = std::filesystem::path(file_relative_path).parent_path();
+                }
+                batches[{f_meta->get_src().get_ip(), dir, has_own_job(*f_meta) ? f_meta : nullptr}].push_back(f_meta);
+            }
+
+            for (const auto &[source, batch] : batches)
+            {
+                nlohmann::json names = nlohmann::json::array();
+                // the files are written again from their start
+                bool checked = true;
+                {
+                    std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                    for (TransferMetadata *f_meta : batch)
+                    {
+                        names.push_back(f_meta->get_file_path().filename().string());
+                        checked = track_checksum(*f_meta, 0) && checked;
+                    }
+                }
+
+                nlohmann::json request;
+                request["srcFs"] = source_fs(std::get<0>(source), std::get<1>(source));
+                request["dstFs"] = dest.string();
+                request["_filter"] = {{"FilesFromRaw", names}};
+                request["_config"] = transfer_config(error_on_no_transfer);
+                if (checked)
+                {
+                    // the chunks are checked against the checksums of the uploader, rclone does not hash the files
+                    request["_config"]["CheckSum"] = false;
+                    request["_config"]["IgnoreChecksum"] = true;
+                }
+                request["_async"] = true;
+
+                auto res = requestRPC("sync/copy", request.dump());
+                TLOG() << "debug : RClone : requested copy of " << batch.size() << " files with parameters : " << request.dump();
+
+                if (!res.has_value() || !res.value().contains("jobid"))
+                {
+                    for (TransferMetadata *f_meta : batch)
+                    {
+                        f_meta->set_status(status_type::e_status::ERROR);
+                        f_meta->set_error_code("failed to start the rclone job");
+                    }
+                    result = false;
+                    continue;
+                }
+
+                int job_id = res.value()["jobid"].get<int>();
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                for (TransferMetadata *f_meta : batch)
+                {
+                    m_jobs_id[f_meta] = job_id;
+                    m_destinations[f_meta] = dest;
+                    m_job_files[job_id][f_meta->get_file_path().filename().string()] = f_meta;
+                }
+                m_poll_now = true;
+            }
+
+            // print local options of the transfer
+            requestRPC("options/local", "");
+
+            return result;
+        }
+
+        /// @brief Download of a file outside of rclone, with HTTP range requests
+        struct range_download_t
+        {
+            TransferMetadata *meta = nullptr;
+            std::thread thread;
+            std::atomic<bool> stop = false;
+            std::atomic<bool> done = false;
+        };
+        std::unordered_map<TransferMetadata *, std::unique_ptr<range_download_t>> m_range_downloads;
+        // destination directory of the files started
+        std::unordered_map<TransferMetadata *, std::filesystem::path> m_destinations;
+
+        /// @brief Get the rest of a file from the HTTP server of the uploader, appended to the bytes on disk
+        void start_ranged_resume(TransferMetadata &f_meta, const std::filesystem::path &local, uint64_t offset)
+        {
+            TLOG() << "debug : RClone : Resuming " << f_meta.get_file_name() << " from byte " << offset;
+
+            IPFormat server(f_meta.get_src().get_ip(), m_params.port);
+            std::string path = "/" + std::filesystem::relative(f_meta.get_file_path(), m_params.root_folder).generic_string();
+
+            auto resume = std::make_unique<range_download_t>();
+            range_download_t *r = resume.get();
+            r->meta = &f_meta;
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            track_checksum(f_meta, offset);
+            r->thread = std::thread([this, r, server, path, local, offset]()
+                                    {
+                                        TransferMetadata &meta = *r->meta;
+                                        std::string error = "cannot open " + local.string();
+                                        uint64_t received = offset;
+                                        auto start = std::chrono::steady_clock::now();
+
+                                        // the chunks are checked as soon as they are written
+                                        std::string chunk_error;
+                                        bool chunks_ok = true;
+                                        uint64_t checked = offset;
+                                        auto check_chunks = [&]()
+                                        {
+                                            chunks_ok = chunks_ok && verify_chunks(r->meta, local, [&](uint64_t, uint64_t end)
+                                                                                   { return end <= received; },
+                                                                                   chunk_error);
+                                            checked = received;
+                                        };
+
+                                        int fd = ::open(local.c_str(), O_WRONLY | O_CLOEXEC);
+                                        bool ok = fd >= 0 && HttpRangeClient::get_range(server, path, offset, meta.get_size() - offset, fd, r->stop, [&](uint64_t bytes)
+                                                                                        {
+                                                                                            received += bytes;
+                                                                                            meta.set_bytes_transferred(received);
+                                                                                            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                                                                                            if (elapsed > 0)
+                                                                                            {
+                                                                                                meta.set_transmission_speed(static_cast<int32_t>(static_cast<double>(received - offset) / elapsed));
+                                                                                            }
+                                                                                            if (received - checked >= (1 << 26))
+                                                                                            {
+                                                                                                check_chunks();
+                                                                                            } },
+                                                                                        error, &m_http_rate);
+                                        if (fd >= 0)
+                                        {
+                                            ::close(fd);
+                                        }
+                                        if (!chunks_ok)
+                                        {
+                                            ok = false;
+                                            error = chunk_error;
+                                        }
+                                        finish_range_download(r, local, ok, error); });
+            m_range_downloads[&f_meta] = std::move(resume);
+        }
+
+        // stripes written of the striped downloads, kept when they are paused
+        std::unordered_map<TransferMetadata *, std::vector<bool>> m_stripes_done;
+
+        /// @brief Files copied by a job of their own, the ones larger than a stripe. Pausing one of them
+        /// does not stop the copy of the other files, the small files of a stopped job are cheap to start again
+        bool has_own_job(const TransferMetadata &f_meta) const
+        {
+            return f_meta.get_size() > MemoryBudget::parse_size(m_params.stripe_size);
+        }
+
+        /// @brief Files downloaded by stripes from the uploader and the mirrors, the ones larger than a stripe
+        bool is_striped(const TransferMetadata &f_meta) const
+        {
+            return m_params.protocol == "http" && !m_params.mirrors.empty() &&
+                   f_meta.get_size() > MemoryBudget::parse_size(m_params.stripe_size);
+        }
+
+        /// @brief Download a file by stripes from the uploader and every mirror having the same file,
+        /// "transfer_threads" streams per server. Each stream takes the next stripe to get, the faster servers get more of them.
+        /// A stream failing gives its stripe back and tries again after 1, 2 then 4 seconds, it stops when the third retry fails.
+        /// The file fails when every stream stopped. The streams are limited by the scheduled rate of the transfer, see m_http_rate
+        void start_striped_download(TransferMetadata &f_meta, const std::filesystem::path &dest)
+        {
+            std::vector<IPFormat> servers = {IPFormat(f_meta.get_src().get_ip(), m_params.port)};
+            servers.insert(servers.end(), m_params.mirrors.begin(), m_params.mirrors.end());
+            std::string path = "/" + std::filesystem::relative(f_meta.get_file_path(), m_params.root_folder).generic_string();
+            std::filesystem::path local = dest / f_meta.get_file_name();
+            uint64_t stripe = MemoryBudget::parse_size(m_params.stripe_size);
+            int streams = std::max(1, m_params.transfer_threads);
+
+            auto download = std::make_unique<range_download_t>();
+            range_download_t *r = download.get();
+            r->meta = &f_meta;
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            m_destinations[&f_meta] = dest;
+            track_checksum(f_meta, std::numeric_limits<uint64_t>::max());
+            std::vector<bool> &done = m_stripes_done[&f_meta];
+            done.resize((f_meta.get_size() + stripe - 1) / stripe, false);
+
+            TLOG() << "debug : RClone : Downloading " << f_meta.get_file_name() << " by " << done.size() << " stripes from " << servers.size() << " servers";
+
+            r->thread = std::thread([this, r, servers, path, local, stripe, streams]()
+                                    {
+                                        TransferMetadata &meta = *r->meta;
+                                        uint64_t size = meta.get_size();
+                                        std::string error = "cannot open " + local.string();
+
+                                        std::deque<size_t> todo;
+                                        std::atomic<uint64_t> received = 0;
+                                        {
+                                            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                                            const std::vector<bool> &done = m_stripes_done[r->meta];
+                                            for (size_t i = 0; i < done.size(); i++)
+                                            {
+                                                if (done[i])
+                                                {
+                                                    received += std::min(stripe, size - i * stripe);
+                                                }
+                                                else
+                                                {
+                                                    todo.push_back(i);
+                                                }
+                                            }
+                                        }
+                                        uint64_t resumed = received.load();
+
+                                        int fd = ::open(local.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+                                        if (fd >= 0 && ::ftruncate(fd, static_cast<off_t>(size)) != 0)
+                                        {
+                                            error = "cannot allocate " + local.string() + ": " + std::strerror(errno);
+                                            ::close(fd);
+                                            fd = -1;
+                                        }
+
+                                        // the mirrors without the same file are left out
+                                        std::vector<IPFormat> sources;
+                                        for (const auto &server : servers)
+                                        {
+                                            if (fd >= 0 && HttpRangeClient::get_size(server, path) == size)
+                                            {
+                                                sources.push_back(server);
+                                            }
+                                        }
+                                        if (fd >= 0 && sources.empty())
+                                        {
+                                            error = "no server has " + path;
+                                        }
+
+                                        std::mutex todo_mutex;
+                                        std::atomic<bool> corrupted = false;
+                                        std::atomic<int> running = 0;
+                                        std::vector<std::thread> workers;
+                                        for (const auto &source : sources)
+                                        {
+                                            for (int s = 0; s < streams; s++)
+                                            {
+                                                running++;
+                                                workers.emplace_back([&, source]()
+                                                                     {
+                                                                         int failures = 0;
+                                                                         while (!r->stop.load() && !corrupted.load())
+                                                                         {
+                                                                             size_t i = 0;
+                                                                             {
+                                                                                 std::lock_guard<std::mutex> lock(todo_mutex);
+                                                                                 if (todo.empty())
+                                                                                 {
+                                                                                     break;
+                                                                                 }
+                                                                                 i = todo.front();
+                                                                                 todo.pop_front();
+                                                                             }
+
+                                                                             uint64_t got = 0;
+                                                                             std::string stripe_error;
+                                                                             bool ok = HttpRangeClient::get_range(source, path, i * stripe, std::min(stripe, size - i * stripe), fd, r->stop, [&](uint64_t bytes)
+                                                                                                                  {
+                                                                                                                      got += bytes;
+                                                                                                                      received += bytes;
+                                                                                                                  },
+                                                                                                                  stripe_error, &m_http_rate);
+                                                                             if (!ok)
+                                                                             {
+                                                                                 received -= got;
+                                                                                 {
+                                                                                     std::lock_guard<std::mutex> lock(todo_mutex);
+                                                                                     todo.push_back(i);
+                                                                                     error = stripe_error + " from " + source.get_ip_port();
+                                                                                 }
+
+                                                                                 // a server restarting or overloaded for a moment is not left out at once
+                                                                                 if (++failures > 3)
+                                                                                 {
+                                                                                     TLOG() << "debug : RClone : " << source.get_ip_port() << " left out of the stripes of " << path << " : " << stripe_error;
+                                                                                     break;
+                                                                                 }
+                                                                                 auto retry = std::chrono::steady_clock::now() + std::chrono::seconds(1 << (failures - 1));
+                                                                                 while (!r->stop.load() && std::chrono::steady_clock::now() < retry)
+                                                                                 {
+                                                                                     std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                                                                                 }
+                                                                                 continue;
+                                                                             }
+                                                                             failures = 0;
+
+                                                                             {
+                                                                                 std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                                                                                 m_stripes_done[r->meta][i] = true;
+                                                                             }
+
+                                                                             // the chunks completed by the stripe are checked while they are in the page cache
+                                                                             std::string chunk_error;
+                                                                             if (!verify_chunks(r->meta, local, [&](uint64_t begin, uint64_t end)
+                                                                                                {
+                                                                                                    const std::vector<bool> &done = m_stripes_done[r->meta];
+                                                                                                    for (uint64_t k = begin / stripe; k * stripe < end; k++)
+                                                                                                    {
+                                                                                                        if (!done[k])
+                                                                                                        {
+                                                                                                            return false;
+                                                                                                        }
+                                                                                                    }
+                                                                                                    return end > i * stripe && begin < (i + 1) * stripe; },
+                                                                                                chunk_error))
+                                                                             {
+                                                                                 std::lock_guard<std::mutex> lock(todo_mutex);
+                                                                                 error = chunk_error;
+                                                                                 corrupted = true;
+                                                                             }
+                                                                         }
+                                                                         running--; });
+                                            }
+                                        }
+
+                                        // the metadata is only written by this thread
+                                        auto start = std::chrono::steady_clock::now();
+                                        while (running.load() > 0)
+                                        {
+                                            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                                            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                                            meta.set_bytes_transferred(received.load());
+                                            meta.set_progress(static_cast<int>(received.load() * 100 / std::max<uint64_t>(size, 1)));
+                                            meta.set_transmission_speed(static_cast<int32_t>(static_cast<double>(received.load() - resumed) / elapsed));
+                                        }
+                                        for (auto &worker : workers)
+                                        {
+                                            worker.join();
+                                        }
+                                        if (fd >= 0)
+                                        {
+                                            ::close(fd);
+                                        }
+
+                                        finish_range_download(r, local, fd >= 0 && todo.empty() && !corrupted.load(), error); });
+            m_range_downloads[&f_meta] = std::move(download);
+            m_poll_now = true;
+        }
+
+        /// @brief rclone writes a file received by a single stream in order, what is on disk is the start of the file.
+        /// Files above the multi-thread cutoff are written by several streams
+        bool is_written_in_order(const TransferMetadata &f_meta) const
+        {
+            return m_params.transfer_threads <= 1 || f_meta.get_size() < MemoryBudget::parse_size(m_params.chunk_size);
+        }
+
+        /// @brief Checksums of a file being downloaded, and its chunks already checked
+        struct checksum_state_t
+        {
+            std::shared_ptr<const ChunkChecksum> checksum;
+            std::vector<bool> verified;
+        };
+        std::unordered_map<TransferMetadata *, checksum_state_t> m_checksums;
+
+        /// @brief Follow the chunk checksums given by the uploader in the hash of a file. m_jobs_mutex must be held
+        /// @param rewritten first byte written again, the chunks after it are checked again
+        /// @return false if the file has no chunk checksums
+        bool track_checksum(TransferMetadata &f_meta, uint64_t rewritten)
+        {
+            auto it = m_checksums.find(&f_meta);
+            if (it == m_checksums.end())
+            {
+                auto checksum = ChunkChecksum::parse(f_meta.get_hash(), f_meta.get_size());
+                if (!checksum.has_value())
+                {
+                    return false;
+                }
+                size_t count = checksum->get_chunk_count();
+                it = m_checksums.emplace(&f_meta, checksum_state_t{std::make_shared<const ChunkChecksum>(std::move(checksum.value())), std::vector<bool>(count, false)}).first;
+            }
+
+            const ChunkChecksum &checksum = *it->second.checksum;
+            for (size_t i = 0; i < it->second.verified.size(); i++)
+            {
+                if (i * checksum.get_chunk_size() + checksum.get_chunk_length(i) > rewritten)
+                {
+                    it->second.verified[i] = false;
+                }
+            }
+            return true;
+        }
+
+        /// @brief Check the chunks of a file that are on disk and not checked yet, the file is read outside of m_jobs_mutex
+        /// @param written tells if the bytes [begin, end) of the file are written, called with m_jobs_mutex held
+        /// @param error the first chunk not matching
+        /// @return true if the chunks match, or the file has no checksums
+        bool verify_chunks(TransferMetadata *f_meta, const std::filesystem::path &local,
+                           const std::function<bool(uint64_t, uint64_t)> &written, std::string &error)
+        {
+            std::shared_ptr<const ChunkChecksum> checksum;
+            std::vector<size_t> chunks;
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                auto it = m_checksums.find(f_meta);
+                if (it == m_checksums.end())
+                {
+                    return true;
+                }
+                checksum = it->second.checksum;
+                for (size_t i = 0; i < it->second.verified.size(); i++)
+                {
+                    uint64_t begin = i * checksum->get_chunk_size();
+                    if (!it->second.verified[i] && written(begin, begin + checksum->get_chunk_length(i)))
+                    {
+                        chunks.push_back(i);
+                    }
+                }
+            }
+            if (chunks.empty())
+            {
+                return true;
+            }
+
+            int fd = ::open(local.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                error = "cannot open " + local.string() + " to check it: " + std::strerror(errno);
+                return false;
+            }
+            bool ok = true;
+            std::vector<size_t> checked;
+            for (size_t i : chunks)
+            {
+                if (!checksum->verify_chunk(fd, i, error))
+                {
+                    error = f_meta->get_file_name() + ": " + error;
+                    ok = false;
+                    break;
+                }
+                checked.push_back(i);
+            }
+            ::close(fd);
+
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            auto it = m_checksums.find(f_meta);
+            if (it != m_checksums.end() && it->second.checksum == checksum)
+            {
+                for (size_t i : checked)
+                {
+                    it->second.verified[i] = true;
+                }
+            }
+            return ok;
+        }
+
+        /// @brief Last step of a download outside of rclone, or of the check of a file copied by rclone: the chunks
+        /// not checked yet are checked, and the status is set unless the file was paused or cancelled meanwhile
+        void finish_range_download(range_download_t *r, const std::filesystem::path &local, bool ok, std::string error)
+        {
+            TransferMetadata &meta = *r->meta;
+            if (ok && !r->stop.load())
+            {
+                ok = verify_chunks(r->meta, local, [](uint64_t, uint64_t)
+                                   { return true; },
+                                   error);
+            }
+
+            if (!r->stop.load())
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                m_stripes_done.erase(r->meta);
+                m_checksums.erase(r->meta);
+                m_destinations.erase(r->meta);
+                if (ok)
+                {
+                    meta.set_bytes_transferred(meta.get_size());
+                    meta.set_status(status_type::e_status::FINISHED);
+                    meta.set_progress(100);
+                }
+                else
+                {
+                    meta.set_status(status_type::e_status::ERROR);
+                    meta.set_error_code(error);
+                }
+            }
+            meta.set_transmission_speed(0);
+            r->done = true;
+        }
+
+        /// @brief Check the chunks of a file copied by rclone that were not checked during the copy,
+        /// the file stays DOWNLOADING until then. m_jobs_mutex must be held
+        void start_verification(TransferMetadata &f_meta, const std::filesystem::path &local)
+        {
+            auto verification = std::make_unique<range_download_t>();
+            range_download_t *r = verification.get();
+            r->meta = &f_meta;
+            r->thread = std::thread([this, r, local]()
+                                    { finish_range_download(r, local, true, ""); });
+            m_range_downloads[&f_meta] = std::move(verification);
+        }
+
+        /// @brief Stop the transfer of a single file. rclone cannot take a file out of a job,
+        /// the job is stopped and its other files are started again in a new one. The large files have their own job, see has_own_job
+        void detach_file(TransferMetadata &f_meta)
+        {
+            std::unique_ptr<range_download_t> resume;
+            int job_id = -1;
+            std::vector<TransferMetadata *> others;
+            std::filesystem::path dest;
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                auto r = m_range_downloads.find(&f_meta);
+                if (r != m_range_downloads.end())
+                {
+                    resume = std::move(r->second);
+                    resume->stop = true;
+                    m_range_downloads.erase(r);
+                }
+
+                auto j = m_jobs_id.find(&f_meta);
+                if (j != m_jobs_id.end() && m_job_files.count(j->second) != 0)
+                {
+                    job_id = j->second;
+                    for (auto &[name, meta] : m_job_files[job_id])
+                    {
+                        if (meta != &f_meta && meta->get_status() == status_type::e_status::DOWNLOADING)
+                        {
+                            others.push_back(meta);
+                        }
+                        m_jobs_id.erase(meta);
+                    }
+                    m_job_files.erase(job_id);
+                }
+                if (!others.empty())
+                {
+                    dest = m_destinations[others.front()];
+                }
+            }
+
+            if (resume != nullptr && resume->thread.joinable())
+            {
+                resume->thread.join();
+            }
+
+            if (job_id >= 0)
+            {
+                requestRPC("job/stop", nlohmann::json({{"jobid", job_id}}).dump());
+                requestRPC("core/stats-delete", nlohmann::json({{"group", "job/" + std::to_string(job_id)}}).dump());
+                if (!others.empty())
+                {
+                    TLOG() << "debug : RClone : starting again the " << others.size() << " other files of job " << job_id;
+                    start_jobs(others, dest, false);
+                }
+            }
+        }
+
+        /// @brief Join the finished ranged resumes
+        void reap_range_downloads()
+        {
+            std::vector<std::unique_ptr<range_download_t>> finished;
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                for (auto it = m_range_downloads.begin(); it != m_range_downloads.end();)
+                {
+                    if (!it->second->done.load())
+                    {
+                        ++it;
+                        continue;
+                    }
+                    finished.push_back(std::move(it->second));
+                    it = m_range_downloads.erase(it);
+                }
+            }
+            for (auto &r : finished)
+            {
+                r->thread.join();
+            }
+        }
+
+        /// @brief Set the status of the files of a finished job and forget it
+        void finish_job(int job_id, bool success, const std::string &error)
+        {
+            // the files of a failed job may have been copied before the error
+            std::map<std::string, bool> copied;
+            if (!success)
+            {
+                auto transferred = requestRPC("core/transferred", nlohmann::json({{"group", "job/" + std::to_string(job_id)}}).dump());
+                if (transferred.has_value() && transferred.value().contains("transferred"))
+                {
+                    for (const auto &t : transferred.value()["transferred"])
+                    {
+                        copied[t["name"].get<std::string>()] = t["error"].get<std::string>().empty();
+                    }
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                for (auto &[name, meta] : m_job_files[job_id])
+                {
+                    if ((success || copied[name]) && m_checksums.count(meta) != 0)
+                    {
+                        meta->set_progress(100);
+                        start_verification(*meta, m_destinations[meta] / name);
+                    }
+                    else if (success || copied[name])
+                    {
+                        meta->set_status(status_type::e_status::FINISHED);
+                        meta->set_progress(100);
+                    }
+                    else
+                    {
+                        meta->set_status(status_type::e_status::ERROR);
+                        meta->set_error_code(error);
+                    }
+                    meta->set_transmission_speed(0);
+                    // the file is no longer in a job, a verification has its own path
+                    m_jobs_id.erase(meta);
+                    m_destinations.erase(meta);
+                }
+                m_job_files.erase(job_id);
+            }
+            requestRPC("core/stats-delete", nlohmann::json({{"group", "job/" + std::to_string(job_id)}}).dump());
+        }
+
+        // limits given by the bandwidth scheduler to the rclone transfers of the process
+        inline static std::map<TransferInterfaceRClone *, int64_t> m_scheduled_rates;
+        inline static std::mutex m_rates_mutex;
+
+        /// @brief rclone has a single limit for the whole process, set to the sum of the limits of its transfers,
+        /// or to the "rate_limit" option when one of them has no limit. m_rates_mutex must be held
+        void apply_scheduled_rates()
+        {
+            int64_t total = 0;
+            for (const auto &[rclone, rate] : m_scheduled_rates)
+            {
+                if (rate < 0)
+                {
+                    total = -1;
+                    break;
+                }
+                total += rate;
+            }
+            std::string rate = total <= 0 ? m_params.bwlimit : std::to_string(total) + "B";
+            requestRPC("core/bwlimit", "{\"rate\": \"" + rate + "\"}");
+        }
+
+        /// @brief Limit of the HTTP range downloads of the transfer, made outside of rclone and of its bwlimit.
+        /// The scheduled rate of the transfer, or the "rate_limit" option without schedule
+        RateLimiter m_http_rate;
+
+        /// @brief Bytes per second of a rclone bwlimit, 0 for "off" and for the timetables.
+        /// The download rate of an "upload:download" pair
+        static uint64_t parse_rate(const std::string &bwlimit)
+        {
+            if (bwlimit.find_first_of(", ") != std::string::npos)
+            {
+                return 0;
+            }
+            return MemoryBudget::parse_size(bwlimit.substr(bwlimit.find(':') == std::string::npos ? 0 : bwlimit.find(':') + 1));
+        }
+
+        // share of the memory budget, and buffer of each transfer within it
+        std::unique_ptr<MemoryBudget::Reservation> m_memory;
+        std::atomic<uint64_t> m_buffer_bytes = 0;
+
+        uint64_t get_simult_transfers() const { return static_cast<uint64_t>(std::max(1, m_params.simult_transfers)); }
+
+        /// @brief Buffer of each transfer from the share of the memory budget, at most the "buffer_size" option
+        void set_buffer_bytes(uint64_t share)
+        {
+            uint64_t wanted = MemoryBudget::parse_size(m_params.buffer_size);
+            m_buffer_bytes = std::min(wanted, share / get_simult_transfers());
+            if (m_buffer_bytes < wanted)
+            {
+                TLOG() << "debug : RClone : buffer size reduced to " << get_buffer_size() << " by the memory budget";
+            }
+        }
+
+        /// @brief BufferSize given to the rclone jobs
+        std::string get_buffer_size() const
+        {
+            uint64_t bytes = m_buffer_bytes;
+            return bytes == MemoryBudget::parse_size(m_params.buffer_size) ? m_params.buffer_size : std::to_string(bytes / 1024) + "K";
+        }
         std::filesystem::path m_work_dir;
 
         std::optional<nlohmann::json> requestRPC(const std::string &method, const std::string &input)
@@ -480,76 +1207,310 @@ namespace dunedaq::snbmodules
             return j;
         }
 
-        // Threading
-        dunedaq::utilities::WorkerThread m_thread;
-        void do_work(std::atomic<bool> &running)
+        /// @brief rclone http server of the process
+        struct server_t
         {
-            TLOG() << "debug : running thread ";
+            std::string id;
+            std::string address;
+            // stats group of the bytes it sends
+            std::string group;
+            int users = 0;
+        };
+        // servers by address and root folder, shared by the uploaders serving the same folder
+        inline static std::map<std::string, server_t> m_servers;
+        inline static int m_instances = 0;
+        inline static std::mutex m_servers_mutex;
+        // server used by this transfer, empty if none
+        std::string m_server_key;
+
+        // files served by relative path to the root folder, and bytes of their finished requests
+        std::unordered_map<std::string, TransferMetadata *> m_served;
+        std::unordered_map<std::string, uint64_t> m_served_bytes;
+        std::unordered_set<std::string> m_served_requests;
+
+        /// @brief Start, or join, the rclone http server of root_folder on the address of the uploader.
+        /// Its buffers and number of transfers are the ones of the group
+        bool start_server(const std::string &ip)
+        {
+            std::lock_guard<std::mutex> lock(m_servers_mutex);
+            if (!m_server_key.empty())
+            {
+                return true;
+            }
 
-            while (running.load())
+            std::string address = ip + ":" + std::to_string(m_params.port);
+            std::string key = address + m_params.root_folder.string();
+            auto server = m_servers.find(key);
+            if (server == m_servers.end())
             {
-                // requestRPC("cache/stats", "{}");
-                // requestRPC("core/memstats", "{}");
-                auto stats = requestRPC("core/stats", "{}");
+                for (const auto &[k, s] : m_servers)
+                {
+                    if (s.address == address)
+                    {
+                        ers::error(RCloneServeError(ERS_HERE, m_params.root_folder.string(), address, "the address serves " + k.substr(address.size())));
+                        return false;
+                    }
+                }
 
-                if (stats.has_value())
+                std::string group = "serve/" + address;
+                nlohmann::json request = {
+                    {"type", "http"},
+                    {"fs", m_params.root_folder.string()},
+                    {"addr", address},
+                    {"vfs_cache_mode", "off"},
+                    {"no_modtime", true},
+                    {"_group", group},
+                    {"_config", {{"BufferSize", get_buffer_size()}, {"Transfers", m_params.simult_transfers}, {"UseMmap", m_params.use_mmap}}}};
+                auto res = requestRPC("serve/start", request.dump());
+                if (!res.has_value() || !res.value().contains("id"))
                 {
-                    if (stats.value()["transferring"] != nullptr)
+                    ers::error(RCloneServeError(ERS_HERE, m_params.root_folder.string(), address, res.has_value() ? res.value().dump() : "serve/start failed"));
+                    return false;
+                }
+                TLOG() << "debug : RClone : serving " << m_params.root_folder << " on " << address << " with parameters : " << request.dump();
+                server = m_servers.emplace(key, server_t{res.value()["id"].get<std::string>(), address, group}).first;
+            }
+
+            server->second.users++;
+            m_server_key = key;
+            return true;
+        }
+
+        /// @brief Leave the server, stopped by its last user
+        void stop_server()
+        {
+            std::lock_guard<std::mutex> lock(m_servers_mutex);
+            auto server = m_servers.find(m_server_key);
+            m_server_key.clear();
+            if (server == m_servers.end() || --server->second.users > 0)
+            {
+                return;
+            }
+
+            TLOG() << "debug : RClone : stopping the server of " << server->second.address;
+            requestRPC("serve/stop", nlohmann::json({{"id", server->second.id}}).dump());
+            requestRPC("core/stats-delete", nlohmann::json({{"group", server->second.group}}).dump());
+            m_servers.erase(server);
+        }
+
+        /// @brief Count the bytes sent by the server in the metadata of the served files
+        /// @return number of files being sent
+        uint64_t poll_served()
+        {
+            std::string group;
+            {
+                std::lock_guard<std::mutex> lock(m_servers_mutex);
+                auto server = m_servers.find(m_server_key);
+                if (server == m_servers.end())
+                {
+                    return 0;
+                }
+                group = server->second.group;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                if (m_served.empty())
+                {
+                    return 0;
+                }
+            }
+
+            auto stats = requestRPC("core/stats", nlohmann::json({{"group", group}}).dump());
+            auto transferred = requestRPC("core/transferred", nlohmann::json({{"group", group}}).dump());
+
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            // finished requests, rclone keeps the last ones only
+            if (transferred.has_value() && transferred.value().contains("transferred"))
+            {
+                for (const auto &t : transferred.value()["transferred"])
+                {
+                    std::string name = t["name"].get<std::string>();
+                    std::string request = name + "|" + t.value("started_at", "") + "|" + t.value("completed_at", "");
+                    if (m_served.count(name) != 0 && m_served_requests.insert(request).second)
                     {
-                        auto current_transfers = stats.value()["transferring"].get<std::vector<nlohmann::json>>();
+                        m_served_bytes[name] += t["bytes"].get<uint64_t>();
+                    }
+                }
+            }
+
+            // requests in progress
+            std::unordered_map<std::string, std::pair<uint64_t, int32_t>> sending;
+            if (stats.has_value() && stats.value()["transferring"] != nullptr)
+            {
+                for (const auto &t : stats.value()["transferring"])
+                {
+                    auto &file = sending[t["name"].get<std::string>()];
+                    file.first += t["bytes"].get<uint64_t>();
+                    file.second += t["speed"].get<int32_t>();
+                }
+            }
 
-                        for (const auto &t : current_transfers)
+            uint64_t files = 0;
+            for (auto &[name, meta] : m_served)
+            {
+                auto it = sending.find(name);
+                uint64_t in_progress = it == sending.end() ? 0 : it->second.first;
+                meta->set_bytes_transferred(m_served_bytes[name] + in_progress);
+                meta->set_transmission_speed(it == sending.end() ? 0 : it->second.second);
+                files += it == sending.end() ? 0 : 1;
+            }
+            return files;
+        }
+
+        /// @brief Shortest period of the polls, when a file is about to finish
+        static constexpr std::chrono::milliseconds min_refresh_interval = std::chrono::milliseconds(250);
+        /// @brief Poll again without waiting, set when a job is started
+        std::atomic<bool> m_poll_now = false;
+
+        /// @brief Update the progress of the files and the status of the jobs, two requests when the jobs are running
+        /// @return time until the next poll, shorter when a file is about to finish
+        std::chrono::milliseconds poll_jobs()
+        {
+            std::chrono::milliseconds next = std::chrono::seconds(m_params.refresh_rate);
+            reap_range_downloads();
+            uint64_t serving = poll_served();
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                if (m_job_files.empty())
+                {
+                    m_memory->set_used(serving * m_buffer_bytes);
+                    return next;
+                }
+            }
+
+            // requestRPC("cache/stats", "{}");
+            // requestRPC("core/memstats", "{}");
+            auto stats = requestRPC("core/stats", "{}");
+            // parts of the files written in order, checked against their chunk checksums
+            struct chunk_check_t
+            {
+                TransferMetadata *meta;
+                std::filesystem::path local;
+                uint64_t written;
+            };
+            std::vector<chunk_check_t> to_check;
+            if (stats.has_value())
+            {
+                // one buffer used by every file being transferred
+                uint64_t transferring = 0;
+                std::unordered_set<int> transferring_jobs;
+                if (stats.value()["transferring"] != nullptr)
+                {
+                    std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                    for (const auto &t : stats.value()["transferring"])
+                    {
+                        // the requests of the servers are in their own group
+                        auto grp = t["group"].get<std::string>();
+                        if (grp.rfind("job/", 0) != 0)
+                        {
+                            continue;
+                        }
+                        int job_id = std::atoi(grp.substr(4).c_str());
+
+                        auto job = m_job_files.find(job_id);
+                        if (job == m_job_files.end())
+                        {
+                            continue;
+                        }
+                        auto file = job->second.find(t["name"].get<std::string>());
+                        if (file == job->second.end())
+                        {
+                            continue;
+                        }
+                        file->second->set_progress(t["percentage"].get<int>());
+                        file->second->set_transmission_speed(t["speedAvg"].get<int32_t>());
+                        transferring++;
+                        transferring_jobs.insert(job_id);
+
+                        // what rclone counts can still be in its buffers
+                        uint64_t margin = m_buffer_bytes + (1 << 20);
+                        uint64_t bytes = t.contains("bytes") ? t["bytes"].get<uint64_t>() : 0;
+                        if (bytes > margin && m_checksums.count(file->second) != 0 && is_written_in_order(*file->second))
                         {
-                            auto grp = t["group"].get<std::string>();
-                            int job_id = std::stoi(grp.substr(grp.find("/") + 1));
-
-                            for (auto &[meta, id] : m_jobs_id)
-                            {
-                                if (id == job_id)
-                                {
-                                    meta->set_progress(t["percentage"].get<int>());
-                                    meta->set_transmission_speed(t["speedAvg"].get<int32_t>());
-                                    break;
-                                }
-                            }
+                            to_check.push_back({file->second, m_destinations[file->second] / file->first, bytes - margin});
+                        }
+
+                        // poll again when the file should be done
+                        if (t.contains("eta") && t["eta"].is_number())
+                        {
+                            next = std::min(next, std::chrono::milliseconds(static_cast<int64_t>(t["eta"].get<double>() * 1000)));
                         }
                     }
+
+                    // a job without file in transfer is starting or about to finish
+                    if (transferring_jobs.size() < m_job_files.size())
+                    {
+                        next = std::min<std::chrono::milliseconds>(next, std::chrono::seconds(1));
+                    }
                 }
+                m_memory->set_used((transferring + serving) * m_buffer_bytes);
+            }
 
-                // Update information about ongoing transfers
-                for (auto &[meta, id] : m_jobs_id)
+            for (const auto &check : to_check)
+            {
+                std::string error;
+                uint64_t written = check.written;
+                if (!verify_chunks(check.meta, check.local, [written](uint64_t, uint64_t end)
+                                   { return end <= written; },
+                                   error))
                 {
-                    // get refreshed infos
-                    char *input_request = new char[100];
-                    sprintf(input_request, "{"
-                                           "\"jobid\": %d"
-                                           "}",
-                            id);
+                    TLOG() << "debug : RClone : " << error;
+                    detach_file(*check.meta);
+                    check.meta->set_status(status_type::e_status::ERROR);
+                    check.meta->set_error_code(error);
+                }
+            }
 
-                    auto res = requestRPC("job/status", input_request);
-                    delete[] input_request;
+            // only the jobs that left the running list are asked their status, every job if rclone does not give the list
+            auto list = requestRPC("job/list", "{}");
+            std::unordered_set<int> running;
+            bool has_running = list.has_value() && list.value().contains("runningIds") && list.value()["runningIds"].is_array();
+            if (has_running)
+            {
+                for (const auto &id : list.value()["runningIds"])
+                {
+                    running.insert(id.get<int>());
+                }
+            }
 
-                    if (res.has_value())
+            std::vector<int> jobs;
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                for (const auto &[id, job_files] : m_job_files)
+                {
+                    if (!has_running || running.count(id) == 0)
                     {
-                        if (res.value()["finished"] != nullptr && res.value()["finished"].get<bool>())
-                        {
-                            if (res.value()["success"].get<bool>())
-                            {
-                                meta->set_status(status_type::e_status::FINISHED);
-                                meta->set_progress(100);
-                            }
-                            else
-                            {
-                                meta->set_status(status_type::e_status::ERROR);
-                                meta->set_error_code(res.value()["error"].get<std::string>());
-                            }
-                            meta->set_transmission_speed(0);
-                        }
+                        jobs.push_back(id);
                     }
                 }
+            }
+            for (int id : jobs)
+            {
+                auto res = requestRPC("job/status", nlohmann::json({{"jobid", id}}).dump());
+                if (res.has_value() && res.value()["finished"] != nullptr && res.value()["finished"].get<bool>())
+                {
+                    finish_job(id, res.value()["success"].get<bool>(), res.value()["error"].get<std::string>());
+                }
+            }
 
-                // wait
-                std::this_thread::sleep_for(std::chrono::seconds(m_params.refresh_rate));
+            return std::max(next, min_refresh_interval);
+        }
+
+        // Threading
+        dunedaq::utilities::WorkerThread m_thread;
+        void do_work(std::atomic<bool> &running)
+        {
+            TLOG() << "debug : running thread ";
+
+            while (running.load())
+            {
+                auto deadline = std::chrono::steady_clock::now() + poll_jobs();
+
+                // short steps, a new job or the end of the transfer is seen without waiting for the whole interval
+                while (running.load() && !m_poll_now.exchange(false) && std::chrono::steady_clock::now() < deadline)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                }
             }
 
             // TODO Leo joly 11/09/2023 : segmentation fault
@@ -10,24 +10,42 @@
 #define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TRANSFER_INTERFACE_SCP_HPP_
 
 #include "snbmodules/interfaces/transfer_interface_abstract.hpp"
+#include "snbmodules/interfaces/child_process.hpp"
 #include "snbmodules/common/status_enum.hpp"
 
+#include "utilities/WorkerThread.hpp"
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <deque>
 #include <iostream>
 #include <cstdio>
 #include <fstream>
 
 #include <string>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace dunedaq::snbmodules
 {
 
+    /// @brief Files copied by scp commands run in child processes, the client keeps answering while they copy.
+    /// At most "max_concurrent" commands run at once, the other files wait their turn. A worker thread polls the
+    /// commands, updates the progress of the files from their size on disk and reports their end in their metadata
     class TransferInterfaceSCP : public TransferInterfaceAbstract
     {
 
     public:
-        TransferInterfaceSCP(GroupMetadata &config, bool is_uploader) : TransferInterfaceAbstract(config)
+        TransferInterfaceSCP(GroupMetadata &config, bool is_uploader)
+            : TransferInterfaceAbstract(config),
+              m_thread([&](std::atomic<bool> &running)
+                       { this->do_work(running); })
         {
             if (config.get_protocol_options().contains("user"))
             {
@@ -44,9 +62,35 @@ namespace dunedaq::snbmodules
                 m_params.use_password = config.get_protocol_options()["use_password"].get<bool>();
             }
 
+            if (config.get_protocol_options().contains("max_concurrent"))
+            {
+                m_params.max_concurrent = std::max(1, config.get_protocol_options()["max_concurrent"].get<int>());
+            }
+            // the commands asking a password share the terminal of the client, one at a time
+            if (m_params.use_password && m_params.max_concurrent > 1)
+            {
+                TLOG() << "debug : SCP : max_concurrent set to 1, the password is asked for each file";
+                m_params.max_concurrent = 1;
+            }
+
             m_is_uploader = is_uploader;
+            if (!m_is_uploader)
+            {
+                m_thread.start_working_thread();
+            }
+        }
+
+        virtual ~TransferInterfaceSCP()
+        {
+            if (m_thread.thread_running())
+            {
+                m_thread.stop_working_thread();
+            }
+
+            // the commands still running are terminated with their process
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_transfers.clear();
         }
-        virtual ~TransferInterfaceSCP() = default;
 
         bool upload_file(TransferMetadata &f_meta) override
         {
@@ -59,48 +103,35 @@ namespace dunedaq::snbmodules
             f_meta.set_bytes_transferred(f_meta.get_size());
             return true;
         }
+
+        /// @brief Queue the file, its copy is started by the worker thread when less than "max_concurrent" copies run
         bool download_file(TransferMetadata &f_meta, std::filesystem::path dest) override
         {
             TLOG() << "debug : SCP : Downloading file " << f_meta.get_file_name();
             f_meta.set_status(status_type::e_status::DOWNLOADING);
 
+            std::lock_guard<std::mutex> lock(m_mutex);
             m_files_being_transferred[f_meta.get_file_name()] = dest;
-
-            std::string exec = "";
-            if (m_params.use_password)
+            if (std::find(m_queue.begin(), m_queue.end(), &f_meta) == m_queue.end() && m_transfers.count(&f_meta) == 0)
             {
-                exec = "scp " + m_params.user + "@" + f_meta.get_src().get_ip() + ":" + f_meta.get_file_path().string() + " " + dest.string();
+                m_queue.push_back(&f_meta);
             }
-            else
-            {
-
-                exec = "scp -o PasswordAuthentication='no' " + m_params.user + "@" + f_meta.get_src().get_ip() + ":" + f_meta.get_file_path().string() + " " + dest.string();
-            }
-
-            TLOG() << "debug : executing " << exec;
-            if (system(exec.c_str()) == 0) // NOLINT
-            {
-                TLOG() << "debug : SCP : Sucess Download";
-                f_meta.set_status(status_type::e_status::FINISHED);
-                f_meta.set_bytes_transferred(f_meta.get_size());
-            }
-            else
-            {
-                ers::error(ErrorSCPDownloadError(ERS_HERE, "Please check the logs for more information."));
-                f_meta.set_status(status_type::e_status::ERROR);
-                f_meta.set_error_code("Something went wrong during the download");
-                f_meta.set_bytes_transferred(0);
-                return false;
-            }
-
+            m_poll_now = true;
             return true;
         }
 
+        /// @brief Stop the copy of the file, the bytes on disk are kept and fetched again from where they end on resume
         bool pause_file(TransferMetadata &f_meta) override
         {
             TLOG() << "debug : SCP : Pausing file " << f_meta.get_file_name();
+
+            auto transfer = detach_file(f_meta);
+            if (transfer != nullptr)
+            {
+                transfer->process.terminate();
+                f_meta.set_bytes_transferred(get_local_size(transfer->local));
+            }
             f_meta.set_status(status_type::e_status::PAUSED);
-            f_meta.set_bytes_transferred(0);
             return true;
         }
 
@@ -112,10 +143,13 @@ namespace dunedaq::snbmodules
             {
                 return upload_file(f_meta);
             }
-            else
+
+            std::filesystem::path dest;
             {
-                return download_file(f_meta, m_files_being_transferred[f_meta.get_file_name()]);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                dest = m_files_being_transferred[f_meta.get_file_name()];
             }
+            return download_file(f_meta, dest);
         }
 
         bool hash_file(TransferMetadata &f_meta) override
@@ -125,9 +159,16 @@ namespace dunedaq::snbmodules
             return true;
         }
 
+        /// @brief Stop the copy of the file, killing its command
         bool cancel_file(TransferMetadata &f_meta) override
         {
             TLOG() << "debug : SCP : Cancelling file " << f_meta.get_file_name();
+
+            auto transfer = detach_file(f_meta);
+            if (transfer != nullptr)
+            {
+                transfer->process.terminate();
+            }
             f_meta.set_status(status_type::e_status::CANCELLED);
             return true;
         }
@@ -137,10 +178,202 @@ namespace dunedaq::snbmodules
         {
             std::string user;
             bool use_password = false;
+            int max_concurrent = 4;
         } m_params;
 
+        /// @brief Copy of a file running in a child process
+        struct transfer_t
+        {
+            ChildProcess process;
+            std::filesystem::path local;
+            uint64_t last_bytes = 0;
+            std::chrono::steady_clock::time_point last_poll;
+        };
+
         bool m_is_uploader;
         std::map<std::string, std::filesystem::path> m_files_being_transferred;
+
+        /// @brief Protects the queue, the transfers and the destinations, shared with the worker thread
+        std::mutex m_mutex;
+        /// @brief Files waiting for a free slot, in their download order
+        std::deque<TransferMetadata *> m_queue;
+        std::map<TransferMetadata *, std::unique_ptr<transfer_t>> m_transfers;
+
+        /// @brief Period of the polls of the commands
+        static constexpr std::chrono::milliseconds refresh_interval = std::chrono::milliseconds(500);
+        /// @brief Poll again without waiting, set when a file is queued or stopped
+        std::atomic<bool> m_poll_now = false;
+
+        static uint64_t get_local_size(const std::filesystem::path &local)
+        {
+            std::error_code ec;
+            uint64_t size = std::filesystem::file_size(local, ec);
+            return ec ? 0 : size;
+        }
+
+        /// @brief Remove the file from the queue or the running copies
+        /// @return its running copy, to be terminated without holding the lock, nullptr if it was not running
+        std::unique_ptr<transfer_t> detach_file(TransferMetadata &f_meta)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.erase(std::remove(m_queue.begin(), m_queue.end(), &f_meta), m_queue.end());
+            // the freed slot is given to the next file at once
+            m_poll_now = true;
+
+            auto it = m_transfers.find(&f_meta);
+            if (it == m_transfers.end())
+            {
+                return nullptr;
+            }
+            auto transfer = std::move(it->second);
+            m_transfers.erase(it);
+            return transfer;
+        }
+
+        /// @brief Command copying a file. A file partly on disk, from a paused or interrupted copy, is continued with
+        /// sftp -a instead of copied again from its start
+        std::vector<std::string> get_command(const TransferMetadata &f_meta, const std::filesystem::path &local) const
+        {
+            uint64_t on_disk = get_local_size(local);
+            bool resume = on_disk > 0 && on_disk < f_meta.get_size();
+
+            std::vector<std::string> args;
+            if (resume)
+            {
+                args = {"sftp", "-a", "-q"};
+            }
+            else
+            {
+                args = {"scp", "-q"};
+            }
+            if (!m_params.use_password)
+            {
+                args.insert(args.end(), {"-o", "PasswordAuthentication=no"});
+            }
+            args.push_back(m_params.user + "@" + f_meta.get_src().get_ip() + ":" + f_meta.get_file_path().string());
+            args.push_back(local.string());
+            return args;
+        }
+
+        /// @brief Start the queued files while less than "max_concurrent" copies run
+        void start_queued()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while (!m_queue.empty() && m_transfers.size() < static_cast<size_t>(m_params.max_concurrent))
+            {
+                TransferMetadata *meta = m_queue.front();
+                m_queue.pop_front();
+                if (meta->get_status() != status_type::e_status::DOWNLOADING)
+                {
+                    continue;
+                }
+
+                auto transfer = std::make_unique<transfer_t>();
+                std::filesystem::path dest = m_files_being_transferred[meta->get_file_name()];
+                transfer->local = std::filesystem::is_directory(dest) ? dest / meta->get_file_name() : dest;
+                transfer->last_bytes = get_local_size(transfer->local);
+                transfer->last_poll = std::chrono::steady_clock::now();
+
+                auto args = get_command(*meta, transfer->local);
+                std::string exec;
+                for (const auto &arg : args)
+                {
+                    exec += (exec.empty() ? "" : " ") + arg;
+                }
+                TLOG() << "debug : executing " << exec;
+
+                std::string error;
+                if (!transfer->process.start(args, error, m_params.use_password))
+                {
+                    ers::error(ErrorSCPDownloadError(ERS_HERE, error));
+                    meta->set_status(status_type::e_status::ERROR);
+                    meta->set_error_code(error);
+                    continue;
+                }
+                m_transfers[meta] = std::move(transfer);
+            }
+        }
+
+        /// @brief Update the progress of the running copies and report the ended ones
+        void poll_transfers()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = m_transfers.begin(); it != m_transfers.end();)
+            {
+                TransferMetadata *meta = it->first;
+                transfer_t &transfer = *it->second;
+
+                auto code = transfer.process.poll();
+                uint64_t bytes = get_local_size(transfer.local);
+                if (!code.has_value())
+                {
+                    // the commands write the file in order, its size is what was received
+                    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - transfer.last_poll).count();
+                    if (elapsed > 0 && bytes >= transfer.last_bytes)
+                    {
+                        meta->set_transmission_speed(static_cast<int32_t>(std::min<uint64_t>((bytes - transfer.last_bytes) * 1000 / elapsed, INT32_MAX)));
+                    }
+                    transfer.last_bytes = bytes;
+                    transfer.last_poll = now;
+                    meta->set_bytes_transferred(bytes);
+                    if (meta->get_size() > 0)
+                    {
+                        meta->set_progress(static_cast<int>(std::min<uint64_t>(bytes * 100 / meta->get_size(), 99)));
+                    }
+                    ++it;
+                    continue;
+                }
+
+                if (code.value() == 0 && (meta->get_size() == 0 || bytes == meta->get_size()))
+                {
+                    TLOG() << "debug : SCP : Sucess Download " << meta->get_file_name();
+                    meta->set_bytes_transferred(bytes);
+                    meta->set_progress(100);
+                    meta->set_transmission_speed(0);
+                    meta->set_status(status_type::e_status::FINISHED);
+                }
+                else
+                {
+                    // the last line written by the command tells why it failed
+                    std::string output = transfer.process.get_error_output();
+                    output.erase(output.find_last_not_of("\r\n") + 1);
+                    std::string reason = output.substr(output.find_last_of('\n') + 1);
+                    if (code.value() == 0)
+                    {
+                        reason = std::to_string(bytes) + " bytes received instead of " + std::to_string(meta->get_size());
+                    }
+                    else if (reason.empty())
+                    {
+                        reason = "exit code " + std::to_string(code.value());
+                    }
+
+                    ers::error(ErrorSCPDownloadError(ERS_HERE, meta->get_file_name() + ": " + reason));
+                    meta->set_status(status_type::e_status::ERROR);
+                    meta->set_error_code(reason);
+                    meta->set_bytes_transferred(bytes);
+                    meta->set_transmission_speed(0);
+                }
+                it = m_transfers.erase(it);
+            }
+        }
+
+        // Threading
+        dunedaq::utilities::WorkerThread m_thread;
+        void do_work(std::atomic<bool> &running)
+        {
+            while (running.load())
+            {
+                poll_transfers();
+                start_queued();
+
+                auto deadline = std::chrono::steady_clock::now() + refresh_interval;
+                while (running.load() && !m_poll_now.exchange(false) && std::chrono::steady_clock::now() < deadline)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                }
+            }
+        }
     };
 } // namespace dunedaq::snbmodules
 #endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TRANSFER_INTERFACE_SCP_HPP_
\ No newline at end of file
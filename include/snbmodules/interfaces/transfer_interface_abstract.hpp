@@ -19,6 +19,7 @@
 #include "logging/Logging.hpp"
 
 #include <set>
+#include <vector>
 #include <iostream>
 
 namespace dunedaq::snbmodules
@@ -39,6 +40,33 @@ namespace dunedaq::snbmodules
         virtual bool hash_file(TransferMetadata &f_meta) = 0;
         virtual bool cancel_file(TransferMetadata &f_meta) = 0;
 
+        /// @brief Download several files of the group at once, protocols able to batch them override it.
+        /// By default every file is downloaded on its own
+        /// @return false if any file failed to start, the files that failed have their own status
+        virtual bool download_files(const std::vector<TransferMetadata *> &files, const std::filesystem::path &dest)
+        {
+            bool result = true;
+            for (TransferMetadata *f_meta : files)
+            {
+                if (!download_file(*f_meta, dest))
+                {
+                    f_meta->set_status(status_type::e_status::ERROR);
+                    result = false;
+                }
+            }
+            return result;
+        }
+
+        /// @brief Limit the bandwidth of the transfer, set by the bandwidth scheduler of the client.
+        /// Uploaders limit what they send, downloaders what they receive
+        /// @param bytes_per_second -1 for no limit
+        /// @return false if the protocol cannot limit its bandwidth
+        virtual bool set_rate_limit(int64_t bytes_per_second)
+        {
+            (void)bytes_per_second;
+            return false;
+        }
+
     protected:
         /// @brief MetadataAbstract of the transfer, contain settings and status of the transfer
         GroupMetadata &m_config;
@@ -10,6 +10,13 @@
 #define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_TRANSFER_INTERFACE_BITTORRENT_HPP_
 
 #include "snbmodules/interfaces/transfer_interface_abstract.hpp"
+#include "snbmodules/interfaces/torrent_hasher.hpp"
+#include "snbmodules/interfaces/torrent_tail_hasher.hpp"
+#include "snbmodules/interfaces/torrent_cache.hpp"
+#include "snbmodules/interfaces/bittorrent_session.hpp"
+#include "snbmodules/interfaces/alert_journal.hpp"
+#include "snbmodules/interfaces/bittorrent_telemetry.hpp"
+#include "snbmodules/interfaces/web_seed_server.hpp"
 #include "utilities/WorkerThread.hpp"
 
 #include "libtorrent/torrent_handle.hpp"
@@ -38,6 +45,8 @@
 #include "libtorrent/disk_interface.hpp"   // for open_file_state
 #include "libtorrent/disabled_disk_io.hpp" // for disabled_disk_io_constructor
 #include "libtorrent/load_torrent.hpp"
+#include "libtorrent/socket.hpp"
+#include "libtorrent/address.hpp"
 
 #include <termios.h>
 #include <sys/ioctl.h>
@@ -57,6 +66,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <unordered_map>
 
 namespace dunedaq::snbmodules
 {
@@ -64,38 +78,56 @@ namespace dunedaq::snbmodules
     using lt::seconds;
     using std::chrono::duration_cast;
 
-    struct session_state_t
-    {
-        // torrent_view &view;
-        // session_view &ses_view;
-        std::deque<std::string> events;
-        std::vector<lt::peer_info> peers;
-        std::vector<std::int64_t> file_progress;
-        std::vector<lt::partial_piece_info> download_queue;
-        std::vector<lt::block_info> download_queue_block_info;
-        std::vector<int> piece_availability;
-        std::vector<lt::announce_entry> trackers;
-
-        void clear()
-        {
-            peers.clear();
-            file_progress.clear();
-            download_queue.clear();
-            download_queue_block_info.clear();
-            piece_availability.clear();
-            trackers.clear();
-        }
-    };
-
-    class TransferInterfaceBittorrent : public TransferInterfaceAbstract
+    class TransferInterfaceBittorrent : public TransferInterfaceAbstract, public BittorrentSessionListener
     {
 
     public:
         TransferInterfaceBittorrent(GroupMetadata &config, bool is_client, std::filesystem::path work_dir, const IPFormat &listening_ip);
-        ~TransferInterfaceBittorrent();
+        ~TransferInterfaceBittorrent() override;
+
+        void generate_torrents_files(const std::filesystem::path &dest, const std::string &tracker, size_t num_destinations = 1);
 
-        void generate_torrents_files(const std::filesystem::path &dest, const std::string &tracker);
+        /// @brief Generate the torrent file of one file of the group
+        /// @param f_meta metadata of the file, status and progress are updated while hashing
+        /// @param dest directory where the torrent file is written
+        /// @param tracker tracker url, can be empty
+        /// @param num_destinations number of clients downloading the file, used to choose the piece size
+        /// @return magnet link of the torrent, empty on error
+        std::string generate_torrent_file(TransferMetadata &f_meta, const std::filesystem::path &dest, const std::string &tracker, size_t num_destinations = 1);
+
+        /// @brief Generate one multi-file torrent for files of the group, used when the "single_torrent" option is set.
+        /// The torrent is made from a directory of links to the files, named after the group
+        /// @param files metadata of the files, status and hash are updated
+        /// @param dest directory where the torrent file is written
+        /// @param tracker tracker url, can be empty
+        /// @param num_destinations number of clients downloading the files, used to choose the piece size
+        /// @return magnet link of each file, selecting the file in the torrent, empty on error
+        std::vector<std::string> generate_group_torrent(const std::vector<TransferMetadata *> &files, const std::filesystem::path &dest, const std::string &tracker, size_t num_destinations = 1);
+        bool is_single_torrent() const { return m_single_torrent; }
+
+        /// @brief Choose the piece size of a torrent, power of two between 16 KiB and 16 MiB.
+        /// Pieces are small enough to give every destination enough pieces to exchange, and not bigger than needed
+        /// for a piece to take a few milliseconds on the link
+        /// @param file_size size of the file in bytes
+        /// @param num_destinations number of clients downloading the file
+        /// @param link_speed speed of the link in bytes/s, 0 if unknown
+        /// @return piece size in bytes
+        static int compute_piece_size(uint64_t file_size, size_t num_destinations, uint64_t link_speed);
         std::filesystem::path get_work_dir() { return m_work_dir; }
+        /// @brief Port the session of the transfer listens on, shared with the other transfers of the client
+        int get_listen_port() const { return m_session->get_listen_port(); }
+
+        /// @brief Announce url put in the generated torrents, empty for none
+        const std::string &get_tracker() const { return m_tracker; }
+
+        /// @brief Downloaders exchange pieces between themselves, see add_peers
+        bool is_swarm_enabled() const { return m_swarm; }
+        /// @brief Last samples of the peers, download queue and disk queue of the transfer, see the "telemetry_interval" option
+        BittorrentTelemetry &get_telemetry() { return m_telemetry; }
+        /// @brief Add the endpoints of the other downloaders of the group, downloaders only.
+        /// Every torrent of the transfer connects to them, and pieces are then picked rarest first instead of in order
+        /// @param endpoints "ip:port" of the sessions of the other downloaders
+        void add_peers(const std::vector<std::string> &endpoints);
 
         bool upload_file(TransferMetadata &f_meta) override;
         bool download_file(TransferMetadata &f_meta, std::filesystem::path dest) override;
@@ -103,19 +135,108 @@ namespace dunedaq::snbmodules
         bool resume_file(TransferMetadata &f_meta) override;
         bool hash_file(TransferMetadata &f_meta) override;
         bool cancel_file(TransferMetadata &f_meta) override;
+        /// @brief The limit is shared by the torrents of the transfer, with the "rate_limit" option as maximum for the downloaders
+        bool set_rate_limit(int64_t bytes_per_second) override;
+
+        // BittorrentSessionListener
+        void on_alert(torrent_entry_t &entry, lt::alert const *a) override;
+        /// @brief Push the changes of a torrent status to its metadata
+        void on_status(torrent_entry_t &entry, lt::torrent_status const &s) override;
 
     private:
-        lt::session ses;
         bool m_is_client;
+        /// @brief Session shared with the other transfers of the same role, see BittorrentSessionPool
+        std::shared_ptr<BittorrentSession> m_session;
+        lt::session &ses;
+        // counters of the torrents of this transfer, updated by the alert thread of the session
         int m_torrent_num = 0;
+        int m_finished_torrents = 0;
         int m_peer_num = 0;
         int m_paused = 0;
         bool save_on_exit = true;
         std::filesystem::path m_work_dir;
         IPFormat m_listening_ip;
-        session_state_t session_state;
-        std::map<std::string, TransferMetadata *> m_filename_to_metadata;
+        /// @brief Samples of the peers and queues of the torrents of this transfer
+        BittorrentTelemetry m_telemetry;
+        /// @brief Period in seconds of the telemetry samples, 0 to disable them
+        int m_telemetry_interval = 5;
+        /// @brief Torrents of this transfer by metadata, the session finds them by handle.
+        /// Every file of the group shares the same entry when the group has a single torrent
+        std::unordered_map<TransferMetadata *, std::shared_ptr<torrent_entry_t>> m_torrents;
+        std::mutex m_torrents_mutex;
+        /// @brief Transfer the whole group in one multi-file torrent
+        bool m_single_torrent = false;
+        std::shared_ptr<torrent_entry_t> m_group_entry;
+        /// @brief Index of the files in the group torrent, uploader only
+        std::unordered_map<TransferMetadata *, int> m_group_files;
+        /// @brief Torrent file written for each file, uploader only. Named after the file and an index,
+        /// the files of the group with the same name have their own torrent
+        std::unordered_map<TransferMetadata *, std::filesystem::path> m_torrent_files;
+        int m_next_torrent_file = 0;
+        /// @brief Protects the files and the meta of the entries, m_group_files and m_torrent_files, read by the alert thread, nothing else is locked while it is held
+        std::mutex m_files_mutex;
+        /// @brief Path of the torrent file of a file, chosen at its first call
+        /// @param dest directory of the torrent file
+        std::filesystem::path torrent_file_path(TransferMetadata &f_meta, const std::filesystem::path &dest);
+        /// @brief Path of the torrent file written for a file, empty if none
+        std::filesystem::path get_torrent_file(TransferMetadata &f_meta);
+        /// @brief Tracker of the torrents, from the "tracker" option, set by the client to the tracker of the bookkeeper when missing
+        std::string m_tracker;
+        /// @brief Downloaders connect to each other when they know the endpoints of the group
+        bool m_swarm = true;
+        /// @brief Endpoints of the other downloaders of the group, connected to every torrent of the transfer
+        std::vector<lt::tcp::endpoint> m_peer_endpoints;
+        /// @brief Protects m_peer_endpoints, nothing else is locked while it is held
+        std::mutex m_peers_mutex;
+        /// @brief Connect a torrent to the other downloaders, and pick its pieces rarest first
+        void connect_peers(const lt::torrent_handle &h, const std::vector<lt::tcp::endpoint> &endpoints);
+        /// @brief Minimum period of the progress logs of a torrent
+        std::chrono::seconds m_log_interval = std::chrono::seconds(5);
         int m_rate_limit = -1;
+        /// @brief Limit of the whole transfer given by the bandwidth scheduler of the client, -1 for none
+        std::atomic<int64_t> m_scheduled_rate = -1;
+        /// @brief Number of torrents sharing the scheduled limit when it was last applied, see get_limited_handles
+        std::atomic<size_t> m_limited_torrents = 0;
+        /// @brief Limit of one torrent of the transfer, -1 for none
+        /// @param torrents number of torrents sharing the scheduled limit
+        int torrent_rate_limit(size_t torrents) const;
+        unsigned int m_hashing_threads = 0;
+        /// @brief Piece size forced by the protocol options, 0 to choose it from the file
+        int m_piece_size = 0;
+        /// @brief Speed of the link in bytes/s used to choose the piece size
+        uint64_t m_link_speed = 1250000000;
+        /// @brief Directory of the resume files, named after the info-hash of the torrents
+        std::filesystem::path m_resume_dir;
+        /// @brief Period in seconds of the resume data saves, 0 to save only on pause and exit
+        int m_resume_interval = 30;
+        /// @brief Torrents finished or cancelled, their resume data is not saved anymore
+        std::set<lt::info_hash_t> m_finished;
+        std::mutex m_resume_mutex;
+        /// @brief Optional journal of every alert
+        std::unique_ptr<AlertJournal> m_journal;
+        /// @brief Set when every file is transferred, or when the peers of a seeder left
+        std::mutex m_done_mutex;
+        std::condition_variable m_done_cv;
+        bool m_done = false;
+        /// @brief Resume data requested on exit and not received yet
+        int m_pending_saves = 0;
+        /// @brief Status of the files is final, updates of the session are ignored
+        std::atomic<bool> m_finalized = false;
+        /// @brief Torrents already generated for the shared files, uploader only
+        std::unique_ptr<TorrentCache> m_cache;
+        /// @brief HTTP server of the shared files given as web seed in the magnet links, uploader only, see the "web_seed_port" option.
+        /// Shared with the uploaders of the process listening on the same ip and port
+        std::shared_ptr<WebSeedServer> m_web_seed;
+        /// @brief Directories and files shared on the web seed by this transfer, unshared with it
+        std::vector<std::pair<std::filesystem::path, std::filesystem::path>> m_web_shared;
+        std::mutex m_web_shared_mutex;
+        /// @brief Use the web seeds of the magnet links, downloader only
+        bool m_use_web_seeds = true;
+        /// @brief Add the web seed of a shared file or directory to a magnet link, unchanged without web seed server
+        /// @param magnet magnet link of the torrent of the path
+        /// @param path shared file, or directory of a multi-file torrent
+        /// @param files paths in the directory of the files of a multi-file torrent, the only ones served
+        std::string with_web_seed(const std::string &magnet, const std::filesystem::path &path, const std::vector<std::filesystem::path> &files = {});
 
         // bool print_ip = true;
         // bool print_peaks = true;
@@ -132,12 +253,50 @@ namespace dunedaq::snbmodules
         // return the name of a torrent status enum
         char const *state(lt::torrent_status::state_t s);
 
-        bool add_magnet(lt::string_view uri, const std::filesystem::path &dest);
+        bool add_magnet(lt::string_view uri, const std::filesystem::path &dest, torrent_entry_t *entry = nullptr);
         // return magnet url
-        std::string add_torrent(const std::string &torrent, const std::filesystem::path &dest);
+        std::string add_torrent(const std::string &torrent, const std::filesystem::path &dest, torrent_entry_t *entry = nullptr);
+
+        /// @brief Create the entry of a file before adding its torrent, the alerts of the torrent can arrive right after
+        torrent_entry_t *add_entry(TransferMetadata &f_meta);
+        void remove_entry(TransferMetadata &f_meta);
+        /// @brief Handle of the torrent of a file, invalid if the torrent is not in the session
+        lt::torrent_handle get_handle(TransferMetadata &f_meta);
+        /// @brief Handles of the torrents of this transfer in the session
+        std::vector<lt::torrent_handle> get_handles();
+        /// @brief Handles of the torrents sharing the scheduled limit, the ones of the files still downloading
+        /// for a downloader or uploading for the uploader, not paused
+        std::vector<lt::torrent_handle> get_limited_handles();
+
+        /// @brief Add a file of the group torrent, the first one adds the torrent to the session
+        bool add_group_file(TransferMetadata &f_meta, int index, const std::filesystem::path &dest);
+        /// @brief Select and place the files of the group known when its torrent is added
+        void set_group_params(lt::add_torrent_params &p, torrent_entry_t *entry);
+        /// @brief Select and place a file of the group torrent already in the session
+        void apply_group_file(const lt::torrent_handle &h, int index, const torrent_file_t &file);
+        /// @brief Index of a file in the group torrent, -1 if the file has its own torrent
+        int get_group_index(TransferMetadata &f_meta);
+        /// @brief Metadata of the files of a torrent, copied under m_files_mutex for the alert thread
+        std::vector<TransferMetadata *> get_files(torrent_entry_t &entry);
+        /// @brief File of a single file torrent, nullptr for the torrent of a group
+        TransferMetadata *get_single_file(torrent_entry_t &entry);
+        /// @brief Every file of the group is announced and transferred, or failed
+        bool is_group_done(torrent_entry_t &entry);
+        /// @brief File selected by the so= parameter of a magnet link (BEP 53)
+        /// @return index of the file in the torrent, -1 for a whole torrent
+        static int magnet_file_index(const std::string &magnet);
+
+        void set_done(bool done = true);
+        void resume_data_handled();
 
         void set_torrent_params(lt::add_torrent_params &p, const std::filesystem::path &dest);
-        lt::session_params set_settings(const IPFormat &listen_interface, const std::string &listen_port);
+
+        std::filesystem::path resume_file_path(const lt::info_hash_t &info_hashes) const;
+        /// @brief Write resume data atomically and durably
+        bool save_resume_file(const lt::add_torrent_params &params);
+        /// @brief Replace the parameters of a torrent by its saved resume data, if any
+        /// @return true if resume data was found for the info-hash
+        bool load_resume_file(lt::add_torrent_params &p);
 
         static std::vector<char> load_file(std::string const &filename);
         static std::string branch_path(std::string const &f);
@@ -149,7 +308,10 @@ namespace dunedaq::snbmodules
         // name starts with a .
         static bool file_filter(std::string const &f);
 
-        bool make_torrent(std::filesystem::path full_path, int piece_size, const std::string &tracker, const std::string &outfile);
+        /// @brief Check an existing torrent still matches the file and the forced piece size
+        bool is_reusable_torrent(const std::vector<char> &torrent, const TransferMetadata &f_meta) const;
+
+        bool make_torrent(std::filesystem::path full_path, int piece_size, const std::string &tracker, const std::string &outfile, TransferMetadata *f_meta = nullptr, std::vector<char> *torrent_buffer = nullptr);
 
         // Threading
         dunedaq::utilities::WorkerThread m_thread;
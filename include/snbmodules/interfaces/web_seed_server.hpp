@@ -0,0 +1,128 @@
+/**
+ * @file web_seed_server.hpp WebSeedServer class, HTTP server of the shared files used as web seed by the bittorrent downloaders
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_WEB_SEED_SERVER_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_WEB_SEED_SERVER_HPP_
+
+#include "snbmodules/ip_format.hpp"
+#include "snbmodules/common/errors_declaration.hpp"
+#include "utilities/WorkerThread.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace dunedaq::snbmodules
+{
+    /// @brief HTTP/1.1 server answering the GET and HEAD range requests of the BitTorrent web seeds (BEP 19).
+    /// Only the files shared by the transfers are served, one server per listening ip and port. The downloaders get the missing pieces from it
+    /// in parallel of the BitTorrent peers, and still progress when the BitTorrent listener of the uploader is unreachable
+    class WebSeedServer
+    {
+
+    public:
+        /// @brief Constructor, the server does not listen before start
+        /// @param listen_interface ip and port to listen on, port 0 to choose a free port
+        /// @param max_connections connections served at the same time, the others are answered 503
+        explicit WebSeedServer(const IPFormat &listen_interface, int max_connections = 16);
+        ~WebSeedServer();
+
+        WebSeedServer(const WebSeedServer &) = delete;
+        WebSeedServer &operator=(const WebSeedServer &) = delete;
+
+        /// @brief Listen and serve the requests in background
+        /// @return false if the socket cannot be opened
+        bool start();
+        void stop();
+
+        /// @brief Server of an ip and port shared by the uploaders of the process, started on first use
+        /// @return nothing if it cannot listen
+        static std::shared_ptr<WebSeedServer> get_shared(const IPFormat &listen_interface);
+
+        /// @brief Port the server listens on, 0 before start
+        int get_port() const { return m_port; }
+        /// @brief Serve a file of a directory, nothing else of the directory is visible
+        /// @param relative path of the file in dir
+        /// @return url of the directory, ending with '/'. Append the escaped name of a file for the web seed of a
+        /// single file torrent, a multi-file torrent in the directory uses it as is
+        std::string share_file(const std::filesystem::path &dir, const std::filesystem::path &relative);
+        /// @brief Stop serving a file, it stays served while another transfer shares it
+        void unshare_file(const std::filesystem::path &dir, const std::filesystem::path &relative);
+        /// @brief Bytes of file content sent since start
+        uint64_t get_bytes_served() const { return m_bytes_served; }
+
+        /// @brief File of an url path, public to be tested without socket
+        /// @param path path of the request, url encoded
+        /// @return nothing if the path is not a shared file
+        std::optional<std::filesystem::path> resolve(const std::string &path);
+        /// @brief Parse a single range "bytes=first-last", "bytes=first-" or "bytes=-suffix"
+        /// @param size size of the file
+        /// @return first and last byte included, nothing if not satisfiable
+        static std::optional<std::pair<uint64_t, uint64_t>> parse_range(const std::string &range, uint64_t size);
+        /// @brief Percent-encode everything but the unreserved characters and '/'
+        static std::string escape(const std::string &s);
+
+    private:
+        struct connection_t
+        {
+            std::thread thread;
+            std::atomic<bool> done = false;
+        };
+
+        IPFormat m_listen_interface;
+        int m_max_connections;
+        int m_socket = -1;
+        std::atomic<int> m_port = 0;
+        std::atomic<bool> m_running = false;
+        std::atomic<uint64_t> m_bytes_served = 0;
+
+        struct shared_t
+        {
+            std::filesystem::path root;
+            /// @brief Shared files of the directory, with the number of transfers sharing them
+            std::map<std::filesystem::path, int> files;
+        };
+        /// @brief Directories of the shared files by url prefix
+        std::map<std::string, shared_t> m_shared;
+        std::mutex m_shared_mutex;
+
+        /// @brief Servers of the process by ip and port, alive as long as an uploader uses it
+        inline static std::map<std::string, std::weak_ptr<WebSeedServer>> m_servers;
+        inline static std::mutex m_servers_mutex;
+
+        static std::filesystem::path normalize_root(const std::filesystem::path &dir);
+
+        std::list<std::unique_ptr<connection_t>> m_connections;
+
+        /// @brief Serve the requests of a kept-alive connection until it is closed or idle
+        void handle_connection(int fd);
+        /// @brief Answer one request
+        /// @return false if the connection must be closed
+        bool handle_request(int fd, const std::string &request);
+        /// @brief Join the finished connections
+        /// @param all wait for every connection
+        void reap_connections(bool all);
+
+        static bool send_all(int fd, const std::string &data);
+        static std::string url_decode(const std::string &s);
+
+        // Threading
+        dunedaq::utilities::WorkerThread m_thread;
+        void do_work(std::atomic<bool> &running_flag);
+    };
+
+} // namespace dunedaq::snbmodules
+#endif // SNBMODULES_INCLUDE_SNBMODULES_INTERFACES_WEB_SEED_SERVER_HPP_
@@ -0,0 +1,129 @@
+/**
+ * @file memory_budget.hpp MemoryBudget class, memory of the process shared between the transfer interfaces
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#ifndef SNBMODULES_INCLUDE_SNBMODULES_MEMORY_BUDGET_HPP_
+#define SNBMODULES_INCLUDE_SNBMODULES_MEMORY_BUDGET_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+    // Singleton
+    /// @brief Memory the transfer interfaces may use for their buffers, caches and queues.
+    /// Every session reserves its share when it starts and gives it back when it stops, the shares of all the sessions
+    /// are computed again each time. The sizes of the buffers of a session are derived from its current share.
+    class MemoryBudget
+    {
+
+    public:
+        static MemoryBudget &get()
+        {
+            static MemoryBudget instance;
+            return instance;
+        }
+
+        // not cloneable
+        MemoryBudget(MemoryBudget &other) = delete;
+        // not assignable
+        void operator=(const MemoryBudget &) = delete;
+
+        /// @brief Part of the budget held by one session, given back when destroyed
+        class Reservation
+        {
+        public:
+            ~Reservation();
+
+            Reservation(const Reservation &) = delete;
+            Reservation &operator=(const Reservation &) = delete;
+
+            /// @brief Bytes reserved, the session must size its buffers to stay below
+            uint64_t get_bytes() const { return m_bytes; }
+            /// @brief Bytes the session would use without budget
+            uint64_t get_wanted() const { return m_wanted; }
+            const std::string &get_owner() const { return m_owner; }
+
+            /// @brief Called with the new share of the session when the shares are computed again, a session
+            /// started or stopped. It must not reserve nor release memory. nullptr to stop the calls, it then
+            /// waits for a call in progress
+            void set_on_resize(std::function<void(uint64_t)> on_resize);
+
+            /// @brief Bytes the session really uses, reported by the opmon counters
+            void set_used(uint64_t bytes) { m_used = bytes; }
+            uint64_t get_used() const { return m_used; }
+
+        private:
+            friend class MemoryBudget;
+            Reservation(std::string owner, uint64_t wanted);
+
+            std::string m_owner;
+            uint64_t m_wanted;
+            std::atomic<uint64_t> m_bytes = 0;
+            std::atomic<uint64_t> m_used = 0;
+            std::function<void(uint64_t)> m_on_resize;
+        };
+
+        /// @brief Default budget, 0 for no limit
+        static constexpr uint64_t default_budget = 0;
+        /// @brief Smallest share given to a session, even when the budget is exhausted
+        static constexpr uint64_t min_share = 16ULL * 1024 * 1024;
+
+        /// @brief Set the memory of the process given to the transfers, 0 for no limit.
+        /// The shares of the sessions already started are computed again.
+        void set_budget(uint64_t bytes);
+        uint64_t get_budget();
+
+        /// @brief Reserve the memory of a new session. Every session gets what it wants, at most an equal part of the
+        /// budget between the active sessions, but never less than min_share. What a session does not want is shared
+        /// by the others. The other sessions are told their new share.
+        /// @param owner name of the session, for the logs
+        /// @param wanted bytes the session would use without budget
+        /// @return reservation to keep as long as the session lives
+        std::unique_ptr<Reservation> reserve(const std::string &owner, uint64_t wanted);
+
+        /// @brief Bytes reserved by the active sessions
+        uint64_t get_reserved_bytes();
+        /// @brief Bytes used by the active sessions, as last reported by them
+        uint64_t get_used_bytes();
+        /// @brief Number of active sessions
+        size_t get_sessions_count();
+
+        /// @brief Parse a size as rclone does: "100G", "512K", "10M", KiB without suffix, "off"
+        /// @return size in bytes, 0 for "off" or an invalid size
+        static uint64_t parse_size(const std::string &size);
+
+    private:
+        MemoryBudget() = default;
+
+        void release(Reservation *reservation);
+
+        /// @brief Compute the shares of the sessions, m_mutex must be held
+        /// @return sessions whose share changed, with their new share
+        std::vector<std::pair<Reservation *, uint64_t>> compute_shares();
+        /// @brief Tell the sessions their new share, m_resize_mutex must be held
+        static void notify(const std::vector<std::pair<Reservation *, uint64_t>> &changes);
+
+        /// @brief Held while the sessions are told their share, a reservation is not released meanwhile.
+        /// Taken before m_mutex
+        std::mutex m_resize_mutex;
+        std::mutex m_mutex;
+        uint64_t m_budget = default_budget;
+        uint64_t m_reserved = 0;
+        std::set<Reservation *> m_reservations;
+    };
+
+} // namespace dunedaq::snbmodules
+
+#endif // SNBMODULES_INCLUDE_SNBMODULES_MEMORY_BUDGET_HPP_
@@ -10,6 +10,8 @@
 #define SNBMODULES_INCLUDE_SNBMODULES_TRANSFER_CLIENT_HPP_
 
 #include "snbmodules/transfer_session.hpp"
+#include "snbmodules/bandwidth_scheduler.hpp"
+#include "snbmodules/interfaces/torrent_tail_hasher.hpp"
 #include "snbmodules/ip_format.hpp"
 
 #include "snbmodules/common/notification_enum.hpp"
@@ -25,8 +27,12 @@
 #include <filesystem>
 #include <set>
 #include <iostream>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <utility>
+#include <vector>
 
 namespace dunedaq::snbmodules
 {
@@ -79,6 +85,16 @@ namespace dunedaq::snbmodules
         /// @return Pointer to the new session
         TransferSession &create_session(GroupMetadata transfer_options, e_session_type type, std::string id, const std::filesystem::path &work_dir, IPFormat ip = IPFormat(), const std::set<std::string> &dest_clients = std::set<std::string>());
 
+        /// @brief Hash the files while they are written in the listening directory,
+        /// the torrents are ready to be used by BitTorrent sessions as soon as the files are closed
+        /// @param piece_size piece size of the torrents
+        void start_tail_hashing(int piece_size);
+
+        /// @brief Share a bandwidth between the sessions of the client by priority class, see BandwidthScheduler
+        /// @param egress bytes/s shared by the uploaders, 0 for no limit
+        /// @param ingress bytes/s shared by the downloaders, 0 for no limit
+        void set_bandwidth(int64_t egress, int64_t ingress) { m_bandwidth_scheduler.set_bandwidth(egress, ingress); }
+
         /// @brief Scan available files in the listening directory
         /// @param previous_scan Set of files already scanned
         /// @param folder Folder to scan
@@ -90,8 +106,10 @@ namespace dunedaq::snbmodules
         inline std::string get_client_id() const { return m_client_id; }
         inline std::filesystem::path get_listening_dir() const { return m_listening_dir; }
         TransferSession *get_session(std::string transfer_id);
-        inline std::vector<TransferSession> &get_sessions() { return m_sessions; }
-        inline const std::vector<TransferSession> &get_sessions() const { return m_sessions; }
+        inline std::list<TransferSession> &get_sessions() { return m_sessions; }
+        inline const std::list<TransferSession> &get_sessions() const { return m_sessions; }
+        /// @brief Last telemetry sample of each bittorrent session, safe to call from any thread
+        std::vector<telemetry_sample_t> get_bittorrent_telemetry();
         std::string get_my_conn();
 
         // Setters
@@ -129,12 +147,26 @@ namespace dunedaq::snbmodules
         /// @brief Listening directory, directory where the client will listen for incoming files and files to share
         std::filesystem::path m_listening_dir;
 
-        /// @brief Map of active sessions (key = session ID, value = session)
-        std::vector<TransferSession> m_sessions;
+        /// @brief List of active sessions, sessions are built in place and never moved
+        std::list<TransferSession> m_sessions;
+        /// @brief Held while sessions are added to or removed from m_sessions, and by the readers of other threads.
+        /// The thread of the client changing the list reads it without lock
+        std::mutex m_sessions_mutex;
+
+        /// @brief Hash files while they are written, optional
+        std::unique_ptr<TorrentTailHasher> m_tail_hasher;
+
+        /// @brief Bandwidth of the client shared between the sessions
+        BandwidthScheduler m_bandwidth_scheduler;
 
         /// @brief Map of available files (key = file path, value = file metadata)
         std::map<std::string, std::shared_ptr<TransferMetadata>> m_available_files;
 
+        /// @brief Announce url of the tracker hosted by a bookkeeper, received with its connection request.
+        /// Given to the bittorrent transfers created without "tracker" option
+        std::string m_tracker_url;
+        std::mutex m_tracker_url_mutex;
+
         /// @brief Connection uuid of the client, retrieved using the notification interface and calling get_my_conn()
         std::string m_my_conn = "";
 
@@ -20,14 +20,19 @@
 #include "snbmodules/interfaces/transfer_interface_SCP.hpp"
 #include "snbmodules/interfaces/transfer_interface_RClone.hpp"
 
+#include "utilities/WorkerThread.hpp"
+
 #include <sys/prctl.h>
 #include <sys/wait.h>
 #include <fstream>
+#include <map>
 #include <string>
 #include <set>
 #include <vector>
 #include <utility>
 #include <memory>
+#include <mutex>
+#include <optional>
 
 namespace dunedaq::snbmodules
 {
@@ -72,15 +77,17 @@ namespace dunedaq::snbmodules
         /// @return is less than ?
         bool operator<(TransferSession const &other) const { return m_session_id.compare(other.m_session_id); }
 
-        TransferSession(TransferSession &&) = default;
-        TransferSession &operator=(TransferSession &&) = default;
+        // The transfer interface and the preparation thread keep references to the session
+        TransferSession(TransferSession &&) = delete;
+        TransferSession &operator=(TransferSession &&) = delete;
 
         /// @brief Constructor
         /// @param transfer_options group metadata
         /// @param type type of session
         /// @param id unique identifier of the session
         /// @param ip ip of the client (TODO : useless ?)
-        TransferSession(GroupMetadata transfer_options, e_session_type type, std::string id, const IPFormat &ip, std::filesystem::path work_dir, std::vector<std::string> bk_conn = std::vector<std::string>(), std::set<std::string> client_conn = std::set<std::string>());
+        /// @param target_clients clients that download the files, only used by uploader
+        TransferSession(GroupMetadata transfer_options, e_session_type type, std::string id, const IPFormat &ip, std::filesystem::path work_dir, std::vector<std::string> bk_conn = std::vector<std::string>(), std::set<std::string> client_conn = std::set<std::string>(), std::set<std::string> target_clients = std::set<std::string>());
 
         /// @brief Destructor
         /// Kill all threads created by the session (TODO : useless ?)
@@ -109,10 +116,26 @@ namespace dunedaq::snbmodules
         // Interface for the transfer, TODO: add notifications : DO WE REALLY WANT THAT ?
         void add_file(std::shared_ptr<TransferMetadata> fmeta)
         {
+            std::lock_guard<std::recursive_mutex> lock(m_mutex);
             TransferMetadata &moved_meta = get_transfer_options().add_file(std::move(fmeta));
             update_metadata_to_bookkeeper(moved_meta);
         }
 
+        /// @brief Notify the target clients of the new transfer and send the metadata of the files ready to be transferred.
+        /// Files still being prepared are sent as soon as they are ready
+        void announce_new_transfer();
+
+        /// @brief Send the endpoint of the BitTorrent session of a downloader to the uploader of the group,
+        /// the uploader gives it to the other downloaders so they exchange pieces
+        /// @param uploader_session id of the session of the uploader
+        void announce_peer_endpoint(const std::string &uploader_session);
+
+        /// @brief Receive BitTorrent endpoints of downloaders of the group.
+        /// The uploader relays them to the other downloaders, the downloaders connect to them
+        /// @param source id of the session sending the endpoints
+        /// @param data JSON array of "ip:port"
+        void add_peer_endpoints(const std::string &source, const std::string &data);
+
         bool pause_file(TransferMetadata &f_meta, bool is_multiple = false);
         bool resume_file(TransferMetadata &f_meta, bool is_multiple = false);
         bool hash_file(TransferMetadata &f_meta, bool is_multiple = false);
@@ -122,6 +145,15 @@ namespace dunedaq::snbmodules
         bool resume_all();
         bool cancel_all();
 
+        /// @brief True while files are transferred or hashed, a waiting, paused or finished session is not active
+        bool is_active();
+        /// @brief Limit the bandwidth of the transfer, see BandwidthScheduler
+        /// @param bytes_per_second -1 for no limit
+        /// @return false if the protocol cannot limit its bandwidth
+        bool set_rate_limit(int64_t bytes_per_second);
+        /// @brief Last telemetry sample of the peers and queues of the transfer, BitTorrent only
+        std::optional<telemetry_sample_t> get_bittorrent_telemetry();
+
         /// @brief Start the session by downloading or uploading files depending on the type of session TODO : separate thread ?
         bool start_file(TransferMetadata &f_meta);
         bool start_all();
@@ -164,6 +196,26 @@ namespace dunedaq::snbmodules
         /// @brief clients that dowload the files, only used by uploader
         std::set<std::string> m_target_clients;
 
+        /// @brief Protect the files metadata shared with the preparation thread
+        std::recursive_mutex m_mutex;
+
+        /// @brief Endpoints of the BitTorrent sessions of the downloaders by client, only used by uploader
+        std::map<std::string, std::vector<std::string>> m_peer_endpoints;
+
+        /// @brief True once the target clients have been notified of the new transfer
+        bool m_announced = false;
+
+        /// @brief True if the transfer was started while some files were still being prepared
+        bool m_start_requested = false;
+
+        /// @brief Thread preparing the files of the uploader in background (ex: torrent generation, RClone checksums),
+        /// files go from PREPARING to WAITING one by one
+        dunedaq::utilities::WorkerThread m_prepare_thread;
+        void do_prepare_files(std::atomic<bool> &running_flag);
+        /// @brief Send a prepared file to the targets, and start it if the transfer was started
+        /// @param magnet magnet link of the file, BitTorrent only
+        void publish_prepared_file(TransferMetadata &f_meta, const std::string &magnet = "");
+
         /// @brief handle actions to be taken when a notification is received.
         /// The notification is passed as a parameter by the client because only 1 connection is opened
         /// (not possible to open connection after configuration)
@@ -7,10 +7,14 @@
  */
 
 #include "SNBFileTransfer.hpp"
+#include "snbmodules/memory_budget.hpp"
+#include "snbmodules/snbfiletransferinfo/InfoNljs.hpp"
 #include "appfwk/DAQModuleHelper.hpp"
 
 #include "appfwk/cmd/Nljs.hpp"
 
+#include <algorithm>
+#include <optional>
 #include <string>
 #include <set>
 #include <memory>
@@ -129,14 +133,68 @@ namespace dunedaq::snbmodules
         (void)args;
     }
 
+    void
+    SNBFileTransfer::get_info(opmonlib::InfoCollector &ci, int level)
+    {
+        (void)level;
+        snbfiletransferinfo::Info info;
+        info.memory_budget_bytes = MemoryBudget::get().get_budget();
+        info.memory_reserved_bytes = MemoryBudget::get().get_reserved_bytes();
+        info.memory_used_bytes = MemoryBudget::get().get_used_bytes();
+        info.memory_sessions = MemoryBudget::get().get_sessions_count();
+
+        // the disk queue is shared by the transfers of a session, and the latency is a mean, take the worst
+        if (m_client != nullptr)
+        {
+            // the sessions are added and removed by the thread of the client, they are read under its lock
+            for (const auto &sample : m_client->get_bittorrent_telemetry())
+            {
+                info.bittorrent_sessions++;
+                info.bittorrent_peers += sample.peers;
+                info.bittorrent_download_rate += sample.download_rate;
+                info.bittorrent_upload_rate += sample.upload_rate;
+                info.bittorrent_chokes += sample.chokes;
+                info.bittorrent_unchokes += sample.unchokes;
+                info.bittorrent_download_queue += sample.download_queue;
+                info.bittorrent_queued_disk_jobs = std::max<uint64_t>(info.bittorrent_queued_disk_jobs, sample.queued_disk_jobs);
+                info.bittorrent_queued_write_bytes = std::max<uint64_t>(info.bittorrent_queued_write_bytes, sample.queued_write_bytes);
+                info.bittorrent_request_latency_ms = std::max<int64_t>(info.bittorrent_request_latency_ms, sample.request_latency_ms);
+                if (!sample.slowest_peer.empty() && (info.bittorrent_slowest_peer.empty() || static_cast<uint64_t>(sample.slowest_peer_rate) < info.bittorrent_slowest_peer_rate))
+                {
+                    info.bittorrent_slowest_peer = sample.slowest_peer;
+                    info.bittorrent_slowest_peer_rate = sample.slowest_peer_rate;
+                }
+            }
+        }
+        ci.add(info);
+    }
+
     void
     SNBFileTransfer::do_conf(const nlohmann::json &args)
     {
         if (args.contains("client_ip") && args.contains("work_dir") && args.contains("connection_prefix") && args.contains("timeout_send") && args.contains("timeout_receive"))
         {
+            // before any session reserves its memory
+            if (args.contains("memory_budget"))
+            {
+                MemoryBudget::get().set_budget(args["memory_budget"].get<uint64_t>());
+            }
+
             m_client = std::make_shared<TransferClient>(IPFormat(args["client_ip"].get<std::string>()), m_name, args["work_dir"].get<std::filesystem::path>(), args["connection_prefix"].get<std::string>(), args["timeout_send"].get<int>(), args["timeout_receive"].get<int>());
             m_thread = std::make_unique<dunedaq::utilities::WorkerThread>([&](std::atomic<bool> &running)
                                                                           { m_client->do_work(running); });
+
+            if (args.contains("tail_hashing") && args["tail_hashing"].get<bool>())
+            {
+                int piece_size = args.contains("tail_hashing_piece_size") ? args["tail_hashing_piece_size"].get<int>() : 8 * 1024 * 1024;
+                m_client->start_tail_hashing(piece_size);
+            }
+
+            if (args.contains("egress_rate") || args.contains("ingress_rate"))
+            {
+                m_client->set_bandwidth(args.contains("egress_rate") ? args["egress_rate"].get<int64_t>() : 0,
+                                        args.contains("ingress_rate") ? args["ingress_rate"].get<int64_t>() : 0);
+            }
         }
         else
         {
@@ -35,7 +35,7 @@ namespace dunedaq::snbmodules
         SNBFileTransfer &operator=(SNBFileTransfer &&) = delete;
 
         void init(const nlohmann::json &obj) override;
-        // void get_info(opmonlib::InfoCollector &ci, int level) override;
+        void get_info(opmonlib::InfoCollector &ci, int level) override;
 
     private:
         // Commands
@@ -50,6 +50,12 @@ namespace dunedaq::snbmodules
             m_bookkeeper = std::make_shared<Bookkeeper>(IPFormat(args["bookkeeper_ip"].get<std::string>()), m_name, args["bookkeeper_log_path"].get<std::string>(), args["refresh_rate"].get<int>(), args["connection_prefix"].get<std::string>(), args["timeout_send"].get<int>(), args["timeout_receive"].get<int>());
             m_thread = std::make_unique<dunedaq::utilities::WorkerThread>([&](std::atomic<bool> &running)
                                                                           { m_bookkeeper->do_work(running); });
+
+            // optional tracker of the bittorrent transfers
+            if (args.contains("tracker_port") && args["tracker_port"].get<int>() >= 0)
+            {
+                m_bookkeeper->start_tracker(args["tracker_port"].get<int>());
+            }
         }
         else
         {
@@ -74,6 +74,7 @@ def get_snbmodules_bookkeeper_app(
         HOST,
         BOOKKEEPER_PORT=0,
         BOOKKEEPER_REFRESH_RATE=1,
+        BOOKKEEPER_TRACKER_PORT=-1,
         BOOKKEEPER_NAME="bookkeeper",
         BOOKKEEPER_LOG_PATH="./",
         SNB_CONNECTION_PREFIX="snbmodules",
@@ -98,6 +99,7 @@ def get_snbmodules_bookkeeper_app(
                             bookkeeper_ip = bookkeeper_ip, 
                             bookkeeper_log_path = BOOKKEEPER_LOG_PATH, 
                             refresh_rate = BOOKKEEPER_REFRESH_RATE,
+                            tracker_port = BOOKKEEPER_TRACKER_PORT,
                             connection_prefix = SNB_CONNECTION_PREFIX, 
                             timeout_send = SNB_TIMEOUT_SEND, 
                             timeout_receive = SNB_TIMEOUT_RECEIVE, 
@@ -330,10 +330,30 @@ namespace dunedaq::snbmodules
         }
     }
 
+    bool Bookkeeper::start_tracker(int port)
+    {
+        m_tracker = std::make_unique<BittorrentTracker>(IPFormat(get_ip().get_ip(), port));
+        if (!m_tracker->start())
+        {
+            m_tracker.reset();
+            return false;
+        }
+        TLOG() << "Bookkeeper " << get_bookkeeper_id() << " hosting BitTorrent tracker " << get_tracker_url();
+        return true;
+    }
+
     void Bookkeeper::request_connection_and_available_files(const std::string &client)
     {
-        // send connection request to client
-        send_notification(notification_type::e_notification_type::CONNECTION_REQUEST, get_bookkeeper_id(), client, client, get_bookkeeper_id(), 1);
+        // send connection request to client, with the url of the tracker used by its bittorrent transfers
+        std::string data = get_bookkeeper_id();
+        if (m_tracker != nullptr)
+        {
+            nlohmann::json request;
+            request["bookkeeper"] = get_bookkeeper_id();
+            request["tracker"] = get_tracker_url();
+            data = request.dump();
+        }
+        send_notification(notification_type::e_notification_type::CONNECTION_REQUEST, get_bookkeeper_id(), client, client, data, 1);
 
         // Listen to receive connection response and available files
         // auto msg = listen_for_notification(get_bookkeepers_conn().front(), client);
@@ -464,6 +484,10 @@ namespace dunedaq::snbmodules
         }
 
         *output << "***** Bookkeeper " << get_bookkeeper_id() << " " + get_ip().get_ip_port() << " informations display *****" << std::endl;
+        if (m_tracker != nullptr)
+        {
+            *output << "BitTorrent tracker : " << get_tracker_url() << std::endl;
+        }
         // *output << "q: quit, d : display info, n : new transfer, s : start transfer" << std::endl;
         *output << "Connected clients :" << std::endl;
 
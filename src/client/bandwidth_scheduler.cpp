@@ -0,0 +1,174 @@
+/**
+ * @file bandwidth_scheduler.cpp BandwidthScheduler class, share of the bandwidth of a client between its sessions
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/bandwidth_scheduler.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+
+    void BandwidthScheduler::set_bandwidth(int64_t egress, int64_t ingress)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_egress = std::max<int64_t>(egress, 0);
+            m_ingress = std::max<int64_t>(ingress, 0);
+        }
+        TLOG() << "debug : bandwidth of the client set to " << egress << " bytes/s egress, " << ingress << " bytes/s ingress";
+        rebalance();
+    }
+
+    void BandwidthScheduler::add_session(TransferSession &session)
+    {
+        entry_t entry;
+        entry.session = &session;
+
+        nlohmann::json options = session.get_transfer_options().get_protocol_options();
+        if (options.contains("priority"))
+        {
+            auto priority = priority_type::string_to_priority(options["priority"].get<std::string>());
+            if (priority.has_value())
+            {
+                entry.demand.priority = priority.value();
+            }
+            else
+            {
+                ers::warning(ConfigError(ERS_HERE, "unknown priority " + options["priority"].get<std::string>() + ", using normal"));
+            }
+        }
+        if (options.contains("weight"))
+        {
+            entry.demand.weight = std::max(1, options["weight"].get<int>());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_sessions[session.get_session_id()] = entry;
+        }
+        TLOG() << "debug : scheduling session " << session.get_session_id() << " with priority " << priority_type::priority_to_string(entry.demand.priority) << " and weight " << entry.demand.weight;
+        rebalance();
+    }
+
+    void BandwidthScheduler::remove_session(const TransferSession &session)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_sessions.erase(session.get_session_id());
+        }
+        rebalance();
+    }
+
+    void BandwidthScheduler::update()
+    {
+        if (std::chrono::steady_clock::now() - m_last_rebalance >= m_rebalance_interval)
+        {
+            rebalance();
+        }
+    }
+
+    void BandwidthScheduler::rebalance()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_last_rebalance = std::chrono::steady_clock::now();
+        rebalance(m_egress, true);
+        rebalance(m_ingress, false);
+    }
+
+    void BandwidthScheduler::rebalance(int64_t bandwidth, bool uploaders)
+    {
+        std::vector<entry_t *> entries;
+        std::vector<demand_t> demands;
+        for (auto &[id, entry] : m_sessions)
+        {
+            if (entry.session->is_uploader() == uploaders)
+            {
+                entry.demand.active = entry.session->is_active();
+                entries.push_back(&entry);
+                demands.push_back(entry.demand);
+            }
+        }
+
+        std::vector<int64_t> rates = compute_rates(bandwidth, demands);
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            entry_t &entry = *entries[i];
+            if (entry.applied && entry.rate == rates[i])
+            {
+                continue;
+            }
+            TLOG() << "debug : rate of session " << entry.session->get_session_id() << " set to " << rates[i] << " bytes/s";
+            if (!entry.session->set_rate_limit(rates[i]))
+            {
+                TLOG() << "debug : the protocol of session " << entry.session->get_session_id() << " cannot limit its rate";
+            }
+            entry.rate = rates[i];
+            entry.applied = true;
+        }
+    }
+
+    std::vector<int64_t> BandwidthScheduler::compute_rates(int64_t bandwidth, const std::vector<demand_t> &demands)
+    {
+        if (bandwidth <= 0)
+        {
+            return std::vector<int64_t>(demands.size(), -1);
+        }
+
+        // the highest class with an active session takes the bandwidth
+        bool any_active = false;
+        priority_type::e_priority top = priority_type::e_priority::ARCHIVAL;
+        for (const auto &d : demands)
+        {
+            if (d.active && (!any_active || d.priority > top))
+            {
+                top = d.priority;
+                any_active = true;
+            }
+        }
+
+        int64_t total_weight = 0;
+        int64_t throttled = 0;
+        for (const auto &d : demands)
+        {
+            if (any_active && d.active && d.priority == top)
+            {
+                total_weight += std::max(1, d.weight);
+            }
+            else
+            {
+                throttled++;
+            }
+        }
+
+        // the floor of the throttled sessions never takes more than half of the bandwidth
+        int64_t floor = bandwidth * min_share_percent / 100;
+        if (throttled > 0)
+        {
+            floor = std::max<int64_t>(1, std::min(floor, bandwidth / (2 * throttled)));
+        }
+        int64_t available = bandwidth - floor * throttled;
+
+        std::vector<int64_t> rates;
+        rates.reserve(demands.size());
+        for (const auto &d : demands)
+        {
+            if (any_active && d.active && d.priority == top)
+            {
+                rates.push_back(std::max<int64_t>(1, available * std::max(1, d.weight) / total_weight));
+            }
+            else
+            {
+                rates.push_back(floor);
+            }
+        }
+        return rates;
+    }
+
+} // namespace dunedaq::snbmodules
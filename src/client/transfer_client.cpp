@@ -8,6 +8,7 @@
 
 #include "snbmodules/transfer_client.hpp"
 
+#include <algorithm>
 #include <string>
 #include <set>
 #include <vector>
@@ -42,6 +43,23 @@ namespace dunedaq::snbmodules
 
     TransferClient::~TransferClient()
     {
+        if (m_tail_hasher)
+        {
+            m_tail_hasher->stop();
+        }
+    }
+
+    void TransferClient::start_tail_hashing(int piece_size)
+    {
+        if (m_tail_hasher)
+        {
+            return;
+        }
+        m_tail_hasher = std::make_unique<TorrentTailHasher>(get_listening_dir(), piece_size);
+        if (!m_tail_hasher->start())
+        {
+            m_tail_hasher.reset();
+        }
     }
 
     bool TransferClient::start(int timeout)
@@ -60,6 +78,7 @@ namespace dunedaq::snbmodules
                 TLOG() << "debug : no notification received, timeout";
                 return false;
             }
+            m_bandwidth_scheduler.update();
 
             // print status of sessions
             for (const auto &session : m_sessions)
@@ -93,6 +112,9 @@ namespace dunedaq::snbmodules
                     TLOG() << session.to_string();
                 }
             }
+
+            // sessions starting and finishing change the shares of the bandwidth
+            m_bandwidth_scheduler.update();
         }
 
         return true;
@@ -121,7 +143,18 @@ namespace dunedaq::snbmodules
         }
         // Initialize transfer
 
-        GroupMetadata group_transfer(transfer_id, session_name, m_listening_ip, _protocol.value(), protocol_options);
+        // The torrents announce to the tracker of the bookkeeper, unless the transfer names another one
+        nlohmann::json options = protocol_options;
+        if (_protocol.value() == protocol_type::e_protocol_type::BITTORRENT && !(options.is_object() && options.contains("tracker")))
+        {
+            std::lock_guard<std::mutex> lock(m_tracker_url_mutex);
+            if (!m_tracker_url.empty())
+            {
+                options["tracker"] = m_tracker_url;
+            }
+        }
+
+        GroupMetadata group_transfer(transfer_id, session_name, m_listening_ip, _protocol.value(), options);
 
         for (const auto &file : files)
         {
@@ -153,19 +186,9 @@ namespace dunedaq::snbmodules
         // Create local session, can take time depending on protocol
         auto &s = create_session(std::move(group_transfer), e_session_type::Uploader, session_name, get_listening_dir().append(transfer_id), m_listening_ip, dest_clients);
 
-        // Notify clients and sending group metadata
-        for (const auto &client : dest_clients)
-        {
-            std::string new_session_name = generate_session_id(transfer_id, client);
-            TLOG() << "debug : notifying client " << client;
-            send_notification(notification_type::e_notification_type::NEW_TRANSFER, get_client_id(), new_session_name, client, s.get_transfer_options().export_to_string());
-
-            // Send transfer metadata
-            for (auto file : s.get_transfer_options().get_transfers_meta())
-            {
-                send_notification(notification_type::e_notification_type::TRANSFER_METADATA, get_client_id(), new_session_name, client, file->export_to_string());
-            }
-        }
+        // Notify clients and sending group metadata, metadata of files still being prepared are sent by the session once ready
+        TLOG() << "debug : notifying clients of transfer " << transfer_id;
+        s.announce_new_transfer();
     }
 
     void TransferClient::start_transfer(const std::string &transfer_id)
@@ -248,13 +271,19 @@ namespace dunedaq::snbmodules
             ip = get_ip();
         }
 
-        TransferSession new_session(std::move(transfer_options), type, id, ip, work_dir, get_bookkeepers_conn(), get_clients_conn());
-
-        m_sessions.emplace_back(std::move(new_session));
+        // built outside of the lock, the opmon thread is not blocked while the session prepares its files.
+        // The node is then moved into the list, the session itself stays in place
+        std::list<TransferSession> created;
+        created.emplace_back(std::move(transfer_options), type, id, ip, work_dir, get_bookkeepers_conn(), get_clients_conn(), dest_clients);
+        TransferSession &session = created.back();
+        {
+            std::lock_guard<std::mutex> lock(m_sessions_mutex);
+            m_sessions.splice(m_sessions.end(), created);
+        }
         TLOG() << "debug : session created " << TransferSession::session_type_to_string(type);
-        m_sessions.back().set_target_clients(dest_clients);
+        m_bandwidth_scheduler.add_session(session);
 
-        return m_sessions.back();
+        return session;
     }
 
     void TransferClient::share_available_files(const std::set<std::filesystem::path> &to_share, const std::string &dest)
@@ -293,6 +322,13 @@ namespace dunedaq::snbmodules
         case notification_type::e_notification_type::CONNECTION_REQUEST:
         {
             TLOG() << "debug : receive connection request, sending available files";
+            // bookkeepers hosting a tracker give its url, the older ones only their id
+            nlohmann::json request = nlohmann::json::parse(notif.m_data, nullptr, false);
+            if (request.is_object() && request.contains("tracker"))
+            {
+                std::lock_guard<std::mutex> lock(m_tracker_url_mutex);
+                m_tracker_url = request["tracker"].get<std::string>();
+            }
             std::set<std::filesystem::path> to_share;
             scan_available_files(to_share, true);
             share_available_files(to_share, notif.m_source_id);
@@ -317,7 +353,28 @@ namespace dunedaq::snbmodules
 
             TLOG() << "debug : creating session " << notif.m_target_id << " type " << TransferSession::session_type_to_string(type);
             std::string group_id_tmp = metadata.get_group_id();
-            create_session(metadata, type, notif.m_target_id, get_listening_dir().append(group_id_tmp));
+            auto &s = create_session(metadata, type, notif.m_target_id, get_listening_dir().append(group_id_tmp));
+
+            // the uploader introduces the downloaders of the group to each other
+            if (type == Downloader)
+            {
+                s.announce_peer_endpoint(notif.m_source_id);
+            }
+            break;
+        }
+
+        case notification_type::e_notification_type::PEER_ENDPOINTS:
+        {
+            TLOG() << "debug : peer endpoints for " << notif.m_target_id << " from " << notif.m_source_id;
+            TransferSession *ses = get_session(notif.m_target_id);
+            if (ses != nullptr)
+            {
+                ses->add_peer_endpoints(notif.m_source_id, notif.m_data);
+            }
+            else
+            {
+                ers::warning(SessionIDNotFoundInClientError(ERS_HERE, get_client_id(), notif.m_target_id));
+            }
             break;
         }
 
@@ -485,14 +542,31 @@ namespace dunedaq::snbmodules
             ers::warning(SessionIDNotFoundInClientError(ERS_HERE, get_client_id(), session_id));
             return;
         }
-        for (size_t i = 0; i < m_sessions.size(); i++)
+        m_bandwidth_scheduler.remove_session(*s);
+
+        // taken out of the list under the lock, destroyed once no other thread can see it
+        std::list<TransferSession> removed;
+        {
+            std::lock_guard<std::mutex> lock(m_sessions_mutex);
+            auto it = std::find_if(m_sessions.begin(), m_sessions.end(), [s](const TransferSession &ses)
+                                   { return &ses == s; });
+            removed.splice(removed.end(), m_sessions, it);
+        }
+    }
+
+    std::vector<telemetry_sample_t> TransferClient::get_bittorrent_telemetry()
+    {
+        std::vector<telemetry_sample_t> samples;
+        std::lock_guard<std::mutex> lock(m_sessions_mutex);
+        for (auto &session : m_sessions)
         {
-            if (s->get_session_id() == session_id)
+            std::optional<telemetry_sample_t> sample = session.get_bittorrent_telemetry();
+            if (sample.has_value())
             {
-                m_sessions.erase(m_sessions.begin() + i);
-                return;
+                samples.push_back(std::move(sample.value()));
             }
         }
+        return samples;
     }
 
     std::string TransferClient::generate_session_id(const std::string &transferid, const std::string &dest_id /*= ""*/)
@@ -547,6 +621,12 @@ namespace dunedaq::snbmodules
 
         for (const auto &entry : std::filesystem::directory_iterator(folder))
         {
+            // Hidden files and folders are internal (torrent sidecars, caches...)
+            if (entry.path().filename().string()[0] == '.')
+            {
+                continue;
+            }
+
             if (entry.is_regular_file() && entry.path().extension() != GroupMetadata::m_file_extension)
             {
                 if (previous_scan.insert(entry.path()).second)
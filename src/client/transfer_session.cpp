@@ -18,17 +18,23 @@
 namespace dunedaq::snbmodules
 {
 
-    TransferSession::TransferSession(GroupMetadata transfer_options, e_session_type type, std::string id, const IPFormat &ip, std::filesystem::path work_dir, std::vector<std::string> bk_conn /*= std::vector<std::string>()*/, std::set<std::string> client_conn /*= std::set<std::string>()*/)
+    TransferSession::TransferSession(GroupMetadata transfer_options, e_session_type type, std::string id, const IPFormat &ip, std::filesystem::path work_dir, std::vector<std::string> bk_conn /*= std::vector<std::string>()*/, std::set<std::string> client_conn /*= std::set<std::string>()*/, std::set<std::string> target_clients /*= std::set<std::string>()*/)
         : NotificationInterface(std::move(bk_conn), std::move(client_conn)),
           m_type(type),
           m_session_id(std::move(id)),
           m_ip(ip),
           m_transfer_options(std::move(transfer_options)),
           //   m_threads(std::vector<pid_t>()),
-          m_work_dir(std::move(work_dir))
+          m_work_dir(std::move(work_dir)),
+          m_target_clients(std::move(target_clients)),
+          m_prepare_thread([&](std::atomic<bool> &running)
+                           { this->do_prepare_files(running); })
     {
         std::filesystem::create_directories(m_work_dir);
 
+        // files of the uploader prepared in background before being sent
+        bool prepare = false;
+
         // Init transfer interface with the right protocol
         switch (m_transfer_options.get_protocol())
         {
@@ -43,27 +49,8 @@ namespace dunedaq::snbmodules
 
             m_transfer_interface = std::make_unique<TransferInterfaceBittorrent>(m_transfer_options, type == e_session_type::Downloader, get_work_dir(), get_ip());
 
-            // Generate torrent files and magnet links
-            if (type == e_session_type::Uploader)
-            {
-                TLOG() << "Generating torrent files...";
-                dynamic_cast<TransferInterfaceBittorrent &>(*m_transfer_interface).generate_torrents_files(m_work_dir, "");
-
-                for (auto f_meta : m_transfer_options.get_transfers_meta())
-                {
-                    TLOG() << "Writing magnet link data into transfer Metadata " << get_work_dir().append(f_meta->get_file_name() + ".torrent");
-                    lt::error_code ec;
-                    lt::torrent_info t(get_work_dir().append(f_meta->get_file_name() + ".torrent").string(), ec);
-
-                    if (ec)
-                    {
-                        ers::error(BittorrentInvalidTorrentFileError(ERS_HERE, ec.message()));
-                    }
-
-                    TLOG() << "Magnet link: " << lt::make_magnet_uri(t);
-                    f_meta->set_magnet_link(lt::make_magnet_uri(t) + "&x.pe=" + get_ip().get_ip() + ":" + m_transfer_options.get_protocol_options()["port"].get<std::string>());
-                }
-            }
+            // Torrent files and magnet links are generated in background by the preparation thread
+            prepare = type == e_session_type::Uploader;
             break;
 
         case protocol_type::SCP:
@@ -73,6 +60,9 @@ namespace dunedaq::snbmodules
         case protocol_type::RCLONE:
         {
             m_transfer_interface = std::make_unique<TransferInterfaceRClone>(m_transfer_options, get_work_dir());
+
+            // The checksums sent with the files are computed in background by the preparation thread
+            prepare = type == e_session_type::Uploader && dynamic_cast<TransferInterfaceRClone &>(*m_transfer_interface).is_checksum_enabled();
             break;
         }
 
@@ -85,12 +75,30 @@ namespace dunedaq::snbmodules
             break;
         }
 
+        if (prepare)
+        {
+            for (const auto &f_meta : m_transfer_options.get_transfers_meta())
+            {
+                f_meta->set_status(status_type::e_status::PREPARING);
+            }
+        }
+
         TLOG() << "debug : Transfer session " << get_session_id() << " created";
         update_metadatas_to_bookkeeper();
+
+        if (prepare)
+        {
+            m_prepare_thread.start_working_thread();
+        }
     }
 
     TransferSession::~TransferSession()
     {
+        if (m_prepare_thread.thread_running())
+        {
+            m_prepare_thread.stop_working_thread();
+        }
+
         // TLOG() << "Reaping children";
         // for (pid_t pid : m_threads)
         // {
@@ -111,6 +119,190 @@ namespace dunedaq::snbmodules
         TLOG() << "DONE CLOSING SESSION " << get_session_id();
     }
 
+    void TransferSession::do_prepare_files(std::atomic<bool> &running_flag)
+    {
+        std::vector<std::shared_ptr<TransferMetadata>> to_prepare;
+        {
+            std::lock_guard<std::recursive_mutex> lock(m_mutex);
+            to_prepare = m_transfer_options.get_transfers_meta();
+        }
+
+        // RClone files only need their checksums
+        if (m_transfer_options.get_protocol() == protocol_type::RCLONE)
+        {
+            auto &rclone = dynamic_cast<TransferInterfaceRClone &>(*m_transfer_interface);
+            for (const auto &f_meta : to_prepare)
+            {
+                if (!running_flag.load())
+                {
+                    break;
+                }
+                if (f_meta->get_status() != status_type::e_status::PREPARING)
+                {
+                    continue;
+                }
+                rclone.prepare_file(*f_meta, running_flag);
+                publish_prepared_file(*f_meta);
+            }
+            return;
+        }
+
+        auto &bittorrent = dynamic_cast<TransferInterfaceBittorrent &>(*m_transfer_interface);
+
+        // The whole group is hashed at once in a single torrent
+        if (bittorrent.is_single_torrent())
+        {
+            std::vector<TransferMetadata *> files;
+            for (const auto &f_meta : to_prepare)
+            {
+                if (f_meta->get_status() == status_type::e_status::PREPARING)
+                {
+                    files.push_back(f_meta.get());
+                }
+            }
+
+            TLOG() << "debug : Generating torrent file of group " << m_transfer_options.get_group_id() << " for " << files.size() << " files";
+            std::vector<std::string> magnets = bittorrent.generate_group_torrent(files, m_work_dir, bittorrent.get_tracker(), m_target_clients.size());
+            for (size_t i = 0; i < files.size() && running_flag.load(); i++)
+            {
+                publish_prepared_file(*files[i], magnets[i]);
+            }
+            return;
+        }
+
+        for (const auto &f_meta : to_prepare)
+        {
+            if (!running_flag.load())
+            {
+                break;
+            }
+            if (f_meta->get_status() != status_type::e_status::PREPARING)
+            {
+                continue;
+            }
+
+            TLOG() << "debug : Generating torrent file for " << f_meta->get_file_name();
+            std::string magnet = bittorrent.generate_torrent_file(*f_meta, m_work_dir, bittorrent.get_tracker(), m_target_clients.size());
+            publish_prepared_file(*f_meta, magnet);
+        }
+    }
+
+    void TransferSession::publish_prepared_file(TransferMetadata &f_meta, const std::string &magnet /*= ""*/)
+    {
+        bool is_torrent = m_transfer_options.get_protocol() == protocol_type::BITTORRENT;
+
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        if ((is_torrent && magnet.empty()) || f_meta.get_status() != status_type::e_status::WAITING)
+        {
+            // Hashing failed or the file was cancelled meanwhile
+            update_metadata_to_bookkeeper(f_meta);
+            return;
+        }
+
+        if (is_torrent)
+        {
+            auto &bittorrent = dynamic_cast<TransferInterfaceBittorrent &>(*m_transfer_interface);
+            TLOG() << "debug : Magnet link: " << magnet;
+            // the session can be shared with other transfers, and listen on the port of the first one
+            f_meta.set_magnet_link(magnet + "&x.pe=" + get_ip().get_ip() + ":" + std::to_string(bittorrent.get_listen_port()));
+        }
+
+        // The file can be transferred right away, even if others are still being prepared
+        if (m_announced)
+        {
+            send_notification_to_targets(notification_type::e_notification_type::TRANSFER_METADATA, f_meta.export_to_string());
+        }
+        if (m_start_requested)
+        {
+            upload_file(f_meta);
+        }
+        else
+        {
+            update_metadata_to_bookkeeper(f_meta);
+        }
+    }
+
+    void TransferSession::announce_new_transfer()
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+        send_notification_to_targets(notification_type::e_notification_type::NEW_TRANSFER, m_transfer_options.export_to_string());
+
+        // Send metadata of the files ready to be transferred, others are sent once prepared
+        for (const auto &f_meta : m_transfer_options.get_transfers_meta())
+        {
+            if (f_meta->get_status() != status_type::e_status::PREPARING && f_meta->get_status() != status_type::e_status::HASHING)
+            {
+                send_notification_to_targets(notification_type::e_notification_type::TRANSFER_METADATA, f_meta->export_to_string());
+            }
+        }
+        m_announced = true;
+    }
+
+    void TransferSession::announce_peer_endpoint(const std::string &uploader_session)
+    {
+        if (!is_downloader() || m_transfer_options.get_protocol() != protocol_type::BITTORRENT)
+        {
+            return;
+        }
+
+        auto &bittorrent = dynamic_cast<TransferInterfaceBittorrent &>(*m_transfer_interface);
+        if (!bittorrent.is_swarm_enabled())
+        {
+            return;
+        }
+
+        nlohmann::json endpoints = nlohmann::json::array({get_ip().get_ip() + ":" + std::to_string(bittorrent.get_listen_port())});
+        std::string uploader = uploader_session.substr(0, uploader_session.find("_ses"));
+        send_notification(notification_type::e_notification_type::PEER_ENDPOINTS, get_session_id(), uploader_session, uploader, endpoints.dump());
+    }
+
+    void TransferSession::add_peer_endpoints(const std::string &source, const std::string &data)
+    {
+        if (m_transfer_options.get_protocol() != protocol_type::BITTORRENT)
+        {
+            ers::warning(SessionAccessToIncorrectActionError(ERS_HERE, get_session_id(), "add_peer_endpoints"));
+            return;
+        }
+
+        std::vector<std::string> endpoints;
+        try
+        {
+            endpoints = nlohmann::json::parse(data).get<std::vector<std::string>>();
+        }
+        catch (const nlohmann::json::exception &)
+        {
+            ers::warning(InvalidNotificationReceivedError(ERS_HERE, get_session_id(), source, data));
+            return;
+        }
+
+        if (is_downloader())
+        {
+            dynamic_cast<TransferInterfaceBittorrent &>(*m_transfer_interface).add_peers(endpoints);
+            return;
+        }
+
+        // Uploader: the new downloader gets the endpoints already known, the others get its endpoint
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        std::string client = source.substr(0, source.find("_ses"));
+        std::vector<std::string> known;
+        for (const auto &[other, other_endpoints] : m_peer_endpoints)
+        {
+            if (other == client)
+            {
+                continue;
+            }
+            known.insert(known.end(), other_endpoints.begin(), other_endpoints.end());
+            send_notification(notification_type::e_notification_type::PEER_ENDPOINTS, get_session_id(), other + "_ses" + m_transfer_options.get_group_id(), other, data);
+        }
+        m_peer_endpoints[client] = std::move(endpoints);
+
+        if (!known.empty())
+        {
+            send_notification(notification_type::e_notification_type::PEER_ENDPOINTS, get_session_id(), source, client, nlohmann::json(known).dump());
+        }
+    }
+
     bool TransferSession::action_on_receive_notification(NotificationData notif)
     {
         (void)notif;
@@ -293,6 +485,8 @@ namespace dunedaq::snbmodules
 
     bool TransferSession::upload_file(TransferMetadata &f_meta, bool is_multiple)
     {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
         if (m_type != e_session_type::Uploader)
         {
             ers::warning(SessionAccessToIncorrectActionError(ERS_HERE, get_session_id(), "upload_file"));
@@ -414,6 +608,31 @@ namespace dunedaq::snbmodules
         return result;
     }
 
+    bool TransferSession::is_active()
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+        return m_transfer_options.get_group_status() >= status_type::e_status::CHECKING;
+    }
+
+    bool TransferSession::set_rate_limit(int64_t bytes_per_second)
+    {
+        if (m_transfer_interface == nullptr)
+        {
+            return false;
+        }
+        return m_transfer_interface->set_rate_limit(bytes_per_second);
+    }
+
+    std::optional<telemetry_sample_t> TransferSession::get_bittorrent_telemetry()
+    {
+        auto *bittorrent = dynamic_cast<TransferInterfaceBittorrent *>(m_transfer_interface.get());
+        if (bittorrent == nullptr)
+        {
+            return std::nullopt;
+        }
+        return bittorrent->get_telemetry().get_last_sample();
+    }
+
     // Downloaders only
     bool TransferSession::download_all(const std::filesystem::path &dest)
     {
@@ -423,9 +642,33 @@ namespace dunedaq::snbmodules
         }
 
         bool result = true;
-        for (auto file : m_transfer_options.get_transfers_meta())
+        std::vector<TransferMetadata *> files;
+        for (const auto &file : m_transfer_options.get_transfers_meta())
         {
-            result = result && download_file(*file, dest, true);
+            if (file->get_status() != status_type::e_status::WAITING)
+            {
+                ers::warning(SessionWrongStateTransitionError(ERS_HERE, get_session_id(), file->get_file_name(), status_type::status_to_string(file->get_status()), status_type::status_to_string(status_type::e_status::DOWNLOADING)));
+                result = false;
+                continue;
+            }
+            files.push_back(file.get());
+        }
+
+        if (!files.empty())
+        {
+            // wait for the uploader to be ready
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+
+            for (TransferMetadata *f_meta : files)
+            {
+                f_meta->set_status(status_type::e_status::DOWNLOADING);
+            }
+
+            // the protocol can start every file in one request, it puts in error the files it could not start
+            if (!m_transfer_interface->download_files(files, dest))
+            {
+                result = false;
+            }
         }
         update_metadatas_to_bookkeeper();
         return result;
@@ -439,10 +682,24 @@ namespace dunedaq::snbmodules
             ers::warning(SessionAccessToIncorrectActionError(ERS_HERE, get_session_id(), "upload_all"));
         }
 
+        std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
         bool result = true;
         for (auto file : m_transfer_options.get_transfers_meta())
         {
-            result = result && upload_file(*file, true);
+            if (file->get_status() == status_type::e_status::PREPARING || file->get_status() == status_type::e_status::HASHING)
+            {
+                // Will be started by the preparation thread once ready
+                m_start_requested = true;
+                continue;
+            }
+            if (file->get_status() == status_type::e_status::ERROR)
+            {
+                // failed while prepared, already reported. The other files of the group are still sent
+                result = false;
+                continue;
+            }
+            result = upload_file(*file, true) && result;
         }
         send_notification_to_targets(notification_type::e_notification_type::START_TRANSFER);
         update_metadatas_to_bookkeeper();
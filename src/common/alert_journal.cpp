@@ -0,0 +1,107 @@
+/**
+ * @file alert_journal.cpp AlertJournal class, buffered asynchronous log of the libtorrent alerts
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/alert_journal.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <chrono>
+#include <string>
+
+namespace dunedaq::snbmodules
+{
+
+    AlertJournal::AlertJournal(const std::filesystem::path &file, size_t flush_size)
+        : m_flush_size(flush_size),
+          m_thread([&](std::atomic<bool> &running)
+                   { this->do_work(running); })
+    {
+        m_file = std::fopen(file.c_str(), "w");
+        if (m_file == nullptr)
+        {
+            TLOG() << "debug : cannot open alert journal " << file.string();
+            return;
+        }
+        m_buffer.reserve(m_flush_size * 2);
+        m_thread.start_working_thread();
+    }
+
+    AlertJournal::~AlertJournal()
+    {
+        if (m_thread.thread_running())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+            }
+            m_cv.notify_all();
+            m_thread.stop_working_thread();
+        }
+        if (m_file != nullptr)
+        {
+            write_pending();
+            std::fclose(m_file);
+        }
+    }
+
+    void AlertJournal::log(lt::alert const *a)
+    {
+        if (m_file == nullptr)
+        {
+            return;
+        }
+
+        if (!m_has_first_ts)
+        {
+            m_first_ts = a->timestamp();
+            m_has_first_ts = true;
+        }
+        std::string line = "[" + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(a->timestamp() - m_first_ts).count()) + "] " + a->message() + "\n";
+
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_buffer += line;
+            wake = m_buffer.size() >= m_flush_size;
+        }
+        if (wake)
+        {
+            m_cv.notify_one();
+        }
+    }
+
+    void AlertJournal::write_pending()
+    {
+        std::string out;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            out.swap(m_buffer);
+            m_buffer.reserve(m_flush_size * 2);
+        }
+        if (!out.empty())
+        {
+            std::fwrite(out.data(), 1, out.size(), m_file);
+            std::fflush(m_file);
+        }
+    }
+
+    void AlertJournal::do_work(std::atomic<bool> &running_flag)
+    {
+        while (running_flag.load())
+        {
+            {
+                // written at least every second, even if the buffer is not full
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait_for(lock, std::chrono::seconds(1), [&]()
+                              { return m_buffer.size() >= m_flush_size || m_stopping; });
+            }
+            write_pending();
+        }
+    }
+
+} // namespace dunedaq::snbmodules
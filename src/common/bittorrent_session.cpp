@@ -0,0 +1,468 @@
+/**
+ * @file bittorrent_session.cpp BittorrentSession class, libtorrent session shared by the bittorrent transfers of a client
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/bittorrent_session.hpp"
+
+#include "libtorrent/session_stats.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+    // Sizes given to a session when the memory budget allows it
+    static constexpr int64_t max_queued_disk_bytes = 1024 * 1024 * 1024;
+    static constexpr int64_t max_socket_buffer = 1024 * 1024 * 1024;
+    static constexpr int64_t default_disk_buffer = 256 * 1024 * 1024;
+
+    BittorrentSession::BittorrentSession(const IPFormat &listen_interface, bool is_client, const nlohmann::json &protocol_options)
+        : m_is_client(is_client),
+          m_memory(MemoryBudget::get().reserve("bittorrent " + std::string(is_client ? "client " : "seeder ") + listen_interface.get_ip(),
+                                               wanted_memory(is_client, protocol_options))),
+          m_session(make_params(listen_interface, is_client, protocol_options, m_memory->get_bytes())),
+          m_thread([&](std::atomic<bool> &running)
+                   { this->do_work(running); })
+    {
+        // The alert thread sleeps until libtorrent has something for it
+        m_session.set_alert_notify([this]()
+                                   {
+            {
+                std::lock_guard<std::mutex> lock(m_alert_mutex);
+                m_alert_pending = true;
+            }
+            m_alert_cv.notify_one(); });
+
+        // the queues and buffers follow the share of the session, the disk buffer of the sequential disk backend
+        // keeps the size it was created with
+        m_memory->set_on_resize([this, is_client, protocol_options](uint64_t bytes)
+                                {
+            lt::settings_pack p;
+            set_memory_settings(p, is_client, protocol_options, bytes);
+            m_session.apply_settings(std::move(p)); });
+
+        m_thread.start_working_thread();
+    }
+
+    BittorrentSession::~BittorrentSession()
+    {
+        m_memory->set_on_resize(nullptr);
+        m_thread.stop_working_thread();
+        m_session.set_alert_notify([]() {});
+    }
+
+    void BittorrentSession::track(torrent_entry_t *entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.insert(entry);
+    }
+
+    void BittorrentSession::forget(torrent_entry_t *entry)
+    {
+        // waits for the alerts being dispatched
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.erase(entry);
+        auto it = m_by_handle.find(entry->handle);
+        if (it != m_by_handle.end() && it->second == entry)
+        {
+            m_by_handle.erase(it);
+        }
+    }
+
+    lt::torrent_handle BittorrentSession::get_handle(torrent_entry_t *entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return entry->handle;
+    }
+
+    void BittorrentSession::dispatch(lt::alert const *a)
+    {
+        if (auto at = lt::alert_cast<lt::add_torrent_alert>(a))
+        {
+            auto *entry = at->params.userdata.get<torrent_entry_t *>();
+            if (entry == nullptr || m_entries.count(entry) == 0)
+            {
+                // the transfer adding it is gone meanwhile
+                if (!at->error)
+                {
+                    m_session.remove_torrent(at->handle);
+                }
+                return;
+            }
+            if (!at->error)
+            {
+                entry->handle = at->handle;
+                m_by_handle[at->handle] = entry;
+            }
+            entry->owner->on_alert(*entry, a);
+            return;
+        }
+
+        if (auto st = lt::alert_cast<lt::state_update_alert>(a))
+        {
+            for (lt::torrent_status const &s : st->status)
+            {
+                auto it = m_by_handle.find(s.handle);
+                if (it != m_by_handle.end())
+                {
+                    it->second->owner->on_status(*it->second, s);
+                }
+            }
+            return;
+        }
+
+        if (auto ta = dynamic_cast<lt::torrent_alert const *>(a))
+        {
+            auto it = m_by_handle.find(ta->handle);
+            if (it != m_by_handle.end())
+            {
+                it->second->owner->on_alert(*it->second, a);
+            }
+            return;
+        }
+
+        // session wide alerts
+        if (auto la = lt::alert_cast<lt::listen_failed_alert>(a))
+        {
+            ers::error(BittorrentError(ERS_HERE, la->message()));
+        }
+        else if (auto ls = lt::alert_cast<lt::listen_succeeded_alert>(a))
+        {
+            TLOG() << "debug : " << ls->message();
+        }
+        else if (auto ss = lt::alert_cast<lt::session_stats_alert>(a))
+        {
+            // memory used by the write queue and disk cache blocks of 16 KiB, the socket buffers are kernel memory.
+            // The depth of the disk queue is kept for the telemetry of the transfers
+            static const int queued_idx = lt::find_metric_idx("disk.queued_write_bytes");
+            static const int blocks_idx = lt::find_metric_idx("disk.disk_blocks_in_use");
+            static const int jobs_idx = lt::find_metric_idx("disk.queued_disk_jobs");
+            auto counters = ss->counters();
+            int64_t used = 0;
+            if (queued_idx >= 0)
+            {
+                used += counters[queued_idx];
+                m_queued_write_bytes = counters[queued_idx];
+            }
+            if (jobs_idx >= 0)
+            {
+                m_queued_disk_jobs = counters[jobs_idx];
+            }
+            if (blocks_idx >= 0)
+            {
+                used += counters[blocks_idx] * 16 * 1024;
+            }
+            m_memory->set_used(static_cast<uint64_t>(std::max<int64_t>(used, 0)));
+        }
+        else if (a->category() & lt::alert_category::error)
+        {
+            ers::warning(BittorrentError(ERS_HERE, a->message()));
+        }
+    }
+
+    void BittorrentSession::do_work(std::atomic<bool> &running_flag)
+    {
+        auto next_update = std::chrono::steady_clock::now();
+        auto next_stats = std::chrono::steady_clock::now();
+
+        while (running_flag.load())
+        {
+            std::vector<lt::alert *> alerts;
+            m_session.pop_alerts(&alerts);
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (lt::alert const *a : alerts)
+                {
+                    dispatch(a);
+                }
+            }
+
+            // one status update for every torrent of the session
+            if (std::chrono::steady_clock::now() >= next_update)
+            {
+                m_session.post_torrent_updates();
+                next_update = std::chrono::steady_clock::now() + m_update_interval;
+            }
+            if (std::chrono::steady_clock::now() >= next_stats)
+            {
+                m_session.post_session_stats();
+                next_stats = std::chrono::steady_clock::now() + m_stats_interval;
+            }
+
+            // wait for new alerts, or the next status update
+            std::unique_lock<std::mutex> lock(m_alert_mutex);
+            m_alert_cv.wait_until(lock, next_update, [&]()
+                                  { return m_alert_pending || !running_flag.load(); });
+            m_alert_pending = false;
+        }
+    }
+
+    uint64_t BittorrentSession::wanted_memory(bool is_client, const nlohmann::json &protocol_options)
+    {
+        // receive socket buffer for the downloaders, send buffer and send socket buffer for the seeders
+        int64_t wanted = max_queued_disk_bytes + (is_client ? 1 : 2) * max_socket_buffer;
+
+        std::string disk_io = protocol_options.contains("disk_io") ? protocol_options["disk_io"].get<std::string>() : "default";
+        if (disk_io == "sequential" || disk_io == "mmap")
+        {
+            wanted += protocol_options.contains("disk_buffer") ? protocol_options["disk_buffer"].get<int64_t>() : default_disk_buffer;
+        }
+        return static_cast<uint64_t>(wanted);
+    }
+
+    lt::session_params BittorrentSession::make_params(const IPFormat &listen_interface, bool is_client, const nlohmann::json &protocol_options, uint64_t memory)
+    {
+        lt::session_params sp;
+        auto &p = sp.settings;
+        std::string listen_port = protocol_options["port"].get<std::string>();
+
+        // every size is reduced in the same proportion when the reserved memory is less than wanted
+        double memory_ratio = std::min(1.0, static_cast<double>(memory) / static_cast<double>(wanted_memory(is_client, protocol_options)));
+        auto scaled = [memory_ratio](int64_t bytes)
+        { return static_cast<int64_t>(static_cast<double>(bytes) * memory_ratio); };
+
+        std::string disk_io = protocol_options.contains("disk_io") ? protocol_options["disk_io"].get<std::string>() : "default";
+        if (disk_io == "sequential" || disk_io == "mmap")
+        {
+            unsigned int disk_threads = protocol_options.contains("disk_threads") ? protocol_options["disk_threads"].get<unsigned int>() : 4;
+            int64_t disk_buffer = scaled(protocol_options.contains("disk_buffer") ? protocol_options["disk_buffer"].get<int64_t>() : default_disk_buffer);
+            // Seeders only read files that do not change anymore, they are served from memory mappings
+            bool map_files = disk_io == "mmap" && !is_client;
+            sp.disk_io_constructor = SequentialDiskIO::constructor(disk_threads, disk_buffer, map_files);
+        }
+        else
+        {
+            if (disk_io != "default")
+            {
+                ers::warning(ConfigError(ERS_HERE, "unknown disk_io " + disk_io + ", using default"));
+            }
+            sp.disk_io_constructor = lt::default_disk_io_constructor;
+        }
+
+        int block_size = 1024 * 1024;
+        std::string outgoing_interface = listen_interface.get_ip();
+        std::string listen_interfaces = listen_interface.get_ip() + ":" + listen_port;
+
+        p.set_bool(lt::settings_pack::enable_dht, false);
+        p.set_int(lt::settings_pack::auto_manage_interval, 60);
+        p.set_int(lt::settings_pack::auto_manage_startup, 1);
+        p.set_int(lt::settings_pack::min_reconnect_time, 1);
+        p.set_int(lt::settings_pack::max_failcount, 10);
+
+        // p.set_str(lt::settings_pack::dht_bootstrap_nodes, "192.168.0.105:5001,192.168.0.106:5002");
+        // p.set_bool(lt::settings_pack::use_dht_as_fallback, false);
+        // p.set_bool(lt::settings_pack::dht_prefer_verified_node_ids, false);
+        // p.set_bool(lt::settings_pack::dht_restrict_routing_ips, false);
+        // p.set_bool(lt::settings_pack::dht_restrict_search_ips, false);
+
+        p.set_str(lt::settings_pack::outgoing_interfaces, outgoing_interface);
+        p.set_bool(lt::settings_pack::strict_end_game_mode, false);
+        // p.set_bool(lt::settings_pack::low_prio_disk, false);
+        p.set_bool(lt::settings_pack::smooth_connects, false);
+        p.set_bool(lt::settings_pack::allow_multiple_connections_per_ip, true);
+        p.set_bool(lt::settings_pack::announce_to_all_tiers, true);
+        p.set_bool(lt::settings_pack::announce_to_all_trackers, true);
+        p.set_bool(lt::settings_pack::auto_sequential, true);
+        // p.set_bool(lt::settings_pack::coalesce_reads, true);
+        // p.set_bool(lt::settings_pack::coalesce_writes, true);
+        // p.set_bool(lt::settings_pack::contiguous_recv_buffer, true);
+        p.set_bool(lt::settings_pack::incoming_starts_queued_torrents, true);
+
+        p.set_bool(lt::settings_pack::enable_incoming_tcp, true);
+        p.set_bool(lt::settings_pack::enable_outgoing_tcp, true);
+        p.set_bool(lt::settings_pack::enable_incoming_utp, false);
+        p.set_bool(lt::settings_pack::enable_outgoing_utp, false);
+        p.set_bool(lt::settings_pack::enable_lsd, false);
+        p.set_bool(lt::settings_pack::enable_natpmp, false);
+        p.set_bool(lt::settings_pack::enable_upnp, false);
+        p.set_bool(lt::settings_pack::prefer_rc4, false);
+        p.set_bool(lt::settings_pack::prefer_udp_trackers, true);
+        p.set_bool(lt::settings_pack::rate_limit_ip_overhead, false);
+        // p.set_bool(lt::settings_pack::rate_limit_utp, false);
+
+        p.set_int(lt::settings_pack::aio_threads, 1);
+        // p.set_int(lt::settings_pack::network_threads, 1);
+        p.set_int(lt::settings_pack::hashing_threads, 1);
+        p.set_int(lt::settings_pack::disk_io_read_mode, 3);
+        p.set_int(lt::settings_pack::disk_io_write_mode, 3);
+        p.set_int(lt::settings_pack::allowed_enc_level, 3);
+        p.set_int(lt::settings_pack::allowed_fast_set_size, 5);
+        p.set_int(lt::settings_pack::seed_choking_algorithm, 1);
+        p.set_int(lt::settings_pack::choking_algorithm, 0);
+        p.set_int(lt::settings_pack::in_enc_policy, 2);
+        p.set_int(lt::settings_pack::out_enc_policy, 2);
+        p.set_int(lt::settings_pack::mixed_mode_algorithm, 0);
+        p.set_int(lt::settings_pack::suggest_mode, 0);
+
+        p.set_int(lt::settings_pack::close_file_interval, 0);
+        p.set_int(lt::settings_pack::inactivity_timeout, 10);
+        p.set_int(lt::settings_pack::request_queue_time, 50);
+        p.set_int(lt::settings_pack::peer_timeout, 20);
+        p.set_int(lt::settings_pack::request_timeout, 10);
+        p.set_int(lt::settings_pack::predictive_piece_announce, 20);
+        p.set_int(lt::settings_pack::whole_pieces_threshold, 20);
+        p.set_int(lt::settings_pack::mmap_file_size_cutoff, 0);
+
+        // limits in bytes per seconds
+        p.set_int(lt::settings_pack::upload_rate_limit, 0);
+        p.set_int(lt::settings_pack::download_rate_limit, 0);
+        // p.set_int(lt::settings_pack::local_download_rate_limit, 0);
+        // p.set_int(lt::settings_pack::local_upload_rate_limit, 0);
+        p.set_int(lt::settings_pack::unchoke_slots_limit, -1);
+        p.set_int(lt::settings_pack::max_failcount, 3);
+        p.set_int(lt::settings_pack::max_http_recv_buffer_size, 1024 * 1024 * 8);
+        p.set_int(lt::settings_pack::max_rejects, 20);
+
+        p.set_int(lt::settings_pack::read_cache_line_size, 512);
+        // p.set_int(lt::settings_pack::cache_buffer_chunk_size, 512);
+        // p.set_int(lt::settings_pack::cache_expiry, 400);
+        p.set_int(lt::settings_pack::cache_size_volatile, 128);
+        p.set_int(lt::settings_pack::checking_mem_usage, 1024);
+        // p.set_bool(lt::settings_pack::use_read_cache, true);
+        // p.set_bool(lt::settings_pack::use_write_cache, true);
+        // p.set_bool(lt::settings_pack::use_disk_read_ahead, true);
+        p.set_bool(lt::settings_pack::use_parole_mode, false);
+        // p.set_bool(lt::settings_pack::guided_read_cache, true);
+        // p.set_bool(lt::settings_pack::volatile_read_cache, false);
+        p.set_int(lt::settings_pack::tracker_completion_timeout, 30);
+        p.set_int(lt::settings_pack::tracker_receive_timeout, 30);
+        p.set_int(lt::settings_pack::stop_tracker_timeout, 30);
+        p.set_int(lt::settings_pack::tracker_backoff, 250);
+        p.set_int(lt::settings_pack::tracker_maximum_response_length, 1024 * 1024 * 8);
+        p.set_bool(lt::settings_pack::validate_https_trackers, false);
+        // Only the alerts handled by the transfers, everything when they are journaled
+        bool alert_log = protocol_options.contains("alert_log") && protocol_options["alert_log"].get<bool>();
+        p.set_int(lt::settings_pack::alert_mask, alert_log ? lt::alert_category::all : lt::alert_category::error | lt::alert_category::status | lt::alert_category::storage | lt::alert_category::connect | lt::alert_category::peer);
+
+        p.set_str(lt::settings_pack::listen_interfaces, listen_interfaces);
+
+        if (is_client)
+        {
+            // p.set_str(lt::settings_pack::user_agent, "DuneTorrentClient");
+            p.set_bool(lt::settings_pack::piece_extent_affinity, true);
+            p.set_bool(lt::settings_pack::seeding_outgoing_connections, false);
+
+            p.set_int(lt::settings_pack::tick_interval, 500);
+            p.set_int(lt::settings_pack::torrent_connect_boost, 255);
+
+            p.set_int(lt::settings_pack::connection_speed, 0);
+            p.set_int(lt::settings_pack::active_seeds, 0);
+            p.set_int(lt::settings_pack::active_downloads, 10);
+            p.set_int(lt::settings_pack::active_checking, 10);
+            p.set_int(lt::settings_pack::active_limit, 10);
+            p.set_int(lt::settings_pack::active_tracker_limit, 10);
+            p.set_int(lt::settings_pack::connections_limit, 10);
+            // p.set_int(lt::settings_pack::half_open_limit, 500);
+            p.set_int(lt::settings_pack::file_pool_size, 10);
+            p.set_int(lt::settings_pack::listen_queue_size, 10);
+            p.set_int(lt::settings_pack::max_allowed_in_request_queue, 50000);
+            p.set_int(lt::settings_pack::max_out_request_queue, 50000);
+            p.set_int(lt::settings_pack::dht_upload_rate_limit, block_size * 10);
+
+            p.set_int(lt::settings_pack::write_cache_line_size, 512);
+            // p.set_int(lt::settings_pack::cache_size, 1024 * 1);
+            // p.set_bool(lt::settings_pack::use_disk_cache_pool, true);
+            // p.set_bool(lt::settings_pack::allow_partial_disk_writes, false);
+
+            p.set_int(lt::settings_pack::send_buffer_watermark_factor, 50);
+            p.set_int(lt::settings_pack::send_buffer_low_watermark, 1024 * 10);
+            p.set_int(lt::settings_pack::send_buffer_watermark, 1024 * 500);
+            p.set_int(lt::settings_pack::send_socket_buffer_size, 1024 * 512);
+
+            p.set_bool(lt::settings_pack::no_atime_storage, true);
+            p.set_bool(lt::settings_pack::enable_set_file_valid_data, false);
+            p.set_int(lt::settings_pack::disk_write_mode, 1);
+            p.set_bool(lt::settings_pack::disable_hash_checks, false);
+        }
+        else
+        {
+
+            // p.set_str(lt::settings_pack::user_agent, "DuneTorrentSeeder");
+            p.set_bool(lt::settings_pack::piece_extent_affinity, false);
+            p.set_bool(lt::settings_pack::seeding_outgoing_connections, true);
+
+            p.set_int(lt::settings_pack::tick_interval, 150);
+            p.set_int(lt::settings_pack::torrent_connect_boost, 255);
+
+            p.set_int(lt::settings_pack::connection_speed, 200);
+            p.set_int(lt::settings_pack::active_seeds, 1000);
+            p.set_int(lt::settings_pack::active_downloads, 0);
+            p.set_int(lt::settings_pack::active_checking, 1000);
+            p.set_int(lt::settings_pack::active_limit, 2000);
+            p.set_int(lt::settings_pack::active_tracker_limit, 2000);
+            p.set_int(lt::settings_pack::connections_limit, 8000);
+            // p.set_int(lt::settings_pack::half_open_limit, 50);
+            p.set_int(lt::settings_pack::file_pool_size, 20);
+            p.set_int(lt::settings_pack::listen_queue_size, 3000);
+            p.set_int(lt::settings_pack::max_allowed_in_request_queue, 2000);
+            p.set_int(lt::settings_pack::max_out_request_queue, 2000);
+            p.set_int(lt::settings_pack::dht_upload_rate_limit, block_size * 8);
+
+            p.set_int(lt::settings_pack::write_cache_line_size, 128);
+            // p.set_int(lt::settings_pack::cache_size, 1024 * 50);
+            // p.set_bool(lt::settings_pack::use_disk_cache_pool, false);
+            // p.set_bool(lt::settings_pack::allow_partial_disk_writes, false);
+
+            p.set_int(lt::settings_pack::send_buffer_watermark_factor, 150);
+            p.set_int(lt::settings_pack::send_buffer_low_watermark, 1024 * 10);
+            p.set_int(lt::settings_pack::recv_socket_buffer_size, 1024 * 512);
+
+            // p.set_bool(lt::settings_pack::no_atime_storage, true);
+            // p.set_bool(lt::settings_pack::enable_set_file_valid_data, false);
+            // p.set_int(lt::settings_pack::disk_write_mode, 1);
+            // p.set_bool(lt::settings_pack::disable_hash_checks, false);
+        }
+
+        set_memory_settings(p, is_client, protocol_options, memory);
+        return sp;
+    }
+
+    void BittorrentSession::set_memory_settings(lt::settings_pack &p, bool is_client, const nlohmann::json &protocol_options, uint64_t memory)
+    {
+        // every size is reduced in the same proportion when the reserved memory is less than wanted
+        double memory_ratio = std::min(1.0, static_cast<double>(memory) / static_cast<double>(wanted_memory(is_client, protocol_options)));
+        auto scaled = [memory_ratio](int64_t bytes)
+        { return static_cast<int>(static_cast<double>(bytes) * memory_ratio); };
+
+        p.set_int(lt::settings_pack::max_queued_disk_bytes, scaled(max_queued_disk_bytes));
+        if (is_client)
+        {
+            p.set_int(lt::settings_pack::recv_socket_buffer_size, scaled(max_socket_buffer));
+        }
+        else
+        {
+            p.set_int(lt::settings_pack::send_buffer_watermark, scaled(max_socket_buffer));
+            p.set_int(lt::settings_pack::send_socket_buffer_size, scaled(max_socket_buffer));
+        }
+    }
+
+
+    std::shared_ptr<BittorrentSession> BittorrentSessionPool::get_session(const IPFormat &listen_interface, bool is_client, const nlohmann::json &protocol_options)
+    {
+        if (protocol_options.contains("shared_session") && !protocol_options["shared_session"].get<bool>())
+        {
+            return std::make_shared<BittorrentSession>(listen_interface, is_client, protocol_options);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::string key = listen_interface.get_ip() + (is_client ? "/client" : "/seeder");
+        std::shared_ptr<BittorrentSession> session = m_sessions[key].lock();
+        if (!session)
+        {
+            TLOG() << "debug : new bittorrent session " << key;
+            session = std::make_shared<BittorrentSession>(listen_interface, is_client, protocol_options);
+            m_sessions[key] = session;
+        }
+        return session;
+    }
+
+} // namespace dunedaq::snbmodules
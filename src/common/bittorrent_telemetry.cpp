@@ -0,0 +1,169 @@
+/**
+ * @file bittorrent_telemetry.cpp BittorrentTelemetry class, periodic samples of the peers and queues of the torrents of a transfer
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/bittorrent_telemetry.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+
+    std::string telemetry_sample_t::to_string() const
+    {
+        std::ostringstream out;
+        out << "peers " << peers
+            << " down " << download_rate << " B/s up " << upload_rate << " B/s"
+            << " chokes " << chokes << " unchokes " << unchokes
+            << " download queue " << download_queue
+            << " request latency " << request_latency_ms << " ms"
+            << " disk queue " << queued_disk_jobs << " jobs " << queued_write_bytes << " B";
+        if (!slowest_peer.empty())
+        {
+            out << " slowest peer " << slowest_peer << " " << slowest_peer_rate << " B/s";
+        }
+        return out.str();
+    }
+
+    BittorrentTelemetry::BittorrentTelemetry(bool is_client, size_t capacity)
+        : m_is_client(is_client),
+          m_capacity(capacity)
+    {
+    }
+
+    telemetry_sample_t BittorrentTelemetry::sample(const std::vector<lt::torrent_handle> &handles, const BittorrentSession &session)
+    {
+        // query the torrents before locking, every call waits for the network thread of the session
+        std::map<lt::torrent_handle, session_state_t> states;
+        for (const auto &h : handles)
+        {
+            session_state_t &state = states[h];
+            h.get_peer_info(state.peers);
+            state.download_queue = h.get_download_queue();
+        }
+
+        telemetry_sample_t sample;
+        sample.time = std::chrono::system_clock::now();
+        sample.queued_disk_jobs = session.get_queued_disk_jobs();
+        sample.queued_write_bytes = session.get_queued_write_bytes();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::map<std::string, peer_telemetry_t> peers;
+        std::map<std::pair<lt::torrent_handle, std::string>, bool> choked;
+        int64_t queued_blocks = 0;
+        int64_t queued_latency = 0;
+
+        for (const auto &[handle, state] : states)
+        {
+            for (const auto &p : state.peers)
+            {
+                std::string endpoint = p.ip.address().to_string() + ":" + std::to_string(p.ip.port());
+
+                // the downloaders wait for the peers to unchoke them, the seeders choose who they unchoke
+                bool is_choked = m_is_client ? static_cast<bool>(p.flags & lt::peer_info::remote_choked) : static_cast<bool>(p.flags & lt::peer_info::choked);
+                auto connection = std::make_pair(handle, endpoint);
+                choked[connection] = is_choked;
+
+                auto &peer = peers[endpoint];
+                auto previous = m_peers.find(endpoint);
+                if (peer.endpoint.empty() && previous != m_peers.end())
+                {
+                    peer.chokes = previous->second.chokes;
+                    peer.unchokes = previous->second.unchokes;
+                }
+                auto was_choked = m_choked.find(connection);
+                if (was_choked != m_choked.end() && was_choked->second != is_choked)
+                {
+                    (is_choked ? peer.chokes : peer.unchokes)++;
+                    (is_choked ? sample.chokes : sample.unchokes)++;
+                }
+
+                peer.endpoint = endpoint;
+                peer.client = p.client;
+                peer.download_rate += p.payload_down_speed;
+                peer.upload_rate += p.payload_up_speed;
+                peer.total_download += p.total_download;
+                peer.total_upload += p.total_upload;
+                peer.choked = peer.choked || is_choked;
+                peer.rtt_ms = std::max(peer.rtt_ms, p.rtt);
+                peer.queue_time_ms = std::max<int64_t>(peer.queue_time_ms, std::chrono::duration_cast<std::chrono::milliseconds>(p.download_queue_time).count());
+                peer.queue_length += p.download_queue_length;
+
+                sample.download_rate += p.payload_down_speed;
+                sample.upload_rate += p.payload_up_speed;
+
+                // the peers with more blocks requested weigh more, each of them waits for the queue of its peer
+                queued_blocks += p.download_queue_length;
+                queued_latency += std::chrono::duration_cast<std::chrono::milliseconds>(p.download_queue_time).count() * p.download_queue_length;
+            }
+            sample.download_queue += static_cast<int>(state.download_queue.size());
+        }
+        sample.request_latency_ms = queued_blocks > 0 ? queued_latency / queued_blocks : -1;
+
+        // the slowest among the peers actually exchanging pieces
+        for (const auto &[endpoint, peer] : peers)
+        {
+            int64_t rate = m_is_client ? peer.download_rate : peer.upload_rate;
+            if (rate > 0 && (sample.slowest_peer.empty() || rate < sample.slowest_peer_rate))
+            {
+                sample.slowest_peer = endpoint;
+                sample.slowest_peer_rate = rate;
+            }
+        }
+        sample.peers = static_cast<int>(peers.size());
+
+        m_peers = std::move(peers);
+        m_choked = std::move(choked);
+        m_torrents_state = std::move(states);
+
+        m_samples.push_back(sample);
+        while (m_samples.size() > m_capacity)
+        {
+            m_samples.pop_front();
+        }
+        return sample;
+    }
+
+    std::vector<telemetry_sample_t> BittorrentTelemetry::get_samples()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return std::vector<telemetry_sample_t>(m_samples.begin(), m_samples.end());
+    }
+
+    std::optional<telemetry_sample_t> BittorrentTelemetry::get_last_sample()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_samples.empty())
+        {
+            return std::nullopt;
+        }
+        return m_samples.back();
+    }
+
+    std::vector<peer_telemetry_t> BittorrentTelemetry::get_peers()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<peer_telemetry_t> peers;
+        for (const auto &[endpoint, peer] : m_peers)
+        {
+            peers.push_back(peer);
+        }
+        return peers;
+    }
+
+    std::map<lt::torrent_handle, session_state_t> BittorrentTelemetry::get_torrents_state()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_torrents_state;
+    }
+
+} // namespace dunedaq::snbmodules
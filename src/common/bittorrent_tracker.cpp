@@ -0,0 +1,310 @@
+/**
+ * @file bittorrent_tracker.cpp BittorrentTracker class, minimal HTTP tracker for the bittorrent transfers
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/bittorrent_tracker.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+
+    BittorrentTracker::BittorrentTracker(const IPFormat &listen_interface, int interval)
+        : m_listen_interface(listen_interface),
+          m_interval(interval),
+          m_thread([&](std::atomic<bool> &running)
+                   { this->do_work(running); })
+    {
+    }
+
+    BittorrentTracker::~BittorrentTracker()
+    {
+        stop();
+    }
+
+    bool BittorrentTracker::start()
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(m_listen_interface.get_port()));
+        if (inet_pton(AF_INET, m_listen_interface.get_ip().c_str(), &addr.sin_addr) != 1)
+        {
+            ers::error(ConfigError(ERS_HERE, "invalid tracker ip " + m_listen_interface.get_ip()));
+            return false;
+        }
+
+        m_socket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        if (m_socket < 0 ||
+            setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+            bind(m_socket, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || // NOLINT
+            listen(m_socket, 128) != 0)
+        {
+            ers::error(BittorrentError(ERS_HERE, "cannot listen on " + m_listen_interface.get_ip_port() + " for the tracker: " + std::strerror(errno)));
+            if (m_socket >= 0)
+            {
+                ::close(m_socket);
+                m_socket = -1;
+            }
+            return false;
+        }
+
+        // port chosen by the system if 0 was asked
+        socklen_t len = sizeof(addr);
+        getsockname(m_socket, reinterpret_cast<sockaddr *>(&addr), &len); // NOLINT
+        m_port = ntohs(addr.sin_port);
+
+        TLOG() << "debug : tracker listening on " << get_announce_url();
+        m_thread.start_working_thread();
+        return true;
+    }
+
+    void BittorrentTracker::stop()
+    {
+        if (m_thread.thread_running())
+        {
+            m_thread.stop_working_thread();
+        }
+        if (m_socket >= 0)
+        {
+            ::close(m_socket);
+            m_socket = -1;
+        }
+    }
+
+    std::string BittorrentTracker::get_announce_url() const
+    {
+        return "http://" + m_listen_interface.get_ip() + ":" + std::to_string(m_port.load()) + "/announce";
+    }
+
+    size_t BittorrentTracker::get_peers_count(const std::string &info_hash)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_swarms.find(info_hash);
+        return it == m_swarms.end() ? 0 : it->second.size();
+    }
+
+    void BittorrentTracker::do_work(std::atomic<bool> &running_flag)
+    {
+        pollfd pfd{m_socket, POLLIN, 0};
+        while (running_flag.load())
+        {
+            // wake up regularly to check the running flag
+            if (poll(&pfd, 1, 200) <= 0 || (pfd.revents & POLLIN) == 0)
+            {
+                continue;
+            }
+
+            sockaddr_in remote{};
+            socklen_t len = sizeof(remote);
+            int fd = accept4(m_socket, reinterpret_cast<sockaddr *>(&remote), &len, SOCK_CLOEXEC); // NOLINT
+            if (fd < 0)
+            {
+                continue;
+            }
+
+            char ip[INET_ADDRSTRLEN] = {};
+            inet_ntop(AF_INET, &remote.sin_addr, ip, sizeof(ip));
+            handle_connection(fd, ip);
+            ::close(fd);
+        }
+    }
+
+    void BittorrentTracker::handle_connection(int fd, const std::string &remote_ip)
+    {
+        // a client cannot hold the tracker
+        timeval timeout{1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        std::string request;
+        char buffer[2048];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 16384)
+        {
+            ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0)
+            {
+                return;
+            }
+            request.append(buffer, static_cast<size_t>(n));
+        }
+
+        // GET /announce?query HTTP/1.1
+        std::string status = "200 OK";
+        std::string body;
+        size_t path_start = request.find(' ');
+        size_t path_end = path_start == std::string::npos ? std::string::npos : request.find(' ', path_start + 1);
+        std::string path = path_end == std::string::npos ? "" : request.substr(path_start + 1, path_end - path_start - 1);
+        size_t query_start = path.find('?');
+
+        if (request.compare(0, 4, "GET ") != 0 || path.compare(0, query_start, "/announce") != 0)
+        {
+            status = "404 Not Found";
+            body = failure("unknown request");
+        }
+        else
+        {
+            body = handle_announce(query_start == std::string::npos ? "" : path.substr(query_start + 1), remote_ip);
+        }
+
+        std::string response = "HTTP/1.1 " + status + "\r\n"
+                               "Content-Type: text/plain\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                               "Connection: close\r\n\r\n" + body;
+
+        size_t sent = 0;
+        while (sent < response.size())
+        {
+            ssize_t n = ::send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                return;
+            }
+            sent += static_cast<size_t>(n);
+        }
+    }
+
+    std::string BittorrentTracker::handle_announce(const std::string &query, const std::string &remote_ip)
+    {
+        std::map<std::string, std::string> params;
+        size_t start = 0;
+        while (start < query.size())
+        {
+            size_t end = query.find('&', start);
+            std::string param = query.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            size_t eq = param.find('=');
+            if (eq != std::string::npos)
+            {
+                params[param.substr(0, eq)] = url_decode(param.substr(eq + 1));
+            }
+            start = end == std::string::npos ? query.size() : end + 1;
+        }
+
+        if (params["info_hash"].size() != 20 || params["peer_id"].size() != 20)
+        {
+            return failure("invalid info_hash or peer_id");
+        }
+        int port = std::atoi(params["port"].c_str());
+        if (port <= 0 || port > 65535)
+        {
+            return failure("invalid port");
+        }
+
+        peer_t peer;
+        peer.ip = params.count("ip") != 0 ? params["ip"] : remote_ip;
+        peer.port = static_cast<uint16_t>(port);
+        peer.seed = params.count("left") != 0 && params["left"] == "0";
+        peer.last_seen = std::chrono::steady_clock::now();
+
+        in_addr addr{};
+        if (inet_pton(AF_INET, peer.ip.c_str(), &addr) != 1)
+        {
+            return failure("only ipv4 peers are supported");
+        }
+
+        size_t numwant = 50;
+        if (params.count("numwant") != 0)
+        {
+            numwant = static_cast<size_t>(std::max(0, std::atoi(params["numwant"].c_str())));
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        expire_peers();
+
+        auto &swarm = m_swarms[params["info_hash"]];
+        if (params["event"] == "stopped")
+        {
+            swarm.erase(params["peer_id"]);
+            if (swarm.empty())
+            {
+                m_swarms.erase(params["info_hash"]);
+            }
+            return "d8:intervali" + std::to_string(m_interval) + "e5:peers0:e";
+        }
+        swarm[params["peer_id"]] = peer;
+
+        // compact peer list: 4 bytes of ip and 2 bytes of port, in network order
+        std::string peers;
+        int complete = 0;
+        for (const auto &[peer_id, other] : swarm)
+        {
+            complete += other.seed ? 1 : 0;
+            // a seed has nothing to get from other seeds
+            if (peer_id == params["peer_id"] || (peer.seed && other.seed) || peers.size() / 6 >= numwant)
+            {
+                continue;
+            }
+            in_addr other_addr{};
+            inet_pton(AF_INET, other.ip.c_str(), &other_addr);
+            uint16_t other_port = htons(other.port);
+            peers.append(reinterpret_cast<const char *>(&other_addr.s_addr), 4); // NOLINT
+            peers.append(reinterpret_cast<const char *>(&other_port), 2);         // NOLINT
+        }
+
+        return "d8:completei" + std::to_string(complete) +
+               "e10:incompletei" + std::to_string(static_cast<int>(swarm.size()) - complete) +
+               "e8:intervali" + std::to_string(m_interval) +
+               "e12:min intervali" + std::to_string(m_interval) +
+               "e5:peers" + std::to_string(peers.size()) + ":" + peers + "e";
+    }
+
+    void BittorrentTracker::expire_peers()
+    {
+        auto deadline = std::chrono::steady_clock::now() - std::chrono::seconds(3 * m_interval);
+        for (auto swarm = m_swarms.begin(); swarm != m_swarms.end();)
+        {
+            for (auto peer = swarm->second.begin(); peer != swarm->second.end();)
+            {
+                peer = peer->second.last_seen < deadline ? swarm->second.erase(peer) : std::next(peer);
+            }
+            swarm = swarm->second.empty() ? m_swarms.erase(swarm) : std::next(swarm);
+        }
+    }
+
+    std::string BittorrentTracker::url_decode(const std::string &s)
+    {
+        std::string decoded;
+        decoded.reserve(s.size());
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            if (s[i] == '%' && i + 2 < s.size() && std::isxdigit(static_cast<unsigned char>(s[i + 1])) && std::isxdigit(static_cast<unsigned char>(s[i + 2])))
+            {
+                decoded.push_back(static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16)));
+                i += 2;
+            }
+            else if (s[i] == '+')
+            {
+                decoded.push_back(' ');
+            }
+            else
+            {
+                decoded.push_back(s[i]);
+            }
+        }
+        return decoded;
+    }
+
+    std::string BittorrentTracker::failure(const std::string &reason)
+    {
+        return "d14:failure reason" + std::to_string(reason.size()) + ":" + reason + "e";
+    }
+
+} // namespace dunedaq::snbmodules
@@ -0,0 +1,196 @@
+/**
+ * @file child_process.cpp ChildProcess class, a command run in a child process without blocking the caller
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/child_process.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+
+    ChildProcess::~ChildProcess()
+    {
+        terminate();
+        close_error_output();
+    }
+
+    bool ChildProcess::start(const std::vector<std::string> &args, std::string &error, bool interactive /*= false*/)
+    {
+        if (is_running())
+        {
+            error = "a command is already running";
+            return false;
+        }
+        if (args.empty())
+        {
+            error = "no command";
+            return false;
+        }
+        close_error_output();
+        m_error_output.clear();
+        m_exit_code.reset();
+
+        // everything the child needs is prepared before the fork, it only calls async-signal-safe functions
+        std::vector<char *> argv;
+        for (const auto &arg : args)
+        {
+            argv.push_back(const_cast<char *>(arg.c_str())); // NOLINT
+        }
+        argv.push_back(nullptr);
+        static const char exec_failed[] = "cannot execute the command\n";
+
+        int pipe_fds[2];
+        if (pipe2(pipe_fds, O_CLOEXEC) != 0)
+        {
+            error = std::string("cannot create a pipe: ") + std::strerror(errno);
+            return false;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            error = std::string("cannot fork: ") + std::strerror(errno);
+            ::close(pipe_fds[0]);
+            ::close(pipe_fds[1]);
+            return false;
+        }
+
+        if (pid == 0)
+        {
+            if (!interactive)
+            {
+                setpgid(0, 0);
+                int null_fd = ::open("/dev/null", O_RDWR);
+                if (null_fd >= 0)
+                {
+                    dup2(null_fd, STDIN_FILENO);
+                    dup2(null_fd, STDOUT_FILENO);
+                }
+            }
+            dup2(pipe_fds[1], STDERR_FILENO);
+            execvp(argv[0], argv.data());
+            ssize_t ignored = ::write(STDERR_FILENO, exec_failed, sizeof(exec_failed) - 1);
+            (void)ignored;
+            _exit(127);
+        }
+
+        // also set by the parent, the group exists even if the command is terminated before it runs
+        if (!interactive)
+        {
+            setpgid(pid, pid);
+        }
+        ::close(pipe_fds[1]);
+        m_stderr = pipe_fds[0];
+        fcntl(m_stderr, F_SETFL, fcntl(m_stderr, F_GETFL) | O_NONBLOCK);
+        m_pid = pid;
+        m_own_group = !interactive;
+        return true;
+    }
+
+    std::optional<int> ChildProcess::poll()
+    {
+        if (!is_running())
+        {
+            return m_exit_code;
+        }
+
+        // drained at each poll, a command writing a lot of errors would otherwise block on the pipe
+        read_error_output();
+
+        int status = 0;
+        pid_t res = waitpid(m_pid, &status, WNOHANG);
+        if (res == 0 || (res < 0 && errno == EINTR))
+        {
+            return std::nullopt;
+        }
+
+        if (res < 0)
+        {
+            m_exit_code = -1;
+        }
+        else if (WIFSIGNALED(status))
+        {
+            m_exit_code = 128 + WTERMSIG(status);
+        }
+        else
+        {
+            m_exit_code = WEXITSTATUS(status);
+        }
+        m_pid = -1;
+        read_error_output();
+        close_error_output();
+        return m_exit_code;
+    }
+
+    void ChildProcess::terminate(std::chrono::milliseconds grace /*= std::chrono::seconds(2)*/)
+    {
+        if (!is_running())
+        {
+            return;
+        }
+
+        // scp and sftp run ssh in a child of their own, the whole group is stopped
+        pid_t target = m_own_group ? -m_pid : m_pid;
+        kill(target, SIGTERM);
+        auto deadline = std::chrono::steady_clock::now() + grace;
+        while (!poll().has_value())
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                kill(target, SIGKILL);
+                int status = 0;
+                while (waitpid(m_pid, &status, 0) < 0 && errno == EINTR)
+                {
+                }
+                m_exit_code = 128 + SIGKILL;
+                m_pid = -1;
+                close_error_output();
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    void ChildProcess::read_error_output()
+    {
+        if (m_stderr < 0)
+        {
+            return;
+        }
+
+        char buffer[4096];
+        ssize_t n = 0;
+        while ((n = ::read(m_stderr, buffer, sizeof(buffer))) > 0)
+        {
+            m_error_output.append(buffer, static_cast<size_t>(n));
+            if (m_error_output.size() > sizeof(buffer))
+            {
+                m_error_output.erase(0, m_error_output.size() - sizeof(buffer));
+            }
+        }
+    }
+
+    void ChildProcess::close_error_output()
+    {
+        if (m_stderr >= 0)
+        {
+            ::close(m_stderr);
+            m_stderr = -1;
+        }
+    }
+
+} // namespace dunedaq::snbmodules
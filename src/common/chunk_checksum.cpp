@@ -0,0 +1,393 @@
+/**
+ * @file chunk_checksum.cpp ChunkChecksum class, XXH64 checksums of the chunks of a file
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/chunk_checksum.hpp"
+#include "snbmodules/interfaces/torrent_cache.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+
+    namespace
+    {
+        constexpr uint64_t prime1 = 11400714785074694791ULL;
+        constexpr uint64_t prime2 = 14029467366897019727ULL;
+        constexpr uint64_t prime3 = 1609587929392839161ULL;
+        constexpr uint64_t prime4 = 9650029242287828579ULL;
+        constexpr uint64_t prime5 = 2870177450012600261ULL;
+
+        inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+        inline uint64_t read64(const unsigned char *p)
+        {
+            uint64_t v = 0;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint32_t read32(const unsigned char *p)
+        {
+            uint32_t v = 0;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint64_t round(uint64_t acc, uint64_t input)
+        {
+            acc += input * prime2;
+            return rotl(acc, 31) * prime1;
+        }
+
+        inline uint64_t merge_round(uint64_t acc, uint64_t val)
+        {
+            acc ^= round(0, val);
+            return acc * prime1 + prime4;
+        }
+
+        /// @brief Incremental XXH64, the input can be given in several parts
+        class xxh64_state
+        {
+        public:
+            explicit xxh64_state(uint64_t seed)
+                : m_seed(seed),
+                  m_v{seed + prime1 + prime2, seed + prime2, seed, seed - prime1}
+            {
+            }
+
+            void update(const unsigned char *p, size_t size)
+            {
+                m_total += size;
+
+                // end of the previous part
+                if (m_buffered > 0)
+                {
+                    size_t n = std::min(size, sizeof(m_buffer) - m_buffered);
+                    std::memcpy(m_buffer + m_buffered, p, n);
+                    m_buffered += n;
+                    p += n;
+                    size -= n;
+                    if (m_buffered < sizeof(m_buffer))
+                    {
+                        return;
+                    }
+                    stripe(m_buffer);
+                    m_buffered = 0;
+                }
+
+                while (size >= 32)
+                {
+                    stripe(p);
+                    p += 32;
+                    size -= 32;
+                }
+
+                std::memcpy(m_buffer, p, size);
+                m_buffered = size;
+            }
+
+            uint64_t digest() const
+            {
+                uint64_t h = 0;
+                if (m_total >= 32)
+                {
+                    h = rotl(m_v[0], 1) + rotl(m_v[1], 7) + rotl(m_v[2], 12) + rotl(m_v[3], 18);
+                    for (uint64_t v : m_v)
+                    {
+                        h = merge_round(h, v);
+                    }
+                }
+                else
+                {
+                    h = m_seed + prime5;
+                }
+                h += m_total;
+
+                const unsigned char *p = m_buffer;
+                size_t size = m_buffered;
+                for (; size >= 8; p += 8, size -= 8)
+                {
+                    h ^= round(0, read64(p));
+                    h = rotl(h, 27) * prime1 + prime4;
+                }
+                if (size >= 4)
+                {
+                    h ^= static_cast<uint64_t>(read32(p)) * prime1;
+                    h = rotl(h, 23) * prime2 + prime3;
+                    p += 4;
+                    size -= 4;
+                }
+                for (; size > 0; p++, size--)
+                {
+                    h ^= *p * prime5;
+                    h = rotl(h, 11) * prime1;
+                }
+
+                h ^= h >> 33;
+                h *= prime2;
+                h ^= h >> 29;
+                h *= prime3;
+                h ^= h >> 32;
+                return h;
+            }
+
+        private:
+            void stripe(const unsigned char *p)
+            {
+                for (int i = 0; i < 4; i++)
+                {
+                    m_v[i] = round(m_v[i], read64(p + 8 * i));
+                }
+            }
+
+            uint64_t m_seed;
+            uint64_t m_v[4];
+            uint64_t m_total = 0;
+            unsigned char m_buffer[32] = {};
+            size_t m_buffered = 0;
+        };
+
+        std::string to_hex(uint64_t value)
+        {
+            char hex[17];
+            snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(value)); // NOLINT
+            return hex;
+        }
+    } // namespace
+
+    ChunkChecksum::ChunkChecksum(uint64_t file_size, uint64_t chunk_size, std::vector<uint64_t> chunks)
+        : m_file_size(file_size),
+          m_chunk_size(chunk_size),
+          m_chunks(std::move(chunks))
+    {
+    }
+
+    std::optional<ChunkChecksum> ChunkChecksum::parse(const std::string &checksum, uint64_t file_size)
+    {
+        // xxh64:<chunk size>:<hex>,<hex>,...
+        if (checksum.rfind("xxh64:", 0) != 0)
+        {
+            return std::nullopt;
+        }
+        size_t sep = checksum.find(':', 6);
+        if (sep == std::string::npos)
+        {
+            return std::nullopt;
+        }
+
+        uint64_t chunk_size = 0;
+        std::vector<uint64_t> chunks;
+        try
+        {
+            chunk_size = std::stoull(checksum.substr(6, sep - 6));
+            std::stringstream list(checksum.substr(sep + 1));
+            std::string hex;
+            while (std::getline(list, hex, ','))
+            {
+                chunks.push_back(std::stoull(hex, nullptr, 16));
+            }
+        }
+        catch (const std::exception &)
+        {
+            return std::nullopt;
+        }
+
+        // one chunk per started chunk size, at least one for an empty file
+        if (chunk_size == 0 || chunks.size() != std::max<uint64_t>(1, (file_size + chunk_size - 1) / chunk_size))
+        {
+            return std::nullopt;
+        }
+        return ChunkChecksum(file_size, chunk_size, std::move(chunks));
+    }
+
+    std::string ChunkChecksum::to_string() const
+    {
+        std::string str = "xxh64:" + std::to_string(m_chunk_size) + ":";
+        for (size_t i = 0; i < m_chunks.size(); i++)
+        {
+            str += (i == 0 ? "" : ",") + to_hex(m_chunks[i]);
+        }
+        return str;
+    }
+
+    uint64_t ChunkChecksum::get_chunk_length(size_t index) const
+    {
+        uint64_t start = index * m_chunk_size;
+        return start >= m_file_size ? 0 : std::min(m_chunk_size, m_file_size - start);
+    }
+
+    std::optional<ChunkChecksum> ChunkChecksum::compute(const std::filesystem::path &file, uint64_t chunk_size, std::string &error,
+                                                        const std::atomic<bool> *running /*= nullptr*/)
+    {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(file, ec);
+        int fd = ec || chunk_size == 0 ? -1 : ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            error = "cannot open " + file.string() + (ec ? ": " + ec.message() : "");
+            return std::nullopt;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        ChunkChecksum checksum(size, chunk_size, {});
+        std::vector<char> buffer(1 << 20);
+        size_t count = std::max<uint64_t>(1, (size + chunk_size - 1) / chunk_size);
+        for (size_t i = 0; i < count; i++)
+        {
+            auto hash = hash_range(fd, i * chunk_size, checksum.get_chunk_length(i), buffer, running);
+            if (!hash.has_value())
+            {
+                error = running != nullptr && !running->load() ? "hashing of " + file.string() + " stopped"
+                                                               : "cannot read " + file.string() + ": " + std::strerror(errno);
+                ::close(fd);
+                return std::nullopt;
+            }
+            checksum.m_chunks.push_back(hash.value());
+        }
+        ::close(fd);
+        return checksum;
+    }
+
+    std::optional<ChunkChecksum> ChunkChecksum::compute_cached(const std::filesystem::path &file, uint64_t chunk_size,
+                                                               const std::filesystem::path &cache_dir, std::string &error,
+                                                               const std::atomic<bool> *running /*= nullptr*/)
+    {
+        std::string key = TorrentCache::file_key(file);
+        std::filesystem::path entry = cache_dir / (key + "-" + std::to_string(chunk_size) + ".xxh64");
+
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(file, ec);
+        std::ifstream in(entry);
+        std::string cached;
+        if (!key.empty() && !ec && in.is_open() && std::getline(in, cached))
+        {
+            auto checksum = parse(cached, size);
+            if (checksum.has_value() && checksum->get_chunk_size() == chunk_size)
+            {
+                TLOG() << "debug : checksum of " << file << " found in " << cache_dir;
+                return checksum;
+            }
+        }
+
+        auto checksum = compute(file, chunk_size, error, running);
+        if (checksum.has_value() && !key.empty())
+        {
+            // the path of the file follows the checksum, for prune_cache to find it again
+            std::filesystem::create_directories(cache_dir, ec);
+            std::string content = checksum->to_string() + "\n" + std::filesystem::absolute(file, ec).string() + "\n";
+            if (!TorrentCache::write_atomic(entry, content.data(), content.size()))
+            {
+                TLOG() << "debug : cannot store the checksum of " << file << " in " << cache_dir;
+            }
+        }
+        return checksum;
+    }
+
+    void ChunkChecksum::prune_cache(const std::filesystem::path &cache_dir)
+    {
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(cache_dir, ec))
+        {
+            if (entry.path().extension() != ".xxh64")
+            {
+                continue;
+            }
+
+            // "<key>-<chunk size>", the key of the file when the checksum was computed
+            std::string name = entry.path().stem().string();
+            std::string key = name.substr(0, name.rfind('-'));
+            std::ifstream in(entry.path());
+            std::string checksum;
+            std::string file;
+            bool stale = !std::getline(in, checksum) || !std::getline(in, file) || TorrentCache::file_key(file) != key;
+            in.close();
+
+            if (stale)
+            {
+                TLOG() << "debug : removing stale checksum cache entry " << name;
+                std::filesystem::remove(entry.path(), ec);
+            }
+        }
+    }
+
+    bool ChunkChecksum::verify_chunk(int fd, size_t index, std::string &error) const
+    {
+        if (index >= m_chunks.size())
+        {
+            error = "no chunk " + std::to_string(index);
+            return false;
+        }
+
+        std::vector<char> buffer(1 << 20);
+        auto hash = hash_range(fd, index * m_chunk_size, get_chunk_length(index), buffer);
+        if (!hash.has_value())
+        {
+            error = std::string("cannot read chunk ") + std::to_string(index) + ": " + std::strerror(errno);
+            return false;
+        }
+        if (hash.value() != m_chunks[index])
+        {
+            error = "checksum mismatch of chunk " + std::to_string(index) + " (bytes " + std::to_string(index * m_chunk_size) + "-" +
+                    std::to_string(index * m_chunk_size + get_chunk_length(index)) + "): " + to_hex(hash.value()) + " instead of " + to_hex(m_chunks[index]);
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t ChunkChecksum::xxh64(const void *data, size_t size, uint64_t seed /*= 0*/)
+    {
+        xxh64_state state(seed);
+        state.update(static_cast<const unsigned char *>(data), size);
+        return state.digest();
+    }
+
+    std::optional<uint64_t> ChunkChecksum::hash_range(int fd, uint64_t offset, uint64_t length, std::vector<char> &buffer,
+                                                      const std::atomic<bool> *running /*= nullptr*/)
+    {
+        xxh64_state state(0);
+        uint64_t done = 0;
+        while (done < length)
+        {
+            if (running != nullptr && !running->load())
+            {
+                return std::nullopt;
+            }
+            ssize_t n = ::pread(fd, buffer.data(), std::min<uint64_t>(buffer.size(), length - done), static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                // a file shorter than expected
+                if (n == 0)
+                {
+                    errno = EIO;
+                }
+                return std::nullopt;
+            }
+            state.update(reinterpret_cast<const unsigned char *>(buffer.data()), static_cast<size_t>(n)); // NOLINT
+            done += static_cast<uint64_t>(n);
+        }
+        return state.digest();
+    }
+
+} // namespace dunedaq::snbmodules
@@ -0,0 +1,315 @@
+/**
+ * @file http_range_client.cpp HttpRangeClient class, HTTP range requests writing a part of a file
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/http_range_client.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+
+    namespace
+    {
+        /// @brief Value of a header of a response, lower-cased name, empty if absent
+        std::string header_value(const std::string &headers, const std::string &name)
+        {
+            std::string lower = headers;
+            std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c)
+                           { return std::tolower(c); });
+            size_t start = lower.find("\r\n" + name + ":");
+            if (start == std::string::npos)
+            {
+                return "";
+            }
+            start += name.size() + 3;
+            size_t end = lower.find("\r\n", start);
+            std::string value = headers.substr(start, end - start);
+            value.erase(0, value.find_first_not_of(' '));
+            value.erase(value.find_last_not_of(' ') + 1);
+            return value;
+        }
+    } // namespace
+
+    void RateLimiter::set_rate(uint64_t bytes_per_second)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_rate = bytes_per_second;
+        m_tokens = std::min(m_tokens, static_cast<double>(bytes_per_second));
+        m_last = std::chrono::steady_clock::now();
+    }
+
+    void RateLimiter::consume(uint64_t bytes, const std::atomic<bool> &stop)
+    {
+        double wait = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            double rate = static_cast<double>(m_rate.load());
+            if (rate <= 0)
+            {
+                return;
+            }
+            auto now = std::chrono::steady_clock::now();
+            m_tokens = std::min(rate, m_tokens + rate * std::chrono::duration<double>(now - m_last).count());
+            m_last = now;
+            // the bytes are already received, the debt is paid by the wait of the stream that made it
+            m_tokens -= static_cast<double>(bytes);
+            if (m_tokens < 0)
+            {
+                wait = -m_tokens / rate;
+            }
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(wait));
+        while (!stop.load() && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(std::chrono::milliseconds(100), deadline - std::chrono::steady_clock::now()));
+        }
+    }
+
+    std::optional<uint64_t> HttpRangeClient::get_size(const IPFormat &server, const std::string &path)
+    {
+        std::string error;
+        int fd = send_request(server, "HEAD " + escape_path(path) + " HTTP/1.1\r\nHost: " + server.get_ip_port() + "\r\nConnection: close\r\n\r\n", error);
+        if (fd < 0)
+        {
+            return std::nullopt;
+        }
+
+        std::atomic<bool> stop = false;
+        std::string headers;
+        std::string body;
+        int status = read_headers(fd, stop, headers, body, error);
+        ::close(fd);
+
+        std::string length = header_value(headers, "content-length");
+        if (status != 200 || length.empty() || !std::all_of(length.begin(), length.end(), [](unsigned char c)
+                                                             { return std::isdigit(c) != 0; }))
+        {
+            return std::nullopt;
+        }
+        return std::stoull(length);
+    }
+
+    bool HttpRangeClient::get_range(const IPFormat &server, const std::string &path, uint64_t offset, uint64_t length, int fd,
+                                    const std::atomic<bool> &stop, const std::function<void(uint64_t)> &on_bytes, std::string &error,
+                                    RateLimiter *limiter /*= nullptr*/)
+    {
+        if (length == 0)
+        {
+            return true;
+        }
+
+        std::string request = "GET " + escape_path(path) + " HTTP/1.1\r\nHost: " + server.get_ip_port() +
+                              "\r\nRange: bytes=" + std::to_string(offset) + "-" + std::to_string(offset + length - 1) +
+                              "\r\nConnection: close\r\n\r\n";
+        int sock = send_request(server, request, error);
+        if (sock < 0)
+        {
+            return false;
+        }
+
+        std::string headers;
+        std::string body;
+        int status = read_headers(sock, stop, headers, body, error);
+        // a server ignoring the range would send the file from its start
+        if (status != 206)
+        {
+            if (status > 0)
+            {
+                error = "unexpected HTTP status " + std::to_string(status) + " for a range of " + path;
+            }
+            ::close(sock);
+            return false;
+        }
+        if (header_value(headers, "content-range").find("bytes " + std::to_string(offset) + "-") != 0)
+        {
+            error = "unexpected range " + header_value(headers, "content-range") + " for " + path;
+            ::close(sock);
+            return false;
+        }
+
+        uint64_t written = 0;
+        std::vector<char> buffer(1 << 20);
+        int idle = 0;
+        bool ok = true;
+        while (written < length)
+        {
+            size_t size = 0;
+            if (!body.empty())
+            {
+                size = std::min<size_t>(body.size(), length - written);
+                std::memcpy(buffer.data(), body.data(), size);
+                body.clear();
+            }
+            else
+            {
+                if (stop.load())
+                {
+                    error = "stopped";
+                    ok = false;
+                    break;
+                }
+                // small reads under a limit, the waits stay short
+                uint64_t read_size = std::min<uint64_t>(buffer.size(), length - written);
+                if (limiter != nullptr && limiter->get_rate() > 0)
+                {
+                    read_size = std::min<uint64_t>(read_size, std::max<uint64_t>(16384, limiter->get_rate() / 10));
+                }
+                ssize_t n = ::recv(sock, buffer.data(), read_size, 0);
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) && ++idle < 30)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    error = n == 0 ? "connection closed after " + std::to_string(written) + " bytes" : std::string("receive failed: ") + std::strerror(errno);
+                    ok = false;
+                    break;
+                }
+                idle = 0;
+                size = static_cast<size_t>(n);
+            }
+
+            size_t done = 0;
+            while (done < size)
+            {
+                ssize_t n = ::pwrite(fd, buffer.data() + done, size - done, static_cast<off_t>(offset + written + done));
+                if (n <= 0)
+                {
+                    error = std::string("write failed: ") + std::strerror(errno);
+                    ::close(sock);
+                    return false;
+                }
+                done += static_cast<size_t>(n);
+            }
+            written += size;
+            if (on_bytes)
+            {
+                on_bytes(size);
+            }
+            // the socket is not read while waiting, the sender slows down when its window is full
+            if (limiter != nullptr)
+            {
+                limiter->consume(size, stop);
+            }
+        }
+        ::close(sock);
+        return ok;
+    }
+
+    std::string HttpRangeClient::escape_path(const std::string &path)
+    {
+        static const char hex[] = "0123456789ABCDEF";
+        std::string escaped;
+        for (unsigned char c : path)
+        {
+            if (std::isalnum(c) != 0 || c == '-' || c == '.' || c == '_' || c == '~' || c == '/')
+            {
+                escaped.push_back(static_cast<char>(c));
+            }
+            else
+            {
+                escaped.push_back('%');
+                escaped.push_back(hex[c >> 4]);
+                escaped.push_back(hex[c & 15]);
+            }
+        }
+        return escaped;
+    }
+
+    int HttpRangeClient::send_request(const IPFormat &server, const std::string &request, std::string &error)
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(server.get_port()));
+        if (inet_pton(AF_INET, server.get_ip().c_str(), &addr.sin_addr) != 1)
+        {
+            error = "invalid ip " + server.get_ip();
+            return -1;
+        }
+
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) // NOLINT
+        {
+            error = "cannot connect to " + server.get_ip_port() + ": " + std::strerror(errno);
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            return -1;
+        }
+
+        // the stop flag is checked at each receive timeout
+        timeval timeout{1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        size_t sent = 0;
+        while (sent < request.size())
+        {
+            ssize_t n = ::send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                error = "cannot send the request to " + server.get_ip_port();
+                ::close(fd);
+                return -1;
+            }
+            sent += static_cast<size_t>(n);
+        }
+        return fd;
+    }
+
+    int HttpRangeClient::read_headers(int fd, const std::atomic<bool> &stop, std::string &headers, std::string &body, std::string &error)
+    {
+        char buffer[4096];
+        int idle = 0;
+        while (headers.find("\r\n\r\n") == std::string::npos)
+        {
+            if (stop.load() || headers.size() > 16384)
+            {
+                error = stop.load() ? "stopped" : "response headers too long";
+                return -1;
+            }
+            ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) && ++idle < 30)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                error = "no response";
+                return -1;
+            }
+            headers.append(buffer, static_cast<size_t>(n));
+        }
+
+        size_t end = headers.find("\r\n\r\n");
+        body = headers.substr(end + 4);
+        headers.erase(end + 2);
+
+        // HTTP/1.1 206 Partial Content
+        size_t space = headers.find(' ');
+        if (headers.compare(0, 5, "HTTP/") != 0 || space == std::string::npos)
+        {
+            error = "invalid response";
+            return -1;
+        }
+        return std::atoi(headers.c_str() + space + 1);
+    }
+
+} // namespace dunedaq::snbmodules
@@ -0,0 +1,220 @@
+/**
+ * @file memory_budget.cpp MemoryBudget class, memory of the process shared between the transfer interfaces
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/memory_budget.hpp"
+#include "snbmodules/common/errors_declaration.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+
+    MemoryBudget::Reservation::Reservation(std::string owner, uint64_t wanted)
+        : m_owner(std::move(owner)),
+          m_wanted(wanted)
+    {
+    }
+
+    MemoryBudget::Reservation::~Reservation()
+    {
+        MemoryBudget::get().release(this);
+    }
+
+    void MemoryBudget::Reservation::set_on_resize(std::function<void(uint64_t)> on_resize)
+    {
+        std::lock_guard<std::mutex> lock(MemoryBudget::get().m_resize_mutex);
+        m_on_resize = std::move(on_resize);
+    }
+
+    void MemoryBudget::set_budget(uint64_t bytes)
+    {
+        std::lock_guard<std::mutex> resize_lock(m_resize_mutex);
+        std::vector<std::pair<Reservation *, uint64_t>> changes;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_budget = bytes;
+            changes = compute_shares();
+        }
+        TLOG() << "debug : memory budget of the transfers set to " << (bytes == 0 ? "unlimited" : std::to_string(bytes) + " bytes");
+        notify(changes);
+    }
+
+    uint64_t MemoryBudget::get_budget()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_budget;
+    }
+
+    std::unique_ptr<MemoryBudget::Reservation> MemoryBudget::reserve(const std::string &owner, uint64_t wanted)
+    {
+        std::lock_guard<std::mutex> resize_lock(m_resize_mutex);
+        std::unique_ptr<Reservation> reservation(new Reservation(owner, wanted));
+        std::vector<std::pair<Reservation *, uint64_t>> changes;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_reservations.insert(reservation.get());
+            changes = compute_shares();
+
+            // only the minimum shares can go over the budget
+            if (m_budget != 0 && m_reserved > m_budget)
+            {
+                ers::warning(MemoryBudgetExceededError(ERS_HERE, owner, reservation->get_bytes(), m_reserved, m_budget));
+            }
+        }
+        TLOG() << "debug : " << owner << " reserved " << reservation->get_bytes() << " bytes of memory, " << wanted << " wanted";
+        notify(changes);
+        return reservation;
+    }
+
+    void MemoryBudget::release(Reservation *reservation)
+    {
+        std::lock_guard<std::mutex> resize_lock(m_resize_mutex);
+        std::vector<std::pair<Reservation *, uint64_t>> changes;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_reservations.erase(reservation) == 0)
+            {
+                return;
+            }
+            changes = compute_shares();
+        }
+        notify(changes);
+    }
+
+    std::vector<std::pair<MemoryBudget::Reservation *, uint64_t>> MemoryBudget::compute_shares()
+    {
+        // the sessions wanting the least are served first, what they leave is shared by the others
+        std::vector<Reservation *> sessions(m_reservations.begin(), m_reservations.end());
+        std::sort(sessions.begin(), sessions.end(), [](const Reservation *a, const Reservation *b)
+                  { return a->get_wanted() < b->get_wanted(); });
+
+        std::vector<std::pair<Reservation *, uint64_t>> changes;
+        uint64_t left = m_budget;
+        size_t count = sessions.size();
+        m_reserved = 0;
+        for (Reservation *session : sessions)
+        {
+            uint64_t share = session->get_wanted();
+            if (m_budget != 0)
+            {
+                share = std::min(share, left / count);
+                share = std::max(share, std::min(session->get_wanted(), min_share));
+                left -= std::min(left, share);
+            }
+            count--;
+            m_reserved += share;
+
+            if (share != session->get_bytes())
+            {
+                // the new session gets its first share, it is not a change
+                if (session->get_bytes() != 0)
+                {
+                    changes.emplace_back(session, share);
+                }
+                session->m_bytes = share;
+            }
+        }
+        return changes;
+    }
+
+    void MemoryBudget::notify(const std::vector<std::pair<Reservation *, uint64_t>> &changes)
+    {
+        for (const auto &[reservation, bytes] : changes)
+        {
+            TLOG() << "debug : share of " << reservation->get_owner() << " is now " << bytes << " bytes of memory";
+            if (reservation->m_on_resize)
+            {
+                reservation->m_on_resize(bytes);
+            }
+        }
+    }
+
+    uint64_t MemoryBudget::get_reserved_bytes()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_reserved;
+    }
+
+    uint64_t MemoryBudget::get_used_bytes()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t used = 0;
+        for (const auto *reservation : m_reservations)
+        {
+            used += reservation->get_used();
+        }
+        return used;
+    }
+
+    size_t MemoryBudget::get_sessions_count()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_reservations.size();
+    }
+
+    uint64_t MemoryBudget::parse_size(const std::string &size)
+    {
+        if (size.empty() || size == "off")
+        {
+            return 0;
+        }
+
+        size_t end = 0;
+        double value = 0;
+        try
+        {
+            value = std::stod(size, &end);
+        }
+        catch (const std::exception &)
+        {
+            return 0;
+        }
+        if (value < 0)
+        {
+            return 0;
+        }
+
+        // rclone units are powers of 1024, KiB when there is no suffix
+        uint64_t unit = 1ULL << 10;
+        if (end < size.size())
+        {
+            switch (std::toupper(static_cast<unsigned char>(size[end])))
+            {
+            case 'B':
+                unit = 1;
+                break;
+            case 'K':
+                unit = 1ULL << 10;
+                break;
+            case 'M':
+                unit = 1ULL << 20;
+                break;
+            case 'G':
+                unit = 1ULL << 30;
+                break;
+            case 'T':
+                unit = 1ULL << 40;
+                break;
+            case 'P':
+                unit = 1ULL << 50;
+                break;
+            default:
+                return 0;
+            }
+        }
+        return static_cast<uint64_t>(value * static_cast<double>(unit));
+    }
+
+} // namespace dunedaq::snbmodules
@@ -0,0 +1,1109 @@
+/**
+ * @file sequential_disk_io.cpp SequentialDiskIO class, libtorrent disk backend for a few large files read and written sequentially
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/sequential_disk_io.hpp"
+
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/session_handle.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/performance_counters.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+    namespace
+    {
+        /// @brief Alignment of the O_DIRECT buffers, offsets and sizes
+        constexpr int64_t disk_alignment = 4096;
+
+        int64_t align_up(int64_t v)
+        {
+            return (v + disk_alignment - 1) / disk_alignment * disk_alignment;
+        }
+
+        char *aligned_alloc_buffer(int64_t size)
+        {
+            void *p = nullptr;
+            if (posix_memalign(&p, disk_alignment, static_cast<size_t>(align_up(size))) != 0)
+            {
+                throw std::bad_alloc();
+            }
+            return static_cast<char *>(p);
+        }
+
+        /// @brief pread/pwrite the whole range, retrying on partial transfers
+        /// @return 0 on success, errno otherwise (EIO if the end of the file is reached while reading)
+        int full_io(int fd, char *buf, int64_t size, int64_t offset, bool write)
+        {
+            while (size > 0)
+            {
+                ssize_t ret = write ? pwrite(fd, buf, static_cast<size_t>(size), offset) : pread(fd, buf, static_cast<size_t>(size), offset);
+                if (ret < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return errno;
+                }
+                if (ret == 0)
+                {
+                    return EIO;
+                }
+                buf += ret;
+                offset += ret;
+                size -= ret;
+            }
+            return 0;
+        }
+    } // namespace
+
+    /// @brief Piece being received, blocks are gathered here until the piece is complete
+    struct SequentialDiskIO::piece_buffer_t
+    {
+        piece_buffer_t(lt::piece_index_t p, int s)
+            : piece(p), size(s), data(aligned_alloc_buffer(s)), blocks(static_cast<size_t>((s + lt::default_block_size - 1) / lt::default_block_size), false)
+        {
+        }
+        ~piece_buffer_t() { std::free(data); }
+
+        piece_buffer_t(const piece_buffer_t &) = delete;
+        piece_buffer_t &operator=(const piece_buffer_t &) = delete;
+
+        bool complete() const { return blocks_received == static_cast<int>(blocks.size()); }
+        int64_t allocated() const { return align_up(size); }
+
+        bool has_range(int start, int length) const
+        {
+            for (int b = start / lt::default_block_size; b <= (start + length - 1) / lt::default_block_size; b++)
+            {
+                if (!blocks[static_cast<size_t>(b)])
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        lt::piece_index_t piece;
+        int size;
+        char *data;
+        std::vector<bool> blocks;
+        int blocks_received = 0;
+        /// @brief Being written by an I/O thread, the content cannot change anymore
+        bool flushing = false;
+        /// @brief Called once written, used to delay the clearing of a piece being written
+        std::function<void()> on_flushed;
+    };
+
+    /// @brief Files of one torrent
+    class SequentialDiskIO::Storage
+    {
+    public:
+        explicit Storage(lt::storage_params const &params)
+            : m_files(params.files),
+              m_save_path(params.path),
+              m_allocate(params.mode == lt::storage_mode_allocate),
+              m_handles(static_cast<size_t>(params.files.num_files()))
+        {
+        }
+
+        lt::file_storage const &files() const { return m_files; }
+
+        /// @brief Read or write a range of a piece, going through every file it covers
+        /// @param direct use O_DIRECT for the aligned parts of the range
+        bool io(char *buf, lt::piece_index_t piece, int64_t offset, int64_t size, bool write, bool direct, lt::storage_error &ec)
+        {
+            int64_t pos = 0;
+            for (auto const &s : m_files.map_block(piece, offset, static_cast<int>(size)))
+            {
+                char *p = buf + pos;
+                pos += s.size;
+
+                // pad files are never stored
+                if (m_files.pad_file_at(s.file_index))
+                {
+                    if (!write)
+                    {
+                        std::memset(p, 0, static_cast<size_t>(s.size));
+                    }
+                    continue;
+                }
+
+                auto h = open_file(s.file_index, write, ec);
+                if (h == nullptr)
+                {
+                    return false;
+                }
+
+                int64_t done = 0;
+                int err = 0;
+                if (direct && h->direct_fd >= 0 && s.offset % disk_alignment == 0 && reinterpret_cast<uintptr_t>(p) % disk_alignment == 0)
+                {
+                    done = s.size - s.size % disk_alignment;
+                    err = full_io(h->direct_fd, p, done, s.offset, write);
+                    if (err == EINVAL)
+                    {
+                        // filesystem refusing O_DIRECT on this range, use the page cache
+                        done = 0;
+                        err = 0;
+                    }
+                }
+                if (err == 0 && done < s.size)
+                {
+                    err = full_io(h->fd, p + done, s.size - done, s.offset + done, write);
+                }
+
+                if (err != 0)
+                {
+                    ec.ec = lt::error_code(err, lt::system_category());
+                    ec.file(s.file_index);
+                    ec.operation = write ? lt::operation_t::file_write : lt::operation_t::file_read;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /// @brief Pointer to a range of a piece in the memory mapping of its file, the file is mapped on first use
+        /// @param mapping set to the mapping, the pointer stays valid as long as it is kept
+        /// @return nullptr if the range cannot be mapped (spans several files, pad file, error set in ec)
+        char const *mapped_range(lt::piece_index_t piece, int64_t offset, int64_t size, std::shared_ptr<void> &mapping, lt::storage_error &ec)
+        {
+            auto slices = m_files.map_block(piece, offset, static_cast<int>(size));
+            if (slices.size() != 1 || m_files.pad_file_at(slices[0].file_index))
+            {
+                return nullptr;
+            }
+            auto const &s = slices[0];
+
+            auto m = map_file(s.file_index, ec);
+            if (m == nullptr)
+            {
+                return nullptr;
+            }
+            if (s.offset + s.size > m->size)
+            {
+                ec.ec = lt::error_code(EIO, lt::system_category());
+                ec.file(s.file_index);
+                ec.operation = lt::operation_t::file_read;
+                return nullptr;
+            }
+
+            mapping = m;
+            return m->addr + s.offset;
+        }
+
+        /// @brief Check if some data of the torrent is already on disk
+        bool has_data() const
+        {
+            for (auto const i : m_files.file_range())
+            {
+                std::error_code ec;
+                if (!m_files.pad_file_at(i) && std::filesystem::file_size(file_path(i), ec) > 0 && !ec)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void close_files()
+        {
+            std::lock_guard<std::mutex> lock(m_file_mutex);
+            for (auto &h : m_handles)
+            {
+                h.reset();
+            }
+            // blocks still held by libtorrent keep their mapping alive
+            m_mappings.clear();
+        }
+
+        void rename_file(lt::file_index_t index, const std::string &name, lt::storage_error &ec)
+        {
+            std::string old_path = file_path(index);
+            {
+                std::lock_guard<std::mutex> lock(m_file_mutex);
+                m_handles[static_cast<size_t>(static_cast<int>(index))].reset();
+                m_renamed[index] = name;
+            }
+
+            std::error_code err;
+            if (std::filesystem::exists(old_path, err))
+            {
+                std::filesystem::path new_path = file_path(index);
+                std::filesystem::create_directories(new_path.parent_path(), err);
+                std::filesystem::rename(old_path, new_path, err);
+                if (err)
+                {
+                    ec.ec = err;
+                    ec.file(index);
+                    ec.operation = lt::operation_t::file_rename;
+                }
+            }
+        }
+
+        void delete_files(lt::storage_error &ec)
+        {
+            close_files();
+            for (auto const i : m_files.file_range())
+            {
+                std::error_code err;
+                if (!m_files.pad_file_at(i) && !std::filesystem::remove(file_path(i), err) && err)
+                {
+                    ec.ec = err;
+                    ec.file(i);
+                    ec.operation = lt::operation_t::file_remove;
+                }
+            }
+        }
+
+        std::string file_path(lt::file_index_t index) const
+        {
+            auto it = m_renamed.find(index);
+            if (it != m_renamed.end())
+            {
+                return std::filesystem::path(it->second).is_absolute() ? it->second : (std::filesystem::path(m_save_path) / it->second).string();
+            }
+            return m_files.file_path(index, m_save_path);
+        }
+
+        /// @brief Pieces being received, guarded by mutex
+        std::map<lt::piece_index_t, std::shared_ptr<piece_buffer_t>> pieces;
+        /// @brief First error while writing a buffered piece, reported to the next jobs
+        lt::storage_error write_error;
+        std::mutex mutex;
+
+    private:
+        struct file_handle_t
+        {
+            int fd = -1;
+            int direct_fd = -1;
+            bool writable = false;
+
+            ~file_handle_t()
+            {
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+                if (direct_fd >= 0)
+                {
+                    ::close(direct_fd);
+                }
+            }
+        };
+
+        struct mapping_t
+        {
+            char *addr = nullptr;
+            int64_t size = 0;
+
+            ~mapping_t()
+            {
+                if (addr != nullptr)
+                {
+                    munmap(addr, static_cast<size_t>(size));
+                }
+            }
+        };
+
+        lt::file_storage const &m_files;
+        std::string m_save_path;
+        bool m_allocate;
+        std::map<lt::file_index_t, std::shared_ptr<mapping_t>> m_mappings;
+
+        std::mutex m_file_mutex;
+        // shared, a handle stays open while an I/O thread uses it even if the files are released meanwhile
+        std::vector<std::shared_ptr<file_handle_t>> m_handles;
+        std::map<lt::file_index_t, std::string> m_renamed;
+
+        std::shared_ptr<mapping_t> map_file(lt::file_index_t index, lt::storage_error &ec)
+        {
+            std::lock_guard<std::mutex> lock(m_file_mutex);
+            auto &m = m_mappings[index];
+            if (m != nullptr)
+            {
+                return m;
+            }
+
+            std::string path = file_path(index);
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0)
+            {
+                ec.ec = lt::error_code(errno, lt::system_category());
+                ec.file(index);
+                ec.operation = lt::operation_t::file_open;
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+                return nullptr;
+            }
+
+            auto mapping = std::make_shared<mapping_t>();
+            mapping->size = st.st_size;
+            if (st.st_size > 0)
+            {
+                void *addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+                if (addr == MAP_FAILED)
+                {
+                    ec.ec = lt::error_code(errno, lt::system_category());
+                    ec.file(index);
+                    ec.operation = lt::operation_t::file_mmap;
+                    ::close(fd);
+                    return nullptr;
+                }
+                mapping->addr = static_cast<char *>(addr);
+                madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+            }
+            // the mapping stays valid once the file is closed
+            ::close(fd);
+
+            m = mapping;
+            return m;
+        }
+
+        std::shared_ptr<file_handle_t> open_file(lt::file_index_t index, bool write, lt::storage_error &ec)
+        {
+            std::lock_guard<std::mutex> lock(m_file_mutex);
+            auto &h = m_handles[static_cast<size_t>(static_cast<int>(index))];
+            if (h != nullptr && (!write || h->writable))
+            {
+                return h;
+            }
+
+            std::string path = file_path(index);
+            if (write)
+            {
+                std::error_code err;
+                std::filesystem::create_directories(std::filesystem::path(path).parent_path(), err);
+            }
+
+            auto handle = std::make_shared<file_handle_t>();
+            int mode = write ? O_RDWR | O_CREAT : O_RDONLY;
+            handle->fd = ::open(path.c_str(), mode | O_CLOEXEC, 0644);
+            if (handle->fd < 0)
+            {
+                ec.ec = lt::error_code(errno, lt::system_category());
+                ec.file(index);
+                ec.operation = lt::operation_t::file_open;
+                return nullptr;
+            }
+            // optional, some filesystems do not support it
+            handle->direct_fd = ::open(path.c_str(), (write ? O_RDWR : O_RDONLY) | O_DIRECT | O_CLOEXEC);
+            handle->writable = write;
+            posix_fadvise(handle->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+            if (write && m_allocate)
+            {
+                // contiguous extents, and no out of space error in the middle of a transfer
+                int err = posix_fallocate(handle->fd, 0, m_files.file_size(index));
+                if (err != 0 && err != EOPNOTSUPP && err != EINVAL)
+                {
+                    ec.ec = lt::error_code(err, lt::system_category());
+                    ec.file(index);
+                    ec.operation = lt::operation_t::file_fallocate;
+                    return nullptr;
+                }
+            }
+
+            h = handle;
+            return h;
+        }
+    };
+
+    SequentialDiskIO::SequentialDiskIO(lt::io_context &ioc, unsigned int num_threads, int64_t max_buffered_bytes, bool map_files)
+        : m_ioc(ioc),
+          m_max_buffered_bytes(max_buffered_bytes),
+          m_map_files(map_files)
+    {
+        num_threads = std::max(num_threads, 1U);
+        for (unsigned int i = 0; i < num_threads; i++)
+        {
+            m_threads.emplace_back([this]()
+                                   { io_thread(); });
+        }
+    }
+
+    SequentialDiskIO::~SequentialDiskIO()
+    {
+        abort(true);
+    }
+
+    lt::disk_io_constructor_type SequentialDiskIO::constructor(unsigned int num_threads, int64_t max_buffered_bytes, bool map_files)
+    {
+        return [num_threads, max_buffered_bytes, map_files](lt::io_context &ioc, lt::settings_interface const &, lt::counters &)
+        {
+            return std::make_unique<SequentialDiskIO>(ioc, num_threads, max_buffered_bytes, map_files);
+        };
+    }
+
+    std::shared_ptr<SequentialDiskIO::Storage> SequentialDiskIO::get_storage(lt::storage_index_t idx) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_torrents[idx];
+    }
+
+    void SequentialDiskIO::add_job(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            m_jobs.push_back(std::move(job));
+        }
+        m_jobs_cv.notify_one();
+    }
+
+    void SequentialDiskIO::io_thread()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_jobs_mutex);
+                m_jobs_cv.wait(lock, [this]()
+                               { return m_abort || !m_jobs.empty(); });
+                // pending jobs are still run when aborting, to write the buffered pieces
+                if (m_jobs.empty())
+                {
+                    return;
+                }
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    lt::storage_holder SequentialDiskIO::new_torrent(lt::storage_params const &params, std::shared_ptr<void> const &)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        lt::storage_index_t idx;
+        if (m_free_slots.empty())
+        {
+            idx = m_torrents.end_index();
+            m_torrents.emplace_back(std::make_shared<Storage>(params));
+        }
+        else
+        {
+            idx = m_free_slots.back();
+            m_free_slots.pop_back();
+            m_torrents[idx] = std::make_shared<Storage>(params);
+        }
+        return lt::storage_holder(idx, *this);
+    }
+
+    void SequentialDiskIO::remove_torrent(lt::storage_index_t idx)
+    {
+        std::shared_ptr<Storage> storage;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            storage.swap(m_torrents[idx]);
+            m_free_slots.push_back(idx);
+        }
+
+        // Pieces not written yet are dropped, the torrent was stopped before if they had to be kept
+        int64_t released = 0;
+        {
+            std::lock_guard<std::mutex> lock(storage->mutex);
+            for (auto &[piece, buffer] : storage->pieces)
+            {
+                if (!buffer->flushing)
+                {
+                    released += buffer->allocated();
+                }
+            }
+            storage->pieces.clear();
+        }
+        release_buffer(released);
+    }
+
+    void SequentialDiskIO::async_read(lt::storage_index_t storage, lt::peer_request const &r, std::function<void(lt::disk_buffer_holder, lt::storage_error const &)> handler, lt::disk_job_flags_t)
+    {
+        add_job([this, st = get_storage(storage), r, handler = std::move(handler)]()
+                {
+            lt::storage_error ec;
+
+            // Zero copy, the block handed to libtorrent points in the mapping
+            if (m_map_files)
+            {
+                std::shared_ptr<void> mapping;
+                char const *p = st->mapped_range(r.piece, r.start, r.length, mapping, ec);
+                if (p != nullptr)
+                {
+                    // fault the pages in here rather than in the network thread
+                    uintptr_t page = reinterpret_cast<uintptr_t>(p) & ~static_cast<uintptr_t>(sysconf(_SC_PAGESIZE) - 1);
+                    madvise(reinterpret_cast<void *>(page), static_cast<size_t>(reinterpret_cast<uintptr_t>(p) + r.length - page), MADV_WILLNEED);
+                    {
+                        std::lock_guard<std::mutex> lock(m_mapped_mutex);
+                        m_mapped_buffers.emplace(p, std::move(mapping));
+                    }
+                    post(m_ioc, [this, handler, p, len = r.length]()
+                         { handler(lt::disk_buffer_holder(*this, const_cast<char *>(p), len), lt::storage_error()); });
+                    return;
+                }
+                if (ec)
+                {
+                    post(m_ioc, [handler, ec]()
+                         { handler(lt::disk_buffer_holder(), ec); });
+                    return;
+                }
+            }
+
+            char *buf = static_cast<char *>(std::malloc(static_cast<size_t>(r.length)));
+            if (buf == nullptr)
+            {
+                ec.ec = lt::errors::no_memory;
+                ec.operation = lt::operation_t::alloc_cache_piece;
+                post(m_ioc, [handler, ec]()
+                     { handler(lt::disk_buffer_holder(), ec); });
+                return;
+            }
+
+            bool from_memory = false;
+            {
+                std::lock_guard<std::mutex> lock(st->mutex);
+                auto it = st->pieces.find(r.piece);
+                if (it != st->pieces.end() && it->second->has_range(r.start, r.length))
+                {
+                    std::memcpy(buf, it->second->data + r.start, static_cast<size_t>(r.length));
+                    from_memory = true;
+                }
+            }
+            if (!from_memory)
+            {
+                st->io(buf, r.piece, r.start, r.length, false, false, ec);
+            }
+
+            if (ec)
+            {
+                std::free(buf);
+                post(m_ioc, [handler, ec]()
+                     { handler(lt::disk_buffer_holder(), ec); });
+                return;
+            }
+            post(m_ioc, [this, handler, buf, len = r.length]()
+                 { handler(lt::disk_buffer_holder(*this, buf, len), lt::storage_error()); }); });
+    }
+
+    bool SequentialDiskIO::async_write(lt::storage_index_t storage, lt::peer_request const &r, char const *buf, std::shared_ptr<lt::disk_observer> o, std::function<void(lt::storage_error const &)> handler, lt::disk_job_flags_t)
+    {
+        auto st = get_storage(storage);
+        std::shared_ptr<piece_buffer_t> to_flush;
+        lt::storage_error error;
+        {
+            std::lock_guard<std::mutex> lock(st->mutex);
+            error = st->write_error;
+
+            auto &buffer = st->pieces[r.piece];
+            if (buffer == nullptr)
+            {
+                lt::file_storage const &fs = st->files();
+                buffer = std::make_shared<piece_buffer_t>(r.piece, fs.piece_size(r.piece));
+                m_buffered_bytes += buffer->allocated();
+
+                // blocks of pad files are never sent
+                for (size_t b = 0; b < buffer->blocks.size(); b++)
+                {
+                    int start = static_cast<int>(b) * lt::default_block_size;
+                    int len = std::min(lt::default_block_size, buffer->size - start);
+                    auto slices = fs.map_block(r.piece, start, len);
+                    if (std::all_of(slices.begin(), slices.end(), [&](lt::file_slice const &s)
+                                    { return fs.pad_file_at(s.file_index); }))
+                    {
+                        std::memset(buffer->data + start, 0, static_cast<size_t>(len));
+                        buffer->blocks[b] = true;
+                        buffer->blocks_received++;
+                    }
+                }
+            }
+
+            // end game can send the same block twice, it can already be being written
+            size_t block = static_cast<size_t>(r.start / lt::default_block_size);
+            if (!buffer->blocks[block])
+            {
+                std::memcpy(buffer->data + r.start, buf, static_cast<size_t>(r.length));
+                buffer->blocks[block] = true;
+                buffer->blocks_received++;
+            }
+
+            if (buffer->complete() && !buffer->flushing)
+            {
+                buffer->flushing = true;
+                to_flush = buffer;
+            }
+        }
+
+        if (to_flush != nullptr)
+        {
+            add_job([this, st, to_flush]()
+                    { flush_piece(st, to_flush); });
+        }
+
+        // the block is owned by the buffer now, the peer can go on
+        post(m_ioc, [handler = std::move(handler), error]()
+             { handler(error); });
+
+        if (m_buffered_bytes.load() > m_max_buffered_bytes)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_observers.push_back(o);
+            return true;
+        }
+        return false;
+    }
+
+    void SequentialDiskIO::async_hash(lt::storage_index_t storage, lt::piece_index_t piece, lt::span<lt::sha256_hash> block_hashes, lt::disk_job_flags_t flags, std::function<void(lt::piece_index_t, lt::sha1_hash const &, lt::storage_error const &)> handler)
+    {
+        add_job([this, st = get_storage(storage), piece, block_hashes, flags, handler = std::move(handler)]()
+                {
+            lt::file_storage const &fs = st->files();
+            bool const v1 = static_cast<bool>(flags & lt::disk_interface::v1_hash);
+            int const v1_size = fs.piece_size(piece);
+            int const v2_size = block_hashes.empty() ? 0 : fs.piece_size2(piece);
+            int const len = std::max(v1 ? v1_size : 0, v2_size);
+
+            lt::storage_error ec;
+            std::shared_ptr<piece_buffer_t> buffer;
+            {
+                std::lock_guard<std::mutex> lock(st->mutex);
+                ec = st->write_error;
+                auto it = st->pieces.find(piece);
+                if (it != st->pieces.end() && it->second->complete())
+                {
+                    buffer = it->second;
+                }
+            }
+
+            // Complete pieces are hashed before, or while, being written
+            std::unique_ptr<char, decltype(&std::free)> tmp(nullptr, &std::free);
+            std::shared_ptr<void> mapping;
+            char const *data = nullptr;
+            if (buffer != nullptr)
+            {
+                data = buffer->data;
+            }
+            else if (m_map_files && !ec && (data = st->mapped_range(piece, 0, len, mapping, ec)) != nullptr)
+            {
+                // read from the mapping, no copy
+            }
+            else if (!ec)
+            {
+                tmp.reset(aligned_alloc_buffer(len));
+                st->io(tmp.get(), piece, 0, len, false, true, ec);
+                data = tmp.get();
+            }
+
+            lt::sha1_hash hash;
+            if (!ec)
+            {
+                for (int k = 0; k < static_cast<int>(block_hashes.size()); k++)
+                {
+                    int const offset = k * lt::default_block_size;
+                    block_hashes[k] = lt::hasher256(data + offset, std::min(lt::default_block_size, v2_size - offset)).final();
+                }
+                if (v1)
+                {
+                    hash = lt::hasher(data, v1_size).final();
+                }
+            }
+
+            post(m_ioc, [handler, piece, hash, ec]()
+                 { handler(piece, hash, ec); }); });
+    }
+
+    void SequentialDiskIO::async_hash2(lt::storage_index_t storage, lt::piece_index_t piece, int offset, lt::disk_job_flags_t, std::function<void(lt::piece_index_t, lt::sha256_hash const &, lt::storage_error const &)> handler)
+    {
+        add_job([this, st = get_storage(storage), piece, offset, handler = std::move(handler)]()
+                {
+            int const len = std::min(lt::default_block_size, st->files().piece_size2(piece) - offset);
+            lt::storage_error ec;
+
+            if (m_map_files)
+            {
+                std::shared_ptr<void> mapping;
+                char const *p = st->mapped_range(piece, offset, len, mapping, ec);
+                if (p != nullptr || ec)
+                {
+                    lt::sha256_hash hash;
+                    if (p != nullptr)
+                    {
+                        hash = lt::hasher256(p, len).final();
+                    }
+                    post(m_ioc, [handler, piece, hash, ec]()
+                         { handler(piece, hash, ec); });
+                    return;
+                }
+            }
+
+            std::vector<char> block(static_cast<size_t>(len));
+
+            bool from_memory = false;
+            {
+                std::lock_guard<std::mutex> lock(st->mutex);
+                auto it = st->pieces.find(piece);
+                if (it != st->pieces.end() && it->second->has_range(offset, len))
+                {
+                    std::memcpy(block.data(), it->second->data + offset, static_cast<size_t>(len));
+                    from_memory = true;
+                }
+            }
+            if (!from_memory)
+            {
+                st->io(block.data(), piece, offset, len, false, false, ec);
+            }
+
+            lt::sha256_hash hash;
+            if (!ec)
+            {
+                hash = lt::hasher256(block.data(), len).final();
+            }
+            post(m_ioc, [handler, piece, hash, ec]()
+                 { handler(piece, hash, ec); }); });
+    }
+
+    void SequentialDiskIO::flush_piece(const std::shared_ptr<Storage> &storage, const std::shared_ptr<piece_buffer_t> &buffer)
+    {
+        lt::storage_error ec;
+        storage->io(buffer->data, buffer->piece, 0, buffer->size, true, true, ec);
+
+        std::function<void()> on_flushed;
+        {
+            std::lock_guard<std::mutex> lock(storage->mutex);
+            auto it = storage->pieces.find(buffer->piece);
+            if (it != storage->pieces.end() && it->second == buffer)
+            {
+                storage->pieces.erase(it);
+            }
+            buffer->flushing = false;
+            on_flushed = std::move(buffer->on_flushed);
+
+            if (ec && !storage->write_error)
+            {
+                TLOG() << "debug : cannot write piece " << static_cast<int>(buffer->piece) << " : " << ec.ec.message();
+                storage->write_error = ec;
+            }
+        }
+
+        release_buffer(buffer->allocated());
+        if (on_flushed)
+        {
+            on_flushed();
+        }
+    }
+
+    void SequentialDiskIO::flush_all(const std::shared_ptr<Storage> &storage)
+    {
+        std::vector<std::shared_ptr<piece_buffer_t>> buffers;
+        {
+            std::lock_guard<std::mutex> lock(storage->mutex);
+            for (auto &[piece, buffer] : storage->pieces)
+            {
+                if (!buffer->flushing)
+                {
+                    buffer->flushing = true;
+                    buffers.push_back(buffer);
+                }
+            }
+        }
+
+        for (const auto &buffer : buffers)
+        {
+            if (buffer->complete())
+            {
+                flush_piece(storage, buffer);
+                continue;
+            }
+
+            // Partial piece, write every run of received blocks
+            lt::storage_error ec;
+            size_t b = 0;
+            while (b < buffer->blocks.size() && !ec)
+            {
+                if (!buffer->blocks[b])
+                {
+                    b++;
+                    continue;
+                }
+                size_t end = b;
+                while (end < buffer->blocks.size() && buffer->blocks[end])
+                {
+                    end++;
+                }
+                int start = static_cast<int>(b) * lt::default_block_size;
+                int len = std::min(static_cast<int>(end) * lt::default_block_size, buffer->size) - start;
+                storage->io(buffer->data + start, buffer->piece, start, len, true, true, ec);
+                b = end;
+            }
+
+            std::function<void()> on_flushed;
+            {
+                std::lock_guard<std::mutex> lock(storage->mutex);
+                storage->pieces.erase(buffer->piece);
+                buffer->flushing = false;
+                on_flushed = std::move(buffer->on_flushed);
+                if (ec && !storage->write_error)
+                {
+                    storage->write_error = ec;
+                }
+            }
+            release_buffer(buffer->allocated());
+            if (on_flushed)
+            {
+                on_flushed();
+            }
+        }
+    }
+
+    void SequentialDiskIO::release_buffer(int64_t size)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+
+        // Hysteresis, the peers are woken up once half of the budget is free
+        if (m_buffered_bytes.fetch_sub(size) - size > m_max_buffered_bytes / 2)
+        {
+            return;
+        }
+
+        std::vector<std::weak_ptr<lt::disk_observer>> observers;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            observers.swap(m_observers);
+        }
+        if (!observers.empty())
+        {
+            post(m_ioc, [observers = std::move(observers)]()
+                 {
+                for (const auto &o : observers)
+                {
+                    if (auto p = o.lock())
+                    {
+                        p->on_disk();
+                    }
+                } });
+        }
+    }
+
+    void SequentialDiskIO::async_move_storage(lt::storage_index_t, std::string p, lt::move_flags_t, std::function<void(lt::status_t, std::string const &, lt::storage_error const &)> handler)
+    {
+        // Files are always downloaded in place
+        post(m_ioc, [handler = std::move(handler), p = std::move(p)]()
+             { handler(lt::status_t::fatal_disk_error, p, lt::storage_error(lt::error_code(boost::system::errc::operation_not_supported, lt::system_category()))); });
+    }
+
+    void SequentialDiskIO::async_release_files(lt::storage_index_t storage, std::function<void()> handler)
+    {
+        add_job([this, st = get_storage(storage), handler = std::move(handler)]()
+                {
+            flush_all(st);
+            st->close_files();
+            if (handler)
+            {
+                post(m_ioc, handler);
+            } });
+    }
+
+    void SequentialDiskIO::async_check_files(lt::storage_index_t storage, lt::add_torrent_params const *resume_data, lt::aux::vector<std::string, lt::file_index_t>, std::function<void(lt::status_t, lt::storage_error const &)> handler)
+    {
+        bool has_resume = resume_data != nullptr && !resume_data->have_pieces.empty();
+        add_job([this, st = get_storage(storage), has_resume, handler = std::move(handler)]()
+                {
+            // Without resume data, existing files have to be checked piece by piece
+            lt::status_t status = !has_resume && st->has_data() ? lt::status_t::need_full_check : lt::status_t::no_error;
+            post(m_ioc, [handler, status]()
+                 { handler(status, lt::storage_error()); }); });
+    }
+
+    void SequentialDiskIO::async_stop_torrent(lt::storage_index_t storage, std::function<void()> handler)
+    {
+        async_release_files(storage, std::move(handler));
+    }
+
+    void SequentialDiskIO::async_rename_file(lt::storage_index_t storage, lt::file_index_t index, std::string name, std::function<void(std::string const &, lt::file_index_t, lt::storage_error const &)> handler)
+    {
+        add_job([this, st = get_storage(storage), index, name = std::move(name), handler = std::move(handler)]()
+                {
+            flush_all(st);
+            lt::storage_error ec;
+            st->rename_file(index, name, ec);
+            post(m_ioc, [handler, name, index, ec]()
+                 { handler(name, index, ec); }); });
+    }
+
+    void SequentialDiskIO::async_delete_files(lt::storage_index_t storage, lt::remove_flags_t options, std::function<void(lt::storage_error const &)> handler)
+    {
+        add_job([this, st = get_storage(storage), options, handler = std::move(handler)]()
+                {
+            int64_t released = 0;
+            {
+                std::lock_guard<std::mutex> lock(st->mutex);
+                for (auto &[piece, buffer] : st->pieces)
+                {
+                    if (!buffer->flushing)
+                    {
+                        released += buffer->allocated();
+                    }
+                }
+                st->pieces.clear();
+            }
+            release_buffer(released);
+
+            lt::storage_error ec;
+            if (options & lt::session_handle::delete_files)
+            {
+                st->delete_files(ec);
+            }
+            else
+            {
+                st->close_files();
+            }
+            post(m_ioc, [handler, ec]()
+                 { handler(ec); }); });
+    }
+
+    void SequentialDiskIO::async_set_file_priority(lt::storage_index_t, lt::aux::vector<lt::download_priority_t, lt::file_index_t> prio, std::function<void(lt::storage_error const &, lt::aux::vector<lt::download_priority_t, lt::file_index_t>)> handler)
+    {
+        // Every file is always stored, priorities only change the download order
+        post(m_ioc, [handler = std::move(handler), prio = std::move(prio)]() mutable
+             { handler(lt::storage_error(), std::move(prio)); });
+    }
+
+    void SequentialDiskIO::async_clear_piece(lt::storage_index_t storage, lt::piece_index_t index, std::function<void(lt::piece_index_t)> handler)
+    {
+        auto st = get_storage(storage);
+        int64_t released = 0;
+        {
+            std::lock_guard<std::mutex> lock(st->mutex);
+            auto it = st->pieces.find(index);
+            if (it != st->pieces.end())
+            {
+                auto buffer = it->second;
+                st->pieces.erase(it);
+                if (buffer->flushing)
+                {
+                    // The piece can only be downloaded again once the failed copy is written
+                    buffer->on_flushed = [this, handler = std::move(handler), index]()
+                    {
+                        post(m_ioc, [handler, index]()
+                             { handler(index); });
+                    };
+                    return;
+                }
+                released = buffer->allocated();
+            }
+        }
+        release_buffer(released);
+        post(m_ioc, [handler = std::move(handler), index]()
+             { handler(index); });
+    }
+
+    void SequentialDiskIO::update_stats_counters(lt::counters &c) const
+    {
+        // pieces waiting in memory to be written, counted in the memory used by the session
+        c.set_value(lt::counters::queued_write_bytes, m_buffered_bytes.load());
+    }
+
+    std::vector<lt::open_file_state> SequentialDiskIO::get_status(lt::storage_index_t) const
+    {
+        return {};
+    }
+
+    void SequentialDiskIO::abort(bool wait)
+    {
+        bool first = false;
+        {
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            first = !m_abort;
+        }
+
+        if (first)
+        {
+            // Write what was received before leaving, pending jobs are run before the threads exit
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (const auto &st : m_torrents)
+                {
+                    if (st != nullptr)
+                    {
+                        add_job([this, st]()
+                                { flush_all(st); });
+                    }
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_jobs_mutex);
+                m_abort = true;
+            }
+            m_jobs_cv.notify_all();
+        }
+
+        // The threads are always joined at the latest by the destructor
+        if (wait)
+        {
+            for (auto &t : m_threads)
+            {
+                if (t.joinable())
+                {
+                    t.join();
+                }
+            }
+        }
+    }
+
+    void SequentialDiskIO::submit_jobs()
+    {
+        // Jobs are given to the I/O threads as soon as they are added
+    }
+
+    void SequentialDiskIO::settings_updated()
+    {
+    }
+
+    void SequentialDiskIO::free_disk_buffer(char *buf)
+    {
+        if (m_map_files)
+        {
+            std::lock_guard<std::mutex> lock(m_mapped_mutex);
+            auto it = m_mapped_buffers.find(buf);
+            if (it != m_mapped_buffers.end())
+            {
+                // releases the mapping if its files were closed meanwhile
+                m_mapped_buffers.erase(it);
+                return;
+            }
+        }
+        std::free(buf);
+    }
+
+} // namespace dunedaq::snbmodules
@@ -0,0 +1,165 @@
+/**
+ * @file torrent_cache.cpp TorrentCache class, persistent cache of the torrents generated for the files of the client
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/torrent_cache.hpp"
+
+#include "logging/Logging.hpp"
+#include <nlohmann/json.hpp>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+
+    TorrentCache::TorrentCache(std::filesystem::path cache_dir)
+        : m_cache_dir(std::move(cache_dir))
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(m_cache_dir, ec);
+        if (ec)
+        {
+            ers::warning(BittorrentHashingError(ERS_HERE, m_cache_dir.string(), "cannot create torrent cache: " + ec.message()));
+            return;
+        }
+        prune();
+    }
+
+    std::string TorrentCache::file_key(const std::filesystem::path &file)
+    {
+        struct stat st;
+        if (stat(file.c_str(), &st) != 0)
+        {
+            return "";
+        }
+
+        int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        return std::to_string(st.st_dev) + "-" + std::to_string(st.st_ino) + "-" + std::to_string(st.st_size) + "-" + std::to_string(mtime_ns);
+    }
+
+    bool TorrentCache::lookup(const std::filesystem::path &file, entry_t &entry) const
+    {
+        std::string key = file_key(file);
+        if (key.empty())
+        {
+            return false;
+        }
+
+        std::ifstream meta_in(m_cache_dir / (key + ".json"));
+        std::ifstream torrent_in(m_cache_dir / (key + ".torrent"), std::ios::binary);
+        if (!meta_in.is_open() || !torrent_in.is_open())
+        {
+            return false;
+        }
+
+        try
+        {
+            nlohmann::json meta = nlohmann::json::parse(meta_in);
+            entry.magnet = meta["magnet"].get<std::string>();
+            entry.hash = meta["hash"].get<std::string>();
+            entry.tracker = meta["tracker"].get<std::string>();
+        }
+        catch (const nlohmann::json::exception &e)
+        {
+            TLOG() << "debug : invalid torrent cache entry " << key << " : " << e.what();
+            return false;
+        }
+
+        entry.torrent.assign(std::istreambuf_iterator<char>(torrent_in), std::istreambuf_iterator<char>());
+        return !entry.torrent.empty();
+    }
+
+    bool TorrentCache::store(const std::filesystem::path &file, const entry_t &entry)
+    {
+        std::string key = file_key(file);
+        if (key.empty())
+        {
+            return false;
+        }
+
+        nlohmann::json meta;
+        meta["file"] = std::filesystem::absolute(file).string();
+        meta["magnet"] = entry.magnet;
+        meta["hash"] = entry.hash;
+        meta["tracker"] = entry.tracker;
+        std::string meta_str = meta.dump();
+
+        // The metadata is written last, an entry is only visible once complete
+        if (!write_atomic(m_cache_dir / (key + ".torrent"), entry.torrent.data(), entry.torrent.size()) ||
+            !write_atomic(m_cache_dir / (key + ".json"), meta_str.data(), meta_str.size()))
+        {
+            ers::warning(BittorrentHashingError(ERS_HERE, file.string(), "cannot write torrent cache entry in " + m_cache_dir.string()));
+            return false;
+        }
+        return true;
+    }
+
+    void TorrentCache::prune()
+    {
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(m_cache_dir, ec))
+        {
+            if (entry.path().extension() != ".json")
+            {
+                continue;
+            }
+
+            std::string key = entry.path().stem().string();
+            bool stale = true;
+            try
+            {
+                std::ifstream in(entry.path());
+                nlohmann::json meta = nlohmann::json::parse(in);
+                stale = file_key(meta["file"].get<std::string>()) != key;
+            }
+            catch (const nlohmann::json::exception &)
+            {
+                // invalid entry, removed
+            }
+
+            if (stale)
+            {
+                TLOG() << "debug : removing stale torrent cache entry " << key;
+                std::filesystem::remove(entry.path(), ec);
+                std::filesystem::remove(m_cache_dir / (key + ".torrent"), ec);
+            }
+        }
+    }
+
+    bool TorrentCache::write_atomic(const std::filesystem::path &path, const char *data, size_t size)
+    {
+        // Unique temporary name, several sessions can store the same entry concurrently
+        std::filesystem::path tmp = path;
+        tmp += ".tmp" + std::to_string(getpid()) + "_" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            if (!out.write(data, static_cast<std::streamsize>(size)))
+            {
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+        return true;
+    }
+
+} // namespace dunedaq::snbmodules
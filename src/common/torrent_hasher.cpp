@@ -0,0 +1,230 @@
+/**
+ * @file torrent_hasher.cpp TorrentHasher class, multi-threaded v2 piece hashing used to create torrents
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/torrent_hasher.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+
+    TorrentHasher::TorrentHasher(unsigned int num_threads)
+        : m_num_threads(num_threads)
+    {
+        if (m_num_threads == 0)
+        {
+            m_num_threads = std::max(1U, std::thread::hardware_concurrency());
+        }
+    }
+
+    lt::sha256_hash TorrentHasher::piece_root(char const *data, int64_t len, int blocks_per_piece, bool single_piece_file)
+    {
+        int const num_blocks = static_cast<int>((len + lt::default_block_size - 1) / lt::default_block_size);
+
+        // A piece layer is always blocks_per_piece wide, except for files smaller than a piece
+        // where the tree is only padded to the next power of two
+        int num_leafs = blocks_per_piece;
+        if (single_piece_file)
+        {
+            num_leafs = 1;
+            while (num_leafs < num_blocks)
+            {
+                num_leafs *= 2;
+            }
+        }
+
+        // padding leafs are zero hashes
+        std::vector<lt::sha256_hash> tree(static_cast<size_t>(num_leafs));
+        for (int i = 0; i < num_blocks; i++)
+        {
+            int64_t const block_len = std::min(static_cast<int64_t>(lt::default_block_size), len - static_cast<int64_t>(i) * lt::default_block_size);
+            tree[static_cast<size_t>(i)] = lt::hasher256(data + static_cast<ptrdiff_t>(i) * lt::default_block_size, static_cast<int>(block_len)).final(); // NOLINT
+        }
+
+        for (size_t width = tree.size(); width > 1; width /= 2)
+        {
+            for (size_t i = 0; i < width / 2; i++)
+            {
+                lt::hasher256 h;
+                h.update(tree[2 * i].data(), static_cast<int>(tree[2 * i].size()));
+                h.update(tree[2 * i + 1].data(), static_cast<int>(tree[2 * i + 1].size()));
+                tree[i] = h.final();
+            }
+        }
+        return tree[0];
+    }
+
+    void TorrentHasher::hash_worker(const std::vector<piece_job_t> &jobs, std::vector<lt::sha256_hash> &results, int piece_size)
+    {
+        int const blocks_per_piece = piece_size / lt::default_block_size;
+
+        // aligned buffer to read whole pieces
+        void *raw = nullptr;
+        if (posix_memalign(&raw, 4096, static_cast<size_t>(piece_size)) != 0)
+        {
+            std::lock_guard<std::mutex> lock(m_error_mutex);
+            m_error_msg = "unable to allocate piece buffer";
+            m_failed = true;
+            return;
+        }
+        std::unique_ptr<char, decltype(&free)> buffer(static_cast<char *>(raw), &free);
+
+        while (!m_failed.load())
+        {
+            size_t const idx = m_next_job.fetch_add(1);
+            if (idx >= jobs.size())
+            {
+                break;
+            }
+            const piece_job_t &job = jobs[idx];
+
+            int64_t done = 0;
+            while (done < job.length)
+            {
+                ssize_t const r = pread(job.fd, buffer.get() + done, static_cast<size_t>(job.length - done), job.offset + done);
+                if (r < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (r <= 0)
+                {
+                    std::lock_guard<std::mutex> lock(m_error_mutex);
+                    m_error_msg = r == 0 ? "unexpected end of file" : std::strerror(errno);
+                    m_failed = true;
+                    return;
+                }
+                done += r;
+            }
+
+            results[idx] = piece_root(buffer.get(), job.length, blocks_per_piece, job.single_piece_file);
+            m_bytes_hashed += static_cast<uint64_t>(job.length);
+        }
+    }
+
+    bool TorrentHasher::set_piece_hashes(lt::create_torrent &t, const std::filesystem::path &base_path, const progress_callback_t &progress)
+    {
+        lt::file_storage const &fs = t.files();
+        int const piece_size = t.piece_length();
+
+        m_next_job = 0;
+        m_bytes_hashed = 0;
+        m_failed = false;
+        m_error_msg.clear();
+
+        // Open every file once and list the pieces to hash
+        std::vector<int> fds;
+        std::vector<piece_job_t> jobs;
+        uint64_t total_bytes = 0;
+        bool ok = true;
+
+        for (auto const i : fs.file_range())
+        {
+            if (fs.pad_file_at(i) || fs.file_size(i) == 0)
+            {
+                continue;
+            }
+
+            std::filesystem::path path = base_path / fs.file_path(i);
+            int const fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                ers::error(BittorrentHashingError(ERS_HERE, path.string(), std::strerror(errno)));
+                ok = false;
+                break;
+            }
+            fds.push_back(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+            int64_t const file_size = fs.file_size(i);
+            bool const single_piece_file = file_size <= piece_size;
+            lt::piece_index_t::diff_type piece_in_file(0);
+            for (int64_t offset = 0; offset < file_size; offset += piece_size)
+            {
+                jobs.push_back({fd, i, piece_in_file, offset, std::min(static_cast<int64_t>(piece_size), file_size - offset), single_piece_file});
+                ++piece_in_file;
+            }
+            total_bytes += static_cast<uint64_t>(file_size);
+        }
+
+        if (ok)
+        {
+            std::vector<lt::sha256_hash> results(jobs.size());
+            unsigned int const num_threads = std::min(m_num_threads, static_cast<unsigned int>(std::max<size_t>(jobs.size(), 1)));
+
+            unsigned int active_workers = num_threads;
+            std::mutex workers_mutex;
+            std::condition_variable workers_cv;
+            std::vector<std::thread> workers;
+            workers.reserve(num_threads);
+            for (unsigned int i = 0; i < num_threads; i++)
+            {
+                workers.emplace_back([&]()
+                                     {
+                                         hash_worker(jobs, results, piece_size);
+                                         std::lock_guard<std::mutex> lock(workers_mutex);
+                                         active_workers--;
+                                         workers_cv.notify_one(); });
+            }
+
+            // Progress is only reported from the calling thread
+            {
+                std::unique_lock<std::mutex> lock(workers_mutex);
+                while (!workers_cv.wait_for(lock, std::chrono::milliseconds(200), [&]()
+                                            { return active_workers == 0; }))
+                {
+                    if (progress)
+                    {
+                        progress(m_bytes_hashed.load(), total_bytes);
+                    }
+                }
+            }
+
+            for (auto &w : workers)
+            {
+                w.join();
+            }
+
+            if (m_failed.load())
+            {
+                ers::error(BittorrentHashingError(ERS_HERE, base_path.string(), m_error_msg));
+                ok = false;
+            }
+            else
+            {
+                for (size_t j = 0; j < jobs.size(); j++)
+                {
+                    t.set_hash2(jobs[j].file, jobs[j].piece_in_file, results[j]);
+                }
+                if (progress)
+                {
+                    progress(total_bytes, total_bytes);
+                }
+            }
+        }
+
+        for (int fd : fds)
+        {
+            close(fd);
+        }
+        return ok;
+    }
+
+} // namespace dunedaq::snbmodules
@@ -0,0 +1,292 @@
+/**
+ * @file torrent_tail_hasher.cpp TorrentTailHasher class, hash files while they are being written to have their torrent ready when they are closed
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/torrent_tail_hasher.hpp"
+#include "snbmodules/group_metadata.hpp"
+#include "snbmodules/transfer_metadata.hpp"
+
+#include "libtorrent/bencode.hpp"
+#include "logging/Logging.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dunedaq::snbmodules
+{
+
+    TorrentTailHasher::TorrentTailHasher(std::filesystem::path watch_dir, int piece_size)
+        : m_watch_dir(std::move(watch_dir)),
+          m_piece_size(piece_size),
+          m_buffer(static_cast<size_t>(piece_size)),
+          m_thread([&](std::atomic<bool> &running)
+                   { this->do_work(running); })
+    {
+    }
+
+    TorrentTailHasher::~TorrentTailHasher()
+    {
+        stop();
+    }
+
+    std::filesystem::path TorrentTailHasher::sidecar_path(const std::filesystem::path &file)
+    {
+        return file.parent_path() / ("." + file.filename().string() + ".torrent");
+    }
+
+    bool TorrentTailHasher::start()
+    {
+        m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_inotify_fd < 0 || inotify_add_watch(m_inotify_fd, m_watch_dir.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) < 0)
+        {
+            ers::warning(BittorrentHashingError(ERS_HERE, m_watch_dir.string(), std::string("cannot watch directory: ") + std::strerror(errno)));
+            if (m_inotify_fd >= 0)
+            {
+                close(m_inotify_fd);
+                m_inotify_fd = -1;
+            }
+            return false;
+        }
+
+        TLOG() << "debug : Hashing files written in " << m_watch_dir << " with pieces of " << m_piece_size << " bytes";
+        m_thread.start_working_thread();
+        return true;
+    }
+
+    void TorrentTailHasher::stop()
+    {
+        if (m_thread.thread_running())
+        {
+            m_thread.stop_working_thread();
+        }
+        while (!m_files.empty())
+        {
+            forget(m_files.begin()->first);
+        }
+        if (m_inotify_fd >= 0)
+        {
+            close(m_inotify_fd);
+            m_inotify_fd = -1;
+        }
+    }
+
+    void TorrentTailHasher::forget(const std::string &name)
+    {
+        auto it = m_files.find(name);
+        if (it == m_files.end())
+        {
+            return;
+        }
+        if (it->second.fd >= 0)
+        {
+            close(it->second.fd);
+        }
+        m_files.erase(it);
+    }
+
+    bool TorrentTailHasher::hash_available(tail_state_t &state, bool closed)
+    {
+        struct stat st;
+        if (fstat(state.fd, &st) != 0)
+        {
+            return false;
+        }
+        int64_t const size = st.st_size;
+
+        // File truncated and written again, start over
+        if (size < state.hashed_bytes)
+        {
+            state.hashed_bytes = 0;
+            state.piece_roots.clear();
+        }
+
+        int const blocks_per_piece = m_piece_size / lt::default_block_size;
+        auto read_piece = [&](int64_t offset, int64_t len)
+        {
+            int64_t done = 0;
+            while (done < len)
+            {
+                ssize_t const r = pread(state.fd, m_buffer.data() + done, static_cast<size_t>(len - done), offset + done);
+                if (r < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (r <= 0)
+                {
+                    return false;
+                }
+                done += r;
+            }
+            return true;
+        };
+
+        while (state.hashed_bytes + m_piece_size <= size)
+        {
+            if (!read_piece(state.hashed_bytes, m_piece_size))
+            {
+                return false;
+            }
+            state.piece_roots.push_back(TorrentHasher::piece_root(m_buffer.data(), m_piece_size, blocks_per_piece, false));
+            state.hashed_bytes += m_piece_size;
+        }
+
+        if (closed && size > state.hashed_bytes)
+        {
+            int64_t const remaining = size - state.hashed_bytes;
+            if (!read_piece(state.hashed_bytes, remaining))
+            {
+                return false;
+            }
+            // A file smaller than a piece has a shorter tree
+            state.piece_roots.push_back(TorrentHasher::piece_root(m_buffer.data(), remaining, blocks_per_piece, size < m_piece_size));
+            state.hashed_bytes = size;
+        }
+        return true;
+    }
+
+    bool TorrentTailHasher::write_torrent(const std::filesystem::path &file, tail_state_t &state)
+    try
+    {
+        if (state.hashed_bytes == 0)
+        {
+            return false;
+        }
+
+        lt::create_flags_t flags = lt::create_torrent::v2_only | lt::create_torrent::modification_time;
+        lt::file_storage fs;
+        lt::add_files(fs, file.string(), flags);
+        lt::create_torrent t(fs, m_piece_size, flags);
+
+        // The file changed since the last piece was hashed
+        if (t.files().file_size(lt::file_index_t(0)) != state.hashed_bytes || static_cast<size_t>(t.num_pieces()) != state.piece_roots.size())
+        {
+            TLOG() << "debug : " << file << " changed while hashing, torrent not generated";
+            return false;
+        }
+
+        for (size_t k = 0; k < state.piece_roots.size(); k++)
+        {
+            t.set_hash2(lt::file_index_t(0), lt::piece_index_t::diff_type(static_cast<int>(k)), state.piece_roots[k]);
+        }
+        t.set_creator("libtorrent");
+        t.set_priv(false);
+
+        std::vector<char> torrent;
+        lt::bencode(std::back_inserter(torrent), t.generate());
+
+        // Write then rename, a reader never sees a partial torrent
+        std::filesystem::path dest = sidecar_path(file);
+        std::filesystem::path tmp = dest;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios_base::binary);
+            out.write(torrent.data(), static_cast<std::streamsize>(torrent.size()));
+            if (!out)
+            {
+                return false;
+            }
+        }
+        std::filesystem::rename(tmp, dest);
+
+        TLOG() << "debug : torrent of " << file << " ready in " << dest;
+        return true;
+    }
+    catch (std::exception &e)
+    {
+        ers::warning(BittorrentHashingError(ERS_HERE, file.string(), e.what()));
+        return false;
+    }
+
+    void TorrentTailHasher::do_work(std::atomic<bool> &running_flag)
+    {
+        alignas(inotify_event) char events[64 * 1024];
+
+        while (running_flag.load())
+        {
+            pollfd pfd = {m_inotify_fd, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0)
+            {
+                continue;
+            }
+
+            ssize_t const len = read(m_inotify_fd, events, sizeof(events));
+            if (len <= 0)
+            {
+                continue;
+            }
+
+            for (ssize_t pos = 0; pos < len;)
+            {
+                auto const *ev = reinterpret_cast<inotify_event const *>(events + pos); // NOLINT
+                pos += static_cast<ssize_t>(sizeof(inotify_event) + ev->len);
+
+                if (ev->len == 0 || (ev->mask & IN_ISDIR) != 0)
+                {
+                    continue;
+                }
+
+                std::string name(ev->name); // NOLINT
+                std::filesystem::path path = m_watch_dir / name;
+
+                // Skip hidden files (sidecars) and metadata files
+                if (name[0] == '.' || path.extension() == ".torrent" || path.extension() == GroupMetadata::m_file_extension || path.extension() == TransferMetadata::m_file_extension)
+                {
+                    continue;
+                }
+
+                if ((ev->mask & (IN_DELETE | IN_MOVED_FROM)) != 0)
+                {
+                    forget(name);
+                    continue;
+                }
+
+                // a file renamed into place is complete, it replaces whatever had that name
+                if ((ev->mask & IN_MOVED_TO) != 0)
+                {
+                    forget(name);
+                }
+
+                tail_state_t &state = m_files[name];
+                if (state.fd < 0)
+                {
+                    state.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                    if (state.fd < 0)
+                    {
+                        m_files.erase(name);
+                        continue;
+                    }
+                }
+
+                bool const closed = (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0;
+                if (!hash_available(state, closed))
+                {
+                    ers::warning(BittorrentHashingError(ERS_HERE, path.string(), std::strerror(errno)));
+                    forget(name);
+                    continue;
+                }
+
+                if (closed)
+                {
+                    write_torrent(path, state);
+                    forget(name);
+                }
+            }
+        }
+    }
+
+} // namespace dunedaq::snbmodules
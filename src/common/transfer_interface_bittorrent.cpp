@@ -8,9 +8,17 @@
 
 #include "snbmodules/interfaces/transfer_interface_bittorrent.hpp"
 
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <limits>
 #include <vector>
 #include <utility>
 #include <string>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace dunedaq::snbmodules
 {
@@ -39,462 +47,988 @@ namespace dunedaq::snbmodules
 
     TransferInterfaceBittorrent::TransferInterfaceBittorrent(GroupMetadata &config, bool is_client, std::filesystem::path work_dir, const IPFormat &listening_ip)
         : TransferInterfaceAbstract(config),
-          ses(set_settings(listening_ip, config.get_protocol_options()["port"].get<std::string>())),
           m_is_client(is_client),
+          m_session(BittorrentSessionPool::get().get_session(listening_ip, is_client, config.get_protocol_options())),
+          ses(m_session->get_session()),
           m_listening_ip(listening_ip),
+          m_telemetry(is_client),
           m_thread([&](std::atomic<bool> &running)
                    { this->do_work(running); })
     {
         m_work_dir = std::move(work_dir);
-        m_thread.start_working_thread();
 
         if (config.get_protocol_options().contains("rate_limit"))
         {
             m_rate_limit = config.get_protocol_options()["rate_limit"].get<int>();
         }
+
+        if (config.get_protocol_options().contains("hashing_threads"))
+        {
+            m_hashing_threads = config.get_protocol_options()["hashing_threads"].get<unsigned int>();
+        }
+
+        if (config.get_protocol_options().contains("piece_size"))
+        {
+            m_piece_size = config.get_protocol_options()["piece_size"].get<int>();
+            // libtorrent only takes powers of two, at least one block of 16 KiB
+            if (m_piece_size != 0 && (m_piece_size < 16 * 1024 || (m_piece_size & (m_piece_size - 1)) != 0))
+            {
+                ers::error(ConfigError(ERS_HERE, "piece_size " + std::to_string(m_piece_size) + " is not a power of two of at least 16384, the piece size is chosen from the file size"));
+                m_piece_size = 0;
+            }
+        }
+
+        if (config.get_protocol_options().contains("link_speed"))
+        {
+            m_link_speed = config.get_protocol_options()["link_speed"].get<uint64_t>();
+        }
+
+        if (config.get_protocol_options().contains("single_torrent"))
+        {
+            m_single_torrent = config.get_protocol_options()["single_torrent"].get<bool>();
+        }
+
+        if (config.get_protocol_options().contains("tracker"))
+        {
+            m_tracker = config.get_protocol_options()["tracker"].get<std::string>();
+        }
+
+        if (config.get_protocol_options().contains("swarm"))
+        {
+            m_swarm = config.get_protocol_options()["swarm"].get<bool>();
+        }
+
+        if (config.get_protocol_options().contains("resume_interval"))
+        {
+            m_resume_interval = config.get_protocol_options()["resume_interval"].get<int>();
+        }
+
+        if (config.get_protocol_options().contains("telemetry_interval"))
+        {
+            m_telemetry_interval = config.get_protocol_options()["telemetry_interval"].get<int>();
+        }
+        // Shared by the sessions of the client, a restarted transfer finds its resume data from the info-hash
+        m_resume_dir = m_work_dir.parent_path() / ".resume";
+        std::filesystem::create_directories(m_resume_dir);
+
+        // Torrents of the shared files are kept next to the sessions directories, in the client work directory
+        bool use_cache = !config.get_protocol_options().contains("torrent_cache") || config.get_protocol_options()["torrent_cache"].get<bool>();
+        if (!m_is_client && use_cache)
+        {
+            m_cache = std::make_unique<TorrentCache>(m_work_dir.parent_path() / ".torrent_cache");
+        }
+
+        // The uploader also serves its files over HTTP, a second source for the downloaders
+        if (!m_is_client && config.get_protocol_options().contains("web_seed_port") && config.get_protocol_options()["web_seed_port"].get<int>() >= 0)
+        {
+            m_web_seed = WebSeedServer::get_shared(IPFormat(m_listening_ip.get_ip(), config.get_protocol_options()["web_seed_port"].get<int>()));
+            if (m_web_seed == nullptr)
+            {
+                ers::warning(BittorrentError(ERS_HERE, "web seed disabled, the files are only sent to the BitTorrent peers"));
+            }
+        }
+
+        if (config.get_protocol_options().contains("web_seed"))
+        {
+            m_use_web_seeds = config.get_protocol_options()["web_seed"].get<bool>();
+        }
+
+        if (config.get_protocol_options().contains("alert_log") && config.get_protocol_options()["alert_log"].get<bool>())
+        {
+            m_journal = std::make_unique<AlertJournal>(get_work_dir().append("bittorrent.log"));
+        }
+
+        m_thread.start_working_thread();
     }
 
     TransferInterfaceBittorrent::~TransferInterfaceBittorrent()
     {
         m_thread.stop_working_thread();
+
+        // The session is shared with other transfers, only the torrents of this one leave it
+        std::lock_guard<std::mutex> lock(m_torrents_mutex);
+        std::set<torrent_entry_t *> removed;
+        for (auto &[f_meta, entry] : m_torrents)
+        {
+            if (!removed.insert(entry.get()).second)
+            {
+                continue;
+            }
+            lt::torrent_handle h = m_session->get_handle(entry.get());
+            m_session->forget(entry.get());
+            if (h.is_valid())
+            {
+                ses.remove_torrent(h);
+            }
+        }
+
+        // The web seed server is shared with other transfers, only the files of this one leave it
+        std::lock_guard<std::mutex> web_lock(m_web_shared_mutex);
+        for (const auto &[dir, relative] : m_web_shared)
+        {
+            m_web_seed->unshare_file(dir, relative);
+        }
     }
 
     void TransferInterfaceBittorrent::do_work(std::atomic<bool> &running_flag)
     try
     {
-        bool m_done = false;
-        int finished_torrents = 0;
-        // lt::torrent_handle h;
-
-        FILE *log_file = std::fopen(get_work_dir().append("bittorrent.log").c_str(), "w+");
+        auto last_save_resume = clk::now();
+        auto last_telemetry = clk::now();
 
         TLOG() << "debug : Starting bittorent work on " << m_listening_ip.get_ip_port();
 
-        while (running_flag.load() || save_on_exit)
+        while (running_flag.load())
         {
-
-            // Save before exit
-            if (save_on_exit && !running_flag.load())
+            // save resume data periodically, a crash only loses the pieces of the last period
+            if (m_resume_interval > 0 && clk::now() - last_save_resume > std::chrono::seconds(m_resume_interval))
             {
-                auto const handles = ses.get_torrents();
-                for (const auto &h : handles)
+                for (const auto &h : get_handles())
                 {
                     h.save_resume_data(lt::torrent_handle::only_if_modified | lt::torrent_handle::save_info_dict);
                 }
-                m_done = true;
-                goto done;
+                last_save_resume = clk::now();
             }
 
-            std::vector<lt::alert *> alerts;
-            ses.pop_alerts(&alerts);
-
-            for (lt::alert const *a : alerts)
+            // the scheduled limit is shared again when torrents are added, finished, paused or removed
+            if (m_scheduled_rate.load() >= 0 && get_limited_handles().size() != m_limited_torrents.load())
             {
-                static auto const first_ts = a->timestamp();
+                set_rate_limit(m_scheduled_rate.load());
+            }
 
-                if (log_file)
+            if (m_telemetry_interval > 0 && clk::now() - last_telemetry > std::chrono::seconds(m_telemetry_interval))
+            {
+                std::vector<lt::torrent_handle> handles = get_handles();
+                if (!handles.empty())
                 {
-                    std::fprintf(log_file, "[%ld] %s\n", static_cast<std::int64_t>(duration_cast<std::chrono::milliseconds>(a->timestamp() - first_ts).count()), a->message().c_str());
+                    TLOG() << "debug : telemetry of " << m_config.get_group_id() << " : " << m_telemetry.sample(handles, *m_session).to_string();
                 }
+                last_telemetry = clk::now();
+            }
+
+            // the alerts are handled by the thread of the session, wait for the transfer to be done
+            std::unique_lock<std::mutex> lock(m_done_mutex);
+            m_done_cv.wait_for(lock, std::chrono::seconds(1), [&]()
+                               { return m_done || !running_flag.load(); });
+            if (m_done)
+            {
+                break;
+            }
+        }
+
+        // Save before exit, and wait for the resume data as the torrents leave the session with this transfer
+        if (save_on_exit && !running_flag.load())
+        {
+            std::vector<lt::torrent_handle> handles = get_handles();
+            std::unique_lock<std::mutex> lock(m_done_mutex);
+            m_pending_saves = 0;
+            for (const auto &h : handles)
+            {
+                h.save_resume_data(lt::torrent_handle::only_if_modified | lt::torrent_handle::save_info_dict);
+                m_pending_saves++;
+            }
+            m_done_cv.wait_for(lock, std::chrono::seconds(10), [&]()
+                               { return m_pending_saves <= 0; });
+        }
+
+        // the status of the files is final, later updates are ignored
+        m_finalized = true;
+
+        std::lock_guard<std::mutex> torrents_lock(m_torrents_mutex);
+        for (auto &[s, entry] : m_torrents)
+        {
+            if (!m_is_client)
+            {
+                s->set_status(status_type::e_status::FINISHED);
+                // deleting torrents files
+                std::error_code ec;
+                std::filesystem::remove(get_torrent_file(*s), ec);
+            }
+            else if (s->get_status() != status_type::e_status::FINISHED)
+            {
+                s->set_status(status_type::e_status::ERROR);
+                s->set_error_code("Transfer interrupted");
+            }
+        }
+        if (m_group_entry != nullptr && !m_is_client)
+        {
+            std::error_code ec;
+            std::filesystem::remove(get_work_dir().append(m_config.get_group_id() + ".torrent"), ec);
+            std::filesystem::remove_all(get_work_dir().append(".group"), ec);
+        }
+
+        TLOG() << "\nBittorent session done, shutting down";
+        return;
+    }
+    catch (std::exception &e)
+    {
+        // TODO: handle error
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+
+    void TransferInterfaceBittorrent::set_done(bool done)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_done_mutex);
+            m_done = done;
+        }
+        m_done_cv.notify_all();
+    }
+
+    void TransferInterfaceBittorrent::resume_data_handled()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_done_mutex);
+            if (m_pending_saves > 0)
+            {
+                m_pending_saves--;
+            }
+        }
+        m_done_cv.notify_all();
+    }
 
-                if (auto at = lt::alert_cast<lt::add_torrent_alert>(a))
+    void TransferInterfaceBittorrent::on_alert(torrent_entry_t &entry, lt::alert const *a)
+    {
+        if (m_journal)
+        {
+            m_journal->log(a);
+        }
+
+        if (auto at = lt::alert_cast<lt::add_torrent_alert>(a))
+        {
+            if (at->error)
+            {
+                ers::error(BittorrentError(ERS_HERE, at->error.message()));
+                for (TransferMetadata *f_meta : get_files(entry))
                 {
-                    // h = at->handle;
-                    m_torrent_num++;
-                    TLOG() << "debug : Added torrent " << at->torrent_name();
+                    f_meta->set_status(status_type::e_status::ERROR);
+                    f_meta->set_error_code("failed to add torrent to session: " + at->error.message());
                 }
+                return;
+            }
 
-                if (auto p = lt::alert_cast<lt::torrent_removed_alert>(a))
+            m_torrent_num++;
+            TLOG() << "debug : Added torrent " << at->torrent_name();
+
+            // endpoints of the other downloaders received before the torrent was in the session
+            if (m_is_client)
+            {
+                std::lock_guard<std::mutex> lock(m_peers_mutex);
+                connect_peers(at->handle, m_peer_endpoints);
+            }
+        }
+
+        // files of the group added before the torrent, or before its metadata, was known
+        if ((lt::alert_cast<lt::add_torrent_alert>(a) || lt::alert_cast<lt::metadata_received_alert>(a)) && m_is_client)
+        {
+            auto const *ta = static_cast<lt::torrent_alert const *>(a);
+            std::lock_guard<std::mutex> lock(m_files_mutex);
+            for (const auto &[index, file] : entry.files)
+            {
+                apply_group_file(ta->handle, index, file);
+            }
+        }
+
+        // progress of each file of the group
+        if (auto fp = lt::alert_cast<lt::file_progress_alert>(a))
+        {
+            std::lock_guard<std::mutex> lock(m_files_mutex);
+            for (const auto &[index, file] : entry.files)
+            {
+                if (index < 0 || static_cast<size_t>(index) >= fp->files.size())
                 {
-                    lt::torrent_handle h = p->handle;
+                    continue;
                 }
-
-                if (auto p = lt::alert_cast<lt::torrent_paused_alert>(a))
+                file.meta->set_bytes_transferred(static_cast<uint64_t>(fp->files[static_cast<size_t>(index)]));
+                if (m_is_client && file.meta->get_status() == status_type::e_status::DOWNLOADING && file.meta->get_bytes_transferred() >= file.meta->get_size())
                 {
-                    lt::torrent_handle h = p->handle;
-                    h.save_resume_data(lt::torrent_handle::save_info_dict);
+                    file.meta->set_status(status_type::e_status::FINISHED);
                 }
+            }
+        }
+
+        if (auto p = lt::alert_cast<lt::torrent_paused_alert>(a))
+        {
+            p->handle.save_resume_data(lt::torrent_handle::save_info_dict);
+        }
+
+        // if we receive the finished alert or an error, we're done
+        if (auto p = lt::alert_cast<lt::torrent_finished_alert>(a))
+        {
+            TLOG() << "debug : Torrent finished " << p->torrent_name();
+            m_finished_torrents++;
 
-                if (auto *p = lt::alert_cast<lt::tracker_list_alert>(a))
+            TransferMetadata *single = get_single_file(entry);
+            if (single != nullptr)
+            {
+                entry.total_done = static_cast<int64_t>(single->get_size());
+            }
+            // the files of the group not paused are all downloaded
+            for (TransferMetadata *f_meta : get_files(entry))
+            {
+                if (f_meta->get_status() != status_type::e_status::PAUSED)
                 {
-                    (void)p;
-                    // if (h == p->handle)
-                    // {
-                    //     session_state.trackers = std::move(p->trackers);
-                    // }
+                    f_meta->set_status(status_type::e_status::FINISHED);
+                    f_meta->set_bytes_transferred(f_meta->get_size());
                 }
+            }
 
-                // if (auto *p = lt::alert_cast<lt::file_progress_alert>(a))
-                // {
-                //     m_filename_to_metadata[h.torrent_file()->name()]->set_bytes_transferred(h.status().total_payload_download);
-                //     TLOG() << "debug : Progress: " << h.status().total_payload_download;
-                // }
+            // more files of the group can still be added to the torrent
+            bool done = single != nullptr ? m_finished_torrents == m_torrent_num : is_group_done(entry);
 
-                // if we receive the finished alert or an error, we're done
-                if (auto p = lt::alert_cast<lt::torrent_finished_alert>(a))
+            if (m_is_client && (single != nullptr || done))
+            {
+                // nothing left to resume
                 {
-                    TLOG() << "debug : Torrent finished " << p->torrent_name();
-                    finished_torrents++;
+                    std::lock_guard<std::mutex> lock(m_resume_mutex);
+                    m_finished.insert(p->handle.info_hashes());
+                }
+                std::error_code ec;
+                std::filesystem::remove(resume_file_path(p->handle.info_hashes()), ec);
+            }
+            else
+            {
+                p->handle.save_resume_data(lt::torrent_handle::only_if_modified | lt::torrent_handle::save_info_dict);
+            }
 
-                    p->handle.save_resume_data(lt::torrent_handle::only_if_modified | lt::torrent_handle::save_info_dict);
+            if (done && m_is_client)
+            {
+                set_done();
+            }
+        }
+        if (auto p = lt::alert_cast<lt::torrent_error_alert>(a))
+        {
+            ers::error(BittorrentError(ERS_HERE, p->error.message()));
 
-                    m_filename_to_metadata[p->torrent_name()]->set_status(status_type::e_status::FINISHED);
-                    m_filename_to_metadata[p->torrent_name()]->set_bytes_transferred(m_filename_to_metadata[p->torrent_name()]->get_size());
+            m_finished_torrents++;
+            if (m_finished_torrents == m_torrent_num && m_is_client)
+            {
+                set_done();
+            }
 
-                    if (finished_torrents == m_torrent_num && m_is_client)
-                    {
-                        m_done = true;
-                    }
-                }
-                if (auto p = lt::alert_cast<lt::torrent_error_alert>(a))
-                {
-                    ers::error(BittorrentError(ERS_HERE, p->error.message()));
+            p->handle.save_resume_data(lt::torrent_handle::only_if_modified | lt::torrent_handle::save_info_dict);
+        }
 
-                    finished_torrents++;
-                    if (finished_torrents == m_torrent_num && m_is_client)
-                    {
-                        m_done = true;
-                    }
+        // when resume data is ready, save it
+        if (const auto *rd = lt::alert_cast<lt::save_resume_data_alert>(a))
+        {
+            bool finished = false;
+            {
+                std::lock_guard<std::mutex> lock(m_resume_mutex);
+                finished = m_finished.count(rd->params.info_hashes) != 0;
+            }
+            if (!finished)
+            {
+                save_resume_file(rd->params);
+            }
+            resume_data_handled();
+        }
 
-                    p->handle.save_resume_data(lt::torrent_handle::only_if_modified | lt::torrent_handle::save_info_dict);
-                }
+        if (auto e = lt::alert_cast<lt::save_resume_data_failed_alert>(a))
+        {
+            if (e->error != lt::errors::resume_data_not_modified)
+            {
+                ers::warning(BittorrentSaveResumeFileError(ERS_HERE, e->message()));
+            }
+            resume_data_handled();
+        }
 
-                // when resume data is ready, save it
-                if (const auto *rd = lt::alert_cast<lt::save_resume_data_alert>(a))
-                {
-                    std::ofstream of(get_work_dir().append(".resume_file_" + rd->params.name), std::ios_base::binary);
-                    of.unsetf(std::ios_base::skipws);
-                    auto const b = write_resume_data_buf(rd->params);
-                    of.write(b.data(), static_cast<int>(b.size()));
-                    if (m_done)
-                    {
-                        goto done;
-                    }
-                }
+        if (lt::alert_cast<lt::peer_connect_alert>(a))
+        {
+            m_peer_num++;
+            set_done(false);
+        }
 
-                if (auto e = lt::alert_cast<lt::save_resume_data_failed_alert>(a))
-                {
-                    ers::warning(BittorrentSaveResumeFileError(ERS_HERE, e->message()));
-                    if (m_done)
-                    {
-                        goto done;
-                    }
-                }
+        if (auto e = lt::alert_cast<lt::peer_error_alert>(a))
+        {
+            m_peer_num--;
+            ers::warning(BittorrentPeerDisconnectedError(ERS_HERE, e->message()));
+
+            if (m_peer_num == 0 && m_paused == 0 && !m_is_client)
+            {
+                set_done();
+            }
+        }
+
+        if (auto e = lt::alert_cast<lt::peer_disconnected_alert>(a))
+        {
+            m_peer_num--;
+            ers::warning(BittorrentPeerDisconnectedError(ERS_HERE, e->message()));
+            if (m_peer_num <= 0 && m_paused == 0 && !m_is_client)
+            {
+                set_done();
+            }
+        }
+    }
+
+    bool TransferInterfaceBittorrent::add_magnet(lt::string_view uri, const std::filesystem::path &dest, torrent_entry_t *entry)
+    try
+    {
+        TLOG() << "debug : loading parameters from magnet " << uri.to_string();
+        lt::error_code ec;
+        lt::add_torrent_params p = lt::parse_magnet_uri(uri.to_string(), ec);
+
+        if (ec)
+        {
+            ers::error(BittorrentInvalidMagnetLinkError(ERS_HERE, uri.to_string()));
+            return false;
+        }
+
+        if (!m_use_web_seeds)
+        {
+            p.url_seeds.clear();
+        }
+        for (const auto &url : p.url_seeds)
+        {
+            TLOG() << "debug : web seed " << url;
+        }
+
+        load_resume_file(p);
+        set_torrent_params(p, dest);
+        p.userdata = lt::client_data_t(entry);
+        set_group_params(p, entry);
+
+        TLOG() << "debug : adding torrent";
+        ses.async_add_torrent(std::move(p));
+        return true;
+    }
+    catch (lt::system_error const &e)
+    {
+        ers::error(BittorrentInvalidMagnetLinkError(ERS_HERE, e.code().message()));
+        return false;
+    }
+
+    // return magnet url
+    std::string TransferInterfaceBittorrent::add_torrent(const std::string &torrent, const std::filesystem::path &dest, torrent_entry_t *entry)
+    try
+    {
+        using lt::storage_mode_t;
 
-                if (lt::alert_cast<lt::peer_connect_alert>(a))
+        TLOG() << "debug : [" << m_torrent_num << "] " << torrent;
+
+        // lt::error_code ec;
+        lt::add_torrent_params p = lt::load_torrent_file(torrent);
+
+        load_resume_file(p);
+        set_torrent_params(p, dest);
+        p.userdata = lt::client_data_t(entry);
+        set_group_params(p, entry);
+        std::string magnet = lt::make_magnet_uri(p);
+
+        ses.async_add_torrent(std::move(p));
+
+        return magnet;
+    }
+    catch (lt::system_error const &e)
+    {
+        ers::error(BittorrentInvalidTorrentFileError(ERS_HERE, e.code().message()));
+        return "";
+    }
+
+    torrent_entry_t *TransferInterfaceBittorrent::add_entry(TransferMetadata &f_meta)
+    {
+        std::lock_guard<std::mutex> lock(m_torrents_mutex);
+        auto &entry = m_torrents[&f_meta];
+        if (entry)
+        {
+            // added again, the previous handle is not valid anymore
+            m_session->forget(entry.get());
+        }
+        entry = std::make_shared<torrent_entry_t>();
+        entry->meta = &f_meta;
+        entry->owner = this;
+        m_session->track(entry.get());
+        return entry.get();
+    }
+
+    void TransferInterfaceBittorrent::remove_entry(TransferMetadata &f_meta)
+    {
+        std::lock_guard<std::mutex> lock(m_torrents_mutex);
+        auto it = m_torrents.find(&f_meta);
+        if (it == m_torrents.end())
+        {
+            return;
+        }
+        std::shared_ptr<torrent_entry_t> entry = it->second;
+        m_torrents.erase(it);
+
+        if (entry == m_group_entry)
+        {
+            // the torrent stays for the other files of the group
+            std::lock_guard<std::mutex> files_lock(m_files_mutex);
+            for (auto f = entry->files.begin(); f != entry->files.end(); ++f)
+            {
+                if (f->second.meta == &f_meta)
                 {
-                    m_peer_num++;
-                    m_done = false;
+                    entry->files.erase(f);
+                    break;
                 }
-
-                if (auto e = lt::alert_cast<lt::peer_error_alert>(a))
+            }
+            if (!entry->files.empty())
+            {
+                if (entry->meta == &f_meta)
                 {
-                    m_peer_num--;
-                    // std::this_thread::sleep_for(std::chrono::seconds(1));
-                    // Try to reconnect
-                    // lt::error_code ec;
-                    // h.connect_peer(lt::tcp::endpoint(boost::asio::ip::make_address(config->get_source_ip().get_ip(), ec), std::uint16_t(config->get_source_ip().get_port())));
-                    ers::warning(BittorrentPeerDisconnectedError(ERS_HERE, e->message()));
-                    // f_meta.set_error_code("peer error: " + a->message());
-
-                    if (m_peer_num == 0 && m_paused == 0 && !m_is_client)
-                    {
-                        m_done = true;
-                    }
+                    entry->meta = entry->files.begin()->second.meta;
                 }
+                return;
+            }
+            m_group_entry.reset();
+        }
+        m_session->forget(entry.get());
+    }
+
+    lt::torrent_handle TransferInterfaceBittorrent::get_handle(TransferMetadata &f_meta)
+    {
+        std::lock_guard<std::mutex> lock(m_torrents_mutex);
+        auto it = m_torrents.find(&f_meta);
+        return it == m_torrents.end() ? lt::torrent_handle() : m_session->get_handle(it->second.get());
+    }
 
-                if (auto e = lt::alert_cast<lt::peer_disconnected_alert>(a))
+    void TransferInterfaceBittorrent::add_peers(const std::vector<std::string> &endpoints)
+    {
+        if (!m_is_client || !m_swarm)
+        {
+            return;
+        }
+
+        std::vector<lt::tcp::endpoint> added;
+        {
+            std::lock_guard<std::mutex> lock(m_peers_mutex);
+            for (const std::string &endpoint : endpoints)
+            {
+                size_t colon = endpoint.rfind(':');
+                std::string port = colon == std::string::npos ? "" : endpoint.substr(colon + 1);
+                lt::error_code ec;
+                lt::address address = lt::make_address(endpoint.substr(0, colon), ec);
+                if (ec || port.empty() || port.size() > 5 || port.find_first_not_of("0123456789") != std::string::npos)
                 {
-                    m_peer_num--;
-                    // wait
-                    // std::this_thread::sleep_for(std::chrono::seconds(1));
-                    // Try to reconnect
-                    // lt::error_code ec;
-                    // h.connect_peer(lt::tcp::endpoint(boost::asio::ip::make_address(config->get_source_ip().get_ip(), ec), std::uint16_t(config->get_source_ip().get_port())));
-                    ers::warning(BittorrentPeerDisconnectedError(ERS_HERE, e->message()));
-                    if (m_peer_num <= 0 && m_paused == 0 && !m_is_client)
-                    {
-                        m_done = true;
-                    }
+                    ers::warning(BittorrentError(ERS_HERE, "invalid peer endpoint " + endpoint));
+                    continue;
                 }
+                lt::tcp::endpoint ep(address, static_cast<uint16_t>(std::stoi(port)));
 
-                if (auto st = lt::alert_cast<lt::state_update_alert>(a))
+                // our own endpoint, or already known
+                if ((ep.address() == lt::make_address(m_listening_ip.get_ip(), ec) && ep.port() == get_listen_port()) ||
+                    std::find(m_peer_endpoints.begin(), m_peer_endpoints.end(), ep) != m_peer_endpoints.end())
                 {
-                    // TLOG() << "debug : State update alert";
-                    if (st->status.empty())
-                    {
-                        continue;
-                    }
-
-                    for (uint64_t i = 0; i < st->status.size(); i++)
-                    {
-                        lt::torrent_status const &s = st->status[i];
-
-                        if (m_filename_to_metadata[s.name]->get_status() != status_type::e_status::PAUSED)
-                        {
-
-                            switch (s.state)
-                            {
-                            case lt::torrent_status::checking_files:
-                                m_filename_to_metadata[s.name]->set_status(status_type::e_status::CHECKING);
-                                break;
-                            case lt::torrent_status::downloading_metadata:
-                                m_filename_to_metadata[s.name]->set_status(status_type::e_status::PREPARING);
-                                break;
-                            case lt::torrent_status::downloading:
-                                m_filename_to_metadata[s.name]->set_status(status_type::e_status::DOWNLOADING);
-                                break;
-                            case lt::torrent_status::finished:
-                                m_filename_to_metadata[s.name]->set_status(status_type::e_status::FINISHED);
-                                break;
-                            case lt::torrent_status::seeding:
-                                if (m_is_client)
-                                {
-                                    m_filename_to_metadata[s.name]->set_status(status_type::e_status::FINISHED);
-                                }
-                                else
-                                {
-                                    m_filename_to_metadata[s.name]->set_status(status_type::e_status::UPLOADING);
-                                }
-                                break;
-                            case lt::torrent_status::checking_resume_data:
-                                m_filename_to_metadata[s.name]->set_status(status_type::e_status::CHECKING);
-                                break;
-                            default:
-                                break;
-                            }
-
-                            // if (s.num_peers == 0)
-                            // {
-                            //     m_filename_to_metadata[s.name].set_status(status_type::e_status::WAITING);
-                            // }
-                        }
-
-                        m_filename_to_metadata[s.name]->set_bytes_transferred(s.total_done);
-
-                        TLOG() << "is_client " << m_is_client
-                               << " [" << i << "]" << s.name << " " << state(s.state) << ' '
-                               << (s.download_payload_rate / 1000) << " kB/s "
-                               << (s.total_done / 1000) << " kB ("
-                               << (s.progress_ppm / 10000) << "%) "
-                               << s.current_tracker << " " << static_cast<std::int64_t>(duration_cast<seconds>(s.next_announce).count()) << "s ("
-                               << s.num_peers << " peers) "
-                               << "\n";
-
-                        // h.post_trackers();
-
-                        // for (lt::announce_entry const &ae : session_state.trackers)
-                        // {
-                        //     std::cout << ae.url << " ";
-                        //     if (ae.verified)
-                        //     {
-                        //         std::cout << "OK ";
-                        //     }
-                        //     else
-                        //     {
-                        //         std::cout << "-- ";
-                        //     }
-                        //     std::cout << ae.tier << "\n";
-                        // }
-                        // auto &peers = client_state.peers;
-                        // if (print_peers && !peers.empty())
-                        // {
-                        //     using lt::peer_info;
-                        //     // sort connecting towards the bottom of the list, and by peer_id
-                        //     // otherwise, to keep the list as stable as possible
-                        //     std::sort(peers.begin(), peers.end(), [](peer_info const &lhs, peer_info const &rhs)
-                        //               {
-                        //         {
-                        //             bool const l = bool(lhs.flags & peer_info::connecting);
-                        //             bool const r = bool(rhs.flags & peer_info::connecting);
-                        //             if (l != r) return l < r;
-                        //         }
-
-                        //         {
-                        //             bool const l = bool(lhs.flags & peer_info::handshake);
-                        //             bool const r = bool(rhs.flags & peer_info::handshake);
-                        //             if (l != r) return l < r;
-                        //         }
-
-                        //         return lhs.pid < rhs.pid; });
-
-                        //     print_peer_info(out, peers, 10);
-                        //     if (print_peers_legend)
-                        //     {
-                        //         print_peer_legend(out, 10);
-                        //     }
-                        // }
-
-                        // if (print_trackers)
-                        // {
-                        //     snprintf(str, sizeof(str), "next_announce: %4" PRId64 " | current tracker: %s\x1b[K\n", std::int64_t(duration_cast<seconds>(s.next_announce).count()), s.current_tracker.c_str());
-                        //     out += str;
-                        //     pos += 1;
-                        //     h.post_trackers();
-                        //     for (lt::announce_entry const &ae : client_state.trackers)
-                        //     {
-                        //         std::snprintf(str, sizeof(str), "%2d %-55s %s\x1b[K\n", ae.tier, ae.url.c_str(), ae.verified ? "OK " : "-  ");
-                        //         out += str;
-                        //         pos += 1;
-                        //         int idx = 0;
-                        //         for (auto const &ep : ae.endpoints)
-                        //         {
-                        //             ++idx;
-                        //             if (pos + 1 >= terminal_height)
-                        //             {
-                        //                 break;
-                        //             }
-                        //             if (!ep.enabled)
-                        //             {
-                        //                 continue;
-                        //             }
-                        //             for (lt::protocol_version const v : {lt::protocol_version::V1, lt::protocol_version::V2})
-                        //             {
-                        //                 if (!s.info_hashes.has(v))
-                        //                 {
-                        //                     continue;
-                        //                 }
-                        //                 auto const &av = ep.info_hashes[v];
-
-                        //                 std::snprintf(str, sizeof(str), "  [%2d] %s fails: %-3d (%-3d) %s %5d \"%s\" %s\x1b[K\n", idx, v == lt::protocol_version::V1 ? "v1" : "v2", av.fails, ae.fail_limit, to_string(int(total_seconds(av.next_announce - now)), 8).c_str(), av.min_announce > now ? int(total_seconds(av.min_announce - now)) : 0, av.last_error ? av.last_error.message().c_str() : "", av.message.c_str());
-                        //                 out += str;
-                        //                 pos += 1;
-                        //                 // we only need to show this error once, not for every
-                        //                 // endpoint
-                        //                 if (av.last_error == boost::asio::error::host_not_found)
-                        //                 {
-                        //                     goto tracker_done;
-                        //                 }
-                        //             }
-                        //         }
-                        //     tracker_done:
-
-                        //         if (pos + 1 >= terminal_height)
-                        //         {
-                        //             break;
-                        //         }
-                        //     }
-                        // }
-                    }
-                    // std::cout << "\x1b[K";
-                    // std::cout.flush();
+                    continue;
                 }
+                m_peer_endpoints.push_back(ep);
+                added.push_back(ep);
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
 
-            // ask the session to post a state_update_alert, to update our
-            // state output for the torrent
-            ses.post_torrent_updates();
-            ses.post_session_stats();
+        if (added.empty())
+        {
+            return;
+        }
+        TLOG() << "debug : " << added.size() << " new downloaders in the swarm of the group " << m_config.get_group_id();
 
-            // save resume data once every 30 seconds
-            // if (clk::now() - last_save_resume > std::chrono::seconds(30))
-            // {
-            //     h.save_resume_data(lt::torrent_handle::only_if_modified | lt::torrent_handle::save_info_dict);
-            //     last_save_resume = clk::now();
-            // }
+        // the torrents added later connect to them from their add_torrent_alert
+        for (const auto &h : get_handles())
+        {
+            connect_peers(h, added);
         }
-    done:
+    }
 
-        for (auto &[k, s] : m_filename_to_metadata)
+    void TransferInterfaceBittorrent::connect_peers(const lt::torrent_handle &h, const std::vector<lt::tcp::endpoint> &endpoints)
+    {
+        if (endpoints.empty() || !h.is_valid())
         {
-            if (!m_is_client)
+            return;
+        }
+
+        // pieces are spread between the downloaders, every one of them has different pieces to give to the others
+        h.unset_flags(lt::torrent_flags::sequential_download);
+        for (const auto &ep : endpoints)
+        {
+            h.connect_peer(ep);
+        }
+    }
+
+    bool TransferInterfaceBittorrent::set_rate_limit(int64_t bytes_per_second)
+    {
+        m_scheduled_rate = bytes_per_second;
+        std::vector<lt::torrent_handle> handles = get_handles();
+        // the finished torrents no longer use the limit, it is shared by the others
+        size_t limited = get_limited_handles().size();
+        m_limited_torrents = limited;
+
+        int limit = torrent_rate_limit(limited);
+        for (const auto &h : handles)
+        {
+            if (m_is_client)
             {
-                s->set_status(status_type::e_status::FINISHED);
-                // deleting torrents files
-                std::filesystem::remove(get_work_dir().append(k + ".torrent"));
+                h.set_download_limit(limit);
             }
-            else if (s->get_status() != status_type::e_status::FINISHED)
+            else
             {
-                s->set_status(status_type::e_status::ERROR);
-                s->set_error_code("Transfer interrupted");
+                h.set_upload_limit(limit);
             }
         }
+        TLOG() << "debug : rate limit of the " << limited << " transferring torrents of " << m_config.get_group_id() << " set to " << limit << " bytes/s";
+        return true;
+    }
 
-        TLOG() << "\nBittorent session done, shutting down";
-        if (log_file)
+    int TransferInterfaceBittorrent::torrent_rate_limit(size_t torrents) const
+    {
+        int64_t limit = m_scheduled_rate.load();
+        if (limit >= 0)
         {
-            std::fclose(log_file);
+            limit = std::max<int64_t>(1, limit / static_cast<int64_t>(std::max<size_t>(torrents, 1)));
+            limit = std::min<int64_t>(limit, std::numeric_limits<int>::max());
         }
-        return;
+        // the "rate_limit" option only limits the downloads
+        if (m_is_client && m_rate_limit > 0 && (limit < 0 || m_rate_limit < limit))
+        {
+            limit = m_rate_limit;
+        }
+        return static_cast<int>(limit);
     }
-    catch (std::exception &e)
+
+    std::vector<lt::torrent_handle> TransferInterfaceBittorrent::get_handles()
     {
-        // TODO: handle error
-        std::cerr << "Error: " << e.what() << std::endl;
+        std::vector<lt::torrent_handle> handles;
+        std::lock_guard<std::mutex> lock(m_torrents_mutex);
+        for (const auto &[f_meta, entry] : m_torrents)
+        {
+            lt::torrent_handle h = m_session->get_handle(entry.get());
+            // the files of the group share their torrent
+            if (h.is_valid() && std::find(handles.begin(), handles.end(), h) == handles.end())
+            {
+                handles.push_back(h);
+            }
+        }
+        return handles;
     }
 
-    bool TransferInterfaceBittorrent::add_magnet(lt::string_view uri, const std::filesystem::path &dest)
-    try
+    std::vector<lt::torrent_handle> TransferInterfaceBittorrent::get_limited_handles()
     {
-        TLOG() << "debug : loading parameters from magnet " << uri.to_string();
-        lt::error_code ec;
-        lt::add_torrent_params p = lt::parse_magnet_uri(uri.to_string(), ec);
+        std::vector<lt::torrent_handle> handles;
+        std::lock_guard<std::mutex> lock(m_torrents_mutex);
+        for (const auto &[f_meta, entry] : m_torrents)
+        {
+            status_type::e_status status = f_meta->get_status();
+            if (status == status_type::e_status::FINISHED || status == status_type::e_status::PAUSED ||
+                status == status_type::e_status::ERROR || status == status_type::e_status::CANCELLED)
+            {
+                continue;
+            }
+            lt::torrent_handle h = m_session->get_handle(entry.get());
+            // a group torrent transfers while one of its files does
+            if (h.is_valid() && std::find(handles.begin(), handles.end(), h) == handles.end())
+            {
+                handles.push_back(h);
+            }
+        }
+        return handles;
+    }
 
+    int TransferInterfaceBittorrent::get_group_index(TransferMetadata &f_meta)
+    {
+        std::lock_guard<std::mutex> lock(m_torrents_mutex);
+        if (m_group_entry == nullptr)
+        {
+            return -1;
+        }
+        std::lock_guard<std::mutex> files_lock(m_files_mutex);
+        for (const auto &[index, file] : m_group_entry->files)
+        {
+            if (file.meta == &f_meta)
+            {
+                return index;
+            }
+        }
+        return -1;
+    }
+
+    std::vector<TransferMetadata *> TransferInterfaceBittorrent::get_files(torrent_entry_t &entry)
+    {
+        std::lock_guard<std::mutex> lock(m_files_mutex);
+        if (entry.files.empty())
+        {
+            return {entry.meta};
+        }
+
+        std::vector<TransferMetadata *> files;
+        files.reserve(entry.files.size());
+        for (const auto &[index, file] : entry.files)
+        {
+            files.push_back(file.meta);
+        }
+        return files;
+    }
+
+    TransferMetadata *TransferInterfaceBittorrent::get_single_file(torrent_entry_t &entry)
+    {
+        std::lock_guard<std::mutex> lock(m_files_mutex);
+        return entry.files.empty() ? entry.meta : nullptr;
+    }
+
+    bool TransferInterfaceBittorrent::is_group_done(torrent_entry_t &entry)
+    {
+        // files still announced by the uploader
+        if (!m_config.get_expected_files().empty())
+        {
+            return false;
+        }
+        for (TransferMetadata *f_meta : get_files(entry))
+        {
+            if (f_meta->get_status() != status_type::e_status::FINISHED && f_meta->get_status() != status_type::e_status::ERROR)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int TransferInterfaceBittorrent::magnet_file_index(const std::string &magnet)
+    {
+        lt::error_code ec;
+        lt::add_torrent_params p = lt::parse_magnet_uri(magnet, ec);
         if (ec)
         {
-            ers::error(BittorrentInvalidMagnetLinkError(ERS_HERE, uri.to_string()));
+            return -1;
+        }
+        for (size_t i = 0; i < p.file_priorities.size(); i++)
+        {
+            if (p.file_priorities[i] != lt::dont_download)
+            {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    void TransferInterfaceBittorrent::set_group_params(lt::add_torrent_params &p, torrent_entry_t *entry)
+    {
+        if (entry == nullptr || !m_is_client)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_files_mutex);
+        for (const auto &[index, file] : entry->files)
+        {
+            if (p.file_priorities.size() <= static_cast<size_t>(index))
+            {
+                p.file_priorities.resize(static_cast<size_t>(index) + 1, lt::dont_download);
+            }
+            p.file_priorities[static_cast<size_t>(index)] = lt::default_priority;
+            // outside of the save path, where the file would be if it was transferred alone
+            p.renamed_files[lt::file_index_t{index}] = file.path;
+        }
+    }
+
+    void TransferInterfaceBittorrent::apply_group_file(const lt::torrent_handle &h, int index, const torrent_file_t &file)
+    {
+        // ignored by libtorrent until the metadata is received, applied again then
+        h.rename_file(lt::file_index_t{index}, file.path);
+        if (file.meta->get_status() != status_type::e_status::PAUSED)
+        {
+            h.file_priority(lt::file_index_t{index}, lt::default_priority);
+        }
+    }
+
+    bool TransferInterfaceBittorrent::add_group_file(TransferMetadata &f_meta, int index, const std::filesystem::path &dest)
+    {
+        std::shared_ptr<torrent_entry_t> entry;
+        bool first = false;
+        {
+            std::lock_guard<std::mutex> lock(m_torrents_mutex);
+            if (m_group_entry == nullptr)
+            {
+                m_group_entry = std::make_shared<torrent_entry_t>();
+                m_group_entry->meta = &f_meta;
+                m_group_entry->owner = this;
+                m_session->track(m_group_entry.get());
+                first = true;
+            }
+            entry = m_group_entry;
+            m_torrents[&f_meta] = entry;
+        }
+
+        torrent_file_t file;
+        file.meta = &f_meta;
+        file.path = std::filesystem::absolute(dest / f_meta.get_file_name()).string();
+        {
+            std::lock_guard<std::mutex> lock(m_files_mutex);
+            entry->files[index] = file;
+        }
+
+        if (first)
+        {
+            // the first file adds the torrent of the group, the others are selected in it
+            bool added = m_is_client ? add_magnet(f_meta.get_magnet_link(), dest, entry.get())
+                                     : add_torrent(get_work_dir().append(m_config.get_group_id() + ".torrent"), get_work_dir().append(".group"), entry.get()) != "";
+            if (!added)
+            {
+                remove_entry(f_meta);
+                return false;
+            }
+        }
+        else if (m_is_client)
+        {
+            lt::torrent_handle h = m_session->get_handle(entry.get());
+            if (h.is_valid())
+            {
+                apply_group_file(h, index, file);
+            }
+        }
+        return true;
+    }
+
+    void TransferInterfaceBittorrent::on_status(torrent_entry_t &entry, const lt::torrent_status &s)
+    {
+        if (m_finalized)
+        {
+            return;
+        }
+
+        status_type::e_status status = status_type::e_status::WAITING;
+        bool known_state = true;
+        switch (s.state)
+        {
+        case lt::torrent_status::checking_files:
+        case lt::torrent_status::checking_resume_data:
+            status = status_type::e_status::CHECKING;
+            break;
+        case lt::torrent_status::downloading_metadata:
+            status = status_type::e_status::PREPARING;
+            break;
+        case lt::torrent_status::downloading:
+            status = status_type::e_status::DOWNLOADING;
+            break;
+        case lt::torrent_status::finished:
+            status = status_type::e_status::FINISHED;
+            break;
+        case lt::torrent_status::seeding:
+            status = m_is_client ? status_type::e_status::FINISHED : status_type::e_status::UPLOADING;
+            break;
+        default:
+            known_state = false;
+            break;
+        }
+
+        TransferMetadata *single = get_single_file(entry);
+        for (TransferMetadata *f_meta : known_state ? get_files(entry) : std::vector<TransferMetadata *>())
+        {
+            // a downloaded file of the group stays finished while the others are downloaded
+            bool keep = f_meta->get_status() == status_type::e_status::PAUSED ||
+                        (single == nullptr && m_is_client && f_meta->get_status() == status_type::e_status::FINISHED);
+            if (!keep && status != f_meta->get_status())
+            {
+                f_meta->set_status(status);
+            }
+        }
+
+        if (s.total_done != entry.total_done)
+        {
+            entry.total_done = s.total_done;
+            if (single != nullptr)
+            {
+                single->set_bytes_transferred(static_cast<uint64_t>(s.total_done));
+            }
+            else
+            {
+                // progress of each file comes with the file_progress_alert
+                s.handle.post_file_progress(lt::torrent_handle::piece_granularity);
+            }
+        }
+
+        // log on state changes, and at most every m_log_interval otherwise
+        auto now = clk::now();
+        if (s.state != entry.state || now - entry.last_log >= m_log_interval)
+        {
+            entry.state = s.state;
+            entry.last_log = now;
+            TLOG() << "is_client " << m_is_client
+                   << " " << s.name << " " << state(s.state) << ' '
+                   << (s.download_payload_rate / 1000) << " kB/s "
+                   << (s.total_done / 1000) << " kB ("
+                   << (s.progress_ppm / 10000) << "%) "
+                   << s.current_tracker << " " << static_cast<std::int64_t>(duration_cast<seconds>(s.next_announce).count()) << "s ("
+                   << s.num_peers << " peers) ";
+        }
+    }
+
+    std::filesystem::path TransferInterfaceBittorrent::resume_file_path(const lt::info_hash_t &info_hashes) const
+    {
+        std::stringstream name;
+        if (info_hashes.has_v2())
+        {
+            name << info_hashes.v2;
+        }
+        else
+        {
+            name << info_hashes.v1;
+        }
+        return m_resume_dir / (name.str() + ".resume");
+    }
+
+    bool TransferInterfaceBittorrent::save_resume_file(const lt::add_torrent_params &params)
+    {
+        std::filesystem::path path = resume_file_path(params.info_hashes);
+        std::filesystem::path tmp = path;
+        tmp += ".tmp";
+        auto const b = lt::write_resume_data_buf(params);
+
+        // written aside, synced and renamed, a crash leaves either the previous or the new resume data
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        bool ok = fd >= 0 && ::write(fd, b.data(), b.size()) == static_cast<ssize_t>(b.size()) && ::fsync(fd) == 0;
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+
+        std::error_code ec;
+        if (ok)
+        {
+            std::filesystem::rename(tmp, path, ec);
+        }
+        if (!ok || ec)
+        {
+            std::filesystem::remove(tmp, ec);
+            ers::warning(BittorrentSaveResumeFileError(ERS_HERE, path.string()));
             return false;
         }
-
-        // std::vector<char> resume_data;
-        // if (load_file(resume_file(p.info_hashes, session_number), resume_data))
-        // {
-        //     p = lt::read_resume_data(resume_data, ec);
-        //     if (ec)
-        //     {
-        //         std::printf("  failed to load resume data: %s\n", ec.message().c_str());
-        //     }
-        // }
-
-        set_torrent_params(p, dest);
-
-        TLOG() << "debug : adding torrent";
-        ses.async_add_torrent(std::move(p));
         return true;
     }
-    catch (lt::system_error const &e)
-    {
-        ers::error(BittorrentInvalidMagnetLinkError(ERS_HERE, e.code().message()));
-        return false;
-    }
 
-    // return magnet url
-    std::string TransferInterfaceBittorrent::add_torrent(const std::string &torrent, const std::filesystem::path &dest)
-    try
+    bool TransferInterfaceBittorrent::load_resume_file(lt::add_torrent_params &p)
     {
-        using lt::storage_mode_t;
-
-        TLOG() << "debug : [" << m_torrent_num << "] " << torrent;
-
-        // lt::error_code ec;
-        lt::add_torrent_params p = lt::load_torrent_file(torrent);
-
-        // std::vector<char> resume_data;
-        // if (load_file(resume_file(atp.info_hashes, session_number), resume_data))
-        // {
-        //     lt::add_torrent_params rd = lt::read_resume_data(resume_data, ec);
-        //     if (ec)
-        //     {
-        //         std::printf("  failed to load resume data: %s\n", ec.message().c_str());
-        //     }
-        //     else
-        //     {
-        //         atp = rd;
-        //     }
-        // }
+        std::filesystem::path path = resume_file_path(p.info_hashes);
+        std::error_code fs_ec;
+        if (!std::filesystem::exists(path, fs_ec))
+        {
+            return false;
+        }
 
-        set_torrent_params(p, dest);
-        std::string magnet = lt::make_magnet_uri(p);
+        lt::error_code ec;
+        std::vector<char> buf;
+        try
+        {
+            buf = load_file(path.string());
+        }
+        catch (const std::exception &e)
+        {
+            ers::warning(BittorrentLoadResumeFileError(ERS_HERE, path.string()));
+            return false;
+        }
+        lt::add_torrent_params rd = lt::read_resume_data(buf, ec);
+        if (ec || !(rd.info_hashes == p.info_hashes))
+        {
+            ers::warning(BittorrentLoadResumeFileError(ERS_HERE, path.string()));
+            return false;
+        }
 
-        ses.async_add_torrent(std::move(p));
+        TLOG() << "debug : resuming " << rd.name << " from " << path.string();
 
-        return magnet;
-    }
-    catch (lt::system_error const &e)
-    {
-        ers::error(BittorrentInvalidTorrentFileError(ERS_HERE, e.code().message()));
-        return "";
+        // peers and trackers of the new magnet link are still used
+        rd.peers.insert(rd.peers.end(), p.peers.begin(), p.peers.end());
+        rd.trackers.insert(rd.trackers.end(), p.trackers.begin(), p.trackers.end());
+        p = std::move(rd);
+        return true;
     }
 
     void TransferInterfaceBittorrent::set_torrent_params(lt::add_torrent_params &p, const std::filesystem::path &dest)
@@ -505,12 +1039,19 @@ namespace dunedaq::snbmodules
         bool super_seeding = false;
         bool upload_mode = !m_is_client;
 
+        // in order while the uploader is the only source, rarest first once the downloaders exchange pieces
         bool sequential_mode = true;
+        if (m_is_client)
+        {
+            std::lock_guard<std::mutex> lock(m_peers_mutex);
+            sequential_mode = m_peer_endpoints.empty();
+        }
         int max_connections_per_torrent = 100;
         std::string save_path = dest;
-        // limits in bytes per seconds hqndle by session ?
-        int torrent_upload_limit = -1;
-        int torrent_download_limit = m_rate_limit;
+        // limits in bytes per seconds, the torrent shares the limit of the transfer with the others
+        int torrent_limit = torrent_rate_limit(get_limited_handles().size() + 1);
+        int torrent_upload_limit = m_is_client ? -1 : torrent_limit;
+        int torrent_download_limit = m_is_client ? torrent_limit : m_rate_limit;
 
         p.max_connections = max_connections_per_torrent;
         p.max_uploads = -1;
@@ -558,194 +1099,14 @@ namespace dunedaq::snbmodules
             p.flags &= ~lt::torrent_flags::sequential_download;
         }
 
-        p.save_path = save_path;
-        p.storage_mode = lt::storage_mode_allocate;
-    }
-
-    lt::session_params TransferInterfaceBittorrent::set_settings(const IPFormat &listen_interface, const std::string &listen_port)
-    {
-        lt::session_params sp;
-        auto &p = sp.settings;
-
-        sp.disk_io_constructor = lt::default_disk_io_constructor;
-
-        int block_size = 1024 * 1024;
-        std::string outgoing_interface = listen_interface.get_ip();
-        std::string listen_interfaces = listen_interface.get_ip() + ":" + listen_port;
-
-        p.set_bool(lt::settings_pack::enable_dht, false);
-        p.set_int(lt::settings_pack::auto_manage_interval, 60);
-        p.set_int(lt::settings_pack::auto_manage_startup, 1);
-        p.set_int(lt::settings_pack::min_reconnect_time, 1);
-        p.set_int(lt::settings_pack::max_failcount, 10);
-
-        // p.set_str(lt::settings_pack::dht_bootstrap_nodes, "192.168.0.105:5001,192.168.0.106:5002");
-        // p.set_bool(lt::settings_pack::use_dht_as_fallback, false);
-        // p.set_bool(lt::settings_pack::dht_prefer_verified_node_ids, false);
-        // p.set_bool(lt::settings_pack::dht_restrict_routing_ips, false);
-        // p.set_bool(lt::settings_pack::dht_restrict_search_ips, false);
-
-        p.set_str(lt::settings_pack::outgoing_interfaces, outgoing_interface);
-        p.set_bool(lt::settings_pack::strict_end_game_mode, false);
-        // p.set_bool(lt::settings_pack::low_prio_disk, false);
-        p.set_bool(lt::settings_pack::smooth_connects, false);
-        p.set_bool(lt::settings_pack::allow_multiple_connections_per_ip, true);
-        p.set_bool(lt::settings_pack::announce_to_all_tiers, true);
-        p.set_bool(lt::settings_pack::announce_to_all_trackers, true);
-        p.set_bool(lt::settings_pack::auto_sequential, true);
-        // p.set_bool(lt::settings_pack::coalesce_reads, true);
-        // p.set_bool(lt::settings_pack::coalesce_writes, true);
-        // p.set_bool(lt::settings_pack::contiguous_recv_buffer, true);
-        p.set_bool(lt::settings_pack::incoming_starts_queued_torrents, true);
-
-        p.set_bool(lt::settings_pack::enable_incoming_tcp, true);
-        p.set_bool(lt::settings_pack::enable_outgoing_tcp, true);
-        p.set_bool(lt::settings_pack::enable_incoming_utp, false);
-        p.set_bool(lt::settings_pack::enable_outgoing_utp, false);
-        p.set_bool(lt::settings_pack::enable_lsd, false);
-        p.set_bool(lt::settings_pack::enable_natpmp, false);
-        p.set_bool(lt::settings_pack::enable_upnp, false);
-        p.set_bool(lt::settings_pack::prefer_rc4, false);
-        p.set_bool(lt::settings_pack::prefer_udp_trackers, true);
-        p.set_bool(lt::settings_pack::rate_limit_ip_overhead, false);
-        // p.set_bool(lt::settings_pack::rate_limit_utp, false);
-
-        p.set_int(lt::settings_pack::aio_threads, 1);
-        // p.set_int(lt::settings_pack::network_threads, 1);
-        p.set_int(lt::settings_pack::hashing_threads, 1);
-        p.set_int(lt::settings_pack::disk_io_read_mode, 3);
-        p.set_int(lt::settings_pack::disk_io_write_mode, 3);
-        p.set_int(lt::settings_pack::allowed_enc_level, 3);
-        p.set_int(lt::settings_pack::allowed_fast_set_size, 5);
-        p.set_int(lt::settings_pack::seed_choking_algorithm, 1);
-        p.set_int(lt::settings_pack::choking_algorithm, 0);
-        p.set_int(lt::settings_pack::in_enc_policy, 2);
-        p.set_int(lt::settings_pack::out_enc_policy, 2);
-        p.set_int(lt::settings_pack::mixed_mode_algorithm, 0);
-        p.set_int(lt::settings_pack::suggest_mode, 0);
-
-        p.set_int(lt::settings_pack::close_file_interval, 0);
-        p.set_int(lt::settings_pack::inactivity_timeout, 10);
-        p.set_int(lt::settings_pack::request_queue_time, 50);
-        p.set_int(lt::settings_pack::peer_timeout, 20);
-        p.set_int(lt::settings_pack::request_timeout, 10);
-        p.set_int(lt::settings_pack::predictive_piece_announce, 20);
-        p.set_int(lt::settings_pack::whole_pieces_threshold, 20);
-        p.set_int(lt::settings_pack::mmap_file_size_cutoff, 0);
-
-        // limits in bytes per seconds
-        p.set_int(lt::settings_pack::upload_rate_limit, 0);
-        p.set_int(lt::settings_pack::download_rate_limit, 0);
-        // p.set_int(lt::settings_pack::local_download_rate_limit, 0);
-        // p.set_int(lt::settings_pack::local_upload_rate_limit, 0);
-        p.set_int(lt::settings_pack::unchoke_slots_limit, -1);
-        p.set_int(lt::settings_pack::max_failcount, 3);
-        p.set_int(lt::settings_pack::max_http_recv_buffer_size, 1024 * 1024 * 8);
-        p.set_int(lt::settings_pack::max_rejects, 20);
-        p.set_int(lt::settings_pack::max_queued_disk_bytes, 1024 * 1024 * 1024);
-
-        p.set_int(lt::settings_pack::read_cache_line_size, 512);
-        // p.set_int(lt::settings_pack::cache_buffer_chunk_size, 512);
-        // p.set_int(lt::settings_pack::cache_expiry, 400);
-        p.set_int(lt::settings_pack::cache_size_volatile, 128);
-        p.set_int(lt::settings_pack::checking_mem_usage, 1024);
-        // p.set_bool(lt::settings_pack::use_read_cache, true);
-        // p.set_bool(lt::settings_pack::use_write_cache, true);
-        // p.set_bool(lt::settings_pack::use_disk_read_ahead, true);
-        p.set_bool(lt::settings_pack::use_parole_mode, false);
-        // p.set_bool(lt::settings_pack::guided_read_cache, true);
-        // p.set_bool(lt::settings_pack::volatile_read_cache, false);
-        p.set_int(lt::settings_pack::tracker_completion_timeout, 30);
-        p.set_int(lt::settings_pack::tracker_receive_timeout, 30);
-        p.set_int(lt::settings_pack::stop_tracker_timeout, 30);
-        p.set_int(lt::settings_pack::tracker_backoff, 250);
-        p.set_int(lt::settings_pack::tracker_maximum_response_length, 1024 * 1024 * 8);
-        p.set_bool(lt::settings_pack::validate_https_trackers, false);
-        p.set_int(lt::settings_pack::alert_mask, lt::alert_category::all);
-
-        p.set_str(lt::settings_pack::listen_interfaces, listen_interfaces);
-
-        if (m_is_client)
+        // torrents generated before the tracker was configured still announce to it
+        if (!m_tracker.empty() && std::find(p.trackers.begin(), p.trackers.end(), m_tracker) == p.trackers.end())
         {
-            // p.set_str(lt::settings_pack::user_agent, "DuneTorrentClient");
-            p.set_bool(lt::settings_pack::piece_extent_affinity, true);
-            p.set_bool(lt::settings_pack::seeding_outgoing_connections, false);
-
-            p.set_int(lt::settings_pack::tick_interval, 500);
-            p.set_int(lt::settings_pack::torrent_connect_boost, 255);
-
-            p.set_int(lt::settings_pack::connection_speed, 0);
-            p.set_int(lt::settings_pack::active_seeds, 0);
-            p.set_int(lt::settings_pack::active_downloads, 10);
-            p.set_int(lt::settings_pack::active_checking, 10);
-            p.set_int(lt::settings_pack::active_limit, 10);
-            p.set_int(lt::settings_pack::active_tracker_limit, 10);
-            p.set_int(lt::settings_pack::connections_limit, 10);
-            // p.set_int(lt::settings_pack::half_open_limit, 500);
-            p.set_int(lt::settings_pack::file_pool_size, 10);
-            p.set_int(lt::settings_pack::listen_queue_size, 10);
-            p.set_int(lt::settings_pack::max_allowed_in_request_queue, 50000);
-            p.set_int(lt::settings_pack::max_out_request_queue, 50000);
-            p.set_int(lt::settings_pack::dht_upload_rate_limit, block_size * 10);
-
-            p.set_int(lt::settings_pack::write_cache_line_size, 512);
-            // p.set_int(lt::settings_pack::cache_size, 1024 * 1);
-            // p.set_bool(lt::settings_pack::use_disk_cache_pool, true);
-            // p.set_bool(lt::settings_pack::allow_partial_disk_writes, false);
-
-            p.set_int(lt::settings_pack::send_buffer_watermark_factor, 50);
-            p.set_int(lt::settings_pack::send_buffer_low_watermark, 1024 * 10);
-            p.set_int(lt::settings_pack::send_buffer_watermark, 1024 * 500);
-            p.set_int(lt::settings_pack::send_socket_buffer_size, 1024 * 512);
-            p.set_int(lt::settings_pack::recv_socket_buffer_size, 1024 * 1024 * 1024);
-
-            p.set_bool(lt::settings_pack::no_atime_storage, true);
-            p.set_bool(lt::settings_pack::enable_set_file_valid_data, false);
-            p.set_int(lt::settings_pack::disk_write_mode, 1);
-            p.set_bool(lt::settings_pack::disable_hash_checks, false);
+            p.trackers.push_back(m_tracker);
         }
-        else
-        {
 
-            // p.set_str(lt::settings_pack::user_agent, "DuneTorrentSeeder");
-            p.set_bool(lt::settings_pack::piece_extent_affinity, false);
-            p.set_bool(lt::settings_pack::seeding_outgoing_connections, true);
-
-            p.set_int(lt::settings_pack::tick_interval, 150);
-            p.set_int(lt::settings_pack::torrent_connect_boost, 255);
-
-            p.set_int(lt::settings_pack::connection_speed, 200);
-            p.set_int(lt::settings_pack::active_seeds, 1000);
-            p.set_int(lt::settings_pack::active_downloads, 0);
-            p.set_int(lt::settings_pack::active_checking, 1000);
-            p.set_int(lt::settings_pack::active_limit, 2000);
-            p.set_int(lt::settings_pack::active_tracker_limit, 2000);
-            p.set_int(lt::settings_pack::connections_limit, 8000);
-            // p.set_int(lt::settings_pack::half_open_limit, 50);
-            p.set_int(lt::settings_pack::file_pool_size, 20);
-            p.set_int(lt::settings_pack::listen_queue_size, 3000);
-            p.set_int(lt::settings_pack::max_allowed_in_request_queue, 2000);
-            p.set_int(lt::settings_pack::max_out_request_queue, 2000);
-            p.set_int(lt::settings_pack::dht_upload_rate_limit, block_size * 8);
-
-            p.set_int(lt::settings_pack::write_cache_line_size, 128);
-            // p.set_int(lt::settings_pack::cache_size, 1024 * 50);
-            // p.set_bool(lt::settings_pack::use_disk_cache_pool, false);
-            // p.set_bool(lt::settings_pack::allow_partial_disk_writes, false);
-
-            p.set_int(lt::settings_pack::send_buffer_watermark_factor, 150);
-            p.set_int(lt::settings_pack::send_buffer_low_watermark, 1024 * 10);
-            p.set_int(lt::settings_pack::send_buffer_watermark, 1024 * 1024 * 1024);
-            p.set_int(lt::settings_pack::send_socket_buffer_size, 1024 * 1024 * 1024);
-            p.set_int(lt::settings_pack::recv_socket_buffer_size, 1024 * 512);
-
-            // p.set_bool(lt::settings_pack::no_atime_storage, true);
-            // p.set_bool(lt::settings_pack::enable_set_file_valid_data, false);
-            // p.set_int(lt::settings_pack::disk_write_mode, 1);
-            // p.set_bool(lt::settings_pack::disable_hash_checks, false);
-        }
-
-        return sp;
+        p.save_path = save_path;
+        p.storage_mode = lt::storage_mode_allocate;
     }
 
     std::vector<char> TransferInterfaceBittorrent::load_file(std::string const &filename)
@@ -828,7 +1189,7 @@ namespace dunedaq::snbmodules
         return true;
     }
 
-    bool TransferInterfaceBittorrent::make_torrent(std::filesystem::path full_path, int piece_size, const std::string &tracker, const std::string &outfile)
+    bool TransferInterfaceBittorrent::make_torrent(std::filesystem::path full_path, int piece_size, const std::string &tracker, const std::string &outfile, TransferMetadata *f_meta, std::vector<char> *torrent_buffer)
     try
     {
         std::string creator_str = "libtorrent";
@@ -871,14 +1232,47 @@ namespace dunedaq::snbmodules
             }
         }
 
-        t.add_tracker(tracker);
+        if (!tracker.empty())
+        {
+            t.add_tracker(tracker);
+        }
         t.set_priv(false);
 
-        auto const num = t.num_pieces();
-        lt::set_piece_hashes(t, branch_path(full_path), [num](lt::piece_index_t const p)
-                             { std::cerr << "\r" << p << "/" << num; });
+        if (f_meta != nullptr)
+        {
+            f_meta->set_status(status_type::e_status::HASHING);
+        }
+
+        TorrentHasher hasher(m_hashing_threads);
+        bool hashed = hasher.set_piece_hashes(t, branch_path(full_path), [f_meta](uint64_t bytes_hashed, uint64_t /*total_bytes*/)
+                                              {
+                                                  if (f_meta != nullptr)
+                                                  {
+                                                      f_meta->set_bytes_transferred(bytes_hashed);
+                                                  } });
+
+        if (f_meta != nullptr)
+        {
+            // bytes transferred only count the transfer itself
+            f_meta->set_bytes_transferred(0);
+            if (!hashed)
+            {
+                f_meta->set_status(status_type::e_status::ERROR);
+                f_meta->set_error_code("failed to hash file");
+            }
+            else if (f_meta->get_status() == status_type::e_status::HASHING)
+            {
+                // the file can have been cancelled while hashing
+                f_meta->set_status(status_type::e_status::WAITING);
+            }
+        }
+
+        if (!hashed)
+        {
+            return false;
+        }
 
-        std::cerr << "\n";
+        TLOG() << "debug : hashed " << full_path << " (" << hasher.get_bytes_hashed() << " bytes) with " << hasher.get_num_threads() << " threads";
         t.set_creator(creator_str.c_str());
         if (!comment_str.empty())
         {
@@ -907,34 +1301,367 @@ namespace dunedaq::snbmodules
             return false;
         }
 
+        if (torrent_buffer != nullptr)
+        {
+            *torrent_buffer = std::move(torrent);
+        }
+
         return true;
     }
     catch (std::exception &e)
     {
-        std::cerr << "ERROR: " << e.what() << "\n";
+        ers::error(BittorrentError(ERS_HERE, "cannot create the torrent of " + full_path.string() + " : " + e.what()));
+        // the file would otherwise stay HASHING and never be sent
+        if (f_meta != nullptr && f_meta->get_status() != status_type::e_status::CANCELLED)
+        {
+            f_meta->set_bytes_transferred(0);
+            f_meta->set_status(status_type::e_status::ERROR);
+            f_meta->set_error_code(std::string("cannot create the torrent : ") + e.what());
+        }
         return false;
     }
 
-    void TransferInterfaceBittorrent::generate_torrents_files(const std::filesystem::path &dest, const std::string &tracker)
+    int TransferInterfaceBittorrent::compute_piece_size(uint64_t file_size, size_t num_destinations, uint64_t link_speed)
+    {
+        const uint64_t min_piece_size = 16 * 1024;
+        const uint64_t max_piece_size = 16 * 1024 * 1024;
+        // Pieces per destination, enough to keep the request queues busy and to exchange pieces between downloaders
+        const uint64_t pieces_per_destination = 256;
+        // Minimum time to send a piece on the link, under it the request round trips dominate
+        const uint64_t min_piece_time_ms = 4;
+
+        auto next_pow2 = [](uint64_t v)
+        {
+            uint64_t p = 1;
+            while (p < v)
+            {
+                p <<= 1;
+            }
+            return p;
+        };
+
+        // largest piece still giving the target number of pieces
+        uint64_t target_pieces = pieces_per_destination * std::max<uint64_t>(num_destinations, 1);
+        uint64_t piece_size = next_pow2(file_size / target_pieces + 1) >> 1;
+
+        // a piece taking the minimum time on the link is big enough, more pieces only spread the file better
+        if (link_speed > 0)
+        {
+            piece_size = std::min(piece_size, next_pow2(link_speed * min_piece_time_ms / 1000));
+        }
+
+        // never bigger than the file itself
+        piece_size = std::min(piece_size, next_pow2(file_size));
+        piece_size = std::clamp(piece_size, min_piece_size, max_piece_size);
+
+        return static_cast<int>(piece_size);
+    }
+
+    void TransferInterfaceBittorrent::generate_torrents_files(const std::filesystem::path &dest, const std::string &tracker, size_t num_destinations)
     {
         for (const auto &f_meta : get_transfer_options().get_transfers_meta())
         {
-            std::filesystem::path tmp = dest;
-            make_torrent(f_meta->get_file_path(), static_cast<int>(pow(2, 23)), tracker, tmp.append(f_meta->get_file_name() + ".torrent").string());
+            generate_torrent_file(*f_meta, dest, tracker, num_destinations);
+        }
+    }
+
+    std::filesystem::path TransferInterfaceBittorrent::torrent_file_path(TransferMetadata &f_meta, const std::filesystem::path &dest)
+    {
+        std::lock_guard<std::mutex> lock(m_files_mutex);
+        auto it = m_torrent_files.find(&f_meta);
+        if (it == m_torrent_files.end())
+        {
+            it = m_torrent_files.emplace(&f_meta, dest / (f_meta.get_file_name() + "." + std::to_string(m_next_torrent_file++) + ".torrent")).first;
+        }
+        return it->second;
+    }
+
+    std::filesystem::path TransferInterfaceBittorrent::get_torrent_file(TransferMetadata &f_meta)
+    {
+        std::lock_guard<std::mutex> lock(m_files_mutex);
+        auto it = m_torrent_files.find(&f_meta);
+        return it == m_torrent_files.end() ? std::filesystem::path() : it->second;
+    }
+
+    bool TransferInterfaceBittorrent::is_reusable_torrent(const std::vector<char> &torrent, const TransferMetadata &f_meta) const
+    {
+        lt::error_code ec;
+        lt::torrent_info ti(torrent, ec, lt::from_span);
+        return !ec && static_cast<uint64_t>(ti.total_size()) == f_meta.get_size() &&
+               (m_piece_size <= 0 || ti.piece_length() == m_piece_size);
+    }
+
+    std::string TransferInterfaceBittorrent::generate_torrent_file(TransferMetadata &f_meta, const std::filesystem::path &dest, const std::string &tracker, size_t num_destinations)
+    try
+    {
+        std::filesystem::path torrent_path = torrent_file_path(f_meta, dest);
+
+        // Same file already sent to another destination, nothing to read
+        TorrentCache::entry_t cached;
+        if (m_cache != nullptr && m_cache->lookup(f_meta.get_file_path(), cached) && cached.tracker == tracker && is_reusable_torrent(cached.torrent, f_meta))
+        {
+            TLOG() << "debug : reusing cached torrent of " << f_meta.get_file_name();
+            std::ofstream out(torrent_path, std::ios_base::binary);
+            out.write(cached.torrent.data(), static_cast<std::streamsize>(cached.torrent.size()));
+            if (!out)
+            {
+                ers::error(BittorrentError(ERS_HERE, "cannot write torrent file " + torrent_path.string()));
+                return "";
+            }
+
+            f_meta.set_hash(cached.hash);
+            if (f_meta.get_status() == status_type::e_status::PREPARING)
+            {
+                f_meta.set_status(status_type::e_status::WAITING);
+            }
+            return with_web_seed(cached.magnet, f_meta.get_file_path());
+        }
+
+        std::vector<char> torrent;
+
+        // The torrent may already have been generated while the file was written (see TorrentTailHasher).
+        // The tail hasher can rewrite or remove it at any time, any failure falls back to hashing the file
+        std::filesystem::path sidecar = TorrentTailHasher::sidecar_path(f_meta.get_file_path());
+        bool from_sidecar = false;
+        std::error_code sidecar_ec;
+        std::error_code file_ec;
+        auto sidecar_time = std::filesystem::last_write_time(sidecar, sidecar_ec);
+        auto file_time = std::filesystem::last_write_time(f_meta.get_file_path(), file_ec);
+        if (!sidecar_ec && !file_ec && sidecar_time >= file_time)
+        {
+            std::ifstream in(sidecar, std::ios_base::binary);
+            torrent.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            from_sidecar = in.is_open() && !in.bad() && is_reusable_torrent(torrent, f_meta);
+            if (from_sidecar)
+            {
+                std::filesystem::copy_file(sidecar, torrent_path, std::filesystem::copy_options::overwrite_existing, sidecar_ec);
+                from_sidecar = !sidecar_ec;
+            }
+        }
+
+        if (from_sidecar)
+        {
+            TLOG() << "debug : reusing torrent hashed while writing " << f_meta.get_file_name();
+            if (f_meta.get_status() == status_type::e_status::PREPARING)
+            {
+                f_meta.set_status(status_type::e_status::WAITING);
+            }
+        }
+        else
+        {
+            int piece_size = m_piece_size > 0 ? m_piece_size : compute_piece_size(f_meta.get_size(), num_destinations, m_link_speed);
+            TLOG() << "debug : piece size of " << f_meta.get_file_name() << " : " << piece_size << " bytes";
+
+            torrent.clear();
+            if (!make_torrent(f_meta.get_file_path(), piece_size, tracker, torrent_path.string(), &f_meta, &torrent))
+            {
+                return "";
+            }
+        }
+
+        // Magnet link is built from the in memory torrent, no need to reload it from disk
+        lt::add_torrent_params atp = lt::load_torrent_buffer(torrent);
+        // the torrent hashed while the file was written has no tracker, it is not part of the info-hash
+        if (!tracker.empty() && std::find(atp.trackers.begin(), atp.trackers.end(), tracker) == atp.trackers.end())
+        {
+            atp.trackers.push_back(tracker);
+        }
+        TorrentCache::entry_t entry;
+        entry.magnet = lt::make_magnet_uri(atp);
+        entry.tracker = tracker;
+
+        // Whole file hash is the merkle root of the file
+        std::stringstream root;
+        root << atp.ti->files().root(lt::file_index_t{0});
+        entry.hash = root.str();
+        f_meta.set_hash(entry.hash);
+
+        if (m_cache != nullptr)
+        {
+            entry.torrent = std::move(torrent);
+            m_cache->store(f_meta.get_file_path(), entry);
+        }
+        return with_web_seed(entry.magnet, f_meta.get_file_path());
+    }
+    catch (lt::system_error const &e)
+    {
+        ers::error(BittorrentInvalidTorrentFileError(ERS_HERE, e.code().message()));
+        return "";
+    }
+
+    std::string TransferInterfaceBittorrent::with_web_seed(const std::string &magnet, const std::filesystem::path &path, const std::vector<std::filesystem::path> &files /*= {}*/)
+    {
+        if (m_web_seed == nullptr || magnet.empty())
+        {
+            return magnet;
+        }
+
+        // BEP 19: the url of a single file torrent is the file, a multi-file torrent appends its name and the path of each file.
+        // Only these files are served, not the rest of the directory as the torrent sidecars
+        std::filesystem::path dir = path.parent_path();
+        std::vector<std::filesystem::path> shared;
+        if (std::filesystem::is_regular_file(path))
+        {
+            shared.push_back(path.filename());
+        }
+        for (const auto &file : files)
+        {
+            shared.push_back(path.filename() / file);
+        }
+
+        std::string url;
+        std::lock_guard<std::mutex> lock(m_web_shared_mutex);
+        for (const auto &relative : shared)
+        {
+            url = m_web_seed->share_file(dir, relative);
+            m_web_shared.emplace_back(dir, relative);
+        }
+        if (url.empty())
+        {
+            return magnet;
+        }
+        if (std::filesystem::is_regular_file(path))
+        {
+            url += WebSeedServer::escape(path.filename().string());
+        }
+        return magnet + "&ws=" + WebSeedServer::escape(url);
+    }
+
+    std::vector<std::string> TransferInterfaceBittorrent::generate_group_torrent(const std::vector<TransferMetadata *> &files, const std::filesystem::path &dest, const std::string &tracker, size_t num_destinations)
+    try
+    {
+        std::vector<std::string> magnets(files.size());
+        if (files.empty())
+        {
+            return magnets;
+        }
+
+        // The files of a group can come from different directories, the torrent is made from links to them.
+        // They are in a hidden directory, not to be found again by the scans of the client
+        std::filesystem::path links_dir = get_work_dir().append(".group").append(m_config.get_group_id());
+        std::filesystem::remove_all(links_dir);
+        std::filesystem::create_directories(links_dir);
+
+        std::map<std::string, size_t> link_to_file;
+        uint64_t max_size = 0;
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            std::string link = files[i]->get_file_name();
+            if (link_to_file.count(link) != 0)
+            {
+                link = std::to_string(i) + "_" + link;
+            }
+            std::filesystem::create_symlink(std::filesystem::absolute(files[i]->get_file_path()), links_dir / link);
+            link_to_file[link] = i;
+            max_size = std::max(max_size, files[i]->get_size());
+            files[i]->set_status(status_type::e_status::HASHING);
+        }
+
+        // every file starts on a piece boundary, pieces are not bigger than the largest file
+        int piece_size = m_piece_size > 0 ? m_piece_size : compute_piece_size(max_size, num_destinations, m_link_speed);
+        TLOG() << "debug : piece size of the torrent of group " << m_config.get_group_id() << " : " << piece_size << " bytes";
+
+        std::vector<char> torrent;
+        bool hashed = make_torrent(links_dir, piece_size, tracker, (dest / (m_config.get_group_id() + ".torrent")).string(), nullptr, &torrent);
+        for (TransferMetadata *f_meta : files)
+        {
+            if (!hashed)
+            {
+                f_meta->set_status(status_type::e_status::ERROR);
+                f_meta->set_error_code("failed to hash file");
+            }
+            else if (f_meta->get_status() == status_type::e_status::HASHING)
+            {
+                // the file can have been cancelled while hashing
+                f_meta->set_status(status_type::e_status::WAITING);
+            }
+        }
+        if (!hashed)
+        {
+            return magnets;
+        }
+
+        // Each file gets the magnet link of the torrent selecting only itself
+        lt::add_torrent_params atp = lt::load_torrent_buffer(torrent);
+        std::vector<std::filesystem::path> links;
+        for (const auto &[link, i] : link_to_file)
+        {
+            links.emplace_back(link);
+        }
+        std::string magnet = with_web_seed(lt::make_magnet_uri(atp), links_dir, links);
+        lt::file_storage const &fs = atp.ti->files();
+
+        std::lock_guard<std::mutex> lock(m_files_mutex);
+        for (auto const i : fs.file_range())
+        {
+            if (fs.pad_file_at(i))
+            {
+                continue;
+            }
+            auto it = link_to_file.find(std::filesystem::path(fs.file_path(i)).filename().string());
+            if (it == link_to_file.end())
+            {
+                continue;
+            }
+
+            TransferMetadata *f_meta = files[it->second];
+            std::stringstream root;
+            root << fs.root(i);
+            f_meta->set_hash(root.str());
+            m_group_files[f_meta] = static_cast<int>(i);
+            magnets[it->second] = magnet + "&so=" + std::to_string(static_cast<int>(i));
+        }
+        return magnets;
+    }
+    catch (std::exception const &e)
+    {
+        ers::error(BittorrentError(ERS_HERE, e.what()));
+        for (TransferMetadata *f_meta : files)
+        {
+            f_meta->set_status(status_type::e_status::ERROR);
+            f_meta->set_error_code("failed to generate the torrent of the group");
         }
+        return std::vector<std::string>(files.size());
     }
 
     bool TransferInterfaceBittorrent::upload_file(TransferMetadata &f_meta)
     {
         TLOG() << "debug : uploading " << f_meta.get_file_name();
 
-        if (add_torrent(get_work_dir().append(f_meta.get_file_name() + ".torrent"), f_meta.get_file_path().remove_filename()) == "")
+        int group_index = -1;
+        {
+            std::lock_guard<std::mutex> lock(m_files_mutex);
+            auto it = m_group_files.find(&f_meta);
+            if (it != m_group_files.end())
+            {
+                group_index = it->second;
+            }
+        }
+        if (group_index >= 0)
+        {
+            if (!add_group_file(f_meta, group_index, f_meta.get_file_path().parent_path()))
+            {
+                f_meta.set_error_code("failed to add torrent to session");
+                return false;
+            }
+            return true;
+        }
+
+        std::filesystem::path torrent_file = get_torrent_file(f_meta);
+        if (torrent_file.empty())
+        {
+            ers::error(BittorrentError(ERS_HERE, "no torrent generated for " + f_meta.get_file_name()));
+            f_meta.set_error_code("no torrent generated");
+            return false;
+        }
+        torrent_entry_t *entry = add_entry(f_meta);
+        if (add_torrent(torrent_file, f_meta.get_file_path().remove_filename(), entry) == "")
         {
+            remove_entry(f_meta);
             f_meta.set_error_code("failed to add torrent to session");
             return false;
         }
 
-        m_filename_to_metadata[f_meta.get_file_name()] = &f_meta;
         return true;
     }
 
@@ -942,17 +1669,29 @@ namespace dunedaq::snbmodules
     {
         TLOG() << "debug : starting download " << f_meta.get_file_name();
 
+        // file of a group transferred in a single torrent
+        int group_index = magnet_file_index(f_meta.get_magnet_link());
+        if (group_index >= 0)
+        {
+            if (!add_group_file(f_meta, group_index, dest))
+            {
+                f_meta.set_error_code("failed to add magnet link to session");
+                return false;
+            }
+            return true;
+        }
+
         // need to add before adding magnet because can instant access after adding magnet
-        m_filename_to_metadata[f_meta.get_file_name()] = &f_meta;
+        torrent_entry_t *entry = add_entry(f_meta);
 
-        if (add_magnet(f_meta.get_magnet_link(), dest))
+        if (add_magnet(f_meta.get_magnet_link(), dest, entry))
         {
             TLOG() << "debug : added magnet passed ";
         }
         else
         {
-            // erasing from map because we failed to add magnet
-            m_filename_to_metadata.erase(f_meta.get_file_name());
+            // erasing from the table because we failed to add magnet
+            remove_entry(f_meta);
             f_meta.set_error_code("failed to add magnet link to session");
             return false;
         }
@@ -963,16 +1702,19 @@ namespace dunedaq::snbmodules
 
     bool TransferInterfaceBittorrent::pause_file(TransferMetadata &f_meta)
     {
-        auto handles = ses.get_torrents();
-        for (const auto &h : handles)
+        lt::torrent_handle h = get_handle(f_meta);
+        int group_index = get_group_index(f_meta);
+        if (h.is_valid() && group_index >= 0 && m_is_client)
         {
-            if (h.torrent_file()->name() == f_meta.get_file_name())
-            {
-                m_paused++;
-                h.pause(lt::torrent_handle::graceful_pause);
-                TLOG() << "debug : pausing " << f_meta.get_file_name() << " and saving pause data in " << get_work_dir().string() << "/.resume_file_" << f_meta.get_file_name();
-                break;
-            }
+            // the other files of the group keep downloading
+            h.file_priority(lt::file_index_t{group_index}, lt::dont_download);
+            TLOG() << "debug : pausing " << f_meta.get_file_name() << " in the torrent of the group";
+        }
+        else if (h.is_valid())
+        {
+            m_paused++;
+            h.pause(lt::torrent_handle::graceful_pause);
+            TLOG() << "debug : pausing " << f_meta.get_file_name() << " and saving pause data in " << resume_file_path(h.info_hashes()).string();
         }
 
         return true;
@@ -981,56 +1723,40 @@ namespace dunedaq::snbmodules
     bool TransferInterfaceBittorrent::resume_file(TransferMetadata &f_meta)
     {
 
-        bool found = false;
-        auto const handles = ses.get_torrents();
-        for (const auto &h : handles)
+        lt::torrent_handle h = get_handle(f_meta);
+        int group_index = get_group_index(f_meta);
+        bool found = h.is_valid();
+        if (found && group_index >= 0 && m_is_client)
         {
-            if (h.torrent_file()->name() == f_meta.get_file_name())
-            {
-                m_paused--;
-                h.resume();
-                // lt::error_code ec;
-                // TODO
-                // h.connect_peer(lt::tcp::endpoint(boost::asio::ip::make_address("192.168.0.106", ec), std::uint16_t(5010)));
-                // if (!peer.empty())
-                // {
-                //     auto port = peer.find_last_of(':');
-                //     if (port != std::string::npos)
-                //     {
-                //         peer[port++] = '\0';
-                //         char const* ip = peer.data();
-                //         int const peer_port = atoi(peer.data() + port);
-                //         error_code ec;
-                //         if (peer_port > 0)
-                //         {
-                //             h.connect_peer(tcp::endpoint(asio::ip::make_address(ip, ec), std::uint16_t(peer_port)));
-                //         }
-                //     }
-                // }
-                found = true;
-                break;
-            }
+            h.file_priority(lt::file_index_t{group_index}, lt::default_priority);
         }
-
-        if (!found)
+        else if (found)
         {
-            // load resume data from disk and pass it in as we add the magnet link
-            auto buf = load_file(get_work_dir().append(".resume_file" + f_meta.get_file_name()));
-            lt::add_torrent_params atp;
+            m_paused--;
+            h.resume();
+        }
 
-            if (buf.size())
+        if (!found && magnet_file_index(f_meta.get_magnet_link()) >= 0)
+        {
+            // file of the group torrent, added again with the resume data of the torrent
+            if (!add_group_file(f_meta, magnet_file_index(f_meta.get_magnet_link()), get_work_dir()))
             {
-                atp = lt::read_resume_data(buf);
+                ers::error(BittorrentLoadResumeFileError(ERS_HERE, f_meta.get_file_name()));
+                f_meta.set_error_code("failed to load resume data");
+                return false;
             }
-            else
+        }
+        else if (!found)
+        {
+            // not in the session anymore (restarted), the resume data of the magnet info-hash is loaded as it is added
+            torrent_entry_t *entry = add_entry(f_meta);
+            if (!add_magnet(f_meta.get_magnet_link(), get_work_dir(), entry))
             {
+                remove_entry(f_meta);
                 ers::error(BittorrentLoadResumeFileError(ERS_HERE, f_meta.get_file_name()));
                 f_meta.set_error_code("failed to load resume data");
                 return false;
             }
-
-            m_filename_to_metadata[f_meta.get_file_name()] = &f_meta;
-            ses.async_add_torrent(std::move(atp));
         }
 
         return true;
@@ -1038,28 +1764,51 @@ namespace dunedaq::snbmodules
 
     bool TransferInterfaceBittorrent::cancel_file(TransferMetadata &f_meta)
     {
-        auto const handles = ses.get_torrents();
-        for (const auto &h : handles)
+        lt::torrent_handle h = get_handle(f_meta);
+        int group_index = get_group_index(f_meta);
+        bool last_of_group = true;
+        if (group_index >= 0)
+        {
+            std::lock_guard<std::mutex> lock(m_files_mutex);
+            last_of_group = m_group_entry == nullptr || m_group_entry->files.size() <= 1;
+        }
+
+        if (!last_of_group)
         {
-            if (h.torrent_file()->name() == f_meta.get_file_name())
+            // only this file leaves the torrent of the group
+            if (h.is_valid() && m_is_client)
             {
-                // Remove torrent from session
-                ses.remove_torrent(h);
-                break;
+                h.file_priority(lt::file_index_t{group_index}, lt::dont_download);
+            }
+            remove_entry(f_meta);
+            if (m_is_client)
+            {
+                std::filesystem::remove(get_work_dir().append(f_meta.get_file_name()));
             }
+            return true;
+        }
+
+        if (h.is_valid())
+        {
+            // Remove torrent from session, and its resume data
+            {
+                std::lock_guard<std::mutex> lock(m_resume_mutex);
+                m_finished.insert(h.info_hashes());
+            }
+            std::error_code ec;
+            std::filesystem::remove(resume_file_path(h.info_hashes()), ec);
+            ses.remove_torrent(h);
         }
 
         // wait for the session to remove the torrent
         std::this_thread::sleep_for(std::chrono::seconds(1));
-        m_filename_to_metadata.erase(f_meta.get_file_name());
-
-        // remove resume data
-        std::filesystem::remove(get_work_dir().append(".resume_file" + f_meta.get_file_name()));
+        remove_entry(f_meta);
 
         // remove torrent file if uploader or file if downloader
         if (!m_is_client)
         {
-            std::filesystem::remove(get_work_dir().append(f_meta.get_file_name() + ".torrent"));
+            std::error_code ec;
+            std::filesystem::remove(group_index >= 0 ? get_work_dir().append(m_config.get_group_id() + ".torrent") : get_torrent_file(f_meta), ec);
         }
         else
         {
@@ -1076,252 +1825,4 @@ namespace dunedaq::snbmodules
         return true;
     }
 
-    // Custom disk IO interface
-    // struct temp_storage
-    // {
-    //     explicit temp_storage(lt::file_storage const &fs) : m_files(fs) {}
-
-    //     lt::span<char const> readv(lt::peer_request const r, lt::storage_error &ec) const
-    //     {
-    //         auto const i = m_file_data.find(r.piece);
-    //         if (i == m_file_data.end())
-    //         {
-    //             ec.operation = lt::operation_t::file_read;
-    //             ec.ec = boost::asio::error::eof;
-    //             return {};
-    //         }
-    //         if (int(i->second.size()) <= r.start)
-    //         {
-    //             ec.operation = lt::operation_t::file_read;
-    //             ec.ec = boost::asio::error::eof;
-    //             return {};
-    //         }
-    //         return {i->second.data() + r.start, std::min(r.length, int(i->second.size()) - r.start)};
-    //     }
-    //     void writev(lt::span<char const> const b, lt::piece_index_t const piece, int const offset)
-    //     {
-    //         auto &data = m_file_data[piece];
-    //         if (data.empty())
-    //         {
-    //             // allocate the whole piece, otherwise we'll invalidate the pointers
-    //             // we have returned back to libtorrent
-    //             int const size = piece_size(piece);
-    //             data.resize(std::size_t(size));
-    //         }
-    //         TORRENT_ASSERT(offset + b.size() <= int(data.size()));
-    //         std::memcpy(data.data() + offset, b.data(), std::size_t(b.size()));
-    //     }
-    //     lt::sha1_hash hash(lt::piece_index_t const piece, lt::span<lt::sha256_hash> const block_hashes, lt::storage_error &ec) const
-    //     {
-    //         auto const i = m_file_data.find(piece);
-    //         if (i == m_file_data.end())
-    //         {
-    //             ec.operation = lt::operation_t::file_read;
-    //             ec.ec = boost::asio::error::eof;
-    //             return {};
-    //         }
-    //         if (!block_hashes.empty())
-    //         {
-    //             int const piece_size2 = m_files.piece_size2(piece);
-    //             int const blocks_in_piece2 = m_files.blocks_in_piece2(piece);
-    //             char const *buf = i->second.data();
-    //             std::int64_t offset = 0;
-    //             for (int k = 0; k < blocks_in_piece2; ++k)
-    //             {
-    //                 lt::hasher256 h2;
-    //                 std::ptrdiff_t const len2 = std::min(lt::default_block_size, int(piece_size2 - offset));
-    //                 h2.update({buf, len2});
-    //                 buf += len2;
-    //                 offset += len2;
-    //                 block_hashes[k] = h2.final();
-    //             }
-    //         }
-    //         return lt::hasher(i->second).final();
-    //     }
-    //     lt::sha256_hash hash2(lt::piece_index_t const piece, int const offset, lt::storage_error &ec)
-    //     {
-    //         auto const i = m_file_data.find(piece);
-    //         if (i == m_file_data.end())
-    //         {
-    //             ec.operation = lt::operation_t::file_read;
-    //             ec.ec = boost::asio::error::eof;
-    //             return {};
-    //         }
-
-    //         int const piece_size = m_files.piece_size2(piece);
-
-    //         std::ptrdiff_t const len = std::min(lt::default_block_size, piece_size - offset);
-
-    //         lt::span<char const> b = {i->second.data() + offset, len};
-    //         return lt::hasher256(b).final();
-    //     }
-
-    // private:
-    //     int piece_size(lt::piece_index_t piece) const
-    //     {
-    //         int const num_pieces = static_cast<int>((m_files.total_size() + m_files.piece_length() - 1) / m_files.piece_length());
-    //         return static_cast<int>(piece) < num_pieces - 1
-    //                    ? m_files.piece_length()
-    //                    : static_cast<int>(m_files.total_size() - std::int64_t(num_pieces - 1) * m_files.piece_length());
-    //     }
-
-    //     lt::file_storage const &m_files;
-    //     std::map<lt::piece_index_t, std::vector<char>> m_file_data;
-    // };
-
-    // lt::storage_index_t pop(std::vector<lt::storage_index_t> &q)
-    // {
-    //     TORRENT_ASSERT(!q.empty());
-    //     lt::storage_index_t const ret = q.back();
-    //     q.pop_back();
-    //     return ret;
-    // }
-
-    // struct temp_disk_io final : lt::disk_interface, lt::buffer_allocator_interface
-    // {
-    //     explicit temp_disk_io(lt::io_context &ioc) : m_ioc(ioc) {}
-
-    //     void settings_updated() override {}
-
-    //     lt::storage_holder new_torrent(lt::storage_params const &params, std::shared_ptr<void> const &) override
-    //     {
-    //         lt::storage_index_t const idx = m_free_slots.empty()
-    //                                             ? m_torrents.end_index()
-    //                                             : pop(m_free_slots);
-    //         auto storage = std::make_unique<temp_storage>(params.files);
-    //         if (idx == m_torrents.end_index())
-    //         {
-    //             m_torrents.emplace_back(std::move(storage));
-    //         }
-    //         else
-    //         {
-    //             m_torrents[idx] = std::move(storage);
-    //         }
-    //         return lt::storage_holder(idx, *this);
-    //     }
-
-    //     void remove_torrent(lt::storage_index_t const idx) override
-    //     {
-    //         m_torrents[idx].reset();
-    //         m_free_slots.push_back(idx);
-    //     }
-
-    //     void abort(bool) override {}
-
-    //     void async_read(lt::storage_index_t storage, lt::peer_request const &r, std::function<void(lt::disk_buffer_holder block, lt::storage_error const &se)> handler, lt::disk_job_flags_t) override
-    //     {
-    //         // this buffer is owned by the storage. It will remain valid for as
-    //         // long as the torrent remains in the session. We don't need any lifetime
-    //         // management of it.
-    //         lt::storage_error error;
-    //         lt::span<char const> b = m_torrents[storage]->readv(r, error);
-
-    //         post(m_ioc, [handler, error, b, this]
-    //              { handler(lt::disk_buffer_holder(*this, const_cast<char *>(b.data()), int(b.size())), error); });
-    //     }
-
-    //     bool async_write(lt::storage_index_t storage, lt::peer_request const &r, char const *buf, std::shared_ptr<lt::disk_observer>, std::function<void(lt::storage_error const &)> handler, lt::disk_job_flags_t) override
-    //     {
-    //         lt::span<char const> const b = {buf, r.length};
-
-    //         m_torrents[storage]->writev(b, r.piece, r.start);
-
-    //         post(m_ioc, [=]
-    //              { handler(lt::storage_error()); });
-    //         return false;
-    //     }
-
-    //     void async_hash(lt::storage_index_t storage, lt::piece_index_t const piece, lt::span<lt::sha256_hash> block_hashes, lt::disk_job_flags_t, std::function<void(lt::piece_index_t, lt::sha1_hash const &, lt::storage_error const &)> handler) override
-    //     {
-    //         lt::storage_error error;
-    //         lt::sha1_hash const hash = m_torrents[storage]->hash(piece, block_hashes, error);
-    //         post(m_ioc, [=]
-    //              { handler(piece, hash, error); });
-    //     }
-
-    //     void async_hash2(lt::storage_index_t storage, lt::piece_index_t const piece, int const offset, lt::disk_job_flags_t, std::function<void(lt::piece_index_t, lt::sha256_hash const &, lt::storage_error const &)> handler) override
-    //     {
-    //         lt::storage_error error;
-    //         lt::sha256_hash const hash = m_torrents[storage]->hash2(piece, offset, error);
-    //         post(m_ioc, [=]
-    //              { handler(piece, hash, error); });
-    //     }
-
-    //     void async_move_storage(lt::storage_index_t, std::string p, lt::move_flags_t, std::function<void(lt::status_t, std::string const &, lt::storage_error const &)> handler) override
-    //     {
-    //         post(m_ioc, [=]
-    //              { handler(lt::status_t::fatal_disk_error, p, lt::storage_error(lt::error_code(boost::system::errc::operation_not_supported, lt::system_category()))); });
-    //     }
-
-    //     void async_release_files(lt::storage_index_t, std::function<void()>) override {}
-
-    //     void async_delete_files(lt::storage_index_t, lt::remove_flags_t, std::function<void(lt::storage_error const &)> handler) override
-    //     {
-    //         post(m_ioc, [=]
-    //              { handler(lt::storage_error()); });
-    //     }
-
-    //     void async_check_files(lt::storage_index_t, lt::add_torrent_params const *, lt::aux::vector<std::string, lt::file_index_t>, std::function<void(lt::status_t, lt::storage_error const &)> handler) override
-    //     {
-    //         post(m_ioc, [=]
-    //              { handler(lt::status_t::no_error, lt::storage_error()); });
-    //     }
-
-    //     void async_rename_file(lt::storage_index_t, lt::file_index_t const idx, std::string const name, std::function<void(std::string const &, lt::file_index_t, lt::storage_error const &)> handler) override
-    //     {
-    //         post(m_ioc, [=]
-    //              { handler(name, idx, lt::storage_error()); });
-    //     }
-
-    //     void async_stop_torrent(lt::storage_index_t, std::function<void()> handler) override
-    //     {
-    //         post(m_ioc, handler);
-    //     }
-
-    //     void async_set_file_priority(lt::storage_index_t, lt::aux::vector<lt::download_priority_t, lt::file_index_t> prio, std::function<void(lt::storage_error const &, lt::aux::vector<lt::download_priority_t, lt::file_index_t>)> handler) override
-    //     {
-    //         post(m_ioc, [=]
-    //              { handler(lt::storage_error(lt::error_code(
-    //                            boost::system::errc::operation_not_supported, lt::system_category())),
-    //                        std::move(prio)); });
-    //     }
-
-    //     void async_clear_piece(lt::storage_index_t, lt::piece_index_t index, std::function<void(lt::piece_index_t)> handler) override
-    //     {
-    //         post(m_ioc, [=]
-    //              { handler(index); });
-    //     }
-
-    //     // implements buffer_allocator_interface
-    //     void free_disk_buffer(char *) override
-    //     {
-    //         // never free any buffer. We only return buffers owned by the storage
-    //         // object
-    //     }
-
-    //     void update_stats_counters(lt::counters &) const override {}
-
-    //     std::vector<lt::open_file_state> get_status(lt::storage_index_t) const override
-    //     {
-    //         return {};
-    //     }
-
-    //     void submit_jobs() override {}
-
-    // private:
-    //     lt::aux::vector<std::shared_ptr<temp_storage>, lt::storage_index_t> m_torrents;
-
-    //     // slots that are unused in the m_torrents vector
-    //     std::vector<lt::storage_index_t> m_free_slots;
-
-    //     // callbacks are posted on this
-    //     lt::io_context &m_ioc;
-    // };
-
-    // std::unique_ptr<lt::disk_interface> temp_disk_constructor(
-    //     lt::io_context &ioc, lt::settings_interface const &, lt::counters &)
-    // {
-    //     return std::make_unique<temp_disk_io>(ioc);
-    // }
-
 } // namespace dunedaq::snbmodules
@@ -0,0 +1,508 @@
+/**
+ * @file web_seed_server.cpp WebSeedServer class, HTTP server of the shared files used as web seed by the bittorrent downloaders
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/web_seed_server.hpp"
+
+#include "logging/Logging.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string>
+
+namespace dunedaq::snbmodules
+{
+
+    WebSeedServer::WebSeedServer(const IPFormat &listen_interface, int max_connections)
+        : m_listen_interface(listen_interface),
+          m_max_connections(std::max(1, max_connections)),
+          m_thread([&](std::atomic<bool> &running)
+                   { this->do_work(running); })
+    {
+    }
+
+    WebSeedServer::~WebSeedServer()
+    {
+        stop();
+    }
+
+    bool WebSeedServer::start()
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(m_listen_interface.get_port()));
+        if (inet_pton(AF_INET, m_listen_interface.get_ip().c_str(), &addr.sin_addr) != 1)
+        {
+            ers::error(ConfigError(ERS_HERE, "invalid web seed ip " + m_listen_interface.get_ip()));
+            return false;
+        }
+
+        m_socket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        if (m_socket < 0 ||
+            setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+            bind(m_socket, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || // NOLINT
+            listen(m_socket, 128) != 0)
+        {
+            ers::error(BittorrentError(ERS_HERE, "cannot listen on " + m_listen_interface.get_ip_port() + " for the web seed: " + std::strerror(errno)));
+            if (m_socket >= 0)
+            {
+                ::close(m_socket);
+                m_socket = -1;
+            }
+            return false;
+        }
+
+        // port chosen by the system if 0 was asked
+        socklen_t len = sizeof(addr);
+        getsockname(m_socket, reinterpret_cast<sockaddr *>(&addr), &len); // NOLINT
+        m_port = ntohs(addr.sin_port);
+
+        TLOG() << "debug : web seed listening on " << m_listen_interface.get_ip() << ":" << m_port.load();
+        m_running = true;
+        m_thread.start_working_thread();
+        return true;
+    }
+
+    void WebSeedServer::stop()
+    {
+        m_running = false;
+        if (m_thread.thread_running())
+        {
+            m_thread.stop_working_thread();
+        }
+        reap_connections(true);
+        if (m_socket >= 0)
+        {
+            ::close(m_socket);
+            m_socket = -1;
+        }
+    }
+
+    std::shared_ptr<WebSeedServer> WebSeedServer::get_shared(const IPFormat &listen_interface)
+    {
+        std::lock_guard<std::mutex> lock(m_servers_mutex);
+        std::string key = listen_interface.get_ip_port();
+        std::shared_ptr<WebSeedServer> server = m_servers[key].lock();
+        if (!server)
+        {
+            server = std::make_shared<WebSeedServer>(listen_interface);
+            if (!server->start())
+            {
+                m_servers.erase(key);
+                return nullptr;
+            }
+            m_servers[key] = server;
+        }
+        return server;
+    }
+
+    std::filesystem::path WebSeedServer::normalize_root(const std::filesystem::path &dir)
+    {
+        std::filesystem::path root = std::filesystem::absolute(dir).lexically_normal();
+        if (!root.has_filename())
+        {
+            root = root.parent_path();
+        }
+        return root;
+    }
+
+    std::string WebSeedServer::share_file(const std::filesystem::path &dir, const std::filesystem::path &relative)
+    {
+        std::filesystem::path root = normalize_root(dir);
+
+        std::lock_guard<std::mutex> lock(m_shared_mutex);
+        std::string prefix;
+        for (const auto &[p, shared] : m_shared)
+        {
+            if (shared.root == root)
+            {
+                prefix = p;
+                break;
+            }
+        }
+        // the prefixes are never reused, a directory keeps its url
+        if (prefix.empty())
+        {
+            prefix = std::to_string(m_shared.size());
+            m_shared[prefix].root = root;
+        }
+        m_shared[prefix].files[relative.lexically_normal()]++;
+        return "http://" + m_listen_interface.get_ip() + ":" + std::to_string(m_port.load()) + "/" + prefix + "/";
+    }
+
+    void WebSeedServer::unshare_file(const std::filesystem::path &dir, const std::filesystem::path &relative)
+    {
+        std::filesystem::path root = normalize_root(dir);
+
+        std::lock_guard<std::mutex> lock(m_shared_mutex);
+        for (auto &[p, shared] : m_shared)
+        {
+            auto it = shared.root == root ? shared.files.find(relative.lexically_normal()) : shared.files.end();
+            if (it != shared.files.end() && --it->second <= 0)
+            {
+                shared.files.erase(it);
+            }
+        }
+    }
+
+    std::optional<std::filesystem::path> WebSeedServer::resolve(const std::string &path)
+    {
+        std::string decoded = url_decode(path.substr(0, path.find('?')));
+        if (decoded.empty() || decoded[0] != '/')
+        {
+            return std::nullopt;
+        }
+
+        // /prefix/path of the file in the shared directory
+        size_t end = decoded.find('/', 1);
+        if (end == std::string::npos)
+        {
+            return std::nullopt;
+        }
+        std::filesystem::path relative = std::filesystem::path(decoded.substr(end + 1)).lexically_normal();
+
+        // only the shared files, not the rest of their directory
+        std::lock_guard<std::mutex> lock(m_shared_mutex);
+        auto it = m_shared.find(decoded.substr(1, end - 1));
+        if (it == m_shared.end() || it->second.files.count(relative) == 0)
+        {
+            return std::nullopt;
+        }
+        return it->second.root / relative;
+    }
+
+    std::optional<std::pair<uint64_t, uint64_t>> WebSeedServer::parse_range(const std::string &range, uint64_t size)
+    {
+        auto is_number = [](const std::string &s)
+        {
+            return !s.empty() && s.size() < 20 && std::all_of(s.begin(), s.end(), [](unsigned char c)
+                                                              { return std::isdigit(c) != 0; });
+        };
+
+        const std::string unit = "bytes=";
+        if (range.compare(0, unit.size(), unit) != 0 || size == 0)
+        {
+            return std::nullopt;
+        }
+        std::string spec = range.substr(unit.size());
+        size_t dash = spec.find('-');
+        // several ranges are never asked by the web seeds
+        if (dash == std::string::npos || spec.find(',') != std::string::npos)
+        {
+            return std::nullopt;
+        }
+        std::string first = spec.substr(0, dash);
+        std::string last = spec.substr(dash + 1);
+
+        // last bytes of the file
+        if (first.empty())
+        {
+            if (!is_number(last) || std::stoull(last) == 0)
+            {
+                return std::nullopt;
+            }
+            return std::make_pair(size - std::min<uint64_t>(std::stoull(last), size), size - 1);
+        }
+
+        if (!is_number(first) || (!last.empty() && !is_number(last)))
+        {
+            return std::nullopt;
+        }
+        uint64_t begin = std::stoull(first);
+        uint64_t end = last.empty() ? size - 1 : std::min<uint64_t>(std::stoull(last), size - 1);
+        if (begin >= size || end < begin)
+        {
+            return std::nullopt;
+        }
+        return std::make_pair(begin, end);
+    }
+
+    std::string WebSeedServer::escape(const std::string &s)
+    {
+        static const char hex[] = "0123456789ABCDEF";
+        std::string escaped;
+        for (unsigned char c : s)
+        {
+            if (std::isalnum(c) != 0 || c == '-' || c == '.' || c == '_' || c == '~' || c == '/')
+            {
+                escaped.push_back(static_cast<char>(c));
+            }
+            else
+            {
+                escaped.push_back('%');
+                escaped.push_back(hex[c >> 4]);
+                escaped.push_back(hex[c & 15]);
+            }
+        }
+        return escaped;
+    }
+
+    void WebSeedServer::do_work(std::atomic<bool> &running_flag)
+    {
+        pollfd pfd{m_socket, POLLIN, 0};
+        while (running_flag.load())
+        {
+            reap_connections(false);
+
+            // wake up regularly to check the running flag
+            if (poll(&pfd, 1, 200) <= 0 || (pfd.revents & POLLIN) == 0)
+            {
+                continue;
+            }
+
+            int fd = accept4(m_socket, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                continue;
+            }
+
+            if (static_cast<int>(m_connections.size()) >= m_max_connections)
+            {
+                send_all(fd, "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 5\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+                ::close(fd);
+                continue;
+            }
+
+            auto connection = std::make_unique<connection_t>();
+            connection_t *c = connection.get();
+            connection->thread = std::thread([this, fd, c]()
+                                             {
+                                                 handle_connection(fd);
+                                                 c->done = true; });
+            m_connections.push_back(std::move(connection));
+        }
+    }
+
+    void WebSeedServer::reap_connections(bool all)
+    {
+        for (auto it = m_connections.begin(); it != m_connections.end();)
+        {
+            if (!all && !(*it)->done.load())
+            {
+                ++it;
+                continue;
+            }
+            if ((*it)->thread.joinable())
+            {
+                (*it)->thread.join();
+            }
+            it = m_connections.erase(it);
+        }
+    }
+
+    void WebSeedServer::handle_connection(int fd)
+    {
+        // sendfile has no MSG_NOSIGNAL, a downloader closing the connection must not kill the process.
+        // The SIGPIPE raised by this thread stays pending and is dropped with it
+        sigset_t sigpipe;
+        sigemptyset(&sigpipe);
+        sigaddset(&sigpipe, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+
+        // the receive timeout checks the running flag, the send timeout drops the stalled downloaders
+        timeval receive_timeout{1, 0};
+        timeval send_timeout{10, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &receive_timeout, sizeof(receive_timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+        std::string buffer;
+        char data[4096];
+        int idle = 0;
+        while (m_running.load())
+        {
+            size_t end = buffer.find("\r\n\r\n");
+            if (end != std::string::npos)
+            {
+                std::string request = buffer.substr(0, end + 4);
+                buffer.erase(0, end + 4);
+                idle = 0;
+                if (!handle_request(fd, request))
+                {
+                    break;
+                }
+                continue;
+            }
+            if (buffer.size() > 16384)
+            {
+                break;
+            }
+
+            ssize_t n = ::recv(fd, data, sizeof(data), 0);
+            if (n > 0)
+            {
+                buffer.append(data, static_cast<size_t>(n));
+            }
+            // kept alive at most 30 seconds without request
+            else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) || ++idle >= 30)
+            {
+                break;
+            }
+        }
+        ::close(fd);
+    }
+
+    bool WebSeedServer::handle_request(int fd, const std::string &request)
+    {
+        // GET /prefix/path HTTP/1.1
+        size_t method_end = request.find(' ');
+        size_t path_end = method_end == std::string::npos ? std::string::npos : request.find(' ', method_end + 1);
+        size_t line_end = request.find("\r\n");
+        if (path_end == std::string::npos || path_end > line_end)
+        {
+            send_all(fd, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            return false;
+        }
+        std::string method = request.substr(0, method_end);
+        std::string path = request.substr(method_end + 1, path_end - method_end - 1);
+        std::string version = request.substr(path_end + 1, line_end - path_end - 1);
+
+        std::string range;
+        bool keep_alive = version == "HTTP/1.1";
+        size_t start = line_end + 2;
+        while (start < request.size())
+        {
+            size_t end = request.find("\r\n", start);
+            std::string header = request.substr(start, end - start);
+            start = end + 2;
+            size_t colon = header.find(':');
+            if (colon == std::string::npos)
+            {
+                continue;
+            }
+            std::string name = header.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c)
+                           { return std::tolower(c); });
+            std::string value = header.substr(header.find_first_not_of(' ', colon + 1) == std::string::npos ? header.size() : header.find_first_not_of(' ', colon + 1));
+            if (name == "range")
+            {
+                range = value;
+            }
+            else if (name == "connection")
+            {
+                std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c)
+                               { return std::tolower(c); });
+                keep_alive = value == "keep-alive" || (keep_alive && value != "close");
+            }
+        }
+        std::string connection = keep_alive ? "" : "Connection: close\r\n";
+
+        if (method != "GET" && method != "HEAD")
+        {
+            send_all(fd, "HTTP/1.1 405 Method Not Allowed\r\nAllow: GET, HEAD\r\nContent-Length: 0\r\n" + connection + "\r\n");
+            return keep_alive;
+        }
+
+        std::optional<std::filesystem::path> file = resolve(path);
+        int file_fd = file.has_value() ? ::open(file->c_str(), O_RDONLY | O_CLOEXEC) : -1;
+        struct stat st = {};
+        if (file_fd < 0 || fstat(file_fd, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            if (file_fd >= 0)
+            {
+                ::close(file_fd);
+            }
+            TLOG() << "debug : web seed request of an unknown file " << path;
+            return send_all(fd, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n" + connection + "\r\n") && keep_alive;
+        }
+
+        uint64_t size = static_cast<uint64_t>(st.st_size);
+        std::string header;
+        uint64_t first = 0;
+        uint64_t length = size;
+        if (!range.empty())
+        {
+            auto bytes = parse_range(range, size);
+            if (!bytes.has_value())
+            {
+                ::close(file_fd);
+                return send_all(fd, "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + std::to_string(size) + "\r\nContent-Length: 0\r\n" + connection + "\r\n") && keep_alive;
+            }
+            first = bytes->first;
+            length = bytes->second - bytes->first + 1;
+            header = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(bytes->first) + "-" + std::to_string(bytes->second) + "/" + std::to_string(size) + "\r\n";
+        }
+        else
+        {
+            header = "HTTP/1.1 200 OK\r\n";
+        }
+        header += "Content-Type: application/octet-stream\r\nAccept-Ranges: bytes\r\nContent-Length: " + std::to_string(length) + "\r\n" + connection + "\r\n";
+
+        bool sent = send_all(fd, header);
+        if (sent && method == "GET")
+        {
+            // straight from the page cache to the socket
+            off_t offset = static_cast<off_t>(first);
+            uint64_t left = length;
+            while (left > 0)
+            {
+                ssize_t n = sendfile(fd, file_fd, &offset, std::min<uint64_t>(left, 1 << 30));
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    sent = false;
+                    break;
+                }
+                left -= static_cast<uint64_t>(n);
+                m_bytes_served += static_cast<uint64_t>(n);
+            }
+        }
+        ::close(file_fd);
+        return sent && keep_alive;
+    }
+
+    bool WebSeedServer::send_all(int fd, const std::string &data)
+    {
+        size_t sent = 0;
+        while (sent < data.size())
+        {
+            ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                return false;
+            }
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    std::string WebSeedServer::url_decode(const std::string &s)
+    {
+        std::string decoded;
+        decoded.reserve(s.size());
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            if (s[i] == '%' && i + 2 < s.size() && std::isxdigit(static_cast<unsigned char>(s[i + 1])) && std::isxdigit(static_cast<unsigned char>(s[i + 2])))
+            {
+                decoded.push_back(static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16)));
+                i += 2;
+            }
+            else
+            {
+                decoded.push_back(s[i]);
+            }
+        }
+        return decoded;
+    }
+
+} // namespace dunedaq::snbmodules
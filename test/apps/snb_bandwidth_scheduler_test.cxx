@@ -0,0 +1,63 @@
+/**
+ * @file snb_bandwidth_scheduler_test.cxx Test app of the share of the bandwidth of a client between its sessions
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/bandwidth_scheduler.hpp"
+#include "logging/Logging.hpp"
+
+#include <cassert>
+#include <vector>
+
+using namespace dunedaq::snbmodules;
+
+static BandwidthScheduler::demand_t demand(priority_type::e_priority priority, int weight = 1, bool active = true)
+{
+    BandwidthScheduler::demand_t d;
+    d.priority = priority;
+    d.weight = weight;
+    d.active = active;
+    return d;
+}
+
+int main()
+{
+    const int64_t bandwidth = 1000000000;
+
+    // no limit
+    std::vector<int64_t> rates = BandwidthScheduler::compute_rates(0, {demand(priority_type::URGENT), demand(priority_type::NORMAL)});
+    assert(rates.size() == 2 && rates[0] == -1 && rates[1] == -1);
+
+    // sessions of the same class share by weight
+    rates = BandwidthScheduler::compute_rates(bandwidth, {demand(priority_type::NORMAL, 1), demand(priority_type::NORMAL, 3)});
+    assert(rates[0] == bandwidth / 4);
+    assert(rates[1] == bandwidth * 3 / 4);
+
+    // an urgent transfer preempts the archival ones, which keep a floor of 1%
+    rates = BandwidthScheduler::compute_rates(bandwidth, {demand(priority_type::ARCHIVAL), demand(priority_type::URGENT), demand(priority_type::ARCHIVAL)});
+    assert(rates[0] == bandwidth / 100);
+    assert(rates[2] == bandwidth / 100);
+    assert(rates[1] == bandwidth - 2 * bandwidth / 100);
+
+    // inactive sessions do not take the bandwidth of the class
+    rates = BandwidthScheduler::compute_rates(bandwidth, {demand(priority_type::URGENT, 1, false), demand(priority_type::ARCHIVAL)});
+    assert(rates[0] == bandwidth / 100);
+    assert(rates[1] == bandwidth - bandwidth / 100);
+
+    // the floors never take more than half of the bandwidth
+    std::vector<BandwidthScheduler::demand_t> demands(200, demand(priority_type::ARCHIVAL));
+    demands.push_back(demand(priority_type::URGENT));
+    rates = BandwidthScheduler::compute_rates(bandwidth, demands);
+    assert(rates[0] == bandwidth / 400);
+    assert(rates[200] == bandwidth / 2);
+
+    // nothing active, everyone waits with the floor
+    rates = BandwidthScheduler::compute_rates(bandwidth, {demand(priority_type::URGENT, 1, false)});
+    assert(rates[0] == bandwidth / 100);
+
+    TLOG() << "BandwidthScheduler tests passed";
+    return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file snb_bittorrent_disk_io_benchmark.cxx Loopback benchmark of the bittorrent throughput against the disk backend
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/transfer_client.hpp"
+#include "snbmodules/common/protocols_enum.hpp"
+
+#include "utilities/WorkerThread.hpp"
+
+#include <iostream>
+#include <string>
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <vector>
+
+using namespace dunedaq::snbmodules;
+
+namespace
+{
+    bool all_finished(TransferSession *session)
+    {
+        if (session == nullptr || session->get_transfer_options().get_transfers_meta().empty())
+        {
+            return false;
+        }
+        for (const auto &f_meta : session->get_transfer_options().get_transfers_meta())
+        {
+            if (f_meta->get_status() != status_type::e_status::FINISHED)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // Usage: snb_bittorrent_disk_io_benchmark [file size in MiB] [disk I/O threads]
+    uint64_t size_mib = argc > 1 ? std::stoull(argv[1]) : 4096;   // NOLINT
+    unsigned int disk_threads = argc > 2 ? std::stoul(argv[2]) : 4; // NOLINT
+
+    try
+    {
+        // libtorrent cannot connect to itself, use two different loopback addresses
+        std::string ip0 = "127.0.0.1:5009";
+        std::string ip1 = "127.0.0.2:5010";
+
+        TransferClient c0(IPFormat(ip0), "client0", "./client0");
+        TransferClient c1(IPFormat(ip1), "client1", "./client1");
+
+        c0.add_connection(IPFormat(ip0), "client0", "notification_t", true);
+        c0.add_connection(IPFormat(ip1), "client1", "notification_t", true);
+        c0.init_connection_interface();
+
+        // Downloader listening to notifications
+        dunedaq::utilities::WorkerThread thread([&](std::atomic<bool> &running)
+                                                { c0.do_work(running); });
+        thread.start_working_thread();
+
+        // Create file to transfer
+        std::string file_name = "client1/data.bin";
+        {
+            std::ofstream out(file_name, std::ios::binary);
+            std::vector<char> chunk(1024 * 1024);
+            for (uint64_t i = 0; i < size_mib; i++)
+            {
+                for (size_t j = 0; j < chunk.size(); j++)
+                {
+                    chunk[j] = static_cast<char>((i * 13 + j * 3) & 0xff);
+                }
+                out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            }
+        }
+
+        std::vector<std::string> disk_ios = {"default", "sequential", "mmap"};
+        double const mb = static_cast<double>(size_mib) * 1024 * 1024 / 1e6;
+
+        int run = 0;
+        for (const auto &disk_io : disk_ios)
+        {
+            std::string transfer_id = "disk_io_bench" + std::to_string(run);
+            nlohmann::json transfer_options;
+            transfer_options["port"] = std::to_string(5010 + run);
+            transfer_options["rate_limit"] = -1;
+            transfer_options["disk_io"] = disk_io;
+            transfer_options["disk_threads"] = disk_threads;
+            run++;
+
+            c1.create_new_transfer(transfer_id, "BITTORRENT", {c0.get_client_id()}, {file_name}, transfer_options);
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+
+            auto start = std::chrono::steady_clock::now();
+            c1.get_session(transfer_id)->start_all();
+
+            while (!all_finished(c0.get_session(transfer_id)) && std::chrono::steady_clock::now() - start < std::chrono::minutes(10))
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (all_finished(c0.get_session(transfer_id)))
+            {
+                TLOG() << "disk_io " << disk_io << " : " << mb / t << " MB/s (" << t << " s)";
+            }
+            else
+            {
+                TLOG() << "disk_io " << disk_io << " : transfer did not finish";
+            }
+        }
+
+        thread.stop_working_thread();
+
+        // Clean files
+        std::filesystem::remove_all("client0");
+        std::filesystem::remove_all("client1");
+    }
+    catch (const std::exception &e)
+    {
+        TLOG() << e.what();
+        return 1;
+    }
+    return 0;
+}
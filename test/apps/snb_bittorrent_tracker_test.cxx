@@ -0,0 +1,126 @@
+/**
+ * @file snb_bittorrent_tracker_test.cxx Test app of the BitTorrent tracker hosted by the bookkeeper, on loopback
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/bittorrent_tracker.hpp"
+#include "logging/Logging.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace dunedaq::snbmodules;
+
+// GET a path of the tracker, return the body of the response
+static std::string http_get(int port, const std::string &path)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) // NOLINT
+    {
+        throw std::runtime_error("cannot connect to the tracker");
+    }
+
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    ::send(fd, request.data(), request.size(), 0);
+
+    std::string response;
+    char buffer[1024];
+    ssize_t n = 0;
+    while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0)
+    {
+        response.append(buffer, static_cast<size_t>(n));
+    }
+    ::close(fd);
+
+    size_t body = response.find("\r\n\r\n");
+    return body == std::string::npos ? "" : response.substr(body + 4);
+}
+
+static std::string announce(const std::string &peer, int port, const std::string &left, const std::string &event = "")
+{
+    // 20 bytes ids, url encoded
+    std::string query = "/announce?info_hash=%01%02%03%04%05%06%07%08%09%0A%0B%0C%0D%0E%0F%10%11%12%13%14";
+    query += "&peer_id=" + peer + "&port=" + std::to_string(port) + "&left=" + left + "&compact=1";
+    if (!event.empty())
+    {
+        query += "&event=" + event;
+    }
+    return query;
+}
+
+int main()
+{
+    try
+    {
+        const std::string info_hash = "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0A\x0B\x0C\x0D\x0E\x0F\x10\x11\x12\x13\x14";
+
+        BittorrentTracker tracker(IPFormat("127.0.0.1", 0), 1);
+        if (!tracker.start())
+        {
+            return 1;
+        }
+        assert(tracker.get_port() > 0);
+        assert(tracker.get_announce_url() == "http://127.0.0.1:" + std::to_string(tracker.get_port()) + "/announce");
+
+        // The uploader announces first and gets no peer
+        std::string body = http_get(tracker.get_port(), announce("-UP0000-000000000000", 6881, "0", "started"));
+        assert(body.find("5:peers0:") != std::string::npos);
+        assert(tracker.get_peers_count(info_hash) == 1);
+
+        // A downloader gets the uploader, compact: 127.0.0.1:6881
+        body = http_get(tracker.get_port(), announce("-DL0001-000000000000", 6882, "1000", "started"));
+        const std::string uploader = std::string("\x7f\x00\x00\x01\x1a\xe1", 6);
+        assert(body.find("5:peers6:" + uploader) != std::string::npos);
+        assert(body.find("8:completei1e") != std::string::npos);
+
+        // A second downloader gets the uploader and the first downloader
+        body = http_get(tracker.get_port(), announce("-DL0002-000000000000", 6883, "1000", "started"));
+        assert(body.find("5:peers12:") != std::string::npos);
+        assert(tracker.get_peers_count(info_hash) == 3);
+
+        // The seeder does not get the other seeds
+        body = http_get(tracker.get_port(), announce("-DL0001-000000000000", 6882, "0", "completed"));
+        body = http_get(tracker.get_port(), announce("-UP0000-000000000000", 6881, "0"));
+        assert(body.find("5:peers6:") != std::string::npos);
+
+        // A stopped peer is forgotten
+        http_get(tracker.get_port(), announce("-DL0002-000000000000", 6883, "1000", "stopped"));
+        assert(tracker.get_peers_count(info_hash) == 2);
+
+        // Invalid requests
+        assert(http_get(tracker.get_port(), "/scrape").find("failure reason") != std::string::npos);
+        assert(tracker.handle_announce("info_hash=abc&peer_id=abc&port=1", "127.0.0.1").find("failure reason") != std::string::npos);
+        assert(tracker.handle_announce(announce("-DL0003-000000000000", 0, "1").substr(10), "127.0.0.1").find("invalid port") != std::string::npos);
+
+        // Peers not announcing anymore expire after a few intervals
+        std::this_thread::sleep_for(std::chrono::milliseconds(3500));
+        http_get(tracker.get_port(), announce("-DL0004-000000000000", 6884, "1000"));
+        assert(tracker.get_peers_count(info_hash) == 1);
+
+        tracker.stop();
+
+        TLOG() << "BittorrentTracker tests passed";
+        return 0;
+    }
+    catch (const std::exception &e)
+    {
+        TLOG() << e.what();
+        return 1;
+    }
+}
@@ -0,0 +1,93 @@
+/**
+ * @file snb_child_process_test.cxx Test app of the child processes running the SCP transfers
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/child_process.hpp"
+#include "logging/Logging.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+
+using namespace dunedaq::snbmodules;
+
+static std::optional<int> wait_for(ChildProcess &process, std::chrono::milliseconds timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        auto code = process.poll();
+        if (code.has_value())
+        {
+            return code;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return std::nullopt;
+}
+
+int main()
+{
+    try
+    {
+        std::string error;
+
+        // Exit code and error output
+        ChildProcess process;
+        assert(process.start({"sh", "-c", "echo first >&2; echo 'last error' >&2; exit 3"}, error));
+        assert(process.is_running());
+        assert(wait_for(process, std::chrono::seconds(5)) == 3);
+        assert(!process.is_running());
+        assert(process.get_error_output() == "first\nlast error\n");
+        assert(process.poll() == 3);
+
+        // The arguments are not interpreted by a shell
+        assert(process.start({"sh", "-c", "test \"$0\" = 'a b;c'", "a b;c"}, error));
+        assert(wait_for(process, std::chrono::seconds(5)) == 0);
+
+        // A missing command
+        assert(process.start({"snb_command_that_does_not_exist"}, error));
+        assert(wait_for(process, std::chrono::seconds(5)) == 127);
+        TLOG() << "expected error : " << process.get_error_output();
+
+        // Polling does not wait for a long command, terminate stops it and its children
+        assert(process.start({"sh", "-c", "sleep 30 & sleep 30; wait"}, error));
+        auto start = std::chrono::steady_clock::now();
+        assert(!process.poll().has_value());
+        assert(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+        process.terminate();
+        assert(!process.is_running());
+        assert(process.poll() == 128 + 15);
+        assert(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+        // A command ignoring SIGTERM is killed after the grace period
+        assert(process.start({"sh", "-c", "trap '' TERM; sleep 30"}, error));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        process.terminate(std::chrono::milliseconds(200));
+        assert(process.poll() == 128 + 9);
+
+        // Terminated with its owner
+        {
+            ChildProcess owned;
+            assert(owned.start({"sleep", "30"}, error));
+        }
+
+        assert(!process.start({}, error));
+        TLOG() << "expected error : " << error;
+
+        TLOG() << "ChildProcess tests passed";
+        return 0;
+    }
+    catch (const std::exception &e)
+    {
+        TLOG() << e.what();
+        return 1;
+    }
+}
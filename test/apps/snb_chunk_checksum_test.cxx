@@ -0,0 +1,121 @@
+/**
+ * @file snb_chunk_checksum_test.cxx Test app of the chunk checksums sent with the RClone files
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/chunk_checksum.hpp"
+#include "logging/Logging.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace dunedaq::snbmodules;
+
+int main()
+{
+    try
+    {
+        // Reference values of XXH64, seed 0
+        assert(ChunkChecksum::xxh64("", 0) == 0xef46db3751d8e999ULL);
+        assert(ChunkChecksum::xxh64("abc", 3) == 0x44bc2cf5ad770999ULL);
+        std::string sentence = "Nobody inspects the spammish repetition";
+        assert(ChunkChecksum::xxh64(sentence.data(), sentence.size()) == 0xfbcea83c8a378bf1ULL);
+
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / "snb_chunk_checksum_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        std::string content;
+        for (int i = 0; i < 300000; i++)
+        {
+            content += std::to_string(i * 7919) + " ";
+        }
+        std::ofstream(dir / "file.txt", std::ios::binary) << content;
+
+        // Chunks read by blocks of 1 MiB give the hash of the whole chunk
+        uint64_t chunk_size = 1500007;
+        std::string error;
+        auto checksum = ChunkChecksum::compute(dir / "file.txt", chunk_size, error);
+        assert(checksum.has_value());
+        assert(checksum->get_chunk_count() == (content.size() + chunk_size - 1) / chunk_size);
+        char first[17];
+        snprintf(first, sizeof(first), "%016llx", static_cast<unsigned long long>(ChunkChecksum::xxh64(content.data(), chunk_size))); // NOLINT
+        assert(checksum->to_string().find("xxh64:1500007:" + std::string(first) + ",") == 0);
+
+        // Sent as a string in the metadata
+        auto parsed = ChunkChecksum::parse(checksum->to_string(), content.size());
+        assert(parsed.has_value() && parsed->to_string() == checksum->to_string());
+        assert(!ChunkChecksum::parse(checksum->to_string(), content.size() + chunk_size).has_value());
+        assert(!ChunkChecksum::parse("0123456789abcdef0123456789abcdef01234567", content.size()).has_value());
+        assert(!ChunkChecksum::parse("xxh64:0:", 0).has_value());
+        auto empty = ChunkChecksum::parse("xxh64:16:ef46db3751d8e999", 0);
+        assert(empty.has_value() && empty->get_chunk_count() == 1);
+
+        int fd = ::open((dir / "file.txt").c_str(), O_RDONLY);
+        for (size_t i = 0; i < checksum->get_chunk_count(); i++)
+        {
+            std::string chunk = content.substr(i * chunk_size, chunk_size);
+            assert(checksum->get_chunk_length(i) == chunk.size());
+            assert(checksum->verify_chunk(fd, i, error));
+        }
+        ::close(fd);
+
+        // A corrupted byte is found in its chunk only
+        content[chunk_size + 10] ^= 1;
+        std::ofstream(dir / "copy.txt", std::ios::binary) << content;
+        fd = ::open((dir / "copy.txt").c_str(), O_RDONLY);
+        assert(checksum->verify_chunk(fd, 0, error));
+        assert(!checksum->verify_chunk(fd, 1, error));
+        TLOG() << "expected error : " << error;
+        assert(checksum->verify_chunk(fd, 2, error));
+        ::close(fd);
+
+        // Computed once for a file that does not change
+        auto cached = ChunkChecksum::compute_cached(dir / "file.txt", chunk_size, dir / "cache", error);
+        assert(cached.has_value() && cached->to_string() == checksum->to_string());
+        auto count_entries = [&]()
+        {
+            size_t count = 0;
+            for (const auto &entry : std::filesystem::directory_iterator(dir / "cache"))
+            {
+                count += entry.path().extension() == ".xxh64" ? 1 : 0;
+            }
+            return count;
+        };
+        assert(count_entries() == 1);
+        assert(ChunkChecksum::compute_cached(dir / "file.txt", chunk_size, dir / "cache", error)->to_string() == checksum->to_string());
+        assert(!ChunkChecksum::compute_cached(dir / "missing.txt", chunk_size, dir / "cache", error).has_value());
+
+        // The checksum of a file that did not change is kept, the one of a modified file is pruned
+        ChunkChecksum::prune_cache(dir / "cache");
+        assert(count_entries() == 1);
+        std::ofstream(dir / "file.txt", std::ios::binary | std::ios::app) << "more";
+        ChunkChecksum::prune_cache(dir / "cache");
+        assert(count_entries() == 0);
+
+        // A stopped hashing gives no checksum
+        std::atomic<bool> running = false;
+        assert(!ChunkChecksum::compute(dir / "file.txt", chunk_size, error, &running).has_value());
+        TLOG() << "expected error : " << error;
+
+        std::filesystem::remove_all(dir);
+
+        TLOG() << "ChunkChecksum tests passed";
+        return 0;
+    }
+    catch (const std::exception &e)
+    {
+        TLOG() << e.what();
+        return 1;
+    }
+}
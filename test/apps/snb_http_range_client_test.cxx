@@ -0,0 +1,118 @@
+/**
+ * @file snb_http_range_client_test.cxx Test app of the HTTP range requests used to resume the downloads, on loopback
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/http_range_client.hpp"
+#include "snbmodules/interfaces/web_seed_server.hpp"
+#include "logging/Logging.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace dunedaq::snbmodules;
+
+static std::string read_file(const std::filesystem::path &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+int main()
+{
+    try
+    {
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / "snb_http_range_client_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir / "src");
+        std::string content;
+        for (int i = 0; i < 100000; i++)
+        {
+            content += std::to_string(i) + "\n";
+        }
+        std::ofstream(dir / "src" / "file 1.txt", std::ios::binary) << content;
+
+        WebSeedServer server(IPFormat("127.0.0.1", 0));
+        if (!server.start())
+        {
+            return 1;
+        }
+        server.share_file(dir / "src", "file 1.txt");
+        IPFormat address("127.0.0.1", server.get_port());
+
+        assert(HttpRangeClient::escape_path("/0/file 1.txt") == "/0/file%201.txt");
+        assert(HttpRangeClient::get_size(address, "/0/file 1.txt") == content.size());
+        assert(!HttpRangeClient::get_size(address, "/0/missing.txt").has_value());
+
+        // The first part is on disk, the rest is appended at its offset
+        std::filesystem::path local = dir / "file 1.txt";
+        std::ofstream(local, std::ios::binary) << content.substr(0, 1000);
+        int fd = ::open(local.c_str(), O_WRONLY);
+        assert(fd >= 0);
+
+        std::atomic<bool> stop = false;
+        uint64_t received = 0;
+        std::string error;
+        bool ok = HttpRangeClient::get_range(address, "/0/file 1.txt", 1000, content.size() - 1000, fd, stop, [&](uint64_t bytes)
+                                             { received += bytes; },
+                                             error);
+        ::close(fd);
+        assert(ok);
+        assert(received == content.size() - 1000);
+        assert(read_file(local) == content);
+
+        // Two streams sharing a limit of 400 kB/s take the time of the whole file at that rate
+        std::filesystem::remove(local);
+        fd = ::open(local.c_str(), O_WRONLY | O_CREAT, 0644);
+        RateLimiter limiter;
+        limiter.set_rate(400000);
+        uint64_t half = content.size() / 2;
+        auto start = std::chrono::steady_clock::now();
+        std::string first_error;
+        std::thread first([&]()
+                          { ok = HttpRangeClient::get_range(address, "/0/file 1.txt", 0, half, fd, stop, nullptr, first_error, &limiter); });
+        assert(HttpRangeClient::get_range(address, "/0/file 1.txt", half, content.size() - half, fd, stop, nullptr, error, &limiter));
+        first.join();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        ::close(fd);
+        assert(ok);
+        assert(read_file(local) == content);
+        assert(elapsed > 0.8 * static_cast<double>(content.size()) / 400000);
+        TLOG() << "limited download of " << content.size() << " bytes in " << elapsed << " s";
+
+        // A range past the end and a stopped request fail
+        fd = ::open(local.c_str(), O_WRONLY);
+        assert(!HttpRangeClient::get_range(address, "/0/file 1.txt", content.size(), 10, fd, stop, nullptr, error));
+        TLOG() << "expected error : " << error;
+        stop = true;
+        assert(!HttpRangeClient::get_range(address, "/0/file 1.txt", 0, content.size(), fd, stop, nullptr, error));
+        assert(error == "stopped");
+        ::close(fd);
+
+        server.stop();
+        std::filesystem::remove_all(dir);
+
+        TLOG() << "HttpRangeClient tests passed";
+        return 0;
+    }
+    catch (const std::exception &e)
+    {
+        TLOG() << e.what();
+        return 1;
+    }
+}
@@ -0,0 +1,89 @@
+/**
+ * @file snb_memory_budget_test.cxx Test app of the memory budget shared by the transfer sessions
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/memory_budget.hpp"
+#include "logging/Logging.hpp"
+
+#include <cassert>
+#include <memory>
+
+using namespace dunedaq::snbmodules;
+
+int main()
+{
+    const uint64_t mib = 1024 * 1024;
+
+    // rclone sizes
+    assert(MemoryBudget::parse_size("off") == 0);
+    assert(MemoryBudget::parse_size("1024") == 1024 * 1024);
+    assert(MemoryBudget::parse_size("512K") == 512 * 1024);
+    assert(MemoryBudget::parse_size("10M") == 10 * mib);
+    assert(MemoryBudget::parse_size("8GiB") == 8 * 1024 * mib);
+    assert(MemoryBudget::parse_size("1.5G") == 1536 * mib);
+    assert(MemoryBudget::parse_size("abc") == 0);
+
+    MemoryBudget &budget = MemoryBudget::get();
+    // no limit until the client is configured with one
+    assert(budget.get_budget() == 0);
+    budget.set_budget(1024 * mib);
+
+    {
+        // a session gets what it wants while there is room for it
+        auto first = budget.reserve("first", 256 * mib);
+        assert(first->get_bytes() == 256 * mib);
+
+        // what it does not want goes to the others
+        auto second = budget.reserve("second", 1024 * mib);
+        assert(second->get_bytes() == 768 * mib);
+        uint64_t second_share = 0;
+        second->set_on_resize([&](uint64_t bytes)
+                              { second_share = bytes; });
+
+        // the shares are computed again for every new session
+        auto third = budget.reserve("third", 1024 * mib);
+        assert(third->get_bytes() == 384 * mib);
+        assert(second->get_bytes() == 384 * mib && second_share == 384 * mib);
+        assert(first->get_bytes() == 256 * mib);
+        assert(budget.get_reserved_bytes() == 1024 * mib);
+        assert(budget.get_sessions_count() == 3);
+
+        auto fourth = budget.reserve("fourth", 1024 * mib);
+        assert(first->get_bytes() == 256 * mib && second_share == 256 * mib && fourth->get_bytes() == 256 * mib);
+
+        first->set_used(100 * mib);
+        second->set_used(10 * mib);
+        assert(budget.get_used_bytes() == 110 * mib);
+
+        // and when sessions stop
+        third.reset();
+        fourth.reset();
+        assert(second_share == 768 * mib);
+        assert(budget.get_reserved_bytes() == 1024 * mib);
+
+        // never less than the minimal share
+        budget.set_budget(32 * mib);
+        assert(first->get_bytes() == MemoryBudget::min_share && second_share == MemoryBudget::min_share);
+        auto small = budget.reserve("small", 1 * mib);
+        assert(small->get_bytes() == 1 * mib);
+        budget.set_budget(1024 * mib);
+        assert(second_share == 768 * mib - 1 * mib);
+
+        // no more calls once removed
+        second->set_on_resize(nullptr);
+        small.reset();
+        assert(second_share == 768 * mib - 1 * mib && second->get_bytes() == 768 * mib);
+    }
+
+    // no limit
+    budget.set_budget(0);
+    auto unlimited = budget.reserve("unlimited", 100 * 1024 * mib);
+    assert(unlimited->get_bytes() == 100 * 1024 * mib);
+
+    TLOG() << "MemoryBudget tests passed";
+    return 0;
+}
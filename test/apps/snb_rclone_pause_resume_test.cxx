@@ -0,0 +1,137 @@
+/**
+ * @file snb_rclone_pause_resume_test.cxx Test app to test the pause and resume of a single file with rclone
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/transfer_client.hpp"
+#include "snbmodules/common/protocols_enum.hpp"
+
+#include "utilities/WorkerThread.hpp"
+
+#include <iostream>
+#include <string>
+#include <filesystem>
+#include <cassert>
+#include <stdexcept>
+#include <algorithm>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+using namespace dunedaq::snbmodules;
+namespace io = boost::iostreams;
+
+static bool same_content(const std::string &a, const std::string &b)
+{
+    io::mapped_file_source f1(a);
+    io::mapped_file_source f2(b);
+    return f1.size() == f2.size() && std::equal(f1.data(), f1.data() + f1.size(), f2.data()); // NOLINT
+}
+
+int main()
+{
+
+    try
+    {
+        // Create clients
+        std::string ip0 = "localhost:5013";
+        std::string ip1 = "localhost:5014";
+
+        TransferClient c0(IPFormat(ip0), "client0", "./client0");
+        TransferClient c1(IPFormat(ip1), "client1", "./client1");
+
+        // Initialize connections
+        c0.add_connection(IPFormat(ip0), "client0", "notification_t", true);
+        c0.add_connection(IPFormat(ip1), "client1", "notification_t", true);
+        c0.init_connection_interface();
+
+        // Start client0 in a thread ( listening to notifications, Dowloader )
+        dunedaq::utilities::WorkerThread thread([&](std::atomic<bool> &running)
+                                                { c0.do_work(running); });
+        thread.start_working_thread();
+
+        // Create files to transfer, the large one is long enough to be paused during its copy
+        std::string large_name = "./client1/large.txt";
+        std::string small_name = "./client1/small.txt";
+        std::ofstream large(large_name);
+        for (int i = 0; i < 4000000; i++)
+            large << "Hello World " << i << "!" << std::endl;
+        large.close();
+        std::ofstream small(small_name);
+        for (int i = 0; i < 1000; i++)
+            small << "Hello World " << i << "!" << std::endl;
+        small.close();
+
+        // a single stream writes the file in order, it is resumed from the bytes on disk
+        nlohmann::json transfer_options = R"(
+            {
+                "protocol": "http",
+                "serve": true,
+                "rate_limit": "10M",
+                "port": 8092,
+                "refresh_rate": 1,
+                "simult_transfers": 2,
+                "transfer_threads": 1,
+                "checkers_threads": 1,
+                "chunk_size": "8GiB",
+                "stripe_size": "1M",
+                "buffer_size": "0",
+                "use_mmap": false,
+                "checksum": true
+            }
+        )"_json;
+        transfer_options["root_folder"] = std::filesystem::current_path().string();
+
+        // Create transfer with client1 as uploader and client0 as downloader
+        c1.create_new_transfer("transfer0", "RCLONE", {c0.get_client_id()}, {large_name, small_name}, transfer_options);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        c1.get_session("transfer0")->start_all();
+        std::this_thread::sleep_for(std::chrono::seconds(3));
+
+        TransferSession *session = c0.get_session("transfer0");
+        TransferMetadata *large_meta = nullptr;
+        for (auto meta : session->get_transfer_options().get_transfers_meta())
+        {
+            if (meta->get_file_name() == "large.txt")
+            {
+                large_meta = meta.get();
+            }
+        }
+        assert(large_meta != nullptr);
+
+        // the large file has its own job, pausing it leaves the small one going and its bytes on disk
+        assert(session->pause_file(*large_meta));
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+        std::string large_copy = "./client0/transfer0/large.txt";
+        uint64_t paused_size = std::filesystem::file_size(large_copy);
+        TLOG() << "Paused with " << paused_size << " bytes on disk";
+        assert(paused_size > 0 && paused_size < std::filesystem::file_size(large_name));
+        assert(same_content(small_name, "./client0/transfer0/small.txt"));
+
+        // the rest of the file is appended to the bytes on disk
+        assert(session->resume_file(*large_meta));
+        for (int i = 0; i < 60 && large_meta->get_status() != status_type::e_status::FINISHED; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+
+        thread.stop_working_thread();
+
+        // Checking if file was transferred
+        assert(large_meta->get_status() == status_type::e_status::FINISHED);
+        assert(same_content(large_name, large_copy));
+        TLOG() << "Files are equals";
+
+        // Clean files
+        std::filesystem::remove_all("client0");
+        std::filesystem::remove_all("client1");
+    }
+    catch (const std::exception &e)
+    {
+        TLOG() << e.what();
+        return 1;
+    }
+    return 0;
+} // NOLINT
@@ -0,0 +1,105 @@
+/**
+ * @file snb_rclone_serve_test.cxx Test app to test the rclone http server started by the uploader
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/transfer_client.hpp"
+#include "snbmodules/common/protocols_enum.hpp"
+
+#include "utilities/WorkerThread.hpp"
+
+#include <iostream>
+#include <string>
+#include <filesystem>
+#include <cassert>
+#include <stdexcept>
+#include <algorithm>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+using namespace dunedaq::snbmodules;
+namespace io = boost::iostreams;
+
+int main()
+{
+
+    try
+    {
+        // Create clients
+        std::string ip0 = "localhost:5011";
+        std::string ip1 = "localhost:5012";
+
+        TransferClient c0(IPFormat(ip0), "client0", "./client0");
+        TransferClient c1(IPFormat(ip1), "client1", "./client1");
+
+        // Initialize connections
+        c0.add_connection(IPFormat(ip0), "client0", "notification_t", true);
+        c0.add_connection(IPFormat(ip1), "client1", "notification_t", true);
+        c0.init_connection_interface();
+
+        // Start client0 in a thread ( listening to notifications, Dowloader )
+        dunedaq::utilities::WorkerThread thread([&](std::atomic<bool> &running)
+                                                { c0.do_work(running); });
+        thread.start_working_thread();
+
+        // Create file to transfer
+        std::string file_name = "./client1/test.txt";
+        std::ofstream file(file_name);
+        for (int i = 0; i < 100000; i++)
+            file << "Hello World " << i << "!" << std::endl;
+        file.close();
+
+        // no rclone server runs outside, the uploader starts its own on the port
+        nlohmann::json transfer_options = R"(
+            {
+                "protocol": "http",
+                "serve": true,
+                "rate_limit": "off",
+                "port": 8091,
+                "refresh_rate": 5,
+                "simult_transfers": 1,
+                "transfer_threads": 1,
+                "checkers_threads": 1,
+                "chunk_size": "8GiB",
+                "buffer_size": "0",
+                "use_mmap": false,
+                "checksum": true
+            }
+        )"_json;
+        transfer_options["root_folder"] = std::filesystem::current_path().string();
+
+        // Create transfer with client1 as uploader and client0 as downloader
+        c1.create_new_transfer("transfer0", "RCLONE", {c0.get_client_id()}, {file_name}, transfer_options);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        c1.get_session("transfer0")->start_all();
+        std::this_thread::sleep_for(std::chrono::seconds(5));
+
+        thread.stop_working_thread();
+
+        // the file is served until the session of the uploader is removed
+        for (auto meta : c1.get_session("transfer0")->get_transfer_options().get_transfers_meta())
+        {
+            assert(meta->get_status() == status_type::e_status::UPLOADING);
+        }
+
+        // Checking if file was transferred
+        io::mapped_file_source f1(file_name);
+        io::mapped_file_source f2("./client0/transfer0/test.txt");
+
+        assert(f1.size() == f2.size() && std::equal(f1.data(), f1.data() + f1.size(), f2.data())); // NOLINT
+        TLOG() << "Files are equals";
+
+        // Clean files
+        std::filesystem::remove_all("client0");
+        std::filesystem::remove_all("client1");
+    }
+    catch (const std::exception &e)
+    {
+        TLOG() << e.what();
+        return 1;
+    }
+    return 0;
+} // NOLINT
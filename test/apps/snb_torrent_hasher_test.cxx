@@ -0,0 +1,114 @@
+/**
+ * @file snb_torrent_hasher_test.cxx Test app of the multi-threaded torrent hashing, checked against libtorrent
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/torrent_hasher.hpp"
+#include "logging/Logging.hpp"
+
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/create_torrent.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace dunedaq::snbmodules;
+
+static void write_file(const std::filesystem::path &file, uint64_t size)
+{
+    std::ofstream out(file, std::ios::binary);
+    for (uint64_t i = 0; i < size; i++)
+    {
+        out.put(static_cast<char>((i * 31 + i / 4096) & 0xff));
+    }
+}
+
+/// @brief Bencoded torrent of path, hashed by libtorrent if threads is 0, by TorrentHasher otherwise
+static std::vector<char> make_torrent(const std::filesystem::path &path, int piece_size, unsigned int threads)
+{
+    lt::file_storage fs;
+    lt::add_files(fs, path.string(), lt::create_torrent::v2_only);
+    lt::create_torrent t(fs, piece_size, lt::create_torrent::v2_only);
+    // same torrent whatever the second it is generated
+    t.set_creation_date(0);
+
+    if (threads == 0)
+    {
+        lt::set_piece_hashes(t, path.parent_path().string());
+    }
+    else
+    {
+        TorrentHasher hasher(threads);
+        if (!hasher.set_piece_hashes(t, path.parent_path()))
+        {
+            throw std::runtime_error("hashing of " + path.string() + " failed");
+        }
+    }
+
+    std::vector<char> torrent;
+    lt::bencode(std::back_inserter(torrent), t.generate());
+    return torrent;
+}
+
+int main()
+{
+    try
+    {
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / "snb_torrent_hasher_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir / "group");
+
+        // Sizes not multiple of the pieces, a single piece, exact pieces and a multi-file torrent
+        const uint64_t kib = 1024;
+        write_file(dir / "odd.bin", 1000 * kib + 123);
+        write_file(dir / "small.bin", 5 * kib);
+        write_file(dir / "exact.bin", 1024 * kib);
+        write_file(dir / "group" / "a.bin", 300 * kib + 7);
+        write_file(dir / "group" / "b.bin", 16 * kib);
+
+        for (int piece_size : {16 * 1024, 32 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024})
+        {
+            for (const char *name : {"odd.bin", "small.bin", "exact.bin", "group"})
+            {
+                std::vector<char> expected = make_torrent(dir / name, piece_size, 0);
+                for (unsigned int threads : {1U, 4U})
+                {
+                    if (make_torrent(dir / name, piece_size, threads) != expected)
+                    {
+                        TLOG() << "torrent of " << name << " with pieces of " << piece_size << " bytes and " << threads << " threads differs from libtorrent";
+                        assert(false);
+                        return 1;
+                    }
+                }
+            }
+        }
+
+        // A file changed under the hasher is reported
+        TorrentHasher hasher(2);
+        lt::file_storage fs;
+        lt::add_files(fs, (dir / "odd.bin").string(), lt::create_torrent::v2_only);
+        lt::create_torrent t(fs, 16 * 1024, lt::create_torrent::v2_only);
+        std::filesystem::resize_file(dir / "odd.bin", 10 * kib);
+        assert(!hasher.set_piece_hashes(t, dir));
+
+        std::filesystem::remove_all(dir);
+
+        TLOG() << "TorrentHasher tests passed";
+        return 0;
+    }
+    catch (const std::exception &e)
+    {
+        TLOG() << e.what();
+        return 1;
+    }
+}
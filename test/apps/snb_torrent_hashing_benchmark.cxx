@@ -0,0 +1,99 @@
+/**
+ * @file snb_torrent_hashing_benchmark.cxx Benchmark of the multi-threaded torrent hashing against the number of threads
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/torrent_hasher.hpp"
+#include "logging/Logging.hpp"
+
+#include "libtorrent/create_torrent.hpp"
+
+#include <iostream>
+#include <string>
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace dunedaq::snbmodules;
+
+namespace
+{
+    double hash_once(const std::filesystem::path &file, int piece_size, unsigned int threads)
+    {
+        lt::file_storage fs;
+        lt::add_files(fs, file.string(), lt::create_torrent::v2_only);
+        lt::create_torrent t(fs, piece_size, lt::create_torrent::v2_only);
+
+        auto start = std::chrono::steady_clock::now();
+        if (threads == 0)
+        {
+            // libtorrent reference implementation
+            lt::set_piece_hashes(t, file.parent_path().string());
+        }
+        else
+        {
+            TorrentHasher hasher(threads);
+            if (!hasher.set_piece_hashes(t, file.parent_path()))
+            {
+                throw std::runtime_error("hashing failed");
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double>(end - start).count();
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // Usage: snb_torrent_hashing_benchmark [file size in MiB] [piece size in KiB]
+    uint64_t size_mib = argc > 1 ? std::stoull(argv[1]) : 2048; // NOLINT
+    int piece_size = argc > 2 ? std::stoi(argv[2]) * 1024 : 8 * 1024 * 1024; // NOLINT
+
+    try
+    {
+        std::filesystem::create_directories("hashing_benchmark");
+        std::filesystem::path file = std::filesystem::absolute("hashing_benchmark/data.bin");
+
+        // Create the file to hash
+        {
+            std::ofstream out(file, std::ios::binary);
+            std::vector<char> chunk(1024 * 1024);
+            for (uint64_t i = 0; i < size_mib; i++)
+            {
+                for (size_t j = 0; j < chunk.size(); j++)
+                {
+                    chunk[j] = static_cast<char>((i * 31 + j * 7) & 0xff);
+                }
+                out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            }
+        }
+
+        double const gb = static_cast<double>(size_mib) * 1024 * 1024 / 1e9;
+
+        // Warm up the page cache so every run reads from the same place
+        hash_once(file, piece_size, std::thread::hardware_concurrency());
+
+        double t = hash_once(file, piece_size, 0);
+        TLOG() << "libtorrent set_piece_hashes : " << gb / t << " GB/s (" << t << " s)";
+
+        for (unsigned int threads = 1; threads <= std::thread::hardware_concurrency(); threads *= 2)
+        {
+            t = hash_once(file, piece_size, threads);
+            TLOG() << "TorrentHasher " << threads << " threads : " << gb / t << " GB/s (" << t << " s)";
+        }
+
+        std::filesystem::remove_all("hashing_benchmark");
+    }
+    catch (const std::exception &e)
+    {
+        TLOG() << e.what();
+        return 1;
+    }
+    return 0;
+}
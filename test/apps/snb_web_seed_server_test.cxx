@@ -0,0 +1,169 @@
+/**
+ * @file snb_web_seed_server_test.cxx Test app of the HTTP web seed of the BitTorrent uploaders, on loopback
+ *
+ * This is part of the DUNE DAQ , copyright 2020.
+ * Licensing/copyright details are in the COPYING file that you should have
+ * received with this code.
+ */
+
+#include "snbmodules/interfaces/web_seed_server.hpp"
+#include "logging/Logging.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using namespace dunedaq::snbmodules;
+
+// Send a request to the server, return the whole response
+static std::string http_request(int port, const std::string &request)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) // NOLINT
+    {
+        throw std::runtime_error("cannot connect to the web seed");
+    }
+
+    ::send(fd, request.data(), request.size(), 0);
+
+    std::string response;
+    char buffer[1024];
+    ssize_t n = 0;
+    while ((n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0)
+    {
+        response.append(buffer, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    return response;
+}
+
+static std::string get(int port, const std::string &path, const std::string &range = "")
+{
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n";
+    if (!range.empty())
+    {
+        request += "Range: " + range + "\r\n";
+    }
+    return http_request(port, request + "\r\n");
+}
+
+static std::string body(const std::string &response)
+{
+    size_t start = response.find("\r\n\r\n");
+    return start == std::string::npos ? "" : response.substr(start + 4);
+}
+
+using range_t = std::pair<uint64_t, uint64_t>;
+
+int main()
+{
+    try
+    {
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / "snb_web_seed_server_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir / "group");
+        std::string content = "0123456789abcdefghijklmnopqrstuvwxyz";
+        std::ofstream(dir / "file 1.txt") << content;
+        std::ofstream(dir / "group" / "file2.txt") << content;
+        std::ofstream(dir.parent_path() / "snb_web_seed_secret.txt") << "secret";
+
+        // Ranges
+        assert(WebSeedServer::parse_range("bytes=0-9", 36) == range_t(0, 9));
+        assert(WebSeedServer::parse_range("bytes=30-", 36) == range_t(30, 35));
+        assert(WebSeedServer::parse_range("bytes=-6", 36) == range_t(30, 35));
+        assert(WebSeedServer::parse_range("bytes=30-100", 36) == range_t(30, 35));
+        assert(!WebSeedServer::parse_range("bytes=36-", 36).has_value());
+        assert(!WebSeedServer::parse_range("bytes=9-0", 36).has_value());
+        assert(!WebSeedServer::parse_range("bytes=0-1,4-5", 36).has_value());
+        assert(!WebSeedServer::parse_range("items=0-1", 36).has_value());
+        assert(WebSeedServer::escape("a b/c:d") == "a%20b/c%3Ad");
+
+        WebSeedServer server(IPFormat("127.0.0.1", 0));
+        if (!server.start())
+        {
+            return 1;
+        }
+        assert(server.get_port() > 0);
+        std::string url = server.share_file(dir, "file 1.txt");
+        assert(url == "http://127.0.0.1:" + std::to_string(server.get_port()) + "/0/");
+        assert(server.share_file(dir / ".", "group/file2.txt") == url);
+        std::string prefix = url.substr(url.find('/', 7));
+
+        // Only the shared files, nothing else of their directory or outside of it
+        std::ofstream(dir / ".file 1.txt.torrent") << "sidecar";
+        std::ofstream(dir / "group" / "other.txt") << content;
+        assert(server.resolve(prefix + "file%201.txt") == dir / "file 1.txt");
+        assert(!server.resolve(prefix + ".file%201.txt.torrent").has_value());
+        assert(!server.resolve(prefix + "group/other.txt").has_value());
+        assert(!server.resolve(prefix + "../snb_web_seed_secret.txt").has_value());
+        assert(!server.resolve(prefix + "group/%2E%2E/%2E%2E/snb_web_seed_secret.txt").has_value());
+        assert(!server.resolve("/1/file2.txt").has_value());
+        assert(get(server.get_port(), prefix + "../snb_web_seed_secret.txt").find("404") != std::string::npos);
+        assert(get(server.get_port(), prefix + ".file%201.txt.torrent").find("404") != std::string::npos);
+
+        // A file shared twice stays served until both transfers unshare it
+        server.share_file(dir, "file 1.txt");
+        server.unshare_file(dir, "file 1.txt");
+        assert(server.resolve(prefix + "file%201.txt").has_value());
+        server.unshare_file(dir, "file 1.txt");
+        assert(!server.resolve(prefix + "file%201.txt").has_value());
+        assert(server.share_file(dir, "file 1.txt") == url);
+
+        // One server per ip and port for the uploaders of the process
+        {
+            std::shared_ptr<WebSeedServer> shared = WebSeedServer::get_shared(IPFormat("127.0.0.1", 0));
+            assert(shared != nullptr && shared->get_port() > 0);
+            assert(WebSeedServer::get_shared(IPFormat("127.0.0.1", 0)) == shared);
+            std::shared_ptr<WebSeedServer> other = WebSeedServer::get_shared(IPFormat("127.0.0.1", shared->get_port()));
+            assert(other == nullptr);
+            TLOG() << "expected error : the port is used by the shared server";
+        }
+
+        // Whole file and ranges, as asked by the web seeds of single and multi-file torrents
+        std::string response = get(server.get_port(), prefix + "file%201.txt");
+        assert(response.find("HTTP/1.1 200 OK") == 0);
+        assert(body(response) == content);
+
+        response = get(server.get_port(), prefix + "group/file2.txt", "bytes=10-19");
+        assert(response.find("HTTP/1.1 206 Partial Content") == 0);
+        assert(response.find("Content-Range: bytes 10-19/36") != std::string::npos);
+        assert(body(response) == content.substr(10, 10));
+
+        response = get(server.get_port(), prefix + "group/file2.txt", "bytes=40-");
+        assert(response.find("416") != std::string::npos);
+
+        // Several requests on a kept-alive connection, the server closes after the last one
+        response = http_request(server.get_port(), "GET " + prefix + "group/file2.txt HTTP/1.1\r\nRange: bytes=0-3\r\n\r\n"
+                                                   "HEAD " + prefix + "group/file2.txt HTTP/1.1\r\n\r\n"
+                                                   "GET " + prefix + "group/file2.txt HTTP/1.1\r\nRange: bytes=-4\r\nConnection: close\r\n\r\n");
+        assert(response.find("0123HTTP/1.1 200 OK") != std::string::npos);
+        assert(response.substr(response.size() - 4) == "wxyz");
+        assert(server.get_bytes_served() == 36 + 10 + 4 + 4);
+
+        server.stop();
+        std::filesystem::remove_all(dir);
+        std::filesystem::remove(dir.parent_path() / "snb_web_seed_secret.txt");
+
+        TLOG() << "WebSeedServer tests passed";
+        return 0;
+    }
+    catch (const std::exception &e)
+    {
+        TLOG() << e.what();
+        return 1;
+    }
+}